@@ -0,0 +1,166 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: bench/Corpus.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include "Corpus.h"
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+
+namespace
+{
+    // splitmix64 finalizer, a fixed integer function unlike the <random> distributions
+    uint64_t mix(uint64_t x)
+    {
+        x += 0x9E3779B97F4A7C15ULL;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+        return x ^ (x >> 31);
+    }
+
+    uint64_t noise(int x, int y, uint64_t seed)
+    {
+        return mix(seed ^ (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32 | static_cast<uint32_t>(y)));
+    }
+
+    uint32_t rgb(int r, int g, int b)
+    {
+        return static_cast<uint32_t>(std::clamp(r, 0, 255) << 16 | std::clamp(g, 0, 255) << 8 | std::clamp(b, 0, 255));
+    }
+
+    uint32_t gradient(int x, int y, int width, int height)
+    {
+        int r = x * 255 / std::max(1, width - 1);
+        int g = y * 255 / std::max(1, height - 1);
+        int b = (x + y) * 255 / std::max(1, width + height - 2);
+        return rgb(r, g, b);
+    }
+
+    uint32_t photo(int x, int y)
+    {
+        // Bilinear blend of random colors on a 48 pixel lattice plus +-12 grain
+        constexpr int cell = 48;
+        int cx = x / cell;
+        int cy = y / cell;
+        int fx = x % cell;
+        int fy = y % cell;
+        int channels[3] = {};
+        for (int c = 0; c < 3; ++c)
+        {
+            auto corner = [&](int dx, int dy)
+            { return static_cast<int>((noise(cx + dx, cy + dy, 0x51) >> (c * 8)) & 0xFF); };
+            int top = corner(0, 0) * (cell - fx) + corner(1, 0) * fx;
+            int bottom = corner(0, 1) * (cell - fx) + corner(1, 1) * fx;
+            channels[c] = (top * (cell - fy) + bottom * fy) / (cell * cell);
+        }
+        int grain = static_cast<int>(noise(x, y, 0x77) % 25) - 12;
+        return rgb(channels[0] + grain, channels[1] + grain, channels[2] + grain);
+    }
+
+    uint32_t pixelArt(int x, int y, int width)
+    {
+        static constexpr uint32_t palette[16] = {0x000000, 0x1D2B53, 0x7E2553, 0x008751, 0xAB5236, 0x5F574F, 0xC2C3C7, 0xFFF1E8,
+                                                 0xFF004D, 0xFFA300, 0xFFEC27, 0x00E436, 0x29ADFF, 0x83769C, 0xFF77A8, 0xFFCCAA};
+        // Art pixels grow with the image so large sizes look like upscaled sprites
+        int scale = std::max(1, width / 160);
+        int px = x / scale;
+        int py = y / scale;
+        // 16x16 sprites on a flat background, mirrored horizontally like most sprites
+        int sprite = static_cast<int>(noise(px / 16, py / 16, 0x21) & 0xF);
+        int sx = px % 16;
+        int mirrored = sx < 8 ? sx : 15 - sx;
+        bool set = (noise(mirrored, py % 16, 0x33 + sprite) & 3) != 0;
+        if (!set)
+        {
+            return palette[1];
+        }
+        return palette[(sprite + (noise(mirrored, py % 16, 0x44 + sprite) & 3)) & 0xF];
+    }
+
+    uint32_t flat(int x, int y, int width, int height)
+    {
+        // Uneven 5x4 grid of flat regions with a dark one pixel outline
+        int column = x * 5 / std::max(1, width);
+        int row = y * 4 / std::max(1, height);
+        bool edge = (x * 5) % std::max(1, width) < 5 || (y * 4) % std::max(1, height) < 4;
+        if (edge)
+        {
+            return 0x101010;
+        }
+        return static_cast<uint32_t>(noise(column, row, 0x99) & 0xFFFFFF);
+    }
+
+    uint32_t hashed(int x, int y, int width)
+    {
+        // Knuth's multiplicative hash of the pixel index
+        uint32_t index = static_cast<uint32_t>(y) * static_cast<uint32_t>(width) + static_cast<uint32_t>(x);
+        return (index * 2654435761u) & 0xFFFFFF;
+    }
+}
+
+std::string Corpus::name(CorpusKind kind)
+{
+    switch (kind)
+    {
+    case CorpusKind::Gradient:
+        return "Gradient";
+    case CorpusKind::Photo:
+        return "Photo";
+    case CorpusKind::PixelArt:
+        return "PixelArt";
+    case CorpusKind::Flat:
+        return "Flat";
+    case CorpusKind::Noise:
+        return "Noise";
+    default:
+        return "Unknown";
+    }
+}
+
+PixelBuffer Corpus::generate(CorpusKind kind, int width, int height)
+{
+    PixelBuffer image(width, height);
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            switch (kind)
+            {
+            case CorpusKind::Gradient:
+                image(x, y) = gradient(x, y, width, height);
+                break;
+            case CorpusKind::Photo:
+                image(x, y) = photo(x, y);
+                break;
+            case CorpusKind::PixelArt:
+                image(x, y) = pixelArt(x, y, width);
+                break;
+            case CorpusKind::Flat:
+                image(x, y) = flat(x, y, width, height);
+                break;
+            case CorpusKind::Noise:
+                image(x, y) = hashed(x, y, width);
+                break;
+            }
+        }
+    }
+    return image;
+}
+
+const PixelBuffer &Corpus::cached(CorpusKind kind, int width, int height)
+{
+    static std::mutex mutex;
+    static CorpusKind lastKind;
+    static PixelBuffer last;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (last.width() != width || last.height() != height || lastKind != kind)
+    {
+        // Drop the old image first, two 8K images do not need to coexist
+        last = PixelBuffer();
+        last = generate(kind, width, height);
+        lastKind = kind;
+    }
+    return last;
+}
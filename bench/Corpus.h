@@ -0,0 +1,38 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: bench/Corpus.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include "PixelBuffer.h"
+#include <string>
+
+// Synthetic benchmark images. Every pixel is a pure function of its coordinates, so
+// the corpus is identical on every machine and compiler and results stay comparable
+// between releases.
+enum class CorpusKind
+{
+    // Smooth ramps in all three channels, many distinct colors
+    Gradient,
+    // Soft low-frequency shapes with per-pixel grain, like a scanned photo
+    Photo,
+    // Blocky sprites from a small fixed palette
+    PixelArt,
+    // Large flat regions separated by hard edges
+    Flat,
+    // Every pixel a hashed, unrelated color; a worst case for caches and reducers
+    Noise
+};
+
+namespace Corpus
+{
+    // The representative kinds that benchmarks and golden files cover; Noise is left out
+    constexpr CorpusKind kinds[] = {CorpusKind::Gradient, CorpusKind::Photo, CorpusKind::PixelArt, CorpusKind::Flat};
+
+    std::string name(CorpusKind kind);
+    PixelBuffer generate(CorpusKind kind, int width, int height);
+    // The most recently generated image is kept, benchmarks of one size share it
+    const PixelBuffer &cached(CorpusKind kind, int width, int height);
+}
@@ -0,0 +1,149 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: bench/GraphicsConverterBench.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include "Corpus.h"
+#include "ColorReducer.h"
+#include "Dithering.h"
+#include "KoalaConverter.h"
+#include "PixelFormat.h"
+#include "Planar.h"
+#include <benchmark/benchmark.h>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    // 64x64 up to 8K UHD
+    const std::vector<std::pair<int, int>> sizes = {{64, 64}, {256, 256}, {1024, 1024}, {3840, 2160}, {7680, 4320}};
+    const std::vector<int> paletteSizes = {2, 4, 8, 16, 32, 64, 128, 256};
+
+    // Every palette size on the 256x256 images, the extremes and 16 on every other size.
+    // The full cross product would take hours for k-means on 8K images.
+    void paletteArguments(benchmark::internal::Benchmark *benchmark)
+    {
+        std::set<std::vector<int64_t>> arguments;
+        for (const auto &[width, height] : sizes)
+        {
+            for (int colors : paletteSizes)
+            {
+                if (width == 256 || colors == 2 || colors == 16 || colors == 256)
+                {
+                    arguments.insert({width, height, colors});
+                }
+            }
+        }
+        for (const std::vector<int64_t> &args : arguments)
+        {
+            benchmark->Args(args);
+        }
+        benchmark->ArgNames({"width", "height", "colors"});
+    }
+
+    void sizeArguments(benchmark::internal::Benchmark *benchmark)
+    {
+        for (const auto &[width, height] : sizes)
+        {
+            benchmark->Args({width, height});
+        }
+        benchmark->ArgNames({"width", "height"});
+    }
+
+    void setPixelCounters(benchmark::State &state, const PixelBuffer &image)
+    {
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(image.size()));
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(image.size() * sizeof(uint32_t)));
+    }
+
+    void colorReduction(benchmark::State &state, ColorReductionAlgorithm algo, CorpusKind kind)
+    {
+        const PixelBuffer &image = Corpus::cached(kind, static_cast<int>(state.range(0)), static_cast<int>(state.range(1)));
+        const int colors = static_cast<int>(state.range(2));
+        for (auto _ : state)
+        {
+            std::vector<uint32_t> palette = ColorReducer::generatePalette(image, ColorReducer::buildHistogram(image), colors, algo);
+            benchmark::DoNotOptimize(palette.data());
+            PixelBuffer reduced = ColorReducer::remap(image, palette);
+            benchmark::DoNotOptimize(reduced.data());
+        }
+        setPixelCounters(state, image);
+    }
+
+    void dithering(benchmark::State &state, DitheringAlgorithm algo, CorpusKind kind)
+    {
+        const PixelBuffer &image = Corpus::cached(kind, static_cast<int>(state.range(0)), static_cast<int>(state.range(1)));
+        // The palette is an input here, only the dithering itself is measured
+        const std::vector<uint32_t> palette = ColorReducer::generatePalette(image, ColorReducer::buildHistogram(image),
+                                                                            static_cast<int>(state.range(2)), ColorReductionAlgorithm::MedianCut);
+        PixelBuffer output(image.width(), image.height());
+        for (auto _ : state)
+        {
+            Dithering::applyDithering(image, palette, algo, output);
+            benchmark::ClobberMemory();
+        }
+        setPixelCounters(state, image);
+    }
+
+    // Resampling to 160x200 and cell solving; cold runs start without cached cell solutions
+    void koala(benchmark::State &state, CorpusKind kind, bool warm)
+    {
+        const PixelBuffer &image = Corpus::cached(kind, static_cast<int>(state.range(0)), static_cast<int>(state.range(1)));
+        auto cache = std::make_shared<CellSolutionCache>();
+        for (auto _ : state)
+        {
+            KoalaConverter converter;
+            converter.setCellCache(warm ? cache : nullptr);
+            converter.convertImage(image);
+            benchmark::DoNotOptimize(converter.getFileData().data());
+        }
+        setPixelCounters(state, image);
+    }
+
+    void registerBenchmarks()
+    {
+        for (CorpusKind kind : Corpus::kinds)
+        {
+            const std::string corpus = Corpus::name(kind);
+            for (ColorReductionAlgorithm algo : {ColorReductionAlgorithm::MedianCut, ColorReductionAlgorithm::KMeans,
+                                                 ColorReductionAlgorithm::OctreeQuantization})
+            {
+                benchmark::RegisterBenchmark(("ColorReduction/" + ColorReducer::getColorReducerName(algo) + "/" + corpus).c_str(),
+                                             colorReduction, algo, kind)
+                    ->Apply(paletteArguments)
+                    ->Unit(benchmark::kMillisecond);
+            }
+            for (DitheringAlgorithm algo : {DitheringAlgorithm::FloydSteinberg, DitheringAlgorithm::Bayer, DitheringAlgorithm::Ordered})
+            {
+                benchmark::RegisterBenchmark(("Dithering/" + Dithering::getAlgorithmName(algo) + "/" + corpus).c_str(),
+                                             dithering, algo, kind)
+                    ->Apply(paletteArguments)
+                    ->Unit(benchmark::kMillisecond);
+            }
+            benchmark::RegisterBenchmark(("KoalaEncode/Cold/" + corpus).c_str(), koala, kind, false)
+                ->Apply(sizeArguments)
+                ->Unit(benchmark::kMillisecond);
+            benchmark::RegisterBenchmark(("KoalaEncode/Warm/" + corpus).c_str(), koala, kind, true)
+                ->Apply(sizeArguments)
+                ->Unit(benchmark::kMillisecond);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    registerBenchmarks();
+    // Recorded in the JSON context so runs on different machines are not mixed up
+    benchmark::AddCustomContext("pixel_format_kernel", PixelFormat::activeKernelName());
+    benchmark::AddCustomContext("planar_kernel", Planar::activeKernelName());
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
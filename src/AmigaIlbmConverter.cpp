@@ -0,0 +1,189 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/AmigaIlbmConverter.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include "AmigaIlbmConverter.h"
+#include "Planar.h"
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+
+namespace
+{
+    void putU16(std::vector<uint8_t> &out, uint32_t value)
+    {
+        out.push_back(static_cast<uint8_t>((value >> 8) & 0xFF));
+        out.push_back(static_cast<uint8_t>(value & 0xFF));
+    }
+
+    void putU32(std::vector<uint8_t> &out, uint32_t value)
+    {
+        putU16(out, value >> 16);
+        putU16(out, value & 0xFFFF);
+    }
+
+    void putChunk(std::vector<uint8_t> &out, const char *id, const std::vector<uint8_t> &payload)
+    {
+        out.insert(out.end(), id, id + 4);
+        putU32(out, static_cast<uint32_t>(payload.size()));
+        out.insert(out.end(), payload.begin(), payload.end());
+        if (payload.size() % 2 != 0)
+            out.push_back(0);
+    }
+}
+
+EncoderCapabilities AmigaIlbmConverter::capabilities()
+{
+    EncoderCapabilities caps;
+    caps.name = "amiga-ilbm";
+    caps.description = "Amiga IFF ILBM bitplanes";
+    caps.extension = "iff";
+    caps.paletteSize = 256;
+    return caps;
+}
+
+EncoderCapabilities AmigaIlbmConverter::getCapabilities() const
+{
+    return capabilities();
+}
+
+void AmigaIlbmConverter::setColorReduction(ColorReductionAlgorithm algo, int targetColors)
+{
+    if (targetColors < 2 || targetColors > 256)
+    {
+        throw std::invalid_argument("ILBM images need between 2 and 256 colors");
+    }
+    m_algorithm = algo;
+    m_targetColors = targetColors;
+}
+
+void AmigaIlbmConverter::setCompression(bool enabled)
+{
+    m_compress = enabled;
+}
+
+void AmigaIlbmConverter::convertImage(ConstPixelView image)
+{
+    const int width = image.width();
+    const int height = image.height();
+    if (width <= 0 || height <= 0)
+    {
+        throw std::runtime_error("Invalid image for ILBM conversion");
+    }
+    std::vector<uint32_t> reduced = ColorReducer::reduceColors(image, m_targetColors, m_algorithm);
+    convertIndexed(ColorReducer::toIndexed(reduced, width, height));
+}
+
+void AmigaIlbmConverter::convertIndexed(const IndexedImage &image)
+{
+    if (image.width <= 0 || image.height <= 0 || image.palette.empty() || image.palette.size() > 256)
+    {
+        throw std::runtime_error("Invalid indexed image for ILBM conversion");
+    }
+
+    m_width = image.width;
+    m_height = image.height;
+    m_planes = Planar::planesForColors(static_cast<int>(image.palette.size()));
+    m_palette = image.palette;
+
+    // ILBM rows are padded to whole 16-bit words
+    const size_t rowBytes = ((static_cast<size_t>(m_width) + 15) / 16) * 2;
+    std::vector<uint8_t> planes(rowBytes * m_planes);
+    m_body.clear();
+    m_body.reserve(m_compress ? planes.size() * m_height / 2 : planes.size() * m_height);
+
+    for (int y = 0; y < m_height; ++y)
+    {
+        std::fill(planes.begin(), planes.end(), 0);
+        Planar::chunkyToPlanar(image.indices.data() + static_cast<size_t>(y) * m_width, m_width, m_planes, planes.data(), rowBytes);
+        if (m_compress)
+        {
+            for (int p = 0; p < m_planes; ++p)
+            {
+                packByteRun1(planes.data() + p * rowBytes, rowBytes, m_body);
+            }
+        }
+        else
+        {
+            m_body.insert(m_body.end(), planes.begin(), planes.end());
+        }
+    }
+
+    SPDLOG_DEBUG("ILBM conversion: {}x{}, {} planes, body {} bytes ({} kernel)", m_width, m_height, m_planes, m_body.size(), Planar::activeKernelName());
+}
+
+void AmigaIlbmConverter::packByteRun1(const uint8_t *data, size_t size, std::vector<uint8_t> &out)
+{
+    size_t i = 0;
+    while (i < size)
+    {
+        size_t run = 1;
+        while (i + run < size && run < 128 && data[i + run] == data[i])
+        {
+            ++run;
+        }
+        if (run >= 3)
+        {
+            out.push_back(static_cast<uint8_t>(257 - run));
+            out.push_back(data[i]);
+            i += run;
+            continue;
+        }
+
+        size_t start = i;
+        while (i < size && i - start < 128)
+        {
+            if (i + 2 < size && data[i] == data[i + 1] && data[i] == data[i + 2])
+                break;
+            ++i;
+        }
+        out.push_back(static_cast<uint8_t>(i - start - 1));
+        out.insert(out.end(), data + start, data + i);
+    }
+}
+
+std::vector<uint8_t> AmigaIlbmConverter::getFileData() const
+{
+    if (m_width == 0)
+    {
+        throw std::runtime_error("No image converted");
+    }
+
+    std::vector<uint8_t> bmhd;
+    putU16(bmhd, static_cast<uint32_t>(m_width));
+    putU16(bmhd, static_cast<uint32_t>(m_height));
+    putU16(bmhd, 0);
+    putU16(bmhd, 0);
+    bmhd.push_back(static_cast<uint8_t>(m_planes));
+    bmhd.push_back(0);
+    bmhd.push_back(m_compress ? 1 : 0);
+    bmhd.push_back(0);
+    putU16(bmhd, 0);
+    bmhd.push_back(10);
+    bmhd.push_back(11);
+    putU16(bmhd, static_cast<uint32_t>(m_width));
+    putU16(bmhd, static_cast<uint32_t>(m_height));
+
+    std::vector<uint8_t> cmap;
+    for (uint32_t color : m_palette)
+    {
+        cmap.push_back(static_cast<uint8_t>((color >> 16) & 0xFF));
+        cmap.push_back(static_cast<uint8_t>((color >> 8) & 0xFF));
+        cmap.push_back(static_cast<uint8_t>(color & 0xFF));
+    }
+
+    std::vector<uint8_t> form;
+    form.reserve(m_body.size() + cmap.size() + 64);
+    form.insert(form.end(), {'I', 'L', 'B', 'M'});
+    putChunk(form, "BMHD", bmhd);
+    putChunk(form, "CMAP", cmap);
+    putChunk(form, "BODY", m_body);
+
+    std::vector<uint8_t> data;
+    data.reserve(form.size() + 8);
+    data.insert(data.end(), {'F', 'O', 'R', 'M'});
+    putU32(data, static_cast<uint32_t>(form.size()));
+    data.insert(data.end(), form.begin(), form.end());
+    return data;
+}
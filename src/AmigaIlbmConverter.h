@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/AmigaIlbmConverter.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include "ImageConverter.h"
+#include "ColorReducer.h"
+#include <vector>
+#include <cstdint>
+
+// Amiga IFF ILBM with row-interleaved bitplanes and optional ByteRun1 compression
+class AmigaIlbmConverter : public ImageConverter
+{
+public:
+    using ImageConverter::convertImage;
+    void convertImage(ConstPixelView image) override;
+    void convertIndexed(const IndexedImage &image);
+    std::vector<uint8_t> getFileData() const override;
+    EncoderCapabilities getCapabilities() const override;
+
+    void setColorReduction(ColorReductionAlgorithm algo, int targetColors);
+    void setCompression(bool enabled);
+
+    static EncoderCapabilities capabilities();
+    static void packByteRun1(const uint8_t *data, size_t size, std::vector<uint8_t> &out);
+
+private:
+    ColorReductionAlgorithm m_algorithm = ColorReductionAlgorithm::MedianCut;
+    int m_targetColors = 32;
+    bool m_compress = true;
+
+    int m_width = 0;
+    int m_height = 0;
+    int m_planes = 0;
+    std::vector<uint32_t> m_palette;
+    std::vector<uint8_t> m_body;
+};
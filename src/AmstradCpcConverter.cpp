@@ -0,0 +1,170 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/AmstradCpcConverter.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include "AmstradCpcConverter.h"
+#include "C64Palette.h"
+#include "ColorReducer.h"
+#include "Parallel.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+    int closestIndex(uint32_t color, const std::vector<uint32_t> &palette)
+    {
+        int best = 0;
+        int bestDistance = std::numeric_limits<int>::max();
+        for (size_t i = 0; i < palette.size(); ++i)
+        {
+            int d = C64Palette::distance(color & 0xFFFFFF, palette[i]);
+            if (d < bestDistance)
+            {
+                bestDistance = d;
+                best = static_cast<int>(i);
+            }
+        }
+        return best;
+    }
+}
+
+AmstradCpcConverter::AmstradCpcConverter(int mode) : m_mode(mode)
+{
+    if (mode < 0 || mode > 2)
+    {
+        throw std::invalid_argument("Amstrad CPC mode must be 0, 1 or 2");
+    }
+}
+
+uint32_t AmstradCpcConverter::hardwareColor(int firmwareColor)
+{
+    static constexpr uint32_t LEVELS[3] = {0x00, 0x80, 0xFF};
+    int g = firmwareColor / 9;
+    int r = (firmwareColor / 3) % 3;
+    int b = firmwareColor % 3;
+    return (LEVELS[r] << 16) | (LEVELS[g] << 8) | LEVELS[b];
+}
+
+EncoderCapabilities AmstradCpcConverter::capabilities(int mode)
+{
+    if (mode < 0 || mode > 2)
+    {
+        throw std::invalid_argument("Amstrad CPC mode must be 0, 1 or 2");
+    }
+
+    EncoderCapabilities caps;
+    caps.name = "cpc-mode" + std::to_string(mode);
+    caps.description = "Amstrad CPC mode " + std::to_string(mode) + " screen";
+    caps.extension = "scr";
+    caps.width = 160 << mode;
+    caps.height = 200;
+    static constexpr int PENS[3] = {16, 4, 2};
+    caps.paletteSize = PENS[mode];
+    caps.pixelAspect = 2.0 / (1 << mode);
+    return caps;
+}
+
+EncoderCapabilities AmstradCpcConverter::getCapabilities() const
+{
+    return capabilities(m_mode);
+}
+
+const std::vector<uint8_t> &AmstradCpcConverter::getPens() const
+{
+    return m_pens;
+}
+
+void AmstradCpcConverter::convertImage(ConstPixelView image)
+{
+    const int width = image.width();
+    const int height = image.height();
+    EncoderCapabilities caps = capabilities(m_mode);
+    if (width != caps.width || height != caps.height)
+    {
+        throw std::runtime_error("Image dimensions must be " + std::to_string(caps.width) + "x" + std::to_string(caps.height) + " for CPC mode " + std::to_string(m_mode));
+    }
+
+    std::vector<uint32_t> hardware(HARDWARE_COLORS);
+    for (int i = 0; i < HARDWARE_COLORS; ++i)
+    {
+        hardware[i] = hardwareColor(i);
+    }
+
+    // Pick the pens from a reduced palette snapped to the hardware colors
+    std::vector<uint32_t> reduced = ColorReducer::reduceColors(image, caps.paletteSize, ColorReductionAlgorithm::MedianCut);
+    m_pens.clear();
+    for (uint32_t color : reduced)
+    {
+        uint8_t firmware = static_cast<uint8_t>(closestIndex(color, hardware));
+        if (std::find(m_pens.begin(), m_pens.end(), firmware) == m_pens.end())
+        {
+            m_pens.push_back(firmware);
+            if (m_pens.size() == static_cast<size_t>(caps.paletteSize))
+                break;
+        }
+    }
+
+    std::vector<uint32_t> penColors;
+    for (uint8_t pen : m_pens)
+    {
+        penColors.push_back(hardware[pen]);
+    }
+
+    const int pixelsPerByte = 2 << m_mode;
+    m_screen.assign(SCREEN_SIZE, 0);
+    Parallel::forEach(static_cast<size_t>(height), 0, [&](size_t y)
+                      {
+        uint8_t pens[8];
+        for (int byteX = 0; byteX < BYTES_PER_LINE; ++byteX)
+        {
+            for (int p = 0; p < pixelsPerByte; ++p)
+            {
+                pens[p] = static_cast<uint8_t>(closestIndex(image(byteX * pixelsPerByte + p, static_cast<int>(y)), penColors));
+            }
+            size_t address = (y % 8) * 0x800 + (y / 8) * BYTES_PER_LINE + byteX;
+            m_screen[address] = packByte(pens);
+        } });
+
+    SPDLOG_DEBUG("CPC mode {} conversion used {} pens", m_mode, m_pens.size());
+}
+
+uint8_t AmstradCpcConverter::packByte(const uint8_t *pens) const
+{
+    uint8_t byte = 0;
+    switch (m_mode)
+    {
+    case 0:
+        // Pixel 0 owns bits 7,3,5,1 (pen bits 0-3), pixel 1 owns bits 6,2,4,0
+        for (int p = 0; p < 2; ++p)
+        {
+            uint8_t pen = pens[p];
+            byte |= static_cast<uint8_t>(((pen & 1) << (7 - p)) | (((pen >> 1) & 1) << (3 - p)) |
+                                         (((pen >> 2) & 1) << (5 - p)) | (((pen >> 3) & 1) << (1 - p)));
+        }
+        break;
+    case 1:
+        // Pixel p owns bit 7-p (pen bit 0) and bit 3-p (pen bit 1)
+        for (int p = 0; p < 4; ++p)
+        {
+            byte |= static_cast<uint8_t>(((pens[p] & 1) << (7 - p)) | (((pens[p] >> 1) & 1) << (3 - p)));
+        }
+        break;
+    default:
+        for (int p = 0; p < 8; ++p)
+        {
+            byte |= static_cast<uint8_t>((pens[p] & 1) << (7 - p));
+        }
+        break;
+    }
+    return byte;
+}
+
+std::vector<uint8_t> AmstradCpcConverter::getFileData() const
+{
+    return m_screen;
+}
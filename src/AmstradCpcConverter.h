@@ -0,0 +1,43 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/AmstradCpcConverter.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include "ImageConverter.h"
+#include <array>
+#include <vector>
+#include <cstdint>
+
+// Amstrad CPC screen memory dump (16 KB .scr). The CPC has no attribute cells: every mode
+// picks a global set of pens from the 27-color hardware palette.
+class AmstradCpcConverter : public ImageConverter
+{
+public:
+    explicit AmstradCpcConverter(int mode);
+
+    using ImageConverter::convertImage;
+    void convertImage(ConstPixelView image) override;
+    std::vector<uint8_t> getFileData() const override;
+    EncoderCapabilities getCapabilities() const override;
+
+    // Firmware color numbers (0-26) assigned to each pen
+    const std::vector<uint8_t> &getPens() const;
+
+    static EncoderCapabilities capabilities(int mode);
+    static uint32_t hardwareColor(int firmwareColor);
+
+    static constexpr int HARDWARE_COLORS = 27;
+
+private:
+    static constexpr int SCREEN_SIZE = 16384;
+    static constexpr int BYTES_PER_LINE = 80;
+
+    uint8_t packByte(const uint8_t *pens) const;
+
+    int m_mode;
+    std::vector<uint8_t> m_pens;
+    std::vector<uint8_t> m_screen;
+};
@@ -0,0 +1,474 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/AnimationConverter.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include "AnimationConverter.h"
+#include "BoundedQueue.h"
+#include "MappedFile.h"
+#include "Metrics.h"
+#include "PaletteBuilder.h"
+#include "Parallel.h"
+#include <spdlog/spdlog.h>
+#include <stb_image.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+
+namespace
+{
+    class FrameList : public FrameSource
+    {
+    public:
+        explicit FrameList(std::vector<AnimationFrame> frames) : m_frames(std::move(frames)) {}
+
+        size_t frameCount() const override { return m_frames.size(); }
+        AnimationFrame frame(size_t index) const override { return m_frames.at(index); }
+
+    private:
+        std::vector<AnimationFrame> m_frames;
+    };
+
+    class FileSequence : public FrameSource
+    {
+    public:
+        FileSequence(std::vector<std::filesystem::path> files, const DecodeOptions &options)
+            : m_files(std::move(files)), m_options(options) {}
+
+        size_t frameCount() const override { return m_files.size(); }
+        AnimationFrame frame(size_t index) const override { return {ImageIO::load(m_files.at(index).string(), m_options), 0}; }
+
+    private:
+        std::vector<std::filesystem::path> m_files;
+        DecodeOptions m_options;
+    };
+
+    // stb_image composites every GIF frame onto the previous ones, so the frames are
+    // complete images; they are kept as RGBA and converted when requested
+    class GifFrames : public FrameSource
+    {
+    public:
+        explicit GifFrames(const std::filesystem::path &path) : m_pixels(nullptr, stbi_image_free)
+        {
+            MappedFile file = MappedFile::open(path);
+            int *delays = nullptr;
+            int channels = 0;
+            m_pixels.reset(stbi_load_gif_from_memory(file.bytes().data(), static_cast<int>(file.size()), &delays,
+                                                     &m_width, &m_height, &m_count, &channels, 4));
+            if (!m_pixels)
+            {
+                throw std::runtime_error("Unable to decode " + path.string() + ": " + stbi_failure_reason());
+            }
+            if (delays)
+            {
+                m_delays.assign(delays, delays + m_count);
+                std::free(delays);
+            }
+        }
+
+        size_t frameCount() const override { return static_cast<size_t>(m_count); }
+
+        AnimationFrame frame(size_t index) const override
+        {
+            if (index >= frameCount())
+            {
+                throw std::out_of_range("GIF frame index out of range");
+            }
+            size_t frameBytes = static_cast<size_t>(m_width) * m_height * 4;
+            return {ImageIO::fromRgba(m_pixels.get() + index * frameBytes, m_width, m_height),
+                    index < m_delays.size() ? m_delays[index] : 0};
+        }
+
+    private:
+        std::unique_ptr<stbi_uc, void (*)(void *)> m_pixels;
+        std::vector<int> m_delays;
+        int m_width = 0;
+        int m_height = 0;
+        int m_count = 0;
+    };
+
+    int distanceSquared(const std::array<int, 3> &rgb, uint32_t color)
+    {
+        int dr = rgb[0] - static_cast<int>((color >> 16) & 0xFF);
+        int dg = rgb[1] - static_cast<int>((color >> 8) & 0xFF);
+        int db = rgb[2] - static_cast<int>(color & 0xFF);
+        return dr * dr + dg * dg + db * db;
+    }
+
+    uint32_t nearest(const std::array<int, 3> &rgb, const std::vector<uint32_t> &palette, int &distance)
+    {
+        uint32_t best = palette[0];
+        distance = std::numeric_limits<int>::max();
+        for (uint32_t color : palette)
+        {
+            int d = distanceSquared(rgb, color);
+            if (d < distance)
+            {
+                distance = d;
+                best = color;
+            }
+        }
+        return best;
+    }
+}
+
+std::unique_ptr<FrameSource> FrameSource::open(const std::filesystem::path &path, const DecodeOptions &options)
+{
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    if (extension == ".gif")
+    {
+        return std::make_unique<GifFrames>(path);
+    }
+    return sequence({path}, options);
+}
+
+std::unique_ptr<FrameSource> FrameSource::sequence(std::vector<std::filesystem::path> files, const DecodeOptions &options)
+{
+    return std::make_unique<FileSequence>(std::move(files), options);
+}
+
+std::unique_ptr<FrameSource> FrameSource::fromFrames(std::vector<AnimationFrame> frames)
+{
+    return std::make_unique<FrameList>(std::move(frames));
+}
+
+AnimationConverter::AnimationConverter(AnimationOptions options) : m_options(std::move(options)) {}
+
+void AnimationConverter::setPreprocessor(Preprocessor preprocessor)
+{
+    m_preprocessor = std::move(preprocessor);
+}
+
+PixelBuffer AnimationConverter::prepare(const FrameSource &source, size_t index, int &delay) const
+{
+    AnimationFrame frame = source.frame(index);
+    delay = frame.delay;
+    return m_preprocessor ? m_preprocessor(std::move(frame.image)) : std::move(frame.image);
+}
+
+std::vector<uint32_t> AnimationConverter::sharedPalette(const FrameSource &source, ProgressToken *progress) const
+{
+    const size_t count = source.frameCount();
+    if (count == 0)
+    {
+        throw std::invalid_argument("Animation has no frames");
+    }
+    const size_t samples = m_options.paletteSamples == 0 ? count : std::min(count, m_options.paletteSamples);
+
+    // Only the merged histogram of the samples is kept, not the frames themselves
+    ColorHistogram histogram = PaletteBuilder::histogram(samples, [&](size_t i)
+                                                         {
+        int delay = 0;
+        return prepare(source, i * count / samples, delay); }, m_options.threads, progress);
+    return PaletteBuilder::build(histogram, m_options.targetColors, m_options.reducer, progress, m_options.seed);
+}
+
+std::vector<uint32_t> AnimationConverter::evolvePalette(const std::vector<uint32_t> &previous, const std::vector<uint32_t> &fresh, int tolerance)
+{
+    if (previous.empty())
+    {
+        return fresh;
+    }
+
+    const int limit = tolerance * tolerance;
+    std::vector<bool> needed(previous.size(), false);
+    std::vector<uint32_t> missing;
+    for (uint32_t color : fresh)
+    {
+        std::array<int, 3> rgb = {static_cast<int>((color >> 16) & 0xFF), static_cast<int>((color >> 8) & 0xFF), static_cast<int>(color & 0xFF)};
+        int distance = 0;
+        uint32_t match = nearest(rgb, previous, distance);
+        if (distance <= limit)
+        {
+            needed[std::find(previous.begin(), previous.end(), match) - previous.begin()] = true;
+        }
+        else
+        {
+            missing.push_back(color);
+        }
+    }
+
+    std::vector<uint32_t> result = previous;
+    size_t slot = 0;
+    for (uint32_t color : missing)
+    {
+        while (slot < result.size() && needed[slot])
+        {
+            ++slot;
+        }
+        if (slot < result.size())
+        {
+            result[slot] = color;
+            needed[slot] = true;
+        }
+        else if (result.size() < fresh.size())
+        {
+            result.push_back(color);
+            needed.push_back(true);
+        }
+        else
+        {
+            break;
+        }
+    }
+    return result;
+}
+
+bool AnimationConverter::tileChanged(ConstPixelView current, ConstPixelView reference) const
+{
+    for (int y = 0; y < current.height(); ++y)
+    {
+        std::span<const uint32_t> a = current.row(y);
+        std::span<const uint32_t> b = reference.row(y);
+        if (m_options.changeThreshold <= 0)
+        {
+            if (std::memcmp(a.data(), b.data(), a.size_bytes()) != 0)
+            {
+                return true;
+            }
+            continue;
+        }
+        for (size_t x = 0; x < a.size(); ++x)
+        {
+            for (int shift : {0, 8, 16})
+            {
+                if (std::abs(static_cast<int>((a[x] >> shift) & 0xFF) - static_cast<int>((b[x] >> shift) & 0xFF)) > m_options.changeThreshold)
+                {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+void AnimationConverter::convertTile(ConstPixelView source, PixelView output, const std::vector<uint32_t> &palette, bool keepPrevious) const
+{
+    if (!m_options.dither)
+    {
+        ColorReducer::remap(source, palette, output);
+        return;
+    }
+    if (m_options.dithering != DitheringAlgorithm::FloydSteinberg)
+    {
+        // Tiles start on multiples of the threshold matrix sizes, so the pattern lines up across tiles
+        Dithering::applyDithering(source, palette, m_options.dithering, output);
+        return;
+    }
+
+    // Floyd-Steinberg within the tile; the guard column on each side swallows the error
+    // that would leave it
+    const int width = source.width();
+    const double hysteresis = keepPrevious ? m_options.ditherHysteresis : 0.0;
+    std::vector<std::array<float, 3>> error(static_cast<size_t>(width + 2) * 2, {0.0f, 0.0f, 0.0f});
+    for (int y = 0; y < source.height(); ++y)
+    {
+        std::array<float, 3> *current = &error[static_cast<size_t>(y & 1) * (width + 2)];
+        std::array<float, 3> *next = &error[static_cast<size_t>((y + 1) & 1) * (width + 2)];
+        for (int x = 0; x < width; ++x)
+        {
+            uint32_t pixel = source(x, y);
+            std::array<int, 3> rgb;
+            for (int c = 0; c < 3; ++c)
+            {
+                int channel = static_cast<int>((pixel >> (16 - 8 * c)) & 0xFF);
+                rgb[c] = std::clamp(channel + static_cast<int>(std::lround(current[x + 1][c])), 0, 255);
+            }
+
+            int distance = 0;
+            uint32_t chosen = nearest(rgb, palette, distance);
+            if (hysteresis > 0.0)
+            {
+                uint32_t previous = output(x, y);
+                if (previous != chosen && std::sqrt(static_cast<double>(distanceSquared(rgb, previous))) - std::sqrt(static_cast<double>(distance)) <= hysteresis &&
+                    std::find(palette.begin(), palette.end(), previous) != palette.end())
+                {
+                    chosen = previous;
+                }
+            }
+            output(x, y) = chosen;
+
+            for (int c = 0; c < 3; ++c)
+            {
+                float err = static_cast<float>(rgb[c] - static_cast<int>((chosen >> (16 - 8 * c)) & 0xFF));
+                current[x + 2][c] += err * 7.0f / 16.0f;
+                next[x][c] += err * 3.0f / 16.0f;
+                next[x + 1][c] += err * 5.0f / 16.0f;
+                next[x + 2][c] += err * 1.0f / 16.0f;
+            }
+        }
+        std::fill_n(current, width + 2, std::array<float, 3>{0.0f, 0.0f, 0.0f});
+    }
+}
+
+AnimationStatistics AnimationConverter::run(const FrameSource &source, const FrameSink &sink, ProgressToken *progress)
+{
+    if (m_options.targetColors <= 0)
+    {
+        throw std::invalid_argument("Animations need a palette of at least one color");
+    }
+    auto start = std::chrono::steady_clock::now();
+    const size_t count = source.frameCount();
+    AnimationStatistics statistics;
+
+    std::vector<uint32_t> palette;
+    if (m_options.paletteMode == PaletteMode::Shared && count > 0)
+    {
+        palette = sharedPalette(source, progress);
+    }
+
+    struct DecodedFrame
+    {
+        size_t index;
+        PixelBuffer image;
+        int delay;
+    };
+    BoundedQueue<DecodedFrame> decoded(std::max<size_t>(1, m_options.decodeAhead));
+    std::exception_ptr decodeError;
+    std::thread decoder([&]()
+                        {
+        try
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                int delay = 0;
+                PixelBuffer image = prepare(source, i, delay);
+                if (!decoded.push({i, std::move(image), delay}))
+                {
+                    break;
+                }
+            }
+        }
+        catch (...)
+        {
+            decodeError = std::current_exception();
+        }
+        decoded.close(); });
+
+    try
+    {
+        PixelBuffer reference;
+        PixelBuffer output;
+        std::vector<uint32_t> previousPalette;
+        // Tiles that changed since the evolving palette was last built
+        std::vector<uint8_t> staleTiles;
+        while (std::optional<DecodedFrame> frame = decoded.pop())
+        {
+            ProgressToken::checkpoint(progress);
+            StageTimer timer("animate");
+            const PixelBuffer &image = frame->image;
+            const bool first = frame->index == 0;
+            if (first)
+            {
+                reference = PixelBuffer(image.width(), image.height());
+                output = PixelBuffer(image.width(), image.height());
+            }
+            else if (image.width() != output.width() || image.height() != output.height())
+            {
+                throw std::runtime_error("Frame " + std::to_string(frame->index) + " is " + std::to_string(image.width()) + "x" +
+                                         std::to_string(image.height()) + ", the animation is " + std::to_string(output.width()) + "x" +
+                                         std::to_string(output.height()));
+            }
+
+            const int tilesX = (image.width() + TILE - 1) / TILE;
+            const int tilesY = (image.height() + TILE - 1) / TILE;
+            const size_t tiles = static_cast<size_t>(tilesX) * tilesY;
+            // Found before the palette, so a frame with few changes can skip its rebuild
+            std::vector<uint8_t> changed(tiles, 1);
+            if (!first)
+            {
+                Parallel::forEach(static_cast<size_t>(tilesY), m_options.threads, [&](size_t row)
+                                  {
+                    int y = static_cast<int>(row) * TILE;
+                    int height = std::min(TILE, image.height() - y);
+                    for (int x = 0; x < image.width(); x += TILE)
+                    {
+                        int width = std::min(TILE, image.width() - x);
+                        changed[row * tilesX + x / TILE] = tileChanged(image.subView(x, y, width, height), reference.subView(x, y, width, height));
+                    } });
+            }
+
+            if (m_options.paletteMode == PaletteMode::Evolving)
+            {
+                staleTiles.resize(tiles);
+                size_t stale = 0;
+                for (size_t i = 0; i < tiles; ++i)
+                {
+                    staleTiles[i] |= changed[i];
+                    stale += staleTiles[i];
+                }
+                if (first || (stale > 0 && static_cast<double>(stale) > m_options.paletteRebuildArea * static_cast<double>(tiles)))
+                {
+                    std::vector<uint32_t> fresh = ColorReducer::generatePalette(image, ColorReducer::buildHistogram(image), m_options.targetColors,
+                                                                                m_options.reducer, progress, m_options.seed);
+                    palette = evolvePalette(previousPalette, fresh, m_options.paletteTolerance);
+                    std::fill(staleTiles.begin(), staleTiles.end(), uint8_t(0));
+                    ++statistics.paletteBuilds;
+                }
+            }
+            const bool paletteChanged = palette != previousPalette;
+            if (paletteChanged && !first)
+            {
+                ++statistics.paletteChanges;
+            }
+
+            std::atomic<size_t> reused{0};
+            Parallel::forEach(static_cast<size_t>(tilesY), m_options.threads, [&](size_t row)
+                              {
+                int y = static_cast<int>(row) * TILE;
+                int height = std::min(TILE, image.height() - y);
+                for (int x = 0; x < image.width(); x += TILE)
+                {
+                    int width = std::min(TILE, image.width() - x);
+                    ConstPixelView current = image.subView(x, y, width, height);
+                    PixelView referenceTile = reference.subView(x, y, width, height);
+                    if (!first && !paletteChanged && !changed[row * tilesX + x / TILE])
+                    {
+                        ++reused;
+                        continue;
+                    }
+                    convertTile(current, output.subView(x, y, width, height), palette, !first);
+                    for (int ty = 0; ty < height; ++ty)
+                    {
+                        std::copy(current.row(ty).begin(), current.row(ty).end(), referenceTile.row(ty).begin());
+                    }
+                } });
+
+            statistics.tiles += tiles;
+            statistics.reusedTiles += reused;
+            ++statistics.frames;
+            previousPalette = palette;
+            SPDLOG_DEBUG("Animation frame {}: {} of {} tiles reused{}", frame->index, reused.load(), tilesX * tilesY,
+                         paletteChanged && !first ? ", palette changed" : "");
+
+            sink(frame->index, AnimationFrame{output, frame->delay});
+            ProgressToken::report(progress, static_cast<float>(frame->index + 1) / count);
+        }
+    }
+    catch (...)
+    {
+        decoded.close();
+        decoder.join();
+        throw;
+    }
+    decoder.join();
+    if (decodeError)
+    {
+        std::rethrow_exception(decodeError);
+    }
+
+    statistics.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    spdlog::info("Converted {} frames in {} ms, {} of {} tiles reused, {} palette changes", statistics.frames, statistics.elapsed.count(),
+                 statistics.reusedTiles, statistics.tiles, statistics.paletteChanges);
+    return statistics;
+}
@@ -0,0 +1,124 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/AnimationConverter.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include "ColorReducer.h"
+#include "Dithering.h"
+#include "ImageIO.h"
+#include "PixelBuffer.h"
+#include "ProgressToken.h"
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <vector>
+
+struct AnimationFrame
+{
+    PixelBuffer image;
+    // Display time in milliseconds, 0 when the source has none
+    int delay = 0;
+};
+
+// Random access to the frames of an animation. frame() may be called from several threads.
+class FrameSource
+{
+public:
+    virtual ~FrameSource() = default;
+    virtual size_t frameCount() const = 0;
+    virtual AnimationFrame frame(size_t index) const = 0;
+
+    // GIF files yield every frame with disposal already applied, other images a single frame
+    static std::unique_ptr<FrameSource> open(const std::filesystem::path &path, const DecodeOptions &options = {});
+    // One frame per file in the given order, decoded when the frame is requested
+    static std::unique_ptr<FrameSource> sequence(std::vector<std::filesystem::path> files, const DecodeOptions &options = {});
+    static std::unique_ptr<FrameSource> fromFrames(std::vector<AnimationFrame> frames);
+};
+
+enum class PaletteMode
+{
+    // One palette for the whole animation, built from sample frames
+    Shared,
+    // A palette per frame that only replaces the entries the frame no longer needs
+    Evolving
+};
+
+struct AnimationOptions
+{
+    ColorReductionAlgorithm reducer = ColorReductionAlgorithm::MedianCut;
+    int targetColors = 16;
+    uint64_t seed = ColorReducer::DEFAULT_SEED;
+    bool dither = false;
+    DitheringAlgorithm dithering = DitheringAlgorithm::FloydSteinberg;
+    PaletteMode paletteMode = PaletteMode::Shared;
+    // Frames the shared palette is built from, spread evenly over the animation; 0 uses all
+    size_t paletteSamples = 16;
+    // An evolving palette keeps an entry while the frame's own palette has a color within
+    // this RGB distance of it
+    int paletteTolerance = 24;
+    // An evolving palette is only rebuilt once more than this fraction of the frame's tiles
+    // changed since it was last built; 0 rebuilds it on every frame with a changed tile
+    double paletteRebuildArea = 0.1;
+    // A tile is converted again once one of its pixels differs by more than this per
+    // channel from the source it was last converted from; otherwise its output is kept
+    int changeThreshold = 0;
+    // Floyd-Steinberg keeps the previous frame's color of a pixel while it is at most this
+    // RGB distance worse than the best match, so the pattern does not crawl; 0 disables it
+    int ditherHysteresis = 12;
+    // Frames decoded ahead of the one being converted
+    size_t decodeAhead = 2;
+    int threads = 0;
+};
+
+struct AnimationStatistics
+{
+    size_t frames = 0;
+    size_t tiles = 0;
+    // Tiles whose output was carried over from the previous frame
+    size_t reusedTiles = 0;
+    // Frames whose palette differs from the previous frame's
+    size_t paletteChanges = 0;
+    // Evolving palettes built from a frame's histogram
+    size_t paletteBuilds = 0;
+    std::chrono::milliseconds elapsed{0};
+};
+
+// Converts animations and frame sequences with a palette that stays stable from frame to
+// frame. Frames are split into TILE x TILE tiles; tiles whose source did not change keep
+// their previous output, changed tiles are converted independently of each other and in
+// parallel. Error diffusion stays within a tile, so an edit does not shift the dither
+// pattern of the rest of the frame. A decoder thread prepares the next frames while the
+// current one is converted.
+class AnimationConverter
+{
+public:
+    static constexpr int TILE = 16;
+
+    // Receives every converted frame in order on the calling thread of run()
+    using FrameSink = std::function<void(size_t index, const AnimationFrame &frame)>;
+    // Applied to every decoded frame on the decoder thread, e.g. resampling to the encoder size
+    using Preprocessor = std::function<PixelBuffer(PixelBuffer image)>;
+
+    explicit AnimationConverter(AnimationOptions options);
+
+    void setPreprocessor(Preprocessor preprocessor);
+    AnimationStatistics run(const FrameSource &source, const FrameSink &sink, ProgressToken *progress = nullptr);
+
+    // Palette of the evenly spaced sample frames, as used in PaletteMode::Shared
+    std::vector<uint32_t> sharedPalette(const FrameSource &source, ProgressToken *progress = nullptr) const;
+    // Replaces the entries of `previous` that no color of `fresh` is close to by the colors
+    // of `fresh` that no entry is close to; unmatched entries keep their position
+    static std::vector<uint32_t> evolvePalette(const std::vector<uint32_t> &previous, const std::vector<uint32_t> &fresh, int tolerance);
+
+private:
+    PixelBuffer prepare(const FrameSource &source, size_t index, int &delay) const;
+    bool tileChanged(ConstPixelView current, ConstPixelView reference) const;
+    void convertTile(ConstPixelView source, PixelView output, const std::vector<uint32_t> &palette, bool keepPrevious) const;
+
+    AnimationOptions m_options;
+    Preprocessor m_preprocessor;
+};
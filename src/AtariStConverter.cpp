@@ -0,0 +1,93 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/AtariStConverter.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include "AtariStConverter.h"
+#include "Planar.h"
+#include <stdexcept>
+
+EncoderCapabilities AtariStConverter::capabilities()
+{
+    EncoderCapabilities caps;
+    caps.name = "atari-pi1";
+    caps.description = "Atari ST low resolution (Degas PI1)";
+    caps.extension = "pi1";
+    caps.width = ST_WIDTH;
+    caps.height = ST_HEIGHT;
+    caps.paletteSize = ST_COLORS;
+    return caps;
+}
+
+EncoderCapabilities AtariStConverter::getCapabilities() const
+{
+    return capabilities();
+}
+
+void AtariStConverter::setColorReduction(ColorReductionAlgorithm algo)
+{
+    m_algorithm = algo;
+}
+
+uint16_t AtariStConverter::toStColor(uint32_t color)
+{
+    uint16_t r = static_cast<uint16_t>(((color >> 16) & 0xFF) >> 5);
+    uint16_t g = static_cast<uint16_t>(((color >> 8) & 0xFF) >> 5);
+    uint16_t b = static_cast<uint16_t>((color & 0xFF) >> 5);
+    return static_cast<uint16_t>((r << 8) | (g << 4) | b);
+}
+
+void AtariStConverter::convertImage(ConstPixelView image)
+{
+    const int width = image.width();
+    const int height = image.height();
+    if (width != ST_WIDTH || height != ST_HEIGHT)
+    {
+        throw std::runtime_error("Image dimensions must be 320x200 for Atari ST low resolution");
+    }
+    std::vector<uint32_t> reduced = ColorReducer::reduceColors(image, ST_COLORS, m_algorithm);
+    convertIndexed(ColorReducer::toIndexed(reduced, width, height));
+}
+
+void AtariStConverter::convertIndexed(const IndexedImage &image)
+{
+    if (image.width != ST_WIDTH || image.height != ST_HEIGHT)
+    {
+        throw std::runtime_error("Image dimensions must be 320x200 for Atari ST low resolution");
+    }
+    if (image.palette.size() > ST_COLORS)
+    {
+        throw std::runtime_error("Atari ST low resolution supports at most 16 colors");
+    }
+
+    m_palette.assign(ST_COLORS, 0);
+    for (size_t i = 0; i < image.palette.size(); ++i)
+    {
+        m_palette[i] = toStColor(image.palette[i]);
+    }
+
+    const size_t lineBytes = ST_WIDTH / 16 * ST_PLANES * 2;
+    m_screen.assign(ST_SCREEN_SIZE, 0);
+    for (int y = 0; y < ST_HEIGHT; ++y)
+    {
+        Planar::chunkyToInterleavedWords(image.indices.data() + static_cast<size_t>(y) * ST_WIDTH, ST_WIDTH, ST_PLANES,
+                                         m_screen.data() + y * lineBytes);
+    }
+}
+
+std::vector<uint8_t> AtariStConverter::getFileData() const
+{
+    std::vector<uint8_t> data;
+    data.reserve(2 + ST_COLORS * 2 + ST_SCREEN_SIZE);
+    // Resolution word: 0 = low resolution
+    data.push_back(0);
+    data.push_back(0);
+    for (uint16_t color : m_palette)
+    {
+        data.push_back(static_cast<uint8_t>(color >> 8));
+        data.push_back(static_cast<uint8_t>(color & 0xFF));
+    }
+    data.insert(data.end(), m_screen.begin(), m_screen.end());
+    return data;
+}
@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/AtariStConverter.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include "ImageConverter.h"
+#include "ColorReducer.h"
+#include <vector>
+#include <cstdint>
+
+// Atari ST low resolution (320x200, 16 colors) written as Degas PI1
+class AtariStConverter : public ImageConverter
+{
+public:
+    using ImageConverter::convertImage;
+    void convertImage(ConstPixelView image) override;
+    void convertIndexed(const IndexedImage &image);
+    std::vector<uint8_t> getFileData() const override;
+    EncoderCapabilities getCapabilities() const override;
+
+    void setColorReduction(ColorReductionAlgorithm algo);
+
+    static EncoderCapabilities capabilities();
+    // 0x0RGB with three bits per channel
+    static uint16_t toStColor(uint32_t color);
+
+private:
+    static constexpr int ST_WIDTH = 320;
+    static constexpr int ST_HEIGHT = 200;
+    static constexpr int ST_PLANES = 4;
+    static constexpr int ST_COLORS = 16;
+    static constexpr int ST_SCREEN_SIZE = 32000;
+
+    ColorReductionAlgorithm m_algorithm = ColorReductionAlgorithm::MedianCut;
+    std::vector<uint16_t> m_palette;
+    std::vector<uint8_t> m_screen;
+};
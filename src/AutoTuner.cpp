@@ -0,0 +1,214 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/AutoTuner.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include "AutoTuner.h"
+#include "ImageQuality.h"
+#include "Metrics.h"
+#include "Parallel.h"
+#include "Resampler.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace
+{
+    constexpr int ROUNDS = 3;
+    constexpr double SSIM_WEIGHT = 10.0;
+}
+
+std::vector<TuneCandidate> AutoTuner::candidates(const TuneOptions &options)
+{
+    std::vector<TuneCandidate> result;
+    for (int colors : options.paletteSizes)
+    {
+        for (ColorReductionAlgorithm reducer : options.reducers)
+        {
+            for (const std::optional<DitheringAlgorithm> &dithering : options.ditherings)
+            {
+                TuneCandidate candidate;
+                candidate.reducer = reducer;
+                candidate.targetColors = colors;
+                candidate.seed = options.seed;
+                candidate.dither = dithering.has_value();
+                candidate.dithering = dithering.value_or(DitheringAlgorithm::FloydSteinberg);
+                result.push_back(candidate);
+            }
+        }
+    }
+    return result;
+}
+
+PixelBuffer AutoTuner::apply(ConstPixelView image, const TuneCandidate &candidate, ProgressToken *progress)
+{
+    if (candidate.targetColors <= 0)
+    {
+        return PixelBuffer(image);
+    }
+
+    std::vector<uint32_t> palette = ColorReducer::generatePalette(image, ColorReducer::buildHistogram(image),
+                                                                  candidate.targetColors, candidate.reducer, progress, candidate.seed);
+    if (!candidate.dither)
+    {
+        return ColorReducer::remap(image, palette, progress);
+    }
+    return Dithering::applyDithering(image, palette, candidate.dithering, progress);
+}
+
+PixelBuffer AutoTuner::blur(ConstPixelView image)
+{
+    PixelBuffer result(image.width(), image.height());
+    for (int y = 0; y < image.height(); ++y)
+    {
+        for (int x = 0; x < image.width(); ++x)
+        {
+            int sum[3] = {0, 0, 0};
+            int count = 0;
+            for (int ny = std::max(0, y - 1); ny <= std::min(image.height() - 1, y + 1); ++ny)
+            {
+                for (int nx = std::max(0, x - 1); nx <= std::min(image.width() - 1, x + 1); ++nx)
+                {
+                    uint32_t pixel = image(nx, ny);
+                    sum[0] += (pixel >> 16) & 0xFF;
+                    sum[1] += (pixel >> 8) & 0xFF;
+                    sum[2] += pixel & 0xFF;
+                    ++count;
+                }
+            }
+            result(x, y) = static_cast<uint32_t>((sum[0] + count / 2) / count) << 16 |
+                           static_cast<uint32_t>((sum[1] + count / 2) / count) << 8 | static_cast<uint32_t>((sum[2] + count / 2) / count);
+        }
+    }
+    return result;
+}
+
+double AutoTuner::score(ConstPixelView reference, ConstPixelView result)
+{
+    QualityOptions options;
+    options.ssim = false;
+    options.msSsim = false;
+    options.threads = 1;
+    double colorError = ImageQuality::compare(blur(reference), blur(result), options).meanDeltaE;
+    return colorError + SSIM_WEIGHT * (1.0 - ImageQuality::ssim(reference, result, 1));
+}
+
+std::string AutoTuner::describe(const TuneCandidate &candidate)
+{
+    std::string text = ColorReducer::getColorReducerName(candidate.reducer) + ", " + std::to_string(candidate.targetColors) + " colors";
+    return text + (candidate.dither ? ", " + Dithering::getAlgorithmName(candidate.dithering) + " dithering" : ", no dithering");
+}
+
+TuneResult AutoTuner::tune(ConstPixelView image, const TuneOptions &options, ProgressToken *progress)
+{
+    if (image.empty())
+    {
+        throw std::invalid_argument("Cannot auto-tune an empty image");
+    }
+    std::vector<TuneCandidate> pool = candidates(options);
+    if (pool.empty())
+    {
+        throw std::invalid_argument("Auto-tune needs at least one reducer, dithering and palette size");
+    }
+
+    StageTimer timer("auto-tune");
+    auto start = std::chrono::steady_clock::now();
+    TuneResult result;
+    result.candidates = pool.size();
+    result.best = pool.front();
+    result.score = std::numeric_limits<double>::quiet_NaN();
+
+    // Separate from `progress` so running out of time ends the search instead of failing it.
+    // Candidates only get this token, which also trips when the caller cancels.
+    ProgressToken budget(progress);
+    budget.setTimeout(options.budget);
+
+    const double sourcePixels = static_cast<double>(image.width()) * image.height();
+    for (int round = 0; round < ROUNDS; ++round)
+    {
+        ProgressToken::checkpoint(progress);
+        double pixels = std::min(sourcePixels, std::max(options.proxyPixels, 1) / std::pow(4.0, ROUNDS - 1 - round));
+
+        std::optional<PixelBuffer> proxy;
+        if (pixels < sourcePixels)
+        {
+            double factor = std::sqrt(pixels / sourcePixels);
+            ResampleOptions resample;
+            resample.width = std::max(1, static_cast<int>(std::lround(image.width() * factor)));
+            resample.height = std::max(1, static_cast<int>(std::lround(image.height() * factor)));
+            resample.threads = options.threads;
+            proxy = Resampler::resample(image, resample, progress);
+        }
+        ConstPixelView view = proxy ? proxy->view() : image;
+
+        std::vector<double> scores(pool.size(), std::numeric_limits<double>::quiet_NaN());
+        Parallel::forEach(pool.size(), options.threads, [&](size_t i)
+                          {
+            ProgressToken::checkpoint(progress);
+            try
+            {
+                PixelBuffer output = apply(view, pool[i], &budget);
+                budget.checkpoint();
+                scores[i] = score(view, output);
+            }
+            catch (const OperationCancelled &)
+            {
+                // The caller's cancellation wins over an expired budget
+                ProgressToken::checkpoint(progress);
+                if (!budget.isExpired())
+                {
+                    throw;
+                }
+            } });
+
+        std::vector<size_t> order;
+        for (size_t i = 0; i < pool.size(); ++i)
+        {
+            if (!std::isnan(scores[i]))
+            {
+                order.push_back(i);
+            }
+        }
+        // Stable, so ties go to the simpler candidate listed first
+        std::stable_sort(order.begin(), order.end(), [&scores](size_t a, size_t b)
+                         { return scores[a] < scores[b]; });
+        result.evaluated += order.size();
+
+        const bool complete = order.size() == pool.size();
+        // A round cut short only ranks some candidates; the previous winner stands unless there is none
+        if (!order.empty() && (complete || std::isnan(result.score)))
+        {
+            result.best = pool[order.front()];
+            result.score = scores[order.front()];
+        }
+        if (!complete)
+        {
+            result.budgetExhausted = true;
+            break;
+        }
+        ProgressToken::report(progress, static_cast<float>(round + 1) / ROUNDS);
+        // Small sources reach full size before the last round and are ranked completely
+        if (round + 1 == ROUNDS || pixels >= sourcePixels)
+        {
+            break;
+        }
+
+        size_t keep = std::max<size_t>(1, (order.size() + 1) / 2);
+        result.pruned += pool.size() - keep;
+        std::vector<TuneCandidate> survivors;
+        for (size_t i = 0; i < keep; ++i)
+        {
+            survivors.push_back(pool[order[i]]);
+        }
+        pool = std::move(survivors);
+    }
+
+    result.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    SPDLOG_DEBUG("Auto-tune picked {} (score {:.3f}) from {} candidates in {} ms, {} runs, {} pruned{}", describe(result.best),
+                 result.score, result.candidates, result.elapsed.count(), result.evaluated, result.pruned,
+                 result.budgetExhausted ? ", budget exhausted" : "");
+    return result;
+}
@@ -0,0 +1,76 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/AutoTuner.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include "ColorReducer.h"
+#include "Dithering.h"
+#include "PixelBuffer.h"
+#include "ProgressToken.h"
+#include <chrono>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct TuneCandidate
+{
+    ColorReductionAlgorithm reducer = ColorReductionAlgorithm::MedianCut;
+    int targetColors = 16;
+    uint64_t seed = ColorReducer::DEFAULT_SEED;
+    bool dither = false;
+    DitheringAlgorithm dithering = DitheringAlgorithm::FloydSteinberg;
+};
+
+struct TuneOptions
+{
+    std::vector<ColorReductionAlgorithm> reducers = {ColorReductionAlgorithm::MedianCut, ColorReductionAlgorithm::KMeans,
+                                                     ColorReductionAlgorithm::OctreeQuantization};
+    // nullopt stands for no dithering
+    std::vector<std::optional<DitheringAlgorithm>> ditherings = {std::nullopt, DitheringAlgorithm::FloydSteinberg,
+                                                                 DitheringAlgorithm::Bayer, DitheringAlgorithm::Ordered};
+    std::vector<int> paletteSizes = {16};
+    // Passed to every candidate's reducer
+    uint64_t seed = ColorReducer::DEFAULT_SEED;
+    // Wall time for the whole search, 0 for no limit; the best candidate found so far wins when it runs out.
+    // Without a limit the result does not depend on timing or the thread count.
+    std::chrono::milliseconds budget{1000};
+    // Pixels of the largest proxy; earlier rounds use a quarter and a sixteenth of it
+    int proxyPixels = 128 * 128;
+    int threads = 0;
+};
+
+struct TuneResult
+{
+    TuneCandidate best;
+    // Lower is better, see AutoTuner::score; NaN when not even the first round finished
+    double score = 0.0;
+    size_t candidates = 0;
+    // Candidate runs that finished, over all rounds
+    size_t evaluated = 0;
+    // Candidates dropped after a round
+    size_t pruned = 0;
+    bool budgetExhausted = false;
+    std::chrono::milliseconds elapsed{0};
+};
+
+// Picks reducer, dithering and palette size for one image by successive halving: every
+// candidate is scored on a small proxy of the image, the better half moves on to a larger
+// proxy, and so on up to proxyPixels. Candidates of a round run in parallel.
+class AutoTuner
+{
+public:
+    static TuneResult tune(ConstPixelView image, const TuneOptions &options = {}, ProgressToken *progress = nullptr);
+    // Reduces and optionally dithers the image with the candidate's settings
+    static PixelBuffer apply(ConstPixelView image, const TuneCandidate &candidate, ProgressToken *progress = nullptr);
+    // Mean CIEDE2000 of both images after a 3x3 box blur, which judges dithering by the color
+    // the eye averages, plus ten times the SSIM loss for detail that went missing
+    static double score(ConstPixelView reference, ConstPixelView result);
+    static std::string describe(const TuneCandidate &candidate);
+
+private:
+    static std::vector<TuneCandidate> candidates(const TuneOptions &options);
+    static PixelBuffer blur(ConstPixelView image);
+};
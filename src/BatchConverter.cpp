@@ -0,0 +1,427 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/BatchConverter.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include "BatchConverter.h"
+#include "AutoTuner.h"
+#include "BoundedQueue.h"
+#include "CellSolver.h"
+#include "EncoderRegistry.h"
+#include "Hash.h"
+#include "MappedFile.h"
+#include "Metrics.h"
+#include "Parallel.h"
+#include "ResultCache.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+    struct FetchedJob
+    {
+        size_t index;
+        MappedFile file;
+    };
+
+    struct DecodedJob
+    {
+        size_t index;
+        PixelBuffer image;
+        uint64_t cacheKey;
+    };
+
+    struct EncodedJob
+    {
+        size_t index;
+        std::vector<uint8_t> data;
+    };
+}
+
+BatchConverter::BatchConverter(BatchOptions options)
+    : m_options(std::move(options))
+{
+    DecodeOptions decode = decodeOptions(EncoderRegistry::instance().find(m_options.encoder).value_or(EncoderCapabilities{}), m_options);
+    m_loader = [decode](const std::filesystem::path &, std::span<const uint8_t> data)
+    { return ImageIO::loadFromMemory(data.data(), data.size(), decode); };
+}
+
+void BatchConverter::setLoader(Loader loader)
+{
+    m_loader = std::move(loader);
+}
+
+PixelBuffer BatchConverter::process(ConstPixelView image, const BatchOptions &options, ProgressToken *progress,
+                                    const NearestColorMap *paletteMap)
+{
+    if (!options.palette.empty())
+    {
+        if (options.dither)
+        {
+            return paletteMap ? Dithering::applyDithering(image, *paletteMap, options.dithering, progress)
+                              : Dithering::applyDithering(image, options.palette, options.dithering, progress);
+        }
+        if (paletteMap)
+        {
+            return paletteMap->remap(image, progress);
+        }
+        return NearestColorMap(options.palette).remap(image, progress);
+    }
+
+    TuneCandidate settings;
+    settings.reducer = options.reducer;
+    settings.targetColors = options.targetColors;
+    settings.seed = options.seed;
+    settings.dither = options.dither;
+    settings.dithering = options.dithering;
+    if (options.autoTune && options.targetColors > 0)
+    {
+        TuneOptions tune;
+        tune.paletteSizes = {options.targetColors};
+        tune.budget = options.tuneBudget;
+        tune.threads = options.tuneThreads;
+        tune.seed = options.seed;
+        settings = AutoTuner::tune(image, tune, progress).best;
+        spdlog::info("Auto-tune chose {}", AutoTuner::describe(settings));
+    }
+    return AutoTuner::apply(image, settings, progress);
+}
+
+uint64_t BatchConverter::cacheKey(std::span<const uint8_t> source, const BatchOptions &options)
+{
+    uint64_t key = Hash::combine(Hash::xxh64(source.data(), source.size()), ResultCache::FORMAT_VERSION);
+    key = Hash::combine(key, Hash::xxh64(options.encoder.data(), options.encoder.size()));
+    key = Hash::combine(key, static_cast<uint64_t>(options.koalaPacking));
+    key = Hash::combine(key, static_cast<uint64_t>(options.reducer) << 32 | static_cast<uint32_t>(options.targetColors));
+    key = Hash::combine(key, options.seed);
+    key = Hash::combine(key, Hash::xxh64(options.palette.data(), options.palette.size() * sizeof(uint32_t)));
+    // Auto-tuned results do not depend on the reducer and dithering options
+    uint64_t dither = options.autoTune ? 0xA7 : options.dither ? static_cast<uint64_t>(options.dithering) + 1 : 0;
+    key = Hash::combine(key, dither);
+    // Cached results skip the quality check, so a stricter minimum must not hit entries stored under a looser one
+    key = Hash::combine(key, Hash::combine(std::bit_cast<uint64_t>(options.minPsnr), std::bit_cast<uint64_t>(options.minSsim)));
+    return Hash::combine(key, static_cast<uint64_t>(options.filter) << 8 | static_cast<uint64_t>(options.fit));
+}
+
+DecodeOptions BatchConverter::decodeOptions(const EncoderCapabilities &caps, const BatchOptions &options)
+{
+    DecodeOptions decode;
+    decode.memoryCap = options.memoryCap;
+    if (caps.width > 0 && caps.height > 0)
+    {
+        decode.minWidth = static_cast<int>(std::ceil(caps.width * caps.pixelAspect)) * 2;
+        decode.minHeight = caps.height * 2;
+    }
+    return decode;
+}
+
+std::optional<PixelBuffer> BatchConverter::fitToEncoder(ConstPixelView image, const EncoderCapabilities &caps, const BatchOptions &options,
+                                                        ProgressToken *progress)
+{
+    if (caps.width <= 0 || caps.height <= 0 || (image.width() == caps.width && image.height() == caps.height))
+    {
+        return std::nullopt;
+    }
+    ResampleOptions resample;
+    resample.width = caps.width;
+    resample.height = caps.height;
+    resample.filter = options.filter;
+    resample.fit = options.fit;
+    resample.pixelAspect = caps.pixelAspect;
+    // Workers already run one image each, so the resampler stays on this thread
+    resample.threads = 1;
+    return Resampler::resample(image, resample, progress);
+}
+
+BatchReport BatchConverter::run(const std::vector<BatchJob> &jobs)
+{
+    // Fail early on a misspelled encoder instead of once per image
+    std::unique_ptr<ImageConverter> probe = EncoderRegistry::instance().create(m_options.encoder);
+    if (m_options.koalaPacking != KoalaPacking::None && !dynamic_cast<KoalaConverter *>(probe.get()))
+    {
+        spdlog::warn("Packing only applies to Koala files, {} output is written unpacked", m_options.encoder);
+    }
+
+    const int workers = Parallel::resolveThreadCount(m_options.workerThreads);
+    const int decoders = std::max(1, m_options.decodeThreads);
+    const size_t depth = m_options.queueDepth > 0 ? m_options.queueDepth : static_cast<size_t>(workers) * 2;
+    const size_t prefetch = m_options.prefetchFiles > 0 ? m_options.prefetchFiles : static_cast<size_t>(decoders) * 2;
+
+    BoundedQueue<FetchedJob> fetched(prefetch);
+    BoundedQueue<DecodedJob> decoded(depth);
+    BoundedQueue<EncodedJob> encoded(depth);
+    BatchReport report;
+    std::mutex reportMutex;
+    auto fail = [&](size_t index, const std::string &what)
+    {
+        std::string message = jobs[index].input.string() + ": " + what;
+        spdlog::warn("Batch conversion failed for {}", message);
+        std::lock_guard<std::mutex> lock(reportMutex);
+        ++report.failed;
+        report.errors.push_back(std::move(message));
+    };
+
+    const bool reduce = m_options.targetColors > 0 || !m_options.palette.empty();
+    const bool measureQuality = m_options.measureQuality || m_options.minPsnr > 0.0 || m_options.minSsim > 0.0;
+    if (measureQuality && !reduce)
+    {
+        spdlog::warn("Quality metrics need a color reduction, nothing will be measured");
+    }
+
+    // Built once, every worker looks up the shared palette in the same map
+    std::optional<NearestColorMap> paletteMap;
+    if (!m_options.palette.empty())
+    {
+        paletteMap.emplace(m_options.palette);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::optional<ResultCache> cache;
+    if (!m_options.cacheDirectory.empty())
+    {
+        cache.emplace(m_options.cacheDirectory, m_options.cacheBytes);
+    }
+
+    // Reading is sequential in job order so the disk sees one stream instead of
+    // several decoder threads seeking between files
+    std::thread reader([&]()
+                       {
+        for (size_t i = 0; i < jobs.size(); ++i)
+        {
+            if (!m_options.overwrite && std::filesystem::exists(jobs[i].output))
+            {
+                std::lock_guard<std::mutex> lock(reportMutex);
+                ++report.skipped;
+                continue;
+            }
+            try
+            {
+                fetched.push(FetchedJob{i, MappedFile::open(jobs[i].input)});
+            }
+            catch (const std::exception &e)
+            {
+                fail(i, e.what());
+            }
+        }
+        fetched.close(); });
+
+    std::vector<std::thread> decodePool;
+    for (int t = 0; t < decoders; ++t)
+    {
+        decodePool.emplace_back([&]()
+                                {
+            while (std::optional<FetchedJob> job = fetched.pop())
+            {
+                try
+                {
+                    uint64_t key = 0;
+                    if (cache)
+                    {
+                        key = cacheKey(job->file.bytes(), m_options);
+                        if (std::optional<std::vector<uint8_t>> hit = cache->find(key))
+                        {
+                            {
+                                std::lock_guard<std::mutex> lock(reportMutex);
+                                ++report.cached;
+                            }
+                            encoded.push(EncodedJob{job->index, std::move(*hit)});
+                            continue;
+                        }
+                    }
+                    PixelBuffer image = m_loader(jobs[job->index].input, job->file.bytes());
+                    // Unmap before waiting for a worker
+                    job->file = MappedFile();
+                    decoded.push(DecodedJob{job->index, std::move(image), key});
+                }
+                catch (const std::exception &e)
+                {
+                    fail(job->index, e.what());
+                }
+            } });
+    }
+
+    std::vector<std::thread> workerPool;
+    for (int t = 0; t < workers; ++t)
+    {
+        workerPool.emplace_back([&]()
+                                {
+            while (std::optional<DecodedJob> job = decoded.pop())
+            {
+                try
+                {
+                    ProgressToken token;
+                    token.setTimeout(m_options.jobTimeout);
+                    auto encoder = EncoderRegistry::instance().create(m_options.encoder);
+                    std::optional<PixelBuffer> fitted = fitToEncoder(job->image, encoder->getCapabilities(), m_options, &token);
+                    ConstPixelView image = fitted ? fitted->view() : job->image.view();
+                    if (reduce)
+                    {
+                        PixelBuffer pixels = process(image, m_options, &token, paletteMap ? &*paletteMap : nullptr);
+                        token.checkpoint();
+                        if (measureQuality)
+                        {
+                            checkQuality(jobs[job->index].input, image, pixels, report, reportMutex);
+                        }
+                        StageTimer timer("encode");
+                        encoder->convertImage(pixels);
+                    }
+                    else
+                    {
+                        // Nothing to reduce, the encoder reads the decoded or fitted buffer directly
+                        StageTimer timer("encode");
+                        encoder->convertImage(image);
+                    }
+                    token.checkpoint();
+                    // Packed here so the cache and the writer both see the bytes that end up on disk
+                    auto *koala = dynamic_cast<KoalaConverter *>(encoder.get());
+                    std::vector<uint8_t> data = koala ? koala->getPackedData(m_options.koalaPacking) : encoder->getFileData();
+                    if (cache)
+                    {
+                        cache->store(job->cacheKey, data);
+                    }
+                    encoded.push(EncodedJob{job->index, std::move(data)});
+                }
+                catch (const OperationCancelled &e)
+                {
+                    fail(job->index, e.what());
+                    std::lock_guard<std::mutex> lock(reportMutex);
+                    ++report.timedOut;
+                }
+                catch (const std::exception &e)
+                {
+                    fail(job->index, e.what());
+                }
+            } });
+    }
+
+    std::thread writer([&]()
+                       {
+        while (std::optional<EncodedJob> job = encoded.pop())
+        {
+            try
+            {
+                const std::filesystem::path &output = jobs[job->index].output;
+                if (output.has_parent_path())
+                {
+                    std::filesystem::create_directories(output.parent_path());
+                }
+                ImageConverter::writeFile(output.string(), job->data);
+                std::lock_guard<std::mutex> lock(reportMutex);
+                ++report.converted;
+            }
+            catch (const std::exception &e)
+            {
+                fail(job->index, e.what());
+            }
+        } });
+
+    reader.join();
+    for (std::thread &thread : decodePool)
+    {
+        thread.join();
+    }
+    decoded.close();
+    for (std::thread &thread : workerPool)
+    {
+        thread.join();
+    }
+    encoded.close();
+    writer.join();
+
+    report.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    spdlog::info("Batch conversion: {} converted, {} skipped, {} failed ({} timed out) in {} ms",
+                 report.converted, report.skipped, report.failed, report.timedOut, report.elapsed.count());
+    CellSolutionCache::shared()->logStatistics("Batch");
+    if (!report.quality.empty())
+    {
+        double psnr = 0.0, ssim = 0.0, deltaE = 0.0;
+        for (const auto &[input, quality] : report.quality)
+        {
+            psnr += std::min(quality.psnr, 100.0);
+            ssim += quality.ssim;
+            deltaE += quality.meanDeltaE;
+        }
+        double count = static_cast<double>(report.quality.size());
+        spdlog::info("Quality over {} images: mean PSNR {:.2f} dB, mean SSIM {:.4f}, mean CIEDE2000 {:.2f}",
+                     report.quality.size(), psnr / count, ssim / count, deltaE / count);
+    }
+    if (cache)
+    {
+        ResultCacheStatistics stats = cache->statistics();
+        spdlog::info("Result cache: {} hits, {} misses, {} evictions, {} entries using {:.1f} MB",
+                     stats.hits, stats.misses, stats.evictions, stats.entries, stats.bytes / (1024.0 * 1024.0));
+    }
+    return report;
+}
+
+void BatchConverter::checkQuality(const std::filesystem::path &input, ConstPixelView source, ConstPixelView result,
+                                  BatchReport &report, std::mutex &reportMutex) const
+{
+    // Workers already run in parallel, one thread per comparison
+    QualityOptions options;
+    options.threads = 1;
+    QualityReport quality = ImageQuality::compare(source, result, options);
+    spdlog::info("Quality of {}: {}", input.string(), ImageQuality::describe(quality));
+    {
+        std::lock_guard<std::mutex> lock(reportMutex);
+        report.quality.emplace_back(input, quality);
+    }
+    if ((m_options.minPsnr > 0.0 && quality.psnr < m_options.minPsnr) || (m_options.minSsim > 0.0 && quality.ssim < m_options.minSsim))
+    {
+        throw std::runtime_error("Result below the quality minimum: " + ImageQuality::describe(quality));
+    }
+}
+
+std::vector<BatchJob> BatchConverter::collectJobs(const std::vector<std::filesystem::path> &inputs,
+                                                  const std::filesystem::path &outputDir,
+                                                  const std::string &extension, bool recursive)
+{
+    std::vector<BatchJob> jobs;
+    auto addJob = [&](const std::filesystem::path &file, const std::filesystem::path &relative)
+    {
+        std::filesystem::path output = outputDir / relative;
+        output.replace_extension(extension);
+        jobs.push_back(BatchJob{file, output});
+    };
+
+    for (const std::filesystem::path &input : inputs)
+    {
+        if (!std::filesystem::is_directory(input))
+        {
+            if (!std::filesystem::exists(input))
+            {
+                throw std::invalid_argument("Input does not exist: " + input.string());
+            }
+            addJob(input, input.filename());
+            continue;
+        }
+
+        std::vector<std::filesystem::path> files;
+        auto collect = [&](auto iterator)
+        {
+            for (const std::filesystem::directory_entry &entry : iterator)
+            {
+                if (entry.is_regular_file() && ImageIO::isSupportedExtension(entry.path().filename().string()))
+                {
+                    files.push_back(entry.path());
+                }
+            }
+        };
+        if (recursive)
+            collect(std::filesystem::recursive_directory_iterator(input));
+        else
+            collect(std::filesystem::directory_iterator(input));
+
+        std::sort(files.begin(), files.end());
+        for (const std::filesystem::path &file : files)
+        {
+            addJob(file, std::filesystem::relative(file, input));
+        }
+    }
+    return jobs;
+}
@@ -0,0 +1,132 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/BatchConverter.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include "ColorReducer.h"
+#include "Dithering.h"
+#include "ImageConverter.h"
+#include "ImageIO.h"
+#include "ImageQuality.h"
+#include "KoalaConverter.h"
+#include "NearestColorMap.h"
+#include "Resampler.h"
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct BatchJob
+{
+    std::filesystem::path input;
+    std::filesystem::path output;
+};
+
+struct BatchOptions
+{
+    std::string encoder = "koala";
+    // Layout of written Koala files; other encoders ignore it
+    KoalaPacking koalaPacking = KoalaPacking::None;
+    ColorReductionAlgorithm reducer = ColorReductionAlgorithm::MedianCut;
+    // 0 leaves color reduction to the encoder
+    int targetColors = 0;
+    // Initial state of randomized reducers such as KMeans
+    uint64_t seed = ColorReducer::DEFAULT_SEED;
+    // Fixed palette for every image, e.g. from PaletteBuilder; replaces the reducer and auto-tuning
+    std::vector<uint32_t> palette;
+    bool dither = false;
+    DitheringAlgorithm dithering = DitheringAlgorithm::FloydSteinberg;
+    // Images that do not match a fixed encoder size are resampled to it first
+    ResampleFilter filter = ResampleFilter::Mitchell;
+    FitMode fit = FitMode::Fit;
+    // Files the I/O thread reads ahead of the decoders; 0 picks twice the decoder count
+    size_t prefetchFiles = 0;
+    int decodeThreads = 2;
+    // Peak decoding memory per image in bytes, 0 for no limit
+    size_t memoryCap = 0;
+    // 0 uses one worker per hardware thread
+    int workerThreads = 0;
+    // Images in flight between two stages; 0 picks twice the worker count
+    size_t queueDepth = 0;
+    bool overwrite = true;
+    // Limit for reducing, dithering and encoding one image, 0 for none
+    std::chrono::milliseconds jobTimeout{0};
+    // Reuse results of earlier runs for unchanged files and settings; empty disables the cache
+    std::filesystem::path cacheDirectory;
+    uint64_t cacheBytes = uint64_t(1) << 30;
+    // Compare every reduced image with its fitted source and log the result. Images below
+    // a nonzero minimum fail instead of being written. Needs targetColors.
+    bool measureQuality = false;
+    double minPsnr = 0.0;
+    double minSsim = 0.0;
+    // Let AutoTuner pick reducer and dithering per image at targetColors instead of the
+    // settings above, spending at most tuneBudget on the search. Only a budget of 0 gives
+    // the same choice on every machine.
+    bool autoTune = false;
+    std::chrono::milliseconds tuneBudget{500};
+    // Candidates tried in parallel per image; 0 uses every core
+    int tuneThreads = 1;
+};
+
+struct BatchReport
+{
+    size_t converted = 0;
+    size_t skipped = 0;
+    size_t failed = 0;
+    size_t timedOut = 0;
+    // Converted images that were served from the result cache without decoding
+    size_t cached = 0;
+    std::chrono::milliseconds elapsed{0};
+    std::vector<std::string> errors;
+    // Per input when measureQuality or a minimum is set, in completion order
+    std::vector<std::pair<std::filesystem::path, QualityReport>> quality;
+};
+
+// Converts many images with a four stage pipeline: one I/O thread maps input files ahead
+// of time, decode threads turn the bytes into a bounded queue of decoded images, workers
+// reduce, dither and encode them into a second bounded queue and a writer thread stores
+// the results. Memory use is bounded by the queue depths, not by the number of jobs.
+class BatchConverter
+{
+public:
+    // Decodes the prefetched file contents; path is the source of `data`
+    using Loader = std::function<PixelBuffer(const std::filesystem::path &path, std::span<const uint8_t> data)>;
+
+    explicit BatchConverter(BatchOptions options);
+
+    // Replaces the file decoder, mainly for tests
+    void setLoader(Loader loader);
+    BatchReport run(const std::vector<BatchJob> &jobs);
+
+    // Expands files and directories into jobs. Directory trees are mirrored below outputDir.
+    static std::vector<BatchJob> collectJobs(const std::vector<std::filesystem::path> &inputs,
+                                             const std::filesystem::path &outputDir,
+                                             const std::string &extension, bool recursive);
+    // Color reduction and dithering as configured in options, auto-tuned when enabled. A
+    // fixed palette is remapped through paletteMap when given, built from it otherwise.
+    static PixelBuffer process(ConstPixelView image, const BatchOptions &options, ProgressToken *progress = nullptr,
+                               const NearestColorMap *paletteMap = nullptr);
+    // Hash of the encoded source file and every setting that influences the output
+    static uint64_t cacheKey(std::span<const uint8_t> source, const BatchOptions &options);
+    // Fixed size encoders only need twice their resolution, so large files are shrunk while decoding
+    static DecodeOptions decodeOptions(const EncoderCapabilities &caps, const BatchOptions &options);
+    // Resamples to the encoder's fixed size and pixel aspect; nullopt when it already fits
+    static std::optional<PixelBuffer> fitToEncoder(ConstPixelView image, const EncoderCapabilities &caps, const BatchOptions &options,
+                                                   ProgressToken *progress = nullptr);
+
+private:
+    // Records the quality of one result and throws when it misses a minimum
+    void checkQuality(const std::filesystem::path &input, ConstPixelView source, ConstPixelView result,
+                      BatchReport &report, std::mutex &reportMutex) const;
+
+    BatchOptions m_options;
+    Loader m_loader;
+};
@@ -0,0 +1,75 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/C64HiresConverter.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include "C64HiresConverter.h"
+#include "C64Palette.h"
+#include <stdexcept>
+
+C64HiresConverter::C64HiresConverter() : m_cellCache(CellSolutionCache::shared()) {}
+
+void C64HiresConverter::setCellCache(std::shared_ptr<CellSolutionCache> cache)
+{
+    m_cellCache = std::move(cache);
+}
+
+EncoderCapabilities C64HiresConverter::capabilities()
+{
+    EncoderCapabilities caps;
+    caps.name = "c64-hires";
+    caps.description = "C64 hires bitmap (Art Studio)";
+    caps.extension = "art";
+    caps.width = HIRES_WIDTH;
+    caps.height = HIRES_HEIGHT;
+    caps.paletteSize = C64Palette::COLOR_COUNT;
+    caps.cellWidth = 8;
+    caps.cellHeight = 8;
+    caps.colorsPerCell = 2;
+    return caps;
+}
+
+EncoderCapabilities C64HiresConverter::getCapabilities() const
+{
+    return capabilities();
+}
+
+void C64HiresConverter::convertImage(ConstPixelView image)
+{
+    const int width = image.width();
+    const int height = image.height();
+    if (width != HIRES_WIDTH || height != HIRES_HEIGHT)
+    {
+        throw std::runtime_error("Image dimensions must be 320x200 for C64 hires format");
+    }
+
+    CellSolver solver(CellConstraints::c64Hires(), m_cellCache);
+    CellCacheStatistics before = m_cellCache ? m_cellCache->getStatistics() : CellCacheStatistics{};
+    std::vector<CellSolution> solutions = solver.solveImage(solver.quantize(image), width, height);
+    if (m_cellCache)
+    {
+        m_cellCache->logImageStatistics("Hires", before);
+    }
+
+    m_bitmap.assign(solutions.size() * 8, 0);
+    m_screenRam.assign(solutions.size(), 0);
+    for (size_t charIndex = 0; charIndex < solutions.size(); ++charIndex)
+    {
+        const CellSolution &solution = solutions[charIndex];
+        std::copy(solution.bitmap.begin(), solution.bitmap.end(), m_bitmap.begin() + charIndex * 8);
+        m_screenRam[charIndex] = static_cast<uint8_t>((solution.colors[1] << 4) | solution.colors[0]);
+    }
+}
+
+std::vector<uint8_t> C64HiresConverter::getFileData() const
+{
+    std::vector<uint8_t> data;
+    data.reserve(FILE_SIZE);
+    data.push_back(static_cast<uint8_t>(LOAD_ADDRESS & 0xFF));
+    data.push_back(static_cast<uint8_t>(LOAD_ADDRESS >> 8));
+    data.insert(data.end(), m_bitmap.begin(), m_bitmap.end());
+    data.insert(data.end(), m_screenRam.begin(), m_screenRam.end());
+    data.resize(FILE_SIZE, 0);
+    return data;
+}
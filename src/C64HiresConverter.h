@@ -0,0 +1,39 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/C64HiresConverter.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include "ImageConverter.h"
+#include "CellSolver.h"
+#include <vector>
+#include <cstdint>
+#include <memory>
+
+// C64 hires bitmap written in the Art Studio layout (bitmap, screen RAM, border color)
+class C64HiresConverter : public ImageConverter
+{
+public:
+    C64HiresConverter();
+
+    using ImageConverter::convertImage;
+    void convertImage(ConstPixelView image) override;
+    std::vector<uint8_t> getFileData() const override;
+    EncoderCapabilities getCapabilities() const override;
+
+    void setCellCache(std::shared_ptr<CellSolutionCache> cache);
+
+    static EncoderCapabilities capabilities();
+
+private:
+    static constexpr int HIRES_WIDTH = 320;
+    static constexpr int HIRES_HEIGHT = 200;
+    static constexpr uint16_t LOAD_ADDRESS = 0x2000;
+    static constexpr int FILE_SIZE = 9009;
+
+    std::vector<uint8_t> m_bitmap;
+    std::vector<uint8_t> m_screenRam;
+    std::shared_ptr<CellSolutionCache> m_cellCache;
+};
@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/C64Palette.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <limits>
+
+namespace C64Palette
+{
+    constexpr int COLOR_COUNT = 16;
+
+    // Pepto's VIC-II palette, 0x00RRGGBB
+    constexpr std::array<uint32_t, COLOR_COUNT> COLORS = {
+        0x000000, 0xFFFFFF, 0x68372B, 0x70A4B2,
+        0x6F3D86, 0x588D43, 0x352879, 0xB8C76F,
+        0x6F4F25, 0x433900, 0x9A6759, 0x444444,
+        0x6C6C6C, 0x9AD284, 0x6C5EB5, 0x959595};
+
+    constexpr int distance(uint32_t a, uint32_t b)
+    {
+        int dr = static_cast<int>((a >> 16) & 0xFF) - static_cast<int>((b >> 16) & 0xFF);
+        int dg = static_cast<int>((a >> 8) & 0xFF) - static_cast<int>((b >> 8) & 0xFF);
+        int db = static_cast<int>(a & 0xFF) - static_cast<int>(b & 0xFF);
+        return dr * dr + dg * dg + db * db;
+    }
+
+    constexpr uint8_t nearestIndex(uint32_t rgb)
+    {
+        uint8_t best = 0;
+        int bestDistance = std::numeric_limits<int>::max();
+        for (int i = 0; i < COLOR_COUNT; ++i)
+        {
+            int d = distance(rgb, COLORS[i]);
+            if (d < bestDistance)
+            {
+                bestDistance = d;
+                best = static_cast<uint8_t>(i);
+            }
+        }
+        return best;
+    }
+
+    constexpr uint8_t nearestIndex(uint8_t r, uint8_t g, uint8_t b)
+    {
+        return nearestIndex((static_cast<uint32_t>(r) << 16) | (static_cast<uint32_t>(g) << 8) | b);
+    }
+}
@@ -0,0 +1,391 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/CellSolver.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include "CellSolver.h"
+#include "C64Palette.h"
+#include "Hash.h"
+#include "Parallel.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace
+{
+    constexpr int MAX_PALETTE = 16;
+
+    // Calls fn(colors) for every ascending combination of `count` palette entries,
+    // skipping `excluded` and mixing no groups when groups are given
+    template <typename Fn>
+    void forEachCombination(int paletteSize, int count, int excluded, const std::vector<uint8_t> &groups, Fn &&fn)
+    {
+        std::array<uint8_t, 4> colors{};
+        auto recurse = [&](auto &self, int depth, int first) -> void
+        {
+            if (depth == count)
+            {
+                fn(colors);
+                return;
+            }
+            for (int c = first; c < paletteSize; ++c)
+            {
+                if (c == excluded)
+                    continue;
+                if (!groups.empty() && depth > 0 && groups[c] != groups[colors[0]])
+                    continue;
+                colors[depth] = static_cast<uint8_t>(c);
+                self(self, depth + 1, c + 1);
+            }
+        };
+        recurse(recurse, 0, 0);
+    }
+}
+
+uint64_t CellConstraints::id() const
+{
+    uint64_t header[4] = {static_cast<uint64_t>(cellWidth), static_cast<uint64_t>(cellHeight),
+                          static_cast<uint64_t>(freeColors), static_cast<uint64_t>(sharedBackground)};
+    uint64_t h = Hash::xxh64(header, sizeof(header));
+    h = Hash::combine(h, Hash::xxh64(palette.data(), palette.size() * sizeof(uint32_t)));
+    return Hash::combine(h, Hash::xxh64(groups.data(), groups.size()));
+}
+
+const CellConstraints &CellConstraints::c64Multicolor()
+{
+    static const CellConstraints constraints{4, 8, {C64Palette::COLORS.begin(), C64Palette::COLORS.end()}, 3, true, {}};
+    return constraints;
+}
+
+const CellConstraints &CellConstraints::c64Hires()
+{
+    static const CellConstraints constraints{8, 8, {C64Palette::COLORS.begin(), C64Palette::COLORS.end()}, 2, false, {}};
+    return constraints;
+}
+
+double CellCacheStatistics::hitRate() const
+{
+    uint64_t total = hits + misses;
+    return total == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(total);
+}
+
+std::chrono::nanoseconds CellCacheStatistics::estimatedTimeSaved() const
+{
+    if (misses == 0)
+        return std::chrono::nanoseconds(0);
+    return std::chrono::nanoseconds(solveTime.count() / static_cast<int64_t>(misses) * static_cast<int64_t>(hits));
+}
+
+CellSolutionCache::CellSolutionCache(size_t maxEntries) : maxEntries(maxEntries) {}
+
+bool CellSolutionCache::lookup(const CellKey &key, CellSolution &solution)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(key);
+        if (it != entries.end())
+        {
+            solution = it->second;
+            hits.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    misses.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void CellSolutionCache::insert(const CellKey &key, const CellSolution &solution, std::chrono::nanoseconds solveTime)
+{
+    solveNanos.fetch_add(solveTime.count(), std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (entries.size() >= maxEntries)
+    {
+        SPDLOG_DEBUG("Cell cache reached {} entries, clearing", entries.size());
+        entries.clear();
+    }
+    entries.emplace(key, solution);
+}
+
+void CellSolutionCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    hits = 0;
+    misses = 0;
+    solveNanos = 0;
+}
+
+size_t CellSolutionCache::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
+
+CellCacheStatistics CellSolutionCache::getStatistics() const
+{
+    CellCacheStatistics stats;
+    stats.hits = hits.load(std::memory_order_relaxed);
+    stats.misses = misses.load(std::memory_order_relaxed);
+    stats.solveTime = std::chrono::nanoseconds(solveNanos.load(std::memory_order_relaxed));
+    return stats;
+}
+
+void CellSolutionCache::logStatistics(const std::string &label) const
+{
+    CellCacheStatistics stats = getStatistics();
+    spdlog::info("{}: cell cache {} hits / {} misses ({:.1f}% hit rate), {} entries, solve time {:.2f} ms, saved ~{:.2f} ms",
+                 label, stats.hits, stats.misses, stats.hitRate() * 100.0, size(),
+                 std::chrono::duration<double, std::milli>(stats.solveTime).count(),
+                 std::chrono::duration<double, std::milli>(stats.estimatedTimeSaved()).count());
+}
+
+void CellSolutionCache::logImageStatistics([[maybe_unused]] const std::string &label, const CellCacheStatistics &before) const
+{
+    CellCacheStatistics after = getStatistics();
+    uint64_t hits = after.hits - before.hits;
+    [[maybe_unused]] uint64_t cells = hits + after.misses - before.misses;
+    // Cells served from the cache would have cost the average solve time so far
+    [[maybe_unused]] double saved = after.misses == 0 ? 0.0
+                                                      : std::chrono::duration<double, std::milli>(after.solveTime).count() /
+                                                            static_cast<double>(after.misses) * static_cast<double>(hits);
+    SPDLOG_DEBUG("{} conversion: {} of {} cells served from cache ({:.1f}% hit rate), saved ~{:.2f} ms", label, hits, cells,
+                 cells == 0 ? 0.0 : 100.0 * static_cast<double>(hits) / static_cast<double>(cells), saved);
+}
+
+std::shared_ptr<CellSolutionCache> CellSolutionCache::shared()
+{
+    static std::shared_ptr<CellSolutionCache> instance = std::make_shared<CellSolutionCache>();
+    return instance;
+}
+
+CellSolver::CellSolver(const CellConstraints &constraints, std::shared_ptr<CellSolutionCache> cache)
+    : constraints(constraints), constraintsId(constraints.id()), paletteSize(static_cast<int>(constraints.palette.size())), cache(std::move(cache))
+{
+    if (paletteSize == 0 || paletteSize > MAX_PALETTE)
+    {
+        throw std::invalid_argument("Cell palettes must have between 1 and 16 colors");
+    }
+    if (constraints.slotCount() < 1 || constraints.slotCount() > 4 || constraints.freeColors > paletteSize)
+    {
+        throw std::invalid_argument("Cells must have between 1 and 4 color slots");
+    }
+    if (constraints.cellWidth * constraints.bitsPerPixel() != 8 || constraints.cellHeight < 1 || constraints.cellHeight > 8)
+    {
+        throw std::invalid_argument("A cell row must pack into exactly one byte");
+    }
+    if (!constraints.groups.empty() && constraints.groups.size() != constraints.palette.size())
+    {
+        throw std::invalid_argument("Color groups must cover the whole palette");
+    }
+
+    distances.resize(static_cast<size_t>(paletteSize) * paletteSize);
+    for (int i = 0; i < paletteSize; ++i)
+    {
+        for (int j = 0; j < paletteSize; ++j)
+        {
+            distances[i * paletteSize + j] = C64Palette::distance(constraints.palette[i], constraints.palette[j]);
+        }
+    }
+}
+
+const CellConstraints &CellSolver::getConstraints() const
+{
+    return constraints;
+}
+
+CellKey CellSolver::makeKey(uint64_t constraints, uint8_t background, std::span<const uint8_t> indices)
+{
+    CellKey key{};
+    key.constraints = constraints;
+    key.background = background;
+    for (size_t i = 0; i < indices.size() && i / 2 < key.content.size(); ++i)
+    {
+        key.content[i / 2] |= static_cast<uint8_t>((indices[i] & 0x0F) << ((i & 1) * 4));
+    }
+    key.hash = Hash::xxh64(key.content.data(), key.content.size(), Hash::combine(constraints, background));
+    return key;
+}
+
+std::vector<uint8_t> CellSolver::quantize(const std::vector<uint32_t> &pixels, int threads) const
+{
+    int width = static_cast<int>(pixels.size());
+    return quantize(ConstPixelView(pixels.data(), width, pixels.empty() ? 0 : 1, width), threads);
+}
+
+std::vector<uint8_t> CellSolver::quantize(ConstPixelView image, int threads) const
+{
+    constexpr size_t BLOCK = 4096;
+    const size_t width = static_cast<size_t>(image.width());
+    std::vector<uint8_t> indices(image.size());
+    Parallel::forEach((indices.size() + BLOCK - 1) / BLOCK, threads, [&](size_t block)
+                      {
+        size_t end = std::min(indices.size(), (block + 1) * BLOCK);
+        for (size_t i = block * BLOCK; i < end; ++i)
+        {
+            uint32_t pixel = image(static_cast<int>(i % width), static_cast<int>(i / width));
+            int best = 0;
+            int bestDistance = std::numeric_limits<int>::max();
+            for (int c = 0; c < paletteSize; ++c)
+            {
+                int d = C64Palette::distance(pixel & 0xFFFFFF, constraints.palette[c]);
+                if (d < bestDistance)
+                {
+                    bestDistance = d;
+                    best = c;
+                }
+            }
+            indices[i] = static_cast<uint8_t>(best);
+        } });
+    return indices;
+}
+
+uint8_t CellSolver::pickBackground(const std::vector<uint8_t> &indices) const
+{
+    std::array<size_t, MAX_PALETTE> counts{};
+    for (uint8_t index : indices)
+    {
+        ++counts[index & 0x0F];
+    }
+    return static_cast<uint8_t>(std::max_element(counts.begin(), counts.begin() + paletteSize) - counts.begin());
+}
+
+CellSolution CellSolver::solve(std::span<const uint8_t> indices, uint8_t background)
+{
+    if (indices.size() != static_cast<size_t>(constraints.cellWidth * constraints.cellHeight))
+    {
+        throw std::invalid_argument("Cell pixel count does not match the cell constraints");
+    }
+    if (!constraints.sharedBackground)
+        background = 0;
+
+    if (!cache)
+        return compute(indices, background);
+
+    CellKey key = makeKey(constraintsId, background, indices);
+    CellSolution solution;
+    if (cache->lookup(key, solution))
+        return solution;
+
+    auto start = std::chrono::steady_clock::now();
+    solution = compute(indices, background);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    SPDLOG_TRACE("Cell solved in {} ns, colors {} {} {} {}", std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+                 solution.colors[0], solution.colors[1], solution.colors[2], solution.colors[3]);
+    cache->insert(key, solution, elapsed);
+    return solution;
+}
+
+std::vector<CellSolution> CellSolver::solveImage(const std::vector<uint8_t> &indices, int width, int height, uint8_t background, int threads)
+{
+    if (width <= 0 || height <= 0 || width % constraints.cellWidth != 0 || height % constraints.cellHeight != 0 ||
+        indices.size() < static_cast<size_t>(width) * height)
+    {
+        throw std::invalid_argument("Image must consist of whole cells");
+    }
+
+    const int cellsX = width / constraints.cellWidth;
+    const int cellsY = height / constraints.cellHeight;
+    std::vector<CellSolution> solutions(static_cast<size_t>(cellsX) * cellsY);
+
+    Parallel::forEach(static_cast<size_t>(cellsY), threads, [&](size_t row)
+                      {
+        std::array<uint8_t, 64> cell;
+        const int cellPixels = constraints.cellWidth * constraints.cellHeight;
+        for (int charX = 0; charX < cellsX; ++charX)
+        {
+            for (int y = 0; y < constraints.cellHeight; ++y)
+            {
+                const uint8_t *src = indices.data() + (row * constraints.cellHeight + y) * width + charX * constraints.cellWidth;
+                std::copy(src, src + constraints.cellWidth, cell.begin() + y * constraints.cellWidth);
+            }
+            solutions[row * cellsX + charX] = solve(std::span<const uint8_t>(cell.data(), cellPixels), background);
+        } });
+
+    return solutions;
+}
+
+CellSolution CellSolver::compute(std::span<const uint8_t> indices, uint8_t background) const
+{
+    std::array<int, MAX_PALETTE> counts{};
+    for (uint8_t index : indices)
+    {
+        ++counts[index & 0x0F];
+    }
+
+    const bool shared = constraints.sharedBackground;
+    const int offset = shared ? 1 : 0;
+    const int excluded = shared ? background : -1;
+
+    std::vector<uint8_t> present;
+    for (int c = 0; c < paletteSize; ++c)
+    {
+        if (counts[c] > 0 && c != excluded)
+            present.push_back(static_cast<uint8_t>(c));
+    }
+
+    bool sameGroup = std::all_of(present.begin(), present.end(), [&](uint8_t c)
+                                 { return constraints.groups.empty() || constraints.groups[c] == constraints.groups[present[0]]; });
+
+    CellSolution solution;
+    uint8_t filler = shared ? background : (present.empty() ? 0 : present[0]);
+    solution.colors.fill(filler);
+
+    if (present.size() <= static_cast<size_t>(constraints.freeColors) && sameGroup)
+    {
+        for (size_t i = 0; i < present.size(); ++i)
+        {
+            solution.colors[i + offset] = present[i];
+        }
+    }
+    else
+    {
+        // Exhaustive search over every allowed combination of free colors, weighted by the cell histogram
+        int bestCost = std::numeric_limits<int>::max();
+        forEachCombination(paletteSize, constraints.freeColors, excluded, constraints.groups, [&](const std::array<uint8_t, 4> &colors)
+                           {
+            int cost = 0;
+            for (uint8_t p : present)
+            {
+                int d = shared ? distance(p, background) : std::numeric_limits<int>::max();
+                for (int k = 0; k < constraints.freeColors; ++k)
+                {
+                    d = std::min(d, distance(p, colors[k]));
+                }
+                cost += d * counts[p];
+                if (cost >= bestCost)
+                    return;
+            }
+            bestCost = cost;
+            for (int k = 0; k < constraints.freeColors; ++k)
+            {
+                solution.colors[k + offset] = colors[k];
+            } });
+    }
+
+    const int slots = constraints.slotCount();
+    const int bits = constraints.bitsPerPixel();
+    for (int row = 0; row < constraints.cellHeight; ++row)
+    {
+        uint8_t byte = 0;
+        for (int x = 0; x < constraints.cellWidth; ++x)
+        {
+            int index = indices[row * constraints.cellWidth + x] & 0x0F;
+            int bestSlot = 0;
+            int bestDistance = std::numeric_limits<int>::max();
+            for (int slot = 0; slot < slots; ++slot)
+            {
+                int d = distance(index, solution.colors[slot]);
+                if (d < bestDistance)
+                {
+                    bestDistance = d;
+                    bestSlot = slot;
+                }
+            }
+            byte |= static_cast<uint8_t>(bestSlot << (8 - bits * (x + 1)));
+        }
+        solution.bitmap[row] = byte;
+    }
+    return solution;
+}
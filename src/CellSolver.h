@@ -0,0 +1,138 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/CellSolver.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "PixelBuffer.h"
+
+// Describes the color-clash rules of a cell based format. Cells are at most 8x8
+// pixels and one row of a cell packs into exactly one byte.
+struct CellConstraints
+{
+    int cellWidth = 4;
+    int cellHeight = 8;
+    // At most 16 entries
+    std::vector<uint32_t> palette;
+    // Colors chosen freely per cell
+    int freeColors = 3;
+    // Slot 0 of every cell is a global background color
+    bool sharedBackground = true;
+    // Optional: all free colors of a cell must come from the same group (e.g. ZX bright bit)
+    std::vector<uint8_t> groups;
+
+    int slotCount() const { return freeColors + (sharedBackground ? 1 : 0); }
+    int bitsPerPixel() const { return slotCount() > 2 ? 2 : 1; }
+    uint64_t id() const;
+
+    // Bit pair n shows colors[n]: 0 = background, 1/2 = screen RAM hi/lo, 3 = color RAM
+    static const CellConstraints &c64Multicolor();
+    // Set bits show colors[1] (screen RAM hi), cleared bits colors[0] (screen RAM lo)
+    static const CellConstraints &c64Hires();
+};
+
+// bitmap holds one byte per cell row, pixels packed MSB first; colors maps slots to palette indices
+struct CellSolution
+{
+    std::array<uint8_t, 8> bitmap{};
+    std::array<uint8_t, 4> colors{};
+};
+
+struct CellKey
+{
+    uint64_t constraints;
+    uint8_t background;
+    std::array<uint8_t, 32> content; // 64 packed 4-bit palette indices
+    uint64_t hash;
+
+    bool operator==(const CellKey &other) const
+    {
+        return hash == other.hash && constraints == other.constraints && background == other.background && content == other.content;
+    }
+};
+
+struct CellKeyHash
+{
+    size_t operator()(const CellKey &key) const { return static_cast<size_t>(key.hash); }
+};
+
+struct CellCacheStatistics
+{
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    std::chrono::nanoseconds solveTime{0};
+
+    double hitRate() const;
+    std::chrono::nanoseconds estimatedTimeSaved() const;
+};
+
+class CellSolutionCache
+{
+public:
+    explicit CellSolutionCache(size_t maxEntries = DEFAULT_MAX_ENTRIES);
+
+    bool lookup(const CellKey &key, CellSolution &solution);
+    void insert(const CellKey &key, const CellSolution &solution, std::chrono::nanoseconds solveTime);
+    void clear();
+
+    size_t size() const;
+    CellCacheStatistics getStatistics() const;
+    void logStatistics(const std::string &label) const;
+    // Debug line for one image; `before` was taken before it was solved
+    void logImageStatistics(const std::string &label, const CellCacheStatistics &before) const;
+
+    // Process-wide cache, so repeated cells are shared across a whole batch
+    static std::shared_ptr<CellSolutionCache> shared();
+
+    static constexpr size_t DEFAULT_MAX_ENTRIES = 1 << 20;
+
+private:
+    mutable std::mutex mutex;
+    std::unordered_map<CellKey, CellSolution, CellKeyHash> entries;
+    size_t maxEntries;
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<int64_t> solveNanos{0};
+};
+
+// Shared cell-constraint engine used by every cell based encoder
+class CellSolver
+{
+public:
+    explicit CellSolver(const CellConstraints &constraints, std::shared_ptr<CellSolutionCache> cache = nullptr);
+
+    // indices are palette indices of one cell in row-major order
+    CellSolution solve(std::span<const uint8_t> indices, uint8_t background = 0);
+    // Solves every cell of an indexed image in parallel; results are in row-major cell order
+    std::vector<CellSolution> solveImage(const std::vector<uint8_t> &indices, int width, int height, uint8_t background = 0, int threads = 0);
+
+    std::vector<uint8_t> quantize(const std::vector<uint32_t> &pixels, int threads = 0) const;
+    // Row-major indices of the view, padding between rows is skipped
+    std::vector<uint8_t> quantize(ConstPixelView image, int threads = 0) const;
+    uint8_t pickBackground(const std::vector<uint8_t> &indices) const;
+    const CellConstraints &getConstraints() const;
+
+    static CellKey makeKey(uint64_t constraints, uint8_t background, std::span<const uint8_t> indices);
+
+private:
+    CellSolution compute(std::span<const uint8_t> indices, uint8_t background) const;
+    int distance(int a, int b) const { return distances[a * paletteSize + b]; }
+
+    CellConstraints constraints;
+    uint64_t constraintsId;
+    int paletteSize;
+    std::vector<int> distances;
+    std::shared_ptr<CellSolutionCache> cache;
+};
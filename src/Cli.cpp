@@ -0,0 +1,410 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/Cli.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include "AnimationConverter.h"
+#include "BatchConverter.h"
+#include "EncoderRegistry.h"
+#include "Metrics.h"
+#include "PaletteBuilder.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace
+{
+    void printUsage()
+    {
+        std::cout << "Usage: GraphicsConverterCli [options] <input>... -o <output directory>\n"
+                     "\n"
+                     "Inputs may be image files or directories.\n"
+                     "\n"
+                     "Options:\n"
+                     "  -o, --output DIR        Output directory (required)\n"
+                     "  -e, --encoder NAME      Target format (default: koala)\n"
+                     "      --koala-packing P   none, rle or lz for Koala files (default: none)\n"
+                     "  -r, --reducer NAME      median-cut, kmeans or octree (default: median-cut)\n"
+                     "  -c, --colors N          Reduce to N colors before encoding (default: off)\n"
+                     "      --seed N            Seed of the kmeans reducer (default: 0)\n"
+                     "  -d, --dither NAME       none, floyd-steinberg, bayer or ordered (default: none)\n"
+                     "      --shared-palette    Build one palette from all inputs and use it for every image\n"
+                     "      --animation         Convert every frame of GIF inputs; other inputs form one frame sequence\n"
+                     "      --palette-mode MODE shared or evolving palette for animations (default: shared)\n"
+                     "      --auto-tune MS      Pick reducer and dithering per image within MS milliseconds\n"
+                     "                          (0: no limit, the same choice on every run)\n"
+                     "      --filter NAME       box, bilinear, mitchell or lanczos3 (default: mitchell)\n"
+                     "      --fit MODE          stretch, fit or crop to the encoder size (default: fit)\n"
+                     "  -R, --recursive         Descend into subdirectories\n"
+                     "  -j, --threads N         Encoder worker threads (default: all cores)\n"
+                     "      --decoders N        Decoder threads (default: 2)\n"
+                     "      --prefetch N        Files read ahead of the decoders (default: 2 per decoder)\n"
+                     "      --queue N           Images buffered between stages (default: 2 per worker)\n"
+                     "      --memory-cap MB     Refuse images whose decoding needs more than MB megabytes\n"
+                     "      --skip-existing     Keep outputs that already exist\n"
+                     "      --cache DIR         Reuse results of earlier runs stored in DIR\n"
+                     "      --cache-size MB     Evict least recently used results beyond MB (default: 1024)\n"
+                     "      --quality           Log PSNR, SSIM and CIEDE2000 of every reduced image\n"
+                     "      --min-psnr DB       Fail images whose PSNR is below DB (implies --quality)\n"
+                     "      --min-ssim X        Fail images whose SSIM is below X (implies --quality)\n"
+                     "      --metrics FILE      Write per-stage timings and allocations as JSON (- for stdout)\n"
+                     "  -t, --timeout MS        Give up on an image after MS milliseconds of processing\n"
+                     "      --list-encoders     Show the available target formats\n"
+                     "  -v, --verbose           Debug logging\n"
+                     "  -h, --help              Show this help\n";
+    }
+
+    void listEncoders()
+    {
+        for (const EncoderCapabilities &caps : EncoderRegistry::instance().list())
+        {
+            std::string size = caps.width > 0 ? std::to_string(caps.width) + "x" + std::to_string(caps.height) : "any size";
+            std::cout << caps.name << "\t." << caps.extension << "\t" << size << "\t" << caps.description << "\n";
+        }
+    }
+
+    template <typename T>
+    T parseChoice(const std::map<std::string, T> &choices, const std::string &value, const std::string &option)
+    {
+        auto it = choices.find(value);
+        if (it == choices.end())
+        {
+            throw std::invalid_argument("Unknown value '" + value + "' for " + option);
+        }
+        return it->second;
+    }
+
+    int parseCount(const std::string &value, const std::string &option)
+    {
+        size_t used = 0;
+        int count = std::stoi(value, &used);
+        if (used != value.size() || count < 0)
+        {
+            throw std::invalid_argument("Invalid number '" + value + "' for " + option);
+        }
+        return count;
+    }
+
+    // Writes the frames of one animation as <stem>_0000.<ext>, <stem>_0001.<ext> and so on
+    void convertAnimation(const FrameSource &source, const std::filesystem::path &stem, const BatchOptions &options,
+                          const AnimationOptions &animation, const EncoderCapabilities &caps)
+    {
+        AnimationConverter converter(animation);
+        converter.setPreprocessor([&](PixelBuffer image)
+                                  {
+            std::optional<PixelBuffer> fitted = BatchConverter::fitToEncoder(image, caps, options);
+            return fitted ? std::move(*fitted) : std::move(image); });
+
+        std::filesystem::create_directories(stem.parent_path());
+        converter.run(source, [&](size_t index, const AnimationFrame &frame)
+                      {
+            char suffix[16];
+            std::snprintf(suffix, sizeof(suffix), "_%04zu.", index);
+            auto encoder = EncoderRegistry::instance().create(options.encoder);
+            encoder->convertImage(frame.image);
+            encoder->saveFile(stem.string() + suffix + caps.extension); });
+    }
+
+    // One palette for all inputs, counted on the images the encoder will see. Unreadable
+    // inputs are left out here; the batch run reports them like any other failure.
+    std::vector<uint32_t> buildSharedPalette(const std::vector<BatchJob> &jobs, const BatchOptions &options, const EncoderCapabilities &caps)
+    {
+        DecodeOptions decode = BatchConverter::decodeOptions(caps, options);
+        ColorHistogram histogram = PaletteBuilder::histogram(jobs.size(), [&](size_t index)
+                                                             {
+            try
+            {
+                PixelBuffer image = ImageIO::load(jobs[index].input.string(), decode);
+                std::optional<PixelBuffer> fitted = BatchConverter::fitToEncoder(image, caps, options);
+                return fitted ? std::move(*fitted) : std::move(image);
+            }
+            catch (const std::exception &e)
+            {
+                spdlog::warn("Skipping {} for the shared palette: {}", jobs[index].input.string(), e.what());
+                return PixelBuffer();
+            } }, options.workerThreads);
+        if (histogram.colors.empty())
+        {
+            spdlog::warn("No readable input for the shared palette");
+            return {};
+        }
+        std::vector<uint32_t> palette = PaletteBuilder::build(histogram, options.targetColors, options.reducer, nullptr, options.seed);
+        spdlog::info("Shared palette of {} colors from {} images and {} distinct colors", palette.size(), jobs.size(),
+                     histogram.colors.size());
+        return palette;
+    }
+
+    // GIF inputs are animations of their own, every other input is a frame of one sequence
+    // named after its first file
+    int convertAnimations(const std::vector<BatchJob> &jobs, const BatchOptions &options, PaletteMode paletteMode,
+                          const EncoderCapabilities &caps)
+    {
+        AnimationOptions animation;
+        animation.reducer = options.reducer;
+        animation.targetColors = options.targetColors;
+        animation.seed = options.seed;
+        animation.dither = options.dither;
+        animation.dithering = options.dithering;
+        animation.paletteMode = paletteMode;
+        animation.threads = options.workerThreads;
+
+        DecodeOptions decode = BatchConverter::decodeOptions(caps, options);
+        std::vector<std::filesystem::path> sequence;
+        std::filesystem::path sequenceStem;
+        int failed = 0;
+        for (const BatchJob &job : jobs)
+        {
+            std::filesystem::path stem = job.output;
+            stem.replace_extension();
+            std::string extension = job.input.extension().string();
+            std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+            if (extension != ".gif")
+            {
+                if (sequence.empty())
+                    sequenceStem = stem;
+                sequence.push_back(job.input);
+                continue;
+            }
+            try
+            {
+                convertAnimation(*FrameSource::open(job.input, decode), stem, options, animation, caps);
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << job.input.string() << ": " << e.what() << "\n";
+                ++failed;
+            }
+        }
+        if (!sequence.empty())
+        {
+            try
+            {
+                convertAnimation(*FrameSource::sequence(sequence, decode), sequenceStem, options, animation, caps);
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << sequence.front().string() << ": " << e.what() << "\n";
+                ++failed;
+            }
+        }
+        return failed == 0 ? 0 : 1;
+    }
+
+    // "-" writes to stdout, an empty name writes nothing
+    void writeMetrics(const std::string &metricsFile)
+    {
+        if (metricsFile == "-")
+        {
+            std::cout << MetricsRegistry::instance().toJson();
+        }
+        else if (!metricsFile.empty())
+        {
+            std::ofstream out(metricsFile);
+            if (!(out << MetricsRegistry::instance().toJson()))
+            {
+                throw std::runtime_error("Cannot write metrics to " + metricsFile);
+            }
+        }
+    }
+
+    double parseNumber(const std::string &value, const std::string &option)
+    {
+        size_t used = 0;
+        double number = std::stod(value, &used);
+        if (used != value.size() || !(number >= 0.0))
+        {
+            throw std::invalid_argument("Invalid number '" + value + "' for " + option);
+        }
+        return number;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    BatchOptions options;
+    std::vector<std::filesystem::path> inputs;
+    std::filesystem::path outputDir;
+    bool recursive = false;
+    bool animation = false;
+    bool sharedPalette = false;
+    PaletteMode paletteMode = PaletteMode::Shared;
+    std::string metricsFile;
+
+    try
+    {
+        std::vector<std::string> args(argv + 1, argv + argc);
+        for (size_t i = 0; i < args.size(); ++i)
+        {
+            const std::string &arg = args[i];
+            auto value = [&]() -> const std::string &
+            {
+                if (i + 1 >= args.size())
+                {
+                    throw std::invalid_argument("Missing value for " + arg);
+                }
+                return args[++i];
+            };
+
+            if (arg == "-h" || arg == "--help")
+            {
+                printUsage();
+                return 0;
+            }
+            else if (arg == "--list-encoders")
+            {
+                listEncoders();
+                return 0;
+            }
+            else if (arg == "-o" || arg == "--output")
+                outputDir = value();
+            else if (arg == "-e" || arg == "--encoder")
+                options.encoder = value();
+            else if (arg == "--koala-packing")
+                options.koalaPacking = parseChoice<KoalaPacking>({{"none", KoalaPacking::None}, {"rle", KoalaPacking::Rle}, {"lz", KoalaPacking::Lz}},
+                                                                 value(), arg);
+            else if (arg == "-r" || arg == "--reducer")
+                options.reducer = parseChoice<ColorReductionAlgorithm>({{"median-cut", ColorReductionAlgorithm::MedianCut},
+                                                                        {"kmeans", ColorReductionAlgorithm::KMeans},
+                                                                        {"octree", ColorReductionAlgorithm::OctreeQuantization}},
+                                                                       value(), arg);
+            else if (arg == "-c" || arg == "--colors")
+                options.targetColors = parseCount(value(), arg);
+            else if (arg == "--seed")
+            {
+                std::string seed = value();
+                size_t used = 0;
+                options.seed = std::stoull(seed, &used);
+                if (used != seed.size() || seed.front() == '-')
+                {
+                    throw std::invalid_argument("Invalid number '" + seed + "' for " + arg);
+                }
+            }
+            else if (arg == "-d" || arg == "--dither")
+            {
+                std::string name = value();
+                options.dither = name != "none";
+                if (options.dither)
+                    options.dithering = parseChoice<DitheringAlgorithm>({{"floyd-steinberg", DitheringAlgorithm::FloydSteinberg},
+                                                                         {"bayer", DitheringAlgorithm::Bayer},
+                                                                         {"ordered", DitheringAlgorithm::Ordered}},
+                                                                        name, arg);
+            }
+            else if (arg == "--shared-palette")
+                sharedPalette = true;
+            else if (arg == "--animation")
+                animation = true;
+            else if (arg == "--palette-mode")
+                paletteMode = parseChoice<PaletteMode>({{"shared", PaletteMode::Shared}, {"evolving", PaletteMode::Evolving}}, value(), arg);
+            else if (arg == "--auto-tune")
+            {
+                options.autoTune = true;
+                options.tuneBudget = std::chrono::milliseconds(parseCount(value(), arg));
+            }
+            else if (arg == "--filter")
+                options.filter = parseChoice<ResampleFilter>({{"box", ResampleFilter::Box},
+                                                              {"bilinear", ResampleFilter::Bilinear},
+                                                              {"mitchell", ResampleFilter::Mitchell},
+                                                              {"lanczos3", ResampleFilter::Lanczos3}},
+                                                             value(), arg);
+            else if (arg == "--fit")
+                options.fit = parseChoice<FitMode>({{"stretch", FitMode::Stretch}, {"fit", FitMode::Fit}, {"crop", FitMode::Crop}},
+                                                   value(), arg);
+            else if (arg == "-R" || arg == "--recursive")
+                recursive = true;
+            else if (arg == "-j" || arg == "--threads")
+                options.workerThreads = parseCount(value(), arg);
+            else if (arg == "--decoders")
+                options.decodeThreads = parseCount(value(), arg);
+            else if (arg == "--prefetch")
+                options.prefetchFiles = static_cast<size_t>(parseCount(value(), arg));
+            else if (arg == "--queue")
+                options.queueDepth = static_cast<size_t>(parseCount(value(), arg));
+            else if (arg == "--memory-cap")
+                options.memoryCap = static_cast<size_t>(parseCount(value(), arg)) * 1024 * 1024;
+            else if (arg == "--skip-existing")
+                options.overwrite = false;
+            else if (arg == "--cache")
+                options.cacheDirectory = value();
+            else if (arg == "--cache-size")
+                options.cacheBytes = static_cast<uint64_t>(parseCount(value(), arg)) * 1024 * 1024;
+            else if (arg == "--quality")
+                options.measureQuality = true;
+            else if (arg == "--min-psnr")
+                options.minPsnr = parseNumber(value(), arg);
+            else if (arg == "--min-ssim")
+                options.minSsim = parseNumber(value(), arg);
+            else if (arg == "--metrics")
+                metricsFile = value();
+            else if (arg == "-t" || arg == "--timeout")
+                options.jobTimeout = std::chrono::milliseconds(parseCount(value(), arg));
+            else if (arg == "-v" || arg == "--verbose")
+                spdlog::set_level(spdlog::level::debug);
+            else if (!arg.empty() && arg[0] == '-')
+                throw std::invalid_argument("Unknown option " + arg);
+            else
+                inputs.emplace_back(arg);
+        }
+
+        if (inputs.empty() || outputDir.empty())
+        {
+            printUsage();
+            return 2;
+        }
+        if ((options.dither || options.autoTune || animation || sharedPalette) && options.targetColors == 0)
+        {
+            const char *feature = options.dither ? "Dithering" : options.autoTune ? "Auto-tune" : animation ? "Animation" : "--shared-palette";
+            throw std::invalid_argument(std::string(feature) + " needs a palette, use --colors");
+        }
+        if (animation)
+        {
+            // Frames go through AnimationConverter, not the batch pipeline that implements these
+            const bool quality = options.measureQuality || options.minPsnr > 0.0 || options.minSsim > 0.0;
+            const char *option = options.autoTune                  ? "--auto-tune"
+                                 : quality                           ? "--quality, --min-psnr and --min-ssim"
+                                 : sharedPalette                     ? "--shared-palette"
+                                 : !options.cacheDirectory.empty()   ? "--cache"
+                                                                     : nullptr;
+            if (option)
+            {
+                throw std::invalid_argument(std::string(option) + " cannot be used with --animation");
+            }
+        }
+
+        auto caps = EncoderRegistry::instance().find(options.encoder);
+        if (!caps)
+        {
+            throw std::invalid_argument("Unknown encoder " + options.encoder + " (see --list-encoders)");
+        }
+
+        std::vector<BatchJob> jobs = BatchConverter::collectJobs(inputs, outputDir, "." + caps->extension, recursive);
+        if (animation)
+        {
+            int result = convertAnimations(jobs, options, paletteMode, *caps);
+            writeMetrics(metricsFile);
+            return result;
+        }
+        if (sharedPalette && !jobs.empty())
+        {
+            options.palette = buildSharedPalette(jobs, options, *caps);
+        }
+        BatchReport report = BatchConverter(options).run(jobs);
+        for (const std::string &error : report.errors)
+        {
+            std::cerr << error << "\n";
+        }
+        writeMetrics(metricsFile);
+        return report.failed == 0 ? 0 : 1;
+    }
+    catch (const std::exception &e)
+    {
+        spdlog::error("{}", e.what());
+        return 2;
+    }
+}
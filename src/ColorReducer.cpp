@@ -5,6 +5,10 @@
 // Copyright (c) 2022 Volker Schwaberow
 
 #include "ColorReducer.h"
+#include "Metrics.h"
+#include <array>
+#include <stdexcept>
+#include <unordered_map>
 
 int colorDistance(const Color &c1, const Color &c2)
 {
@@ -29,35 +33,212 @@ std::string ColorReducer::getColorReducerName(ColorReductionAlgorithm algo)
     }
 }
 
-std::vector<uint32_t> ColorReducer::reduceColors(const std::vector<uint32_t> &image, int width, int height, int targetColors, ColorReductionAlgorithm algo)
+IndexedImage ColorReducer::toIndexed(const std::vector<uint32_t> &reduced, int width, int height)
+{
+    if (width <= 0 || height <= 0 || reduced.size() < static_cast<size_t>(width) * height)
+    {
+        throw std::invalid_argument("Invalid input parameters");
+    }
+
+    IndexedImage indexed;
+    indexed.width = width;
+    indexed.height = height;
+    indexed.indices.resize(static_cast<size_t>(width) * height);
+
+    std::unordered_map<uint32_t, uint8_t> lookup;
+    uint32_t lastColor = 0;
+    uint8_t lastIndex = 0;
+    bool hasLast = false;
+    for (size_t i = 0; i < indexed.indices.size(); ++i)
+    {
+        uint32_t color = reduced[i];
+        if (!hasLast || color != lastColor)
+        {
+            auto it = lookup.find(color);
+            if (it == lookup.end())
+            {
+                if (indexed.palette.size() >= 256)
+                {
+                    throw std::runtime_error("Indexed images are limited to 256 colors");
+                }
+                it = lookup.emplace(color, static_cast<uint8_t>(indexed.palette.size())).first;
+                indexed.palette.push_back(color);
+            }
+            lastColor = color;
+            lastIndex = it->second;
+            hasLast = true;
+        }
+        indexed.indices[i] = lastIndex;
+    }
+    return indexed;
+}
+
+ColorHistogram ColorReducer::buildHistogram(const std::vector<uint32_t> &image)
+{
+    std::vector<uint32_t> sorted(image);
+    return histogramOfSorted(sorted);
+}
+
+ColorHistogram ColorReducer::buildHistogram(ConstPixelView image)
+{
+    StageTimer timer("histogram");
+    std::vector<uint32_t> sorted = image.toVector();
+    return histogramOfSorted(sorted);
+}
+
+ColorHistogram ColorReducer::histogramOfSorted(std::vector<uint32_t> &pixels)
+{
+    std::sort(pixels.begin(), pixels.end());
+
+    ColorHistogram histogram;
+    for (size_t i = 0; i < pixels.size();)
+    {
+        size_t end = i;
+        while (end < pixels.size() && pixels[end] == pixels[i])
+        {
+            ++end;
+        }
+        histogram.colors.push_back(pixels[i]);
+        histogram.counts.push_back(end - i);
+        i = end;
+    }
+    return histogram;
+}
+
+std::vector<uint32_t> ColorReducer::generatePalette(ConstPixelView image, const ColorHistogram &histogram,
+                                                    int targetColors, ColorReductionAlgorithm algo, ProgressToken *progress, uint64_t seed)
+{
+    StageTimer timer("palette");
+    if (histogram.colors.size() <= static_cast<size_t>(std::max(targetColors, 1)))
+    {
+        return histogram.colors;
+    }
+
+    std::vector<uint32_t> reduced = reduceColors(image, targetColors, algo, progress, seed);
+    std::vector<uint32_t> palette = histogramOfSorted(reduced).colors;
+    if (palette.size() > 256)
+    {
+        palette.resize(256);
+    }
+    return palette;
+}
+
+void ColorReducer::remap(ConstPixelView image, const std::vector<uint32_t> &palette, PixelView output, ProgressToken *progress)
+{
+    StageTimer timer("remap");
+    if (palette.empty())
+    {
+        throw std::invalid_argument("Cannot remap to an empty palette");
+    }
+    if (output.width() != image.width() || output.height() != image.height())
+    {
+        throw std::invalid_argument("Remap output size does not match the image");
+    }
+
+    std::unordered_map<uint32_t, uint32_t> memo;
+    for (int y = 0; y < image.height(); ++y)
+    {
+        if (progress && (y & 15) == 0)
+        {
+            progress->checkpoint();
+            progress->report(static_cast<float>(y) / image.height());
+        }
+        std::span<const uint32_t> in = image.row(y);
+        std::span<uint32_t> out = output.row(y);
+        for (size_t x = 0; x < in.size(); ++x)
+        {
+            auto it = memo.find(in[x]);
+            if (it == memo.end())
+            {
+                Color color(in[x]);
+                uint32_t nearest = palette[0];
+                int minDistance = std::numeric_limits<int>::max();
+                for (uint32_t paletteColor : palette)
+                {
+                    int distance = colorDistance(color, Color(paletteColor));
+                    if (distance < minDistance)
+                    {
+                        minDistance = distance;
+                        nearest = paletteColor;
+                    }
+                }
+                it = memo.emplace(in[x], nearest).first;
+            }
+            out[x] = it->second;
+        }
+    }
+}
+
+PixelBuffer ColorReducer::remap(ConstPixelView image, const std::vector<uint32_t> &palette, ProgressToken *progress)
+{
+    PixelBuffer output(image.width(), image.height());
+    remap(image, palette, output, progress);
+    return output;
+}
+
+std::vector<uint32_t> ColorReducer::remap(const std::vector<uint32_t> &image, const std::vector<uint32_t> &palette,
+                                          ProgressToken *progress)
+{
+    std::vector<uint32_t> result(image.size());
+    int width = static_cast<int>(image.size());
+    remap(ConstPixelView(image.data(), width, 1, width), palette, PixelView(result.data(), width, 1, width), progress);
+    return result;
+}
+
+std::vector<uint32_t> ColorReducer::reduceColors(const std::vector<uint32_t> &image, int width, int height, int targetColors, ColorReductionAlgorithm algo,
+                                                 ProgressToken *progress, uint64_t seed)
+{
+    int size = static_cast<int>(image.size());
+    return reduce(ConstPixelView(image.data(), size, 1, size), targetColors, algo, progress, seed);
+}
+
+std::vector<uint32_t> ColorReducer::reduceColors(ConstPixelView image, int targetColors, ColorReductionAlgorithm algo, ProgressToken *progress,
+                                                 uint64_t seed)
+{
+    return reduce(image, targetColors, algo, progress, seed);
+}
+
+std::vector<uint32_t> ColorReducer::reduce(ConstPixelView image, int targetColors, ColorReductionAlgorithm algo, ProgressToken *progress,
+                                           uint64_t seed)
 {
     try
     {
         // Check if all pixels are the same, so its mono color
-        if (std::adjacent_find(image.begin(), image.end(), std::not_equal_to<>()) == image.end())
+        bool mono = true;
+        for (int y = 0; y < image.height() && mono; ++y)
         {
-            return image;
+            std::span<const uint32_t> row = image.row(y);
+            mono = std::all_of(row.begin(), row.end(), [&](uint32_t pixel)
+                               { return pixel == image(0, 0); });
+        }
+        if (mono)
+        {
+            return image.toVector();
         }
         switch (algo)
         {
         case ColorReductionAlgorithm::MedianCut:
-            return medianCut(image, targetColors);
+            return medianCut(image, targetColors, progress);
         case ColorReductionAlgorithm::KMeans:
-            return kMeans(image, targetColors);
+            return kMeans(image, targetColors, progress, seed);
         case ColorReductionAlgorithm::OctreeQuantization:
-            return octreeQuantization(image, targetColors);
+            return octreeQuantization(image, targetColors, progress);
         default:
-            return image;
+            return image.toVector();
         }
     }
+    catch (const OperationCancelled &)
+    {
+        throw;
+    }
     catch (const std::exception &e)
     {
         std::cerr << "Error: " << e.what() << std::endl;
-        return image;
+        return image.toVector();
     }
 }
 
-std::vector<uint32_t> ColorReducer::medianCut(const std::vector<uint32_t> &image, int targetColors)
+std::vector<uint32_t> ColorReducer::medianCut(ConstPixelView image, int targetColors, ProgressToken *progress)
 {
     auto compareBoxes = [](const ColorBox &a, const ColorBox &b)
     {
@@ -65,10 +246,15 @@ std::vector<uint32_t> ColorReducer::medianCut(const std::vector<uint32_t> &image
     };
     std::priority_queue<ColorBox, std::vector<ColorBox>, decltype(compareBoxes)> boxes(compareBoxes);
 
-    boxes.push(ColorBox(image));
+    boxes.push(ColorBox(image.toVector()));
 
     while (static_cast<int>(boxes.size()) < targetColors)
     {
+        if (progress)
+        {
+            progress->checkpoint();
+            progress->report(0.0f, 0.5f, static_cast<float>(boxes.size()) / targetColors);
+        }
         ColorBox box = boxes.top();
         boxes.pop();
 
@@ -91,7 +277,8 @@ std::vector<uint32_t> ColorReducer::medianCut(const std::vector<uint32_t> &image
     while (!boxes.empty())
     {
         const ColorBox &box = boxes.top();
-        int r = 0, g = 0, b = 0;
+        // 64 bit, so channel sums of images above 8.4M pixels do not overflow
+        uint64_t r = 0, g = 0, b = 0;
         for (uint32_t pixel : box.pixels)
         {
             r += (pixel >> 16) & 0xFF;
@@ -101,60 +288,70 @@ std::vector<uint32_t> ColorReducer::medianCut(const std::vector<uint32_t> &image
         r /= box.pixels.size();
         g /= box.pixels.size();
         b /= box.pixels.size();
-        palette.push_back((r << 16) | (g << 8) | b);
+        palette.push_back(static_cast<uint32_t>((r << 16) | (g << 8) | b));
         boxes.pop();
     }
 
     std::vector<uint32_t> result(image.size());
-    for (size_t i = 0; i < image.size(); ++i)
+    size_t i = 0;
+    for (int y = 0; y < image.height(); ++y)
     {
-        uint32_t pixel = image[i];
-        int r = (pixel >> 16) & 0xFF;
-        int g = (pixel >> 8) & 0xFF;
-        int b = pixel & 0xFF;
-
-        uint32_t closestColor = palette[0];
-        int minDistance = std::numeric_limits<int>::max();
-
-        for (uint32_t paletteColor : palette)
+        for (uint32_t pixel : image.row(y))
         {
-            int pr = (paletteColor >> 16) & 0xFF;
-            int pg = (paletteColor >> 8) & 0xFF;
-            int pb = paletteColor & 0xFF;
+            if (progress && (i & 0xFFFF) == 0)
+            {
+                progress->checkpoint();
+                progress->report(0.5f, 1.0f, static_cast<float>(i) / image.size());
+            }
+            int r = (pixel >> 16) & 0xFF;
+            int g = (pixel >> 8) & 0xFF;
+            int b = pixel & 0xFF;
 
-            int distance = (r - pr) * (r - pr) + (g - pg) * (g - pg) + (b - pb) * (b - pb);
-            if (distance < minDistance)
+            uint32_t closestColor = palette[0];
+            int minDistance = std::numeric_limits<int>::max();
+
+            for (uint32_t paletteColor : palette)
             {
-                minDistance = distance;
-                closestColor = paletteColor;
+                int pr = (paletteColor >> 16) & 0xFF;
+                int pg = (paletteColor >> 8) & 0xFF;
+                int pb = paletteColor & 0xFF;
+
+                int distance = (r - pr) * (r - pr) + (g - pg) * (g - pg) + (b - pb) * (b - pb);
+                if (distance < minDistance)
+                {
+                    minDistance = distance;
+                    closestColor = paletteColor;
+                }
             }
-        }
 
-        result[i] = closestColor;
+            result[i++] = closestColor;
+        }
     }
 
     return result;
 }
 
-std::vector<uint32_t> ColorReducer::kMeans(const std::vector<uint32_t> &image, int targetColors)
+std::vector<uint32_t> ColorReducer::kMeans(ConstPixelView image, int targetColors, ProgressToken *progress, uint64_t seed)
 {
     std::vector<Color> pixels;
     pixels.reserve(image.size());
-    for (uint32_t pixel : image)
+    for (int y = 0; y < image.height(); ++y)
     {
-        pixels.emplace_back(pixel);
+        for (uint32_t pixel : image.row(y))
+        {
+            pixels.emplace_back(pixel);
+        }
     }
 
     std::vector<Color> centroids;
     centroids.reserve(targetColors);
 
-    // Initialize centroids randomly
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> dis(0, image.size() - 1);
+    // Initialize centroids from random pixels. The engine's output is fixed by the standard,
+    // the distributions are not, so the index is reduced by hand to stay the same everywhere.
+    std::mt19937_64 gen(seed);
     for (int i = 0; i < targetColors; ++i)
     {
-        centroids.push_back(pixels[dis(gen)]);
+        centroids.push_back(pixels[gen() % pixels.size()]);
     }
 
     std::vector<int> assignments(pixels.size());
@@ -163,10 +360,17 @@ std::vector<uint32_t> ColorReducer::kMeans(const std::vector<uint32_t> &image, i
 
     while (changed && maxIterations > 0)
     {
+        if (progress)
+        {
+            progress->checkpoint();
+            progress->report((100 - maxIterations) / 100.0f);
+        }
         changed = false;
 
         for (size_t i = 0; i < pixels.size(); ++i)
         {
+            if (progress && (i & 0xFFFF) == 0)
+                progress->checkpoint();
             int nearestCentroid = 0;
             int minDistance = std::numeric_limits<int>::max();
 
@@ -187,25 +391,27 @@ std::vector<uint32_t> ColorReducer::kMeans(const std::vector<uint32_t> &image, i
             }
         }
 
-        std::vector<int> counts(targetColors, 0);
-        std::vector<Color> newCentroids(targetColors);
+        // Channel sums in 64 bit, Color's int overflows above 8.4M pixels
+        std::vector<uint64_t> counts(targetColors, 0);
+        std::vector<std::array<uint64_t, 3>> sums(targetColors, {0, 0, 0});
 
         for (size_t i = 0; i < pixels.size(); ++i)
         {
             int centroidIndex = assignments[i];
-            newCentroids[centroidIndex].r += pixels[i].r;
-            newCentroids[centroidIndex].g += pixels[i].g;
-            newCentroids[centroidIndex].b += pixels[i].b;
+            sums[centroidIndex][0] += pixels[i].r;
+            sums[centroidIndex][1] += pixels[i].g;
+            sums[centroidIndex][2] += pixels[i].b;
             counts[centroidIndex]++;
         }
 
+        std::vector<Color> newCentroids(targetColors);
         for (int i = 0; i < targetColors; ++i)
         {
             if (counts[i] > 0)
             {
-                newCentroids[i].r /= counts[i];
-                newCentroids[i].g /= counts[i];
-                newCentroids[i].b /= counts[i];
+                newCentroids[i].r = static_cast<int>(sums[i][0] / counts[i]);
+                newCentroids[i].g = static_cast<int>(sums[i][1] / counts[i]);
+                newCentroids[i].b = static_cast<int>(sums[i][2] / counts[i]);
             }
         }
 
@@ -222,15 +428,25 @@ std::vector<uint32_t> ColorReducer::kMeans(const std::vector<uint32_t> &image, i
     return result;
 }
 
-std::vector<uint32_t> ColorReducer::octreeQuantization(const std::vector<uint32_t> &image, int targetColors)
+std::vector<uint32_t> ColorReducer::octreeQuantization(ConstPixelView image, int targetColors, ProgressToken *progress)
 {
     OctreeNode root;
     int leafCount = 0;
     int maxLevel = 8;
 
-    for (uint32_t color : image)
+    size_t added = 0;
+    for (int y = 0; y < image.height(); ++y)
     {
-        root.addColor(color, 0, maxLevel, leafCount, targetColors);
+        for (uint32_t pixel : image.row(y))
+        {
+            if (progress && (added & 0xFFFF) == 0)
+            {
+                progress->checkpoint();
+                progress->report(0.0f, 0.5f, static_cast<float>(added) / image.size());
+            }
+            root.addColor(pixel, 0, maxLevel, leafCount, targetColors);
+            ++added;
+        }
     }
 
     std::vector<uint32_t> palette;
@@ -259,23 +475,31 @@ std::vector<uint32_t> ColorReducer::octreeQuantization(const std::vector<uint32_
     }
 
     std::vector<uint32_t> result(image.size());
-    for (size_t i = 0; i < image.size(); ++i)
+    size_t i = 0;
+    for (int y = 0; y < image.height(); ++y)
     {
-        uint32_t originalColor = image[i];
-        uint32_t nearestColor = palette[0];
-        int minDistance = std::numeric_limits<int>::max();
-
-        for (uint32_t paletteColor : palette)
+        for (uint32_t originalColor : image.row(y))
         {
-            int distance = colorDistance(Color(originalColor), Color(paletteColor));
-            if (distance < minDistance)
+            if (progress && (i & 0xFFFF) == 0)
             {
-                minDistance = distance;
-                nearestColor = paletteColor;
+                progress->checkpoint();
+                progress->report(0.5f, 1.0f, static_cast<float>(i) / image.size());
             }
-        }
+            uint32_t nearestColor = palette[0];
+            int minDistance = std::numeric_limits<int>::max();
 
-        result[i] = nearestColor;
+            for (uint32_t paletteColor : palette)
+            {
+                int distance = colorDistance(Color(originalColor), Color(paletteColor));
+                if (distance < minDistance)
+                {
+                    minDistance = distance;
+                    nearestColor = paletteColor;
+                }
+            }
+
+            result[i++] = nearestColor;
+        }
     }
 
     return result;
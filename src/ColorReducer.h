@@ -14,6 +14,10 @@
 #include <limits>
 #include <random>
 #include <iostream>
+#include <string>
+#include "ProgressToken.h"
+#include "PixelBuffer.h"
+#include <span>
 
 enum class ColorReductionAlgorithm
 {
@@ -101,8 +105,12 @@ public:
         int index = getColorIndex(color, level);
         if (children[index] == nullptr)
         {
+            // Out of nodes: this one stands for every color below it
             if (leafCount >= maxLeaves)
+            {
+                isLeaf = true;
                 return;
+            }
             children[index] = new OctreeNode();
             ++leafCount;
         }
@@ -113,15 +121,16 @@ public:
     {
         if (pixelCount == 0)
             return 0;
-        int r = red / pixelCount;
-        int g = green / pixelCount;
-        int b = blue / pixelCount;
+        uint32_t r = static_cast<uint32_t>(red / pixelCount);
+        uint32_t g = static_cast<uint32_t>(green / pixelCount);
+        uint32_t b = static_cast<uint32_t>(blue / pixelCount);
         return (r << 16) | (g << 8) | b;
     }
 
     OctreeNode *children[8];
-    int red, green, blue;
-    int pixelCount;
+    // 64 bit, so channel sums of images above 8.4M pixels do not overflow
+    uint64_t red, green, blue;
+    uint64_t pixelCount;
     bool isLeaf;
 
 private:
@@ -142,14 +151,56 @@ private:
     }
 };
 
+struct IndexedImage
+{
+    int width = 0;
+    int height = 0;
+    std::vector<uint32_t> palette;
+    std::vector<uint8_t> indices;
+};
+
+// Distinct colors of an image with their pixel counts, sorted by color. Counts are
+// 64 bit because merged histograms of many images pass 2^32 for common colors.
+struct ColorHistogram
+{
+    std::vector<uint32_t> colors;
+    std::vector<uint64_t> counts;
+};
+
+// Every algorithm is a pure function of its input and seed: KMeans draws its initial
+// centroids from a std::mt19937_64 seeded with `seed`, the others ignore it
 class ColorReducer
 {
 public:
-    static std::vector<uint32_t> reduceColors(const std::vector<uint32_t> &image, int width, int height, int targetColors, ColorReductionAlgorithm algo);
+    static constexpr uint64_t DEFAULT_SEED = 0;
+
+    // progress may be null; cancellation surfaces as OperationCancelled
+    static std::vector<uint32_t> reduceColors(const std::vector<uint32_t> &image, int width, int height, int targetColors, ColorReductionAlgorithm algo,
+                                              ProgressToken *progress = nullptr, uint64_t seed = DEFAULT_SEED);
+    static std::vector<uint32_t> reduceColors(ConstPixelView image, int targetColors, ColorReductionAlgorithm algo, ProgressToken *progress = nullptr,
+                                              uint64_t seed = DEFAULT_SEED);
     static std::string getColorReducerName(ColorReductionAlgorithm algo);
+    // Splits a reduced image into palette and per-pixel indices, palette in order of first use
+    static IndexedImage toIndexed(const std::vector<uint32_t> &reduced, int width, int height);
+    static ColorHistogram buildHistogram(const std::vector<uint32_t> &image);
+    static ColorHistogram buildHistogram(ConstPixelView image);
+    // Palette chosen by `algo`; images that already fit into targetColors keep their colors
+    static std::vector<uint32_t> generatePalette(ConstPixelView image, const ColorHistogram &histogram,
+                                                 int targetColors, ColorReductionAlgorithm algo, ProgressToken *progress = nullptr,
+                                                 uint64_t seed = DEFAULT_SEED);
+    // Replaces every pixel by its nearest palette color
+    static void remap(ConstPixelView image, const std::vector<uint32_t> &palette, PixelView output, ProgressToken *progress = nullptr);
+    static PixelBuffer remap(ConstPixelView image, const std::vector<uint32_t> &palette, ProgressToken *progress = nullptr);
+    static std::vector<uint32_t> remap(const std::vector<uint32_t> &image, const std::vector<uint32_t> &palette,
+                                       ProgressToken *progress = nullptr);
 
 private:
-    static std::vector<uint32_t> medianCut(const std::vector<uint32_t> &image, int targetColors);
-    static std::vector<uint32_t> kMeans(const std::vector<uint32_t> &image, int targetColors);
-    static std::vector<uint32_t> octreeQuantization(const std::vector<uint32_t> &image, int targetColors);
+    // The reducers read the image row by row, so padded buffers are not copied first; the
+    // result is packed in row order either way
+    static std::vector<uint32_t> reduce(ConstPixelView image, int targetColors, ColorReductionAlgorithm algo, ProgressToken *progress,
+                                        uint64_t seed);
+    static ColorHistogram histogramOfSorted(std::vector<uint32_t> &pixels);
+    static std::vector<uint32_t> medianCut(ConstPixelView image, int targetColors, ProgressToken *progress);
+    static std::vector<uint32_t> kMeans(ConstPixelView image, int targetColors, ProgressToken *progress, uint64_t seed);
+    static std::vector<uint32_t> octreeQuantization(ConstPixelView image, int targetColors, ProgressToken *progress);
 };
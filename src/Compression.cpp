@@ -0,0 +1,172 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/Compression.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include "Compression.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+    constexpr size_t LZ_MIN_MATCH = 3;
+    constexpr size_t LZ_MAX_MATCH = 0x7F + LZ_MIN_MATCH;
+    constexpr size_t LZ_MAX_LITERALS = 0x80;
+    constexpr size_t LZ_MAX_DISTANCE = 0xFFFF;
+    constexpr int LZ_HASH_BITS = 14;
+
+    inline uint32_t hash3(const uint8_t *p)
+    {
+        uint32_t v = static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16);
+        return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+    }
+
+    void flushLiterals(const uint8_t *data, size_t start, size_t end, std::vector<uint8_t> &out)
+    {
+        while (start < end)
+        {
+            size_t count = std::min(end - start, LZ_MAX_LITERALS);
+            out.push_back(static_cast<uint8_t>(count - 1));
+            out.insert(out.end(), data + start, data + start + count);
+            start += count;
+        }
+    }
+}
+
+namespace Compression
+{
+    void packRle(const uint8_t *data, size_t size, std::vector<uint8_t> &out, uint8_t escape)
+    {
+        size_t i = 0;
+        while (i < size)
+        {
+            uint8_t value = data[i];
+            size_t run = 1;
+            while (i + run < size && run < 255 && data[i + run] == value)
+            {
+                ++run;
+            }
+
+            if (run >= 4 || value == escape)
+            {
+                out.push_back(escape);
+                out.push_back(value);
+                out.push_back(static_cast<uint8_t>(run));
+            }
+            else
+            {
+                out.insert(out.end(), run, value);
+            }
+            i += run;
+        }
+    }
+
+    std::vector<uint8_t> unpackRle(const uint8_t *data, size_t size, uint8_t escape)
+    {
+        std::vector<uint8_t> out;
+        out.reserve(size * 2);
+        for (size_t i = 0; i < size; ++i)
+        {
+            if (data[i] != escape)
+            {
+                out.push_back(data[i]);
+                continue;
+            }
+            if (i + 2 >= size)
+            {
+                throw std::runtime_error("Truncated RLE stream");
+            }
+            out.insert(out.end(), data[i + 2], data[i + 1]);
+            i += 2;
+        }
+        return out;
+    }
+
+    void packLz(const uint8_t *data, size_t size, std::vector<uint8_t> &out)
+    {
+        std::vector<int64_t> table(size_t(1) << LZ_HASH_BITS, -1);
+        size_t literalStart = 0;
+        size_t i = 0;
+
+        while (i + LZ_MIN_MATCH <= size)
+        {
+            uint32_t h = hash3(data + i);
+            int64_t candidate = table[h];
+            table[h] = static_cast<int64_t>(i);
+
+            if (candidate < 0 || i - static_cast<size_t>(candidate) > LZ_MAX_DISTANCE ||
+                std::memcmp(data + candidate, data + i, LZ_MIN_MATCH) != 0)
+            {
+                ++i;
+                continue;
+            }
+
+            size_t limit = std::min(size - i, LZ_MAX_MATCH);
+            size_t length = LZ_MIN_MATCH;
+            while (length < limit && data[candidate + length] == data[i + length])
+            {
+                ++length;
+            }
+
+            flushLiterals(data, literalStart, i, out);
+            size_t distance = i - static_cast<size_t>(candidate);
+            out.push_back(static_cast<uint8_t>(0x80 | (length - LZ_MIN_MATCH)));
+            out.push_back(static_cast<uint8_t>(distance & 0xFF));
+            out.push_back(static_cast<uint8_t>(distance >> 8));
+
+            // Index the covered positions so later matches can refer into this one
+            size_t end = i + length;
+            for (++i; i < end && i + LZ_MIN_MATCH <= size; ++i)
+            {
+                table[hash3(data + i)] = static_cast<int64_t>(i);
+            }
+            i = end;
+            literalStart = end;
+        }
+
+        flushLiterals(data, literalStart, size, out);
+    }
+
+    std::vector<uint8_t> unpackLz(const uint8_t *data, size_t size)
+    {
+        std::vector<uint8_t> out;
+        out.reserve(size * 3);
+        size_t i = 0;
+        while (i < size)
+        {
+            uint8_t token = data[i++];
+            if (token < 0x80)
+            {
+                size_t count = static_cast<size_t>(token) + 1;
+                if (i + count > size)
+                {
+                    throw std::runtime_error("Truncated LZ literal run");
+                }
+                out.insert(out.end(), data + i, data + i + count);
+                i += count;
+                continue;
+            }
+
+            if (i + 2 > size)
+            {
+                throw std::runtime_error("Truncated LZ match");
+            }
+            size_t length = (token & 0x7F) + LZ_MIN_MATCH;
+            size_t distance = static_cast<size_t>(data[i]) | (static_cast<size_t>(data[i + 1]) << 8);
+            i += 2;
+            if (distance == 0 || distance > out.size())
+            {
+                throw std::runtime_error("Invalid LZ match distance");
+            }
+            // Byte by byte so overlapping matches replicate
+            size_t from = out.size() - distance;
+            for (size_t k = 0; k < length; ++k)
+            {
+                out.push_back(out[from + k]);
+            }
+        }
+        return out;
+    }
+}
@@ -0,0 +1,28 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/Compression.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Byte-oriented packers for 8-bit file formats. Both run in a single pass over the input.
+namespace Compression
+{
+    // Escape byte used by packed ("GG") Koala files
+    constexpr uint8_t RLE_ESCAPE = 0xFE;
+
+    // Runs of four or more bytes, and every literal escape byte, become
+    // escape, value, count (1-255).
+    void packRle(const uint8_t *data, size_t size, std::vector<uint8_t> &out, uint8_t escape = RLE_ESCAPE);
+    std::vector<uint8_t> unpackRle(const uint8_t *data, size_t size, uint8_t escape = RLE_ESCAPE);
+
+    // LZ77 with a single-probe hash table. Token 0x00-0x7F: copy the next token+1 literals;
+    // token 0x80-0xFF: repeat (token & 0x7F) + 3 bytes from a 16-bit little-endian distance back.
+    void packLz(const uint8_t *data, size_t size, std::vector<uint8_t> &out);
+    std::vector<uint8_t> unpackLz(const uint8_t *data, size_t size);
+}
@@ -0,0 +1,282 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/ConversionPipeline.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include "ConversionPipeline.h"
+#include "EncoderRegistry.h"
+#include "Hash.h"
+#include "Metrics.h"
+#include <spdlog/spdlog.h>
+#include <bit>
+#include <cmath>
+#include <stdexcept>
+
+ConversionPipeline::ConversionPipeline(size_t entriesPerStage)
+    : m_resampled(entriesPerStage), m_histograms(entriesPerStage), m_palettes(entriesPerStage),
+      m_dithered(entriesPerStage), m_encoded(entriesPerStage)
+{
+    for (int stage = 0; stage < StageCount; ++stage)
+    {
+        m_statistics[stage].stage = getStageName(static_cast<Stage>(stage));
+    }
+}
+
+std::string ConversionPipeline::getStageName(Stage stage)
+{
+    switch (stage)
+    {
+    case Load:
+        return "Load";
+    case Resample:
+        return "Resample";
+    case Histogram:
+        return "Histogram";
+    case Palette:
+        return "Palette";
+    case Dither:
+        return "Dither";
+    case Encode:
+        return "Encode";
+    default:
+        return "Unknown";
+    }
+}
+
+void ConversionPipeline::load(const std::string &filename)
+{
+    auto start = std::chrono::steady_clock::now();
+    setSource(ImageIO::load(filename));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    m_statistics[Load].lastCompute = std::chrono::steady_clock::now() - start;
+}
+
+void ConversionPipeline::setSource(const std::vector<uint32_t> &pixels, int width, int height)
+{
+    if (width <= 0 || height <= 0 || pixels.size() != static_cast<size_t>(width) * height)
+    {
+        throw std::invalid_argument("Invalid pipeline source image");
+    }
+    setSource(PixelBuffer(pixels, width, height));
+}
+
+void ConversionPipeline::setSource(PixelBuffer image)
+{
+    if (image.empty())
+    {
+        throw std::invalid_argument("Invalid pipeline source image");
+    }
+
+    // Row by row, so the padding after each row never reaches the key
+    uint64_t key = static_cast<uint64_t>(image.width()) << 32 | static_cast<uint32_t>(image.height());
+    for (int y = 0; y < image.height(); ++y)
+    {
+        std::span<const uint32_t> row = image.row(y);
+        key = Hash::combine(key, Hash::xxh64(row.data(), row.size_bytes()));
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (m_source && key == m_sourceKey)
+    {
+        ++m_statistics[Load].hits;
+        return;
+    }
+    ++m_statistics[Load].misses;
+
+    m_source = std::make_shared<const PixelBuffer>(std::move(image));
+    m_sourceKey = key;
+}
+
+bool ConversionPipeline::hasSource() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return m_source != nullptr;
+}
+
+std::shared_ptr<const PixelBuffer> ConversionPipeline::source() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return m_source;
+}
+
+ConversionPipeline::SourceRef ConversionPipeline::currentSource() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!m_source)
+    {
+        throw std::runtime_error("Pipeline has no source image");
+    }
+    return {m_source, m_sourceKey};
+}
+
+// The lock only covers the lookup and the insert, so a long stage never blocks other
+// callers. Two callers missing the same key both compute it; the first insert wins.
+template <typename T, typename Compute>
+std::shared_ptr<const T> ConversionPipeline::cached(Stage stage, StageCache<T> &cache, uint64_t key, Compute &&compute)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (std::shared_ptr<const T> hit = cache.find(key))
+        {
+            ++m_statistics[stage].hits;
+            return hit;
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto value = std::make_shared<const T>(compute());
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    PipelineStageStatistics &stats = m_statistics[stage];
+    ++stats.misses;
+    stats.lastCompute = elapsed;
+    SPDLOG_DEBUG("Pipeline stage {} recomputed in {:.2f} ms", stats.stage, stats.lastCompute.count());
+    if (std::shared_ptr<const T> existing = cache.find(key))
+    {
+        return existing;
+    }
+    cache.insert(key, value);
+    return value;
+}
+
+uint64_t ConversionPipeline::resampleKey(const SourceRef &source, const PipelineSettings &settings)
+{
+    uint64_t key = Hash::combine(Hash::combine(source.key, static_cast<uint64_t>(settings.width)), static_cast<uint64_t>(settings.height));
+    key = Hash::combine(key, static_cast<uint64_t>(settings.filter) << 8 | static_cast<uint64_t>(settings.fit));
+    return Hash::combine(key, std::bit_cast<uint64_t>(settings.pixelAspect));
+}
+
+uint64_t ConversionPipeline::paletteKey(const SourceRef &source, const PipelineSettings &settings)
+{
+    if (!settings.palette.empty())
+    {
+        return Hash::combine(resampleKey(source, settings), Hash::xxh64(settings.palette.data(), settings.palette.size() * sizeof(uint32_t)));
+    }
+    uint64_t key = Hash::combine(resampleKey(source, settings), static_cast<uint64_t>(settings.reducer));
+    key = Hash::combine(key, static_cast<uint64_t>(settings.targetColors));
+    return Hash::combine(key, settings.seed);
+}
+
+uint64_t ConversionPipeline::ditherKey(const SourceRef &source, const PipelineSettings &settings)
+{
+    uint64_t mode = settings.dither ? static_cast<uint64_t>(settings.dithering) + 1 : 0;
+    return Hash::combine(paletteKey(source, settings), mode);
+}
+
+std::shared_ptr<const PixelBuffer> ConversionPipeline::resampled(const PipelineSettings &settings, ProgressToken *progress)
+{
+    return resampled(currentSource(), settings, progress);
+}
+
+std::shared_ptr<const ColorHistogram> ConversionPipeline::histogram(const PipelineSettings &settings, ProgressToken *progress)
+{
+    return histogram(currentSource(), settings, progress);
+}
+
+std::shared_ptr<const std::vector<uint32_t>> ConversionPipeline::palette(const PipelineSettings &settings, ProgressToken *progress)
+{
+    return palette(currentSource(), settings, progress);
+}
+
+std::shared_ptr<const PixelBuffer> ConversionPipeline::dithered(const PipelineSettings &settings, ProgressToken *progress)
+{
+    return dithered(currentSource(), settings, progress);
+}
+
+std::shared_ptr<const std::vector<uint8_t>> ConversionPipeline::encoded(const PipelineSettings &settings, ProgressToken *progress)
+{
+    SourceRef source = currentSource();
+    std::shared_ptr<const PixelBuffer> input = dithered(source, settings, progress);
+    uint64_t key = Hash::combine(ditherKey(source, settings), Hash::xxh64(settings.encoder.data(), settings.encoder.size()));
+    return cached(Encode, m_encoded, key, [&]()
+                  {
+        ProgressToken::checkpoint(progress);
+        auto encoder = EncoderRegistry::instance().create(settings.encoder);
+        StageTimer timer("encode");
+        encoder->convertImage(input->view());
+        return encoder->getFileData(); });
+}
+
+std::shared_ptr<const PixelBuffer> ConversionPipeline::resampled(const SourceRef &source, const PipelineSettings &settings, ProgressToken *progress)
+{
+    return cached(Resample, m_resampled, resampleKey(source, settings), [&]()
+                  { return resample(source.image->view(), settings, progress); });
+}
+
+std::shared_ptr<const ColorHistogram> ConversionPipeline::histogram(const SourceRef &source, const PipelineSettings &settings,
+                                                                    ProgressToken *progress)
+{
+    std::shared_ptr<const PixelBuffer> input = resampled(source, settings, progress);
+    return cached(Histogram, m_histograms, resampleKey(source, settings), [&]()
+                  { return ColorReducer::buildHistogram(input->view()); });
+}
+
+std::shared_ptr<const std::vector<uint32_t>> ConversionPipeline::palette(const SourceRef &source, const PipelineSettings &settings,
+                                                                         ProgressToken *progress)
+{
+    if (!settings.palette.empty())
+    {
+        return cached(Palette, m_palettes, paletteKey(source, settings), [&]()
+                      { return settings.palette; });
+    }
+    std::shared_ptr<const PixelBuffer> input = resampled(source, settings, progress);
+    std::shared_ptr<const ColorHistogram> colors = histogram(source, settings, progress);
+    return cached(Palette, m_palettes, paletteKey(source, settings), [&]()
+                  { return ColorReducer::generatePalette(input->view(), *colors, settings.targetColors, settings.reducer, progress,
+                                                          settings.seed); });
+}
+
+std::shared_ptr<const PixelBuffer> ConversionPipeline::dithered(const SourceRef &source, const PipelineSettings &settings,
+                                                                ProgressToken *progress)
+{
+    std::shared_ptr<const PixelBuffer> input = resampled(source, settings, progress);
+    std::shared_ptr<const std::vector<uint32_t>> colors = palette(source, settings, progress);
+    return cached(Dither, m_dithered, ditherKey(source, settings), [&]()
+                  {
+        return settings.dither
+                   ? Dithering::applyDithering(input->view(), *colors, settings.dithering, progress)
+                   : ColorReducer::remap(input->view(), *colors, progress); });
+}
+
+std::vector<PipelineStageStatistics> ConversionPipeline::getStatistics() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return std::vector<PipelineStageStatistics>(std::begin(m_statistics), std::end(m_statistics));
+}
+
+void ConversionPipeline::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    m_source.reset();
+    m_sourceKey = 0;
+    m_resampled.clear();
+    m_histograms.clear();
+    m_palettes.clear();
+    m_dithered.clear();
+    m_encoded.clear();
+}
+
+PixelBuffer ConversionPipeline::resample(ConstPixelView image, const PipelineSettings &settings, ProgressToken *progress)
+{
+    int width = settings.width;
+    int height = settings.height;
+    if ((width <= 0 && height <= 0) || (width == image.width() && height == image.height() && settings.pixelAspect == 1.0))
+    {
+        return PixelBuffer(image);
+    }
+    if (width <= 0)
+        width = std::max(1, static_cast<int>(std::lround(image.width() * height / (image.height() * settings.pixelAspect))));
+    if (height <= 0)
+        height = std::max(1, static_cast<int>(std::lround(image.height() * width * settings.pixelAspect / image.width())));
+
+    ResampleOptions options;
+    options.width = width;
+    options.height = height;
+    options.filter = settings.filter;
+    options.fit = settings.fit;
+    options.pixelAspect = settings.pixelAspect;
+    return Resampler::resample(image, options, progress);
+}
@@ -0,0 +1,160 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/ConversionPipeline.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include "ColorReducer.h"
+#include "Dithering.h"
+#include "ImageIO.h"
+#include "ProgressToken.h"
+#include "Resampler.h"
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct PipelineSettings
+{
+    // Resample target, 0 keeps the source size or derives it from the other side
+    int width = 0;
+    int height = 0;
+    ResampleFilter filter = ResampleFilter::Mitchell;
+    FitMode fit = FitMode::Stretch;
+    // Target pixel width relative to its height, e.g. 2.0 for C64 multicolor
+    double pixelAspect = 1.0;
+    ColorReductionAlgorithm reducer = ColorReductionAlgorithm::MedianCut;
+    int targetColors = 16;
+    // Initial state of randomized reducers such as KMeans
+    uint64_t seed = ColorReducer::DEFAULT_SEED;
+    // Fixed palette, e.g. from the palette editor; when set it replaces the reducer
+    std::vector<uint32_t> palette;
+    bool dither = false;
+    DitheringAlgorithm dithering = DitheringAlgorithm::FloydSteinberg;
+    std::string encoder = "koala";
+};
+
+struct PipelineStageStatistics
+{
+    std::string stage;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    std::chrono::duration<double, std::milli> lastCompute{0};
+};
+
+// Small LRU of stage outputs keyed by a hash of the stage inputs and parameters
+template <typename T>
+class StageCache
+{
+public:
+    explicit StageCache(size_t capacity) : capacity(capacity) {}
+
+    std::shared_ptr<const T> find(uint64_t key)
+    {
+        for (auto it = entries.begin(); it != entries.end(); ++it)
+        {
+            if (it->first == key)
+            {
+                entries.splice(entries.begin(), entries, it);
+                return entries.front().second;
+            }
+        }
+        return nullptr;
+    }
+
+    void insert(uint64_t key, std::shared_ptr<const T> value)
+    {
+        entries.emplace_front(key, std::move(value));
+        if (entries.size() > capacity)
+        {
+            entries.pop_back();
+        }
+    }
+
+    void clear()
+    {
+        entries.clear();
+    }
+
+private:
+    size_t capacity;
+    std::list<std::pair<uint64_t, std::shared_ptr<const T>>> entries;
+};
+
+// Load -> resample -> histogram -> palette -> dither -> encode. Every stage keeps its
+// recent outputs keyed by the upstream key and its own parameters, so a settings change
+// only recomputes the stages at and below the first stage that depends on it.
+class ConversionPipeline
+{
+public:
+    enum Stage
+    {
+        Load,
+        Resample,
+        Histogram,
+        Palette,
+        Dither,
+        Encode,
+        StageCount
+    };
+
+    explicit ConversionPipeline(size_t entriesPerStage = 4);
+
+    void load(const std::string &filename);
+    void setSource(PixelBuffer image);
+    void setSource(const std::vector<uint32_t> &pixels, int width, int height);
+    bool hasSource() const;
+
+    std::shared_ptr<const PixelBuffer> source() const;
+    std::shared_ptr<const PixelBuffer> resampled(const PipelineSettings &settings, ProgressToken *progress = nullptr);
+    std::shared_ptr<const ColorHistogram> histogram(const PipelineSettings &settings, ProgressToken *progress = nullptr);
+    // progress may be null. A cancelled stage throws OperationCancelled and caches nothing.
+    std::shared_ptr<const std::vector<uint32_t>> palette(const PipelineSettings &settings, ProgressToken *progress = nullptr);
+    // Final pixels: dithered against the palette, or remapped to it when dithering is off
+    std::shared_ptr<const PixelBuffer> dithered(const PipelineSettings &settings, ProgressToken *progress = nullptr);
+    std::shared_ptr<const std::vector<uint8_t>> encoded(const PipelineSettings &settings, ProgressToken *progress = nullptr);
+
+    std::vector<PipelineStageStatistics> getStatistics() const;
+    void clear();
+
+    static std::string getStageName(Stage stage);
+
+private:
+    // The source a request started with; its stages keep using it even if setSource replaces it meanwhile
+    struct SourceRef
+    {
+        std::shared_ptr<const PixelBuffer> image;
+        uint64_t key;
+    };
+
+    SourceRef currentSource() const;
+    template <typename T, typename Compute>
+    std::shared_ptr<const T> cached(Stage stage, StageCache<T> &cache, uint64_t key, Compute &&compute);
+
+    static uint64_t resampleKey(const SourceRef &source, const PipelineSettings &settings);
+    static uint64_t paletteKey(const SourceRef &source, const PipelineSettings &settings);
+    static uint64_t ditherKey(const SourceRef &source, const PipelineSettings &settings);
+
+    std::shared_ptr<const PixelBuffer> resampled(const SourceRef &source, const PipelineSettings &settings, ProgressToken *progress);
+    std::shared_ptr<const ColorHistogram> histogram(const SourceRef &source, const PipelineSettings &settings, ProgressToken *progress);
+    std::shared_ptr<const std::vector<uint32_t>> palette(const SourceRef &source, const PipelineSettings &settings, ProgressToken *progress);
+    std::shared_ptr<const PixelBuffer> dithered(const SourceRef &source, const PipelineSettings &settings, ProgressToken *progress);
+
+    static PixelBuffer resample(ConstPixelView image, const PipelineSettings &settings, ProgressToken *progress);
+
+    mutable std::mutex mutex;
+    std::shared_ptr<const PixelBuffer> m_source;
+    uint64_t m_sourceKey = 0;
+
+    StageCache<PixelBuffer> m_resampled;
+    StageCache<ColorHistogram> m_histograms;
+    StageCache<std::vector<uint32_t>> m_palettes;
+    StageCache<PixelBuffer> m_dithered;
+    StageCache<std::vector<uint8_t>> m_encoded;
+    PipelineStageStatistics m_statistics[StageCount];
+};
@@ -31,13 +31,48 @@ std::vector<uint8_t> Converter::convertToBitmap(const std::vector<uint32_t> &inp
 
 std::vector<uint8_t> Converter::convertToHires(const std::vector<uint32_t> &inputImage, int width, int height)
 {
-    // TODO: Implement hires conversion
+    return encodeHires(inputImage, width, height).bitmap;
+}
+
+HiresResult Converter::encodeHires(const std::vector<uint32_t> &inputImage, int width, int height)
+{
     if (inputImage.empty() || width <= 0 || height <= 0)
     {
         throw std::invalid_argument("Invalid input parameters");
     }
-    // Placeholder implementation
-    return std::vector<uint8_t>(width * height / 8);
+    if (width % 8 != 0 || height % 8 != 0 || inputImage.size() < static_cast<size_t>(width) * height)
+    {
+        throw std::invalid_argument("Hires images must consist of whole 8x8 cells");
+    }
+
+    const int cellsX = width / 8;
+    const int cellsY = height / 8;
+
+    HiresResult result;
+    result.bitmap.resize(static_cast<size_t>(cellsX) * cellsY * 8);
+    result.colorRAM.resize(static_cast<size_t>(cellsX) * cellsY);
+
+    CellSolver solver(CellConstraints::c64Hires(), cellCache);
+    std::vector<CellSolution> solutions = solver.solveImage(solver.quantize(inputImage), width, height);
+
+    for (size_t charIndex = 0; charIndex < solutions.size(); ++charIndex)
+    {
+        const CellSolution &solution = solutions[charIndex];
+        std::copy(solution.bitmap.begin(), solution.bitmap.end(), result.bitmap.begin() + charIndex * 8);
+        result.colorRAM[charIndex] = static_cast<uint8_t>((solution.colors[1] << 4) | solution.colors[0]);
+    }
+
+    return result;
+}
+
+FliResult Converter::convertToFli(const std::vector<uint32_t> &inputImage, int width, int height, FliMode mode, const FliOptions &options)
+{
+    return FliEncoder::encode(inputImage, width, height, mode, options);
+}
+
+void Converter::setCellCache(std::shared_ptr<CellSolutionCache> cache)
+{
+    cellCache = std::move(cache);
 }
 
 std::vector<uint8_t> Converter::convertToMulticolor(const std::vector<uint32_t> &inputImage, int width, int height)
@@ -10,6 +10,9 @@
 #include <cstdint>
 #include <stdexcept>
 #include <iostream>
+#include <memory>
+#include "CellSolver.h"
+#include "FliEncoder.h"
 
 struct HiresResult
 {
@@ -38,5 +41,14 @@ public:
     std::vector<uint8_t> convertToHires(const std::vector<uint32_t> &inputImage, int width, int height);
     std::vector<uint8_t> convertToMulticolor(const std::vector<uint32_t> &inputImage, int width, int height);
 
+    // colorRAM holds the per-cell screen RAM byte (set bits in the high nibble, cleared bits in the low nibble)
+    HiresResult encodeHires(const std::vector<uint32_t> &inputImage, int width, int height);
+
+    // Width is in logical pixels: 160 for FLI/IFLI, 320 for AFLI
+    FliResult convertToFli(const std::vector<uint32_t> &inputImage, int width, int height, FliMode mode, const FliOptions &options = {});
+
+    void setCellCache(std::shared_ptr<CellSolutionCache> cache);
+
 private:
+    std::shared_ptr<CellSolutionCache> cellCache = CellSolutionCache::shared();
 };
\ No newline at end of file
@@ -5,6 +5,8 @@
 // Copyright (c) 2022 Volker Schwaberow
 
 #include "Dithering.h"
+#include "Metrics.h"
+#include <stdexcept>
 
 
 std::string Dithering::getAlgorithmName(DitheringAlgorithm algo)
@@ -22,18 +24,69 @@ std::string Dithering::getAlgorithmName(DitheringAlgorithm algo)
     }
 }
 
-std::vector<uint32_t> Dithering::applyDithering(const std::vector<uint32_t> &image, int width, int height, const std::vector<uint32_t> &palette, DitheringAlgorithm algo)
+std::vector<uint32_t> Dithering::applyDithering(const std::vector<uint32_t> &image, int width, int height, const std::vector<uint32_t> &palette, DitheringAlgorithm algo,
+                                                ProgressToken *progress)
 {
+    std::vector<uint32_t> result(image.size());
+    applyDithering(ConstPixelView(image, width, height), palette, algo, PixelView(result, width, height), progress);
+    return result;
+}
+
+PixelBuffer Dithering::applyDithering(ConstPixelView image, const std::vector<uint32_t> &palette, DitheringAlgorithm algo,
+                                      ProgressToken *progress)
+{
+    PixelBuffer result(image.width(), image.height());
+    applyDithering(image, palette, algo, result, progress);
+    return result;
+}
+
+void Dithering::applyDithering(ConstPixelView image, const std::vector<uint32_t> &palette, DitheringAlgorithm algo,
+                               PixelView output, ProgressToken *progress)
+{
+    dither(image, output, palette, nullptr, algo, progress);
+}
+
+PixelBuffer Dithering::applyDithering(ConstPixelView image, const NearestColorMap &map, DitheringAlgorithm algo, ProgressToken *progress)
+{
+    PixelBuffer result(image.width(), image.height());
+    dither(image, result, map.palette(), &map, algo, progress);
+    return result;
+}
+
+void Dithering::dither(ConstPixelView image, PixelView output, std::span<const uint32_t> palette, const NearestColorMap *map,
+                       DitheringAlgorithm algo, ProgressToken *progress)
+{
+    StageTimer timer("dither");
+    if (output.width() != image.width() || output.height() != image.height())
+    {
+        throw std::invalid_argument("Dithering output size does not match the image");
+    }
+
     switch (algo)
     {
     case DitheringAlgorithm::FloydSteinberg:
-        return floydSteinberg(image, width, height, palette);
+        floydSteinberg(image, output, palette, map, progress);
+        break;
     case DitheringAlgorithm::Bayer:
-        return bayer(image, width, height, palette);
+        bayer(image, output, palette, map, progress);
+        break;
     case DitheringAlgorithm::Ordered:
-        return ordered(image, width, height, palette);
+        ordered(image, output, palette, map, progress);
+        break;
     default:
-        return image;
+        for (int y = 0; y < image.height(); ++y)
+        {
+            std::copy(image.row(y).begin(), image.row(y).end(), output.row(y).begin());
+        }
+    }
+}
+
+void Dithering::rowCheckpoint(ProgressToken *progress, int y, int height)
+{
+    if (progress && (y & 7) == 0)
+    {
+        progress->checkpoint();
+        progress->report(static_cast<float>(y) / height);
     }
 }
 
@@ -76,7 +129,7 @@ void Dithering::distributeError(std::vector<std::array<float, 3>> &error, const
         int ny = y + offsets[i].second;
         if (nx >= 0 && nx < width && ny < height)
         {
-            int nindex = ny * width + nx;
+            int nindex = (ny & 1) * width + nx;
             for (int j = 0; j < 3; ++j)
             {
                 error[nindex][j] += err[j] * factors[i];
@@ -85,25 +138,30 @@ void Dithering::distributeError(std::vector<std::array<float, 3>> &error, const
     }
 }
 
-std::vector<uint32_t> Dithering::floydSteinberg(std::span<const uint32_t> image, int width, int height, std::span<const uint32_t> palette)
+void Dithering::floydSteinberg(ConstPixelView image, PixelView output, std::span<const uint32_t> palette, const NearestColorMap *map,
+                               ProgressToken *progress)
 {
-
-    std::vector<uint32_t> result(image.begin(), image.end());
-    std::vector<std::array<float, 3>> error(width * height, {0.0f, 0.0f, 0.0f});
+    const int width = image.width();
+    const int height = image.height();
+    // Error only ever flows into the next row, so two alternating rows are enough
+    std::vector<std::array<float, 3>> error(static_cast<size_t>(width) * 2, {0.0f, 0.0f, 0.0f});
 
     for (int y = 0; y < height; ++y)
     {
+        rowCheckpoint(progress, y, height);
+        std::span<const uint32_t> in = image.row(y);
+        std::span<uint32_t> out = output.row(y);
         for (int x = 0; x < width; ++x)
         {
-            int index = y * width + x;
-            auto [oldR, oldG, oldB] = getRGB(result[index]);
+            int index = (y & 1) * width + x;
+            auto [oldR, oldG, oldB] = getRGB(in[x]);
 
             oldR = std::clamp(oldR + static_cast<int>(error[index][0]), 0, 255);
             oldG = std::clamp(oldG + static_cast<int>(error[index][1]), 0, 255);
             oldB = std::clamp(oldB + static_cast<int>(error[index][2]), 0, 255);
 
-            uint32_t newPixel = findClosestColor(oldR, oldG, oldB, palette);
-            result[index] = newPixel;
+            uint32_t newPixel = findClosestColor(oldR, oldG, oldB, palette, map);
+            out[x] = newPixel;
 
             auto [newR, newG, newB] = getRGB(newPixel);
             std::array<float, 3> err = {
@@ -113,14 +171,15 @@ std::vector<uint32_t> Dithering::floydSteinberg(std::span<const uint32_t> image,
 
             distributeError(error, err, index, x, y, width, height);
         }
+        std::fill_n(error.begin() + static_cast<ptrdiff_t>(y & 1) * width, width, std::array<float, 3>{0.0f, 0.0f, 0.0f});
     }
-
-    return result;
 }
 
-std::vector<uint32_t> Dithering::bayer(const std::vector<uint32_t> &image, int width, int height, const std::vector<uint32_t> &palette)
+void Dithering::bayer(ConstPixelView image, PixelView output, std::span<const uint32_t> palette, const NearestColorMap *map,
+                      ProgressToken *progress)
 {
-    std::vector<uint32_t> result(image.size());
+    const int width = image.width();
+    const int height = image.height();
 
     const int bayerMatrix[4][4] = {
         {0, 8, 2, 10},
@@ -130,10 +189,12 @@ std::vector<uint32_t> Dithering::bayer(const std::vector<uint32_t> &image, int w
 
     for (int y = 0; y < height; ++y)
     {
+        rowCheckpoint(progress, y, height);
+        std::span<const uint32_t> in = image.row(y);
+        std::span<uint32_t> out = output.row(y);
         for (int x = 0; x < width; ++x)
         {
-            int index = y * width + x;
-            uint32_t pixel = image[index];
+            uint32_t pixel = in[x];
 
             std::array<int, 3> rgb = getRGB(pixel);
 
@@ -144,17 +205,16 @@ std::vector<uint32_t> Dithering::bayer(const std::vector<uint32_t> &image, int w
                 rgb[i] = std::clamp(rgb[i] + (threshold - 8) * 4, 0, 255);
             }
 
-            uint32_t newPixel = findClosestColor(rgb[0], rgb[1], rgb[2], palette);
-            result[index] = newPixel;
+            out[x] = findClosestColor(rgb[0], rgb[1], rgb[2], palette, map);
         }
     }
-
-    return result;
 }
 
-std::vector<uint32_t> Dithering::ordered(const std::vector<uint32_t> &image, int width, int height, const std::vector<uint32_t> &palette)
+void Dithering::ordered(ConstPixelView image, PixelView output, std::span<const uint32_t> palette, const NearestColorMap *map,
+                        ProgressToken *progress)
 {
-    std::vector<uint32_t> result(image.size());
+    const int width = image.width();
+    const int height = image.height();
 
     const int orderedMatrix[8][8] = {
         {0, 48, 12, 60, 3, 51, 15, 63},
@@ -168,10 +228,12 @@ std::vector<uint32_t> Dithering::ordered(const std::vector<uint32_t> &image, int
 
     for (int y = 0; y < height; ++y)
     {
+        rowCheckpoint(progress, y, height);
+        std::span<const uint32_t> in = image.row(y);
+        std::span<uint32_t> out = output.row(y);
         for (int x = 0; x < width; ++x)
         {
-            int index = y * width + x;
-            uint32_t pixel = image[index];
+            uint32_t pixel = in[x];
 
             std::array<int, 3> rgb = getRGB(pixel);
 
@@ -181,10 +243,7 @@ std::vector<uint32_t> Dithering::ordered(const std::vector<uint32_t> &image, int
                 rgb[i] = std::clamp(rgb[i] + (threshold - 32) * 2, 0, 255);
             }
 
-            uint32_t newPixel = findClosestColor(rgb[0], rgb[1], rgb[2], palette);
-            result[index] = newPixel;
+            out[x] = findClosestColor(rgb[0], rgb[1], rgb[2], palette, map);
         }
     }
-
-    return result;
 }
\ No newline at end of file
@@ -13,6 +13,9 @@
 #include <algorithm>
 #include <span>
 #include <string>
+#include "NearestColorMap.h"
+#include "ProgressToken.h"
+#include "PixelBuffer.h"
 
 enum class DitheringAlgorithm
 {
@@ -24,14 +27,34 @@ enum class DitheringAlgorithm
 class Dithering
 {
 public:
-    static std::vector<uint32_t> applyDithering(const std::vector<uint32_t> &image, int width, int height, const std::vector<uint32_t> &palette, DitheringAlgorithm algo);
+    // progress may be null; cancellation surfaces as OperationCancelled
+    static std::vector<uint32_t> applyDithering(const std::vector<uint32_t> &image, int width, int height, const std::vector<uint32_t> &palette, DitheringAlgorithm algo,
+                                                ProgressToken *progress = nullptr);
+    static PixelBuffer applyDithering(ConstPixelView image, const std::vector<uint32_t> &palette, DitheringAlgorithm algo,
+                                      ProgressToken *progress = nullptr);
+    static void applyDithering(ConstPixelView image, const std::vector<uint32_t> &palette, DitheringAlgorithm algo,
+                               PixelView output, ProgressToken *progress = nullptr);
+    // Same result, with nearest colors looked up in a map built once for many images
+    static PixelBuffer applyDithering(ConstPixelView image, const NearestColorMap &map, DitheringAlgorithm algo,
+                                      ProgressToken *progress = nullptr);
     static std::string getAlgorithmName(DitheringAlgorithm algo);
 
 private:
-    static std::vector<uint32_t> floydSteinberg(std::span<const uint32_t> image, int width, int height, std::span<const uint32_t> palette);
-    static std::vector<uint32_t> bayer(const std::vector<uint32_t> &image, int width, int height, const std::vector<uint32_t> &palette);
-    static std::vector<uint32_t> ordered(const std::vector<uint32_t> &image, int width, int height, const std::vector<uint32_t> &palette);
+    // `map`, when given, is built from `palette`
+    static void dither(ConstPixelView image, PixelView output, std::span<const uint32_t> palette, const NearestColorMap *map,
+                       DitheringAlgorithm algo, ProgressToken *progress);
+    static void floydSteinberg(ConstPixelView image, PixelView output, std::span<const uint32_t> palette, const NearestColorMap *map,
+                               ProgressToken *progress);
+    static void bayer(ConstPixelView image, PixelView output, std::span<const uint32_t> palette, const NearestColorMap *map,
+                      ProgressToken *progress);
+    static void ordered(ConstPixelView image, PixelView output, std::span<const uint32_t> palette, const NearestColorMap *map,
+                        ProgressToken *progress);
+    static void rowCheckpoint(ProgressToken *progress, int y, int height);
     static uint32_t findClosestColor(int r, int g, int b, std::span<const uint32_t> palette);
+    static uint32_t findClosestColor(int r, int g, int b, std::span<const uint32_t> palette, const NearestColorMap *map)
+    {
+        return map ? map->nearest(static_cast<uint32_t>(r << 16 | g << 8 | b)) : findClosestColor(r, g, b, palette);
+    }
     static void distributeError(std::vector<std::array<float, 3>> &error, const std::array<float, 3> &err,
                                 int index, int x, int y, int width, int height);
     static constexpr std::array<int, 3> getRGB(uint32_t pixel);
@@ -0,0 +1,88 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/EncoderRegistry.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include "EncoderRegistry.h"
+#include "KoalaConverter.h"
+#include "C64HiresConverter.h"
+#include "ZxSpectrumConverter.h"
+#include "AmstradCpcConverter.h"
+#include "AmigaIlbmConverter.h"
+#include "AtariStConverter.h"
+#include <stdexcept>
+
+EncoderRegistry &EncoderRegistry::instance()
+{
+    static EncoderRegistry registry;
+    static std::once_flag builtins;
+    std::call_once(builtins, []
+                   { registry.registerBuiltinEncoders(); });
+    return registry;
+}
+
+void EncoderRegistry::registerBuiltinEncoders()
+{
+    registerEncoder(KoalaConverter::capabilities(), []
+                    { return std::make_unique<KoalaConverter>(); });
+    registerEncoder(C64HiresConverter::capabilities(), []
+                    { return std::make_unique<C64HiresConverter>(); });
+    registerEncoder(ZxSpectrumConverter::capabilities(), []
+                    { return std::make_unique<ZxSpectrumConverter>(); });
+    for (int mode = 0; mode <= 2; ++mode)
+    {
+        registerEncoder(AmstradCpcConverter::capabilities(mode), [mode]
+                        { return std::make_unique<AmstradCpcConverter>(mode); });
+    }
+    registerEncoder(AmigaIlbmConverter::capabilities(), []
+                    { return std::make_unique<AmigaIlbmConverter>(); });
+    registerEncoder(AtariStConverter::capabilities(), []
+                    { return std::make_unique<AtariStConverter>(); });
+}
+
+void EncoderRegistry::registerEncoder(const EncoderCapabilities &capabilities, Factory factory)
+{
+    if (capabilities.name.empty() || !factory)
+    {
+        throw std::invalid_argument("Encoders need a name and a factory");
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    entries[capabilities.name] = Entry{capabilities, std::move(factory)};
+}
+
+std::unique_ptr<ImageConverter> EncoderRegistry::create(const std::string &name) const
+{
+    Factory factory;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(name);
+        if (it == entries.end())
+        {
+            throw std::invalid_argument("Unknown encoder: " + name);
+        }
+        factory = it->second.factory;
+    }
+    return factory();
+}
+
+std::optional<EncoderCapabilities> EncoderRegistry::find(const std::string &name) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(name);
+    if (it == entries.end())
+        return std::nullopt;
+    return it->second.capabilities;
+}
+
+std::vector<EncoderCapabilities> EncoderRegistry::list() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<EncoderCapabilities> result;
+    result.reserve(entries.size());
+    for (const auto &[name, entry] : entries)
+    {
+        result.push_back(entry.capabilities);
+    }
+    return result;
+}
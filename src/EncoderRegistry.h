@@ -0,0 +1,43 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/EncoderRegistry.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include "ImageConverter.h"
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+class EncoderRegistry
+{
+public:
+    using Factory = std::function<std::unique_ptr<ImageConverter>()>;
+
+    // The built-in encoders are registered on first use
+    static EncoderRegistry &instance();
+
+    void registerEncoder(const EncoderCapabilities &capabilities, Factory factory);
+    std::unique_ptr<ImageConverter> create(const std::string &name) const;
+    std::optional<EncoderCapabilities> find(const std::string &name) const;
+    std::vector<EncoderCapabilities> list() const;
+
+private:
+    EncoderRegistry() = default;
+    void registerBuiltinEncoders();
+
+    struct Entry
+    {
+        EncoderCapabilities capabilities;
+        Factory factory;
+    };
+
+    mutable std::mutex mutex;
+    std::map<std::string, Entry> entries;
+};
@@ -0,0 +1,478 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/FliEncoder.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include "FliEncoder.h"
+#include "C64Palette.h"
+#include "Parallel.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+
+namespace
+{
+    constexpr int COLORS = C64Palette::COLOR_COUNT;
+    using ColorCosts = std::array<int32_t, COLORS>;
+    using Clock = std::chrono::steady_clock;
+
+    class Deadline
+    {
+    public:
+        explicit Deadline(std::chrono::milliseconds budget)
+            : enabled(budget.count() > 0), end(Clock::now() + budget) {}
+
+        bool expired() const { return enabled && Clock::now() >= end; }
+
+    private:
+        bool enabled;
+        Clock::time_point end;
+    };
+
+    int luma(uint32_t color)
+    {
+        return (299 * static_cast<int>((color >> 16) & 0xFF) + 587 * static_cast<int>((color >> 8) & 0xFF) +
+                114 * static_cast<int>(color & 0xFF)) /
+               1000;
+    }
+
+    uint32_t mix(uint32_t a, uint32_t b)
+    {
+        uint32_t r = (((a >> 16) & 0xFF) + ((b >> 16) & 0xFF) + 1) / 2;
+        uint32_t g = (((a >> 8) & 0xFF) + ((b >> 8) & 0xFF) + 1) / 2;
+        uint32_t bl = ((a & 0xFF) + (b & 0xFF) + 1) / 2;
+        return (r << 16) | (g << 8) | bl;
+    }
+
+    struct FrameLayout
+    {
+        int width;
+        int height;
+        bool multicolor;
+        int cellWidth;
+        int cellsX;
+        int cellsY;
+
+        FrameLayout(int width, int height, bool multicolor)
+            : width(width), height(height), multicolor(multicolor), cellWidth(multicolor ? 4 : 8),
+              cellsX(width / (multicolor ? 4 : 8)), cellsY(height / 8) {}
+
+        size_t pixel(int cellX, int cellY, int line, int x) const
+        {
+            return static_cast<size_t>(cellY * 8 + line) * width + cellX * cellWidth + x;
+        }
+    };
+
+    FliFrame makeFrame(const FrameLayout &layout, uint8_t background)
+    {
+        size_t cells = static_cast<size_t>(layout.cellsX) * layout.cellsY;
+        FliFrame frame;
+        frame.bitmap.assign(cells * 8, 0);
+        for (auto &screen : frame.screenRAM)
+        {
+            screen.assign(cells, 0);
+        }
+        if (layout.multicolor)
+            frame.colorRAM.assign(cells, 0);
+        frame.background = background;
+        return frame;
+    }
+
+    // Cheapest pair of screen RAM colors for one rasterline of a cell. base holds the
+    // per-pixel cost of the colors that are already available (background, color RAM).
+    int64_t bestLinePair(const std::vector<ColorCosts> &costs, const size_t *pixels, const int32_t *base, int count,
+                         uint8_t &outA, uint8_t &outB)
+    {
+        int64_t best = std::numeric_limits<int64_t>::max();
+        for (int a = 0; a < COLORS; ++a)
+        {
+            for (int b = a + 1; b < COLORS; ++b)
+            {
+                int64_t sum = 0;
+                for (int i = 0; i < count && sum < best; ++i)
+                {
+                    const ColorCosts &c = costs[pixels[i]];
+                    sum += std::min(base[i], std::min(c[a], c[b]));
+                }
+                if (sum < best)
+                {
+                    best = sum;
+                    outA = static_cast<uint8_t>(a);
+                    outB = static_cast<uint8_t>(b);
+                }
+            }
+        }
+        return best;
+    }
+
+    struct CellChoice
+    {
+        uint8_t colorRam = 0;
+        std::array<std::array<uint8_t, 2>, 8> pairs{};
+        int64_t cost = std::numeric_limits<int64_t>::max();
+    };
+
+    CellChoice solveMulticolorCell(const std::vector<ColorCosts> &costs, const FrameLayout &layout, int cellX, int cellY,
+                                   uint8_t background, int firstColorRam, int lastColorRam)
+    {
+        CellChoice best;
+        size_t pixels[4];
+        int32_t base[4];
+        for (int c3 = firstColorRam; c3 <= lastColorRam; ++c3)
+        {
+            CellChoice candidate;
+            candidate.colorRam = static_cast<uint8_t>(c3);
+            candidate.cost = 0;
+            for (int line = 0; line < 8 && candidate.cost < best.cost; ++line)
+            {
+                for (int x = 0; x < 4; ++x)
+                {
+                    pixels[x] = layout.pixel(cellX, cellY, line, x);
+                    base[x] = std::min(costs[pixels[x]][background], costs[pixels[x]][c3]);
+                }
+                candidate.cost += bestLinePair(costs, pixels, base, 4, candidate.pairs[line][0], candidate.pairs[line][1]);
+            }
+            if (candidate.cost < best.cost)
+                best = candidate;
+        }
+        return best;
+    }
+
+    uint8_t greedyColorRam(const std::vector<ColorCosts> &costs, const FrameLayout &layout, int cellX, int cellY, uint8_t background)
+    {
+        int64_t bestCost = std::numeric_limits<int64_t>::max();
+        uint8_t best = background;
+        for (int c = 0; c < COLORS; ++c)
+        {
+            int64_t sum = 0;
+            for (int line = 0; line < 8; ++line)
+            {
+                for (int x = 0; x < 4; ++x)
+                {
+                    const ColorCosts &pc = costs[layout.pixel(cellX, cellY, line, x)];
+                    sum += std::min(pc[background], pc[c]);
+                }
+            }
+            if (sum < bestCost)
+            {
+                bestCost = sum;
+                best = static_cast<uint8_t>(c);
+            }
+        }
+        return best;
+    }
+
+    void writeMulticolorCell(const std::vector<ColorCosts> &costs, const FrameLayout &layout, int cellX, int cellY,
+                             const CellChoice &choice, FliFrame &frame)
+    {
+        size_t cellIndex = static_cast<size_t>(cellY) * layout.cellsX + cellX;
+        frame.colorRAM[cellIndex] = choice.colorRam;
+        for (int line = 0; line < 8; ++line)
+        {
+            std::array<uint8_t, 4> slots = {frame.background, choice.pairs[line][0], choice.pairs[line][1], choice.colorRam};
+            uint8_t byte = 0;
+            for (int x = 0; x < 4; ++x)
+            {
+                const ColorCosts &pc = costs[layout.pixel(cellX, cellY, line, x)];
+                int bestSlot = 0;
+                for (int slot = 1; slot < 4; ++slot)
+                {
+                    if (pc[slots[slot]] < pc[slots[bestSlot]])
+                        bestSlot = slot;
+                }
+                byte |= static_cast<uint8_t>(bestSlot << (6 - x * 2));
+            }
+            frame.bitmap[cellIndex * 8 + line] = byte;
+            frame.screenRAM[line][cellIndex] = static_cast<uint8_t>((choice.pairs[line][0] << 4) | choice.pairs[line][1]);
+        }
+    }
+
+    int64_t solveHiresCell(const std::vector<ColorCosts> &costs, const FrameLayout &layout, int cellX, int cellY, FliFrame &frame)
+    {
+        size_t cellIndex = static_cast<size_t>(cellY) * layout.cellsX + cellX;
+        size_t pixels[8];
+        int32_t base[8];
+        std::fill(std::begin(base), std::end(base), std::numeric_limits<int32_t>::max());
+        int64_t total = 0;
+        for (int line = 0; line < 8; ++line)
+        {
+            for (int x = 0; x < 8; ++x)
+            {
+                pixels[x] = layout.pixel(cellX, cellY, line, x);
+            }
+            uint8_t a = 0, b = 0;
+            total += bestLinePair(costs, pixels, base, 8, a, b);
+
+            uint8_t byte = 0;
+            for (int x = 0; x < 8; ++x)
+            {
+                if (costs[pixels[x]][a] < costs[pixels[x]][b])
+                    byte |= static_cast<uint8_t>(0x80 >> x);
+            }
+            frame.bitmap[cellIndex * 8 + line] = byte;
+            frame.screenRAM[line][cellIndex] = static_cast<uint8_t>((a << 4) | b);
+        }
+        return total;
+    }
+
+    // Greedy pass over every cell, then exhaustive color RAM search starting with the worst
+    // cells until the deadline. The frame is a valid encoding at every point.
+    int64_t solveFrame(const std::vector<ColorCosts> &costs, const FrameLayout &layout, const Deadline &deadline,
+                       int threads, FliFrame &frame, bool &complete)
+    {
+        size_t cells = static_cast<size_t>(layout.cellsX) * layout.cellsY;
+        std::vector<int64_t> cellCost(cells, 0);
+
+        Parallel::forEach(static_cast<size_t>(layout.cellsY), threads, [&](size_t row)
+                          {
+            int cellY = static_cast<int>(row);
+            for (int cellX = 0; cellX < layout.cellsX; ++cellX)
+            {
+                size_t cellIndex = static_cast<size_t>(cellY) * layout.cellsX + cellX;
+                if (layout.multicolor)
+                {
+                    uint8_t c3 = greedyColorRam(costs, layout, cellX, cellY, frame.background);
+                    CellChoice choice = solveMulticolorCell(costs, layout, cellX, cellY, frame.background, c3, c3);
+                    writeMulticolorCell(costs, layout, cellX, cellY, choice, frame);
+                    cellCost[cellIndex] = choice.cost;
+                }
+                else
+                {
+                    cellCost[cellIndex] = solveHiresCell(costs, layout, cellX, cellY, frame);
+                }
+            } });
+
+        if (layout.multicolor)
+        {
+            std::vector<size_t> order(cells);
+            std::iota(order.begin(), order.end(), 0);
+            std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+                             { return cellCost[a] > cellCost[b]; });
+
+            std::atomic<bool> budgetHit{false};
+            Parallel::forEach(cells, threads, [&](size_t k)
+                              {
+                size_t cellIndex = order[k];
+                if (cellCost[cellIndex] == 0)
+                    return;
+                if (deadline.expired())
+                {
+                    budgetHit = true;
+                    return;
+                }
+                int cellX = static_cast<int>(cellIndex % layout.cellsX);
+                int cellY = static_cast<int>(cellIndex / layout.cellsX);
+                CellChoice choice = solveMulticolorCell(costs, layout, cellX, cellY, frame.background, 0, COLORS - 1);
+                if (choice.cost < cellCost[cellIndex])
+                {
+                    writeMulticolorCell(costs, layout, cellX, cellY, choice, frame);
+                    cellCost[cellIndex] = choice.cost;
+                } });
+            if (budgetHit)
+                complete = false;
+        }
+
+        return std::accumulate(cellCost.begin(), cellCost.end(), int64_t{0});
+    }
+
+    std::vector<uint8_t> decodeFrame(const FliFrame &frame, const FrameLayout &layout)
+    {
+        std::vector<uint8_t> indices(static_cast<size_t>(layout.width) * layout.height);
+        for (int cellY = 0; cellY < layout.cellsY; ++cellY)
+        {
+            for (int cellX = 0; cellX < layout.cellsX; ++cellX)
+            {
+                size_t cellIndex = static_cast<size_t>(cellY) * layout.cellsX + cellX;
+                for (int line = 0; line < 8; ++line)
+                {
+                    uint8_t byte = frame.bitmap[cellIndex * 8 + line];
+                    uint8_t screen = frame.screenRAM[line][cellIndex];
+                    for (int x = 0; x < layout.cellWidth; ++x)
+                    {
+                        uint8_t color;
+                        if (layout.multicolor)
+                        {
+                            int bits = (byte >> (6 - x * 2)) & 3;
+                            color = bits == 0   ? frame.background
+                                    : bits == 1 ? static_cast<uint8_t>(screen >> 4)
+                                    : bits == 2 ? static_cast<uint8_t>(screen & 0x0F)
+                                                : static_cast<uint8_t>(frame.colorRAM[cellIndex] & 0x0F);
+                        }
+                        else
+                        {
+                            color = (byte & (0x80 >> x)) ? static_cast<uint8_t>(screen >> 4) : static_cast<uint8_t>(screen & 0x0F);
+                        }
+                        indices[layout.pixel(cellX, cellY, line, x)] = color;
+                    }
+                }
+            }
+        }
+        return indices;
+    }
+
+    // Cost of showing palette color c in this frame while the other frame shows other[p]
+    std::vector<ColorCosts> interlacedCosts(const std::vector<uint32_t> &image, const std::vector<uint8_t> &other, float flickerWeight)
+    {
+        std::array<std::array<uint32_t, COLORS>, COLORS> mixed{};
+        std::array<std::array<int32_t, COLORS>, COLORS> flicker{};
+        for (int a = 0; a < COLORS; ++a)
+        {
+            for (int b = 0; b < COLORS; ++b)
+            {
+                mixed[a][b] = mix(C64Palette::COLORS[a], C64Palette::COLORS[b]);
+                int dy = luma(C64Palette::COLORS[a]) - luma(C64Palette::COLORS[b]);
+                flicker[a][b] = static_cast<int32_t>(flickerWeight * static_cast<float>(dy * dy));
+            }
+        }
+
+        std::vector<ColorCosts> costs(image.size());
+        for (size_t p = 0; p < image.size(); ++p)
+        {
+            uint8_t o = other[p];
+            for (int c = 0; c < COLORS; ++c)
+            {
+                costs[p][c] = C64Palette::distance(image[p] & 0xFFFFFF, mixed[c][o]) + flicker[c][o];
+            }
+        }
+        return costs;
+    }
+}
+
+std::string FliEncoder::getModeName(FliMode mode)
+{
+    switch (mode)
+    {
+    case FliMode::Fli:
+        return "FLI";
+    case FliMode::Afli:
+        return "AFLI";
+    case FliMode::Ifli:
+        return "IFLI";
+    default:
+        return "Unknown";
+    }
+}
+
+FliResult FliEncoder::encode(const std::vector<uint32_t> &image, int width, int height, FliMode mode, const FliOptions &options)
+{
+    bool multicolor = mode != FliMode::Afli;
+    int cellWidth = multicolor ? 4 : 8;
+    if (image.empty() || width <= 0 || height <= 0)
+    {
+        throw std::invalid_argument("Invalid input parameters");
+    }
+    if (width % cellWidth != 0 || height % 8 != 0 || image.size() < static_cast<size_t>(width) * height)
+    {
+        throw std::invalid_argument(getModeName(mode) + " images must consist of whole cells");
+    }
+
+    auto start = Clock::now();
+    Deadline deadline(options.timeBudget);
+    FrameLayout layout(width, height, multicolor);
+    size_t pixelCount = static_cast<size_t>(width) * height;
+
+    std::vector<ColorCosts> costs(pixelCount);
+    std::vector<uint8_t> nearest(pixelCount);
+    std::array<size_t, COLORS> histogram{};
+    for (size_t p = 0; p < pixelCount; ++p)
+    {
+        for (int c = 0; c < COLORS; ++c)
+        {
+            costs[p][c] = C64Palette::distance(image[p] & 0xFFFFFF, C64Palette::COLORS[c]);
+        }
+        nearest[p] = C64Palette::nearestIndex(image[p] & 0xFFFFFF);
+        ++histogram[nearest[p]];
+    }
+    uint8_t background = multicolor ? static_cast<uint8_t>(std::max_element(histogram.begin(), histogram.end()) - histogram.begin()) : 0;
+
+    FliResult result;
+    result.mode = mode;
+    result.width = width;
+    result.height = height;
+
+    FliFrame first = makeFrame(layout, background);
+    bool complete = true;
+    int64_t error = solveFrame(costs, layout, deadline, options.threads, first, complete);
+    result.passes = 1;
+
+    if (mode != FliMode::Ifli)
+    {
+        result.frames.push_back(std::move(first));
+    }
+    else
+    {
+        // Alternate between the frames: each one is re-solved against the blend with the other
+        FliFrame second = first;
+        error = std::numeric_limits<int64_t>::max();
+        bool solveSecond = true;
+
+        for (int pass = 0; pass < std::max(1, options.maxPasses); ++pass)
+        {
+            FliFrame &target = solveSecond ? second : first;
+            const FliFrame &fixed = solveSecond ? first : second;
+            std::vector<ColorCosts> blendCosts = interlacedCosts(image, decodeFrame(fixed, layout), options.flickerWeight);
+
+            FliFrame candidate = makeFrame(layout, background);
+            bool passComplete = true;
+            int64_t passError = solveFrame(blendCosts, layout, deadline, options.threads, candidate, passComplete);
+            ++result.passes;
+            if (!passComplete)
+                complete = false;
+
+            SPDLOG_DEBUG("IFLI pass {}: error {}", result.passes, passError);
+            if (passError >= error)
+                break;
+            error = passError;
+            target = std::move(candidate);
+            solveSecond = !solveSecond;
+
+            if (deadline.expired())
+            {
+                complete = false;
+                break;
+            }
+        }
+
+        result.frames.push_back(std::move(first));
+        result.frames.push_back(std::move(second));
+    }
+
+    result.error = static_cast<uint64_t>(error);
+    result.complete = complete;
+
+    spdlog::info("{} encode {}x{}: error {}, {} passes, {} in {:.1f} ms", getModeName(mode), width, height, result.error,
+                 result.passes, complete ? "complete" : "budget exhausted",
+                 std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+    return result;
+}
+
+std::vector<uint32_t> FliEncoder::render(const FliResult &result)
+{
+    std::vector<uint32_t> pixels;
+    if (result.frames.empty())
+        return pixels;
+
+    FrameLayout layout(result.width, result.height, result.mode != FliMode::Afli);
+    std::vector<uint8_t> first = decodeFrame(result.frames[0], layout);
+    pixels.resize(first.size());
+    if (result.frames.size() == 1)
+    {
+        for (size_t i = 0; i < first.size(); ++i)
+        {
+            pixels[i] = C64Palette::COLORS[first[i]];
+        }
+    }
+    else
+    {
+        std::vector<uint8_t> second = decodeFrame(result.frames[1], layout);
+        for (size_t i = 0; i < first.size(); ++i)
+        {
+            pixels[i] = mix(C64Palette::COLORS[first[i]], C64Palette::COLORS[second[i]]);
+        }
+    }
+    return pixels;
+}
@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/FliEncoder.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class FliMode
+{
+    Fli,  // multicolor, screen RAM switched every rasterline
+    Afli, // hires, screen RAM switched every rasterline
+    Ifli  // two interlaced FLI frames blended by flicker
+};
+
+struct FliOptions
+{
+    // Zero means no limit: every cell gets the exhaustive search
+    std::chrono::milliseconds timeBudget{0};
+    // Zero means std::thread::hardware_concurrency()
+    int threads = 0;
+    // Alternating frame refinements for IFLI
+    int maxPasses = 4;
+    // Penalty for luminance differences between the two IFLI frames
+    float flickerWeight = 0.5f;
+};
+
+// Per-line screen RAMs are stored as screenRAM[line][cell], line being the rasterline within the cell row.
+struct FliFrame
+{
+    std::vector<uint8_t> bitmap;
+    std::array<std::vector<uint8_t>, 8> screenRAM;
+    std::vector<uint8_t> colorRAM;
+    uint8_t background = 0;
+};
+
+struct FliResult
+{
+    FliMode mode = FliMode::Fli;
+    int width = 0;
+    int height = 0;
+    std::vector<FliFrame> frames;
+    uint64_t error = 0;
+    int passes = 0;
+    // False when the time budget ran out before every cell got the full search
+    bool complete = true;
+};
+
+class FliEncoder
+{
+public:
+    // Width is in logical pixels: 160 for FLI/IFLI (double-wide), 320 for AFLI
+    static FliResult encode(const std::vector<uint32_t> &image, int width, int height, FliMode mode, const FliOptions &options = {});
+    // Renders the result as 0x00RRGGBB pixels; IFLI frames are averaged
+    static std::vector<uint32_t> render(const FliResult &result);
+    static std::string getModeName(FliMode mode);
+};
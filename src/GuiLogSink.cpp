@@ -5,23 +5,128 @@
 // Copyright (c) 2022 Volker Schwaberow
 
 #include "GuiLogSink.h"
+#include <spdlog/details/os.h>
+#include <spdlog/fmt/chrono.h>
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <thread>
 
-GuiLogSink::GuiLogSink() {}
+GuiLogSink::GuiLogSink() : m_slots(std::make_unique<Slot[]>(CAPACITY)) {}
 
-const std::deque<LogMessage> &GuiLogSink::getLogBuffer() const
+void GuiLogSink::log(const spdlog::details::log_msg &msg)
 {
-    return logBuffer;
+    if (!should_log(msg.level))
+    {
+        return;
+    }
+
+    // Formatted on the logging thread into the inline buffer, no heap allocation for lines
+    // that fit into a slot anyway
+    std::tm time = spdlog::details::os::localtime(std::chrono::system_clock::to_time_t(msg.time));
+    auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(msg.time.time_since_epoch()).count() % 1000;
+    spdlog::string_view_t level = spdlog::level::to_string_view(msg.level);
+    spdlog::memory_buf_t formatted;
+    fmt::format_to(std::back_inserter(formatted), "[{:%H:%M:%S}.{:03}] [{}] ", time, millis,
+                   std::string_view(level.data(), level.size()));
+    formatted.append(msg.payload.data(), msg.payload.data() + msg.payload.size());
+
+    char text[MESSAGE_BYTES] = {};
+    size_t length = std::min(formatted.size(), MESSAGE_BYTES);
+    std::memcpy(text, formatted.data(), length);
+
+    uint64_t index = m_head.fetch_add(1, std::memory_order_relaxed);
+    Slot &slot = m_slots[index % CAPACITY];
+    uint64_t writing = 2 * index + 1;
+    uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    while (true)
+    {
+        if (sequence >= writing)
+        {
+            // A writer a full lap ahead already reused the slot; this message is stale
+            return;
+        }
+        if (sequence & 1)
+        {
+            // The previous lap is still being written, only possible with CAPACITY messages in flight
+            std::this_thread::yield();
+            sequence = slot.sequence.load(std::memory_order_relaxed);
+            continue;
+        }
+        if (slot.sequence.compare_exchange_weak(sequence, writing, std::memory_order_relaxed))
+        {
+            break;
+        }
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.level.store(static_cast<int>(msg.level), std::memory_order_relaxed);
+    slot.length.store(static_cast<uint32_t>(length), std::memory_order_relaxed);
+    for (size_t w = 0; w < WORDS; ++w)
+    {
+        uint64_t word;
+        std::memcpy(&word, text + w * sizeof(uint64_t), sizeof(uint64_t));
+        slot.text[w].store(word, std::memory_order_relaxed);
+    }
+    slot.sequence.store(writing + 1, std::memory_order_release);
 }
 
-void GuiLogSink::sink_it_(const spdlog::details::log_msg &msg)
+size_t GuiLogSink::readSince(uint64_t &cursor, std::vector<LogMessage> &out) const
 {
-    spdlog::memory_buf_t formatted;
-    spdlog::sinks::base_sink<std::mutex>::formatter_->format(msg, formatted);
-    logBuffer.push_back({msg.level, fmt::to_string(formatted)});
-    if (logBuffer.size() > MAX_LOG_BUFFER_SIZE)
+    uint64_t head = m_head.load(std::memory_order_acquire);
+    uint64_t first = std::max(cursor, head > CAPACITY ? head - CAPACITY : 0);
+    size_t lost = static_cast<size_t>(first - std::min(cursor, first));
+    cursor = first;
+
+    char text[MESSAGE_BYTES];
+    for (uint64_t index = first; index < head; ++index)
     {
-        logBuffer.pop_front();
+        const Slot &slot = m_slots[index % CAPACITY];
+        uint64_t complete = 2 * index + 2;
+        uint64_t before = slot.sequence.load(std::memory_order_acquire);
+        if (before < complete)
+        {
+            // Claimed but not written yet; pick it up on the next call
+            break;
+        }
+
+        int level = slot.level.load(std::memory_order_relaxed);
+        size_t length = std::min<size_t>(slot.length.load(std::memory_order_relaxed), MESSAGE_BYTES);
+        for (size_t w = 0; w < WORDS; ++w)
+        {
+            uint64_t word = slot.text[w].load(std::memory_order_relaxed);
+            std::memcpy(text + w * sizeof(uint64_t), &word, sizeof(uint64_t));
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t after = slot.sequence.load(std::memory_order_relaxed);
+
+        cursor = index + 1;
+        if (before != complete || after != complete)
+        {
+            // Overwritten by a newer message while or before it was copied
+            ++lost;
+            continue;
+        }
+        out.push_back({static_cast<spdlog::level::level_enum>(level), std::string(text, length)});
     }
+    return lost;
+}
+
+std::vector<LogMessage> GuiLogSink::snapshot() const
+{
+    std::vector<LogMessage> messages;
+    uint64_t cursor = 0;
+    readSince(cursor, messages);
+    return messages;
 }
 
-void GuiLogSink::flush_() {}
\ No newline at end of file
+uint64_t GuiLogSink::published() const
+{
+    return m_head.load(std::memory_order_relaxed);
+}
+
+void GuiLogSink::flush() {}
+
+void GuiLogSink::set_pattern(const std::string &) {}
+
+void GuiLogSink::set_formatter(std::unique_ptr<spdlog::formatter>) {}
@@ -6,10 +6,13 @@
 
 #pragma once
 
-#include <spdlog/sinks/base_sink.h>
-#include <deque>
-#include <mutex>
-#include <new>
+#include <spdlog/sinks/sink.h>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
 
 struct LogMessage
 {
@@ -17,17 +20,45 @@ struct LogMessage
     std::string message;
 };
 
-class GuiLogSink : public spdlog::sinks::base_sink<std::mutex>
+// Keeps the most recent CAPACITY log lines for the debug window. Any number of threads
+// log without taking a lock: each message claims the next slot of a preallocated ring
+// and publishes it with a per-slot sequence number, the reader copies finished slots and
+// skips ones that are being rewritten. Lines are "[HH:MM:SS.mmm] [level] text", cut at
+// MESSAGE_BYTES; set_pattern and set_formatter do not apply to this sink.
+class GuiLogSink : public spdlog::sinks::sink
 {
 public:
+    static constexpr size_t CAPACITY = 1024;
+    static constexpr size_t MESSAGE_BYTES = 256;
+
     GuiLogSink();
-    const std::deque<LogMessage> &getLogBuffer() const;
 
-protected:
-    void sink_it_(const spdlog::details::log_msg &msg) override;
-    void flush_() override;
+    // Appends the messages published since cursor to out and advances cursor past them.
+    // Returns how many were overwritten before they could be read. Start with cursor 0.
+    size_t readSince(uint64_t &cursor, std::vector<LogMessage> &out) const;
+    // All messages still in the ring, oldest first
+    std::vector<LogMessage> snapshot() const;
+    // Number of messages logged so far
+    uint64_t published() const;
+
+    void log(const spdlog::details::log_msg &msg) override;
+    void flush() override;
+    void set_pattern(const std::string &pattern) override;
+    void set_formatter(std::unique_ptr<spdlog::formatter> formatter) override;
 
 private:
-    std::deque<LogMessage> logBuffer;
-    const size_t MAX_LOG_BUFFER_SIZE = 1000;
+    static constexpr size_t WORDS = MESSAGE_BYTES / sizeof(uint64_t);
+
+    struct Slot
+    {
+        // 2 * index + 1 while message index is written, 2 * index + 2 once it is complete
+        std::atomic<uint64_t> sequence{0};
+        std::atomic<int> level{0};
+        std::atomic<uint32_t> length{0};
+        // Stored word by word so a reader racing a writer sees torn text, never undefined behavior
+        std::array<std::atomic<uint64_t>, WORDS> text{};
+    };
+
+    std::atomic<uint64_t> m_head{0};
+    std::unique_ptr<Slot[]> m_slots;
 };
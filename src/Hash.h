@@ -0,0 +1,121 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/Hash.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+// XXH64 (xxHash, 64-bit variant). Small and fast enough to hash cell contents,
+// stage parameters and whole source files with the same function.
+namespace Hash
+{
+    constexpr uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+    constexpr uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+    constexpr uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+    constexpr uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+    constexpr uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+    inline uint64_t rotl(uint64_t x, int r)
+    {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    inline uint64_t read64(const uint8_t *p)
+    {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    inline uint32_t read32(const uint8_t *p)
+    {
+        uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    inline uint64_t round(uint64_t acc, uint64_t input)
+    {
+        acc += input * PRIME64_2;
+        acc = rotl(acc, 31);
+        return acc * PRIME64_1;
+    }
+
+    inline uint64_t mergeRound(uint64_t acc, uint64_t val)
+    {
+        acc ^= round(0, val);
+        return acc * PRIME64_1 + PRIME64_4;
+    }
+
+    inline uint64_t xxh64(const void *data, size_t length, uint64_t seed = 0)
+    {
+        const uint8_t *p = static_cast<const uint8_t *>(data);
+        const uint8_t *end = p + length;
+        uint64_t h;
+
+        if (length >= 32)
+        {
+            uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+            uint64_t v2 = seed + PRIME64_2;
+            uint64_t v3 = seed;
+            uint64_t v4 = seed - PRIME64_1;
+            const uint8_t *limit = end - 32;
+            do
+            {
+                v1 = round(v1, read64(p));
+                v2 = round(v2, read64(p + 8));
+                v3 = round(v3, read64(p + 16));
+                v4 = round(v4, read64(p + 24));
+                p += 32;
+            } while (p <= limit);
+
+            h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+            h = mergeRound(h, v1);
+            h = mergeRound(h, v2);
+            h = mergeRound(h, v3);
+            h = mergeRound(h, v4);
+        }
+        else
+        {
+            h = seed + PRIME64_5;
+        }
+
+        h += static_cast<uint64_t>(length);
+
+        while (p + 8 <= end)
+        {
+            h ^= round(0, read64(p));
+            h = rotl(h, 27) * PRIME64_1 + PRIME64_4;
+            p += 8;
+        }
+        if (p + 4 <= end)
+        {
+            h ^= static_cast<uint64_t>(read32(p)) * PRIME64_1;
+            h = rotl(h, 23) * PRIME64_2 + PRIME64_3;
+            p += 4;
+        }
+        while (p < end)
+        {
+            h ^= (*p) * PRIME64_5;
+            h = rotl(h, 11) * PRIME64_1;
+            ++p;
+        }
+
+        h ^= h >> 33;
+        h *= PRIME64_2;
+        h ^= h >> 29;
+        h *= PRIME64_3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    inline uint64_t combine(uint64_t seed, uint64_t value)
+    {
+        return seed ^ (value + 0x9E3779B97F4A7C15ULL + (seed << 6) + (seed >> 2));
+    }
+}
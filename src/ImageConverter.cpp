@@ -0,0 +1,44 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/ImageConverter.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include "ImageConverter.h"
+#include <spdlog/spdlog.h>
+#include <fstream>
+#include <stdexcept>
+
+void ImageConverter::convertImage(const std::vector<uint32_t> &pixels, int width, int height)
+{
+    if (width < 0 || height < 0 || pixels.size() < static_cast<size_t>(width) * height)
+    {
+        throw std::runtime_error("Not enough pixel data for conversion");
+    }
+    convertImage(ConstPixelView(pixels.data(), width, height, width));
+}
+
+void ImageConverter::saveFile(const std::string &filename) const
+{
+    writeFile(filename, getFileData());
+}
+
+void ImageConverter::writeFile(const std::string &filename, const std::vector<uint8_t> &data)
+{
+    std::ofstream file;
+    // Without a stream buffer the single write below goes straight to the OS
+    file.rdbuf()->pubsetbuf(nullptr, 0);
+    file.open(filename, std::ios::binary);
+    if (!file)
+    {
+        spdlog::error("Unable to open {} for writing", filename);
+        throw std::runtime_error("Unable to open file for writing");
+    }
+
+    file.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()));
+    if (!file)
+    {
+        spdlog::error("Error writing {} bytes to {}", data.size(), filename);
+        throw std::runtime_error("Error writing to file");
+    }
+}
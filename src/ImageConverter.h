@@ -9,11 +9,38 @@
 #include <vector>
 #include <string>
 #include <cstdint>
+#include "PixelBuffer.h"
+
+// Describes what an encoder produces. width/height are zero for formats that accept any
+// size, cellWidth/cellHeight/colorsPerCell are zero for formats without attribute cells.
+struct EncoderCapabilities
+{
+    std::string name;
+    std::string description;
+    std::string extension;
+    int width = 0;
+    int height = 0;
+    int paletteSize = 0;
+    int cellWidth = 0;
+    int cellHeight = 0;
+    int colorsPerCell = 0;
+    bool sharedBackground = false;
+    // Width of one pixel relative to its height on the target display
+    double pixelAspect = 1.0;
+};
 
 class ImageConverter
 {
 public:
     virtual ~ImageConverter() = default;
-    virtual void convertImage(const std::vector<uint8_t> &pixelData, int width, int height) = 0;
-    virtual void saveFile(const std::string &filename) const = 0;
+    // pixels are 0x00RRGGBB, the view size must match the capabilities when they are fixed
+    virtual void convertImage(ConstPixelView image) = 0;
+    // Convenience for contiguous pixel vectors
+    void convertImage(const std::vector<uint32_t> &pixels, int width, int height);
+    virtual std::vector<uint8_t> getFileData() const = 0;
+    virtual EncoderCapabilities getCapabilities() const = 0;
+    virtual void saveFile(const std::string &filename) const;
+
+    // Writes the whole buffer with one unbuffered write
+    static void writeFile(const std::string &filename, const std::vector<uint8_t> &data);
 };
@@ -0,0 +1,149 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/ImageIO.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include "ImageIO.h"
+#include "Metrics.h"
+#include "ScanlineDecoder.h"
+#include <algorithm>
+#include <climits>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+PixelBuffer ImageIO::load(const std::string &filename, const DecodeOptions &options)
+{
+    return decode([&filename](int scale)
+                  { return ScanlineDecoder::open(filename, scale); },
+                  filename, options);
+}
+
+PixelBuffer ImageIO::loadFromMemory(const uint8_t *data, size_t size, const DecodeOptions &options)
+{
+    std::span<const uint8_t> bytes(data, size);
+    return decode([bytes](int scale)
+                  { return ScanlineDecoder::open(bytes, scale); },
+                  "image", options);
+}
+
+PixelBuffer ImageIO::decode(const Opener &open, const std::string &name, const DecodeOptions &options)
+{
+    StageTimer timer("load");
+    std::unique_ptr<ScanlineDecoder> decoder = open(1);
+    int factor = shrinkFactor(decoder->width(), decoder->height(), options);
+    if (factor > 1 && decoder->canScale())
+    {
+        // Let the JPEG decoder do the power of two part of the shrink in the DCT
+        int scale = std::min(factor, 8);
+        while ((scale & (scale - 1)) != 0)
+        {
+            scale &= scale - 1;
+        }
+        decoder = open(scale);
+        factor = shrinkFactor(decoder->width(), decoder->height(), options);
+    }
+
+    const int sourceWidth = decoder->width();
+    const int sourceHeight = decoder->height();
+    const int width = (sourceWidth + factor - 1) / factor;
+    const int height = (sourceHeight + factor - 1) / factor;
+
+    const size_t alignedWidth = (static_cast<size_t>(width) + 15) / 16 * 16;
+    size_t peak = decoder->workingSetBytes() + alignedWidth * height * sizeof(uint32_t);
+    if (factor > 1)
+    {
+        peak += static_cast<size_t>(sourceWidth) * sizeof(uint32_t) + static_cast<size_t>(width) * 3 * sizeof(uint32_t);
+    }
+    if (options.memoryCap != 0 && peak > options.memoryCap)
+    {
+        const size_t mb = 1024 * 1024;
+        throw std::runtime_error("Decoding " + name + " needs about " + std::to_string((peak + mb - 1) / mb) + " MB, the limit is " +
+                                 std::to_string(options.memoryCap / mb) + " MB");
+    }
+
+    PixelBuffer image(width, height);
+    if (factor == 1)
+    {
+        for (int y = 0; y < height; ++y)
+        {
+            decoder->readRow(image.row(y));
+        }
+        return image;
+    }
+
+    // Box filter: sum `factor` source rows per target row, then divide by the covered area
+    std::vector<uint32_t> row(sourceWidth);
+    std::vector<uint32_t> sums(static_cast<size_t>(width) * 3);
+    for (int y = 0; y < height; ++y)
+    {
+        std::fill(sums.begin(), sums.end(), 0);
+        const int rows = std::min(factor, sourceHeight - y * factor);
+        for (int r = 0; r < rows; ++r)
+        {
+            decoder->readRow(row);
+            for (int x = 0; x < sourceWidth; ++x)
+            {
+                uint32_t *sum = &sums[static_cast<size_t>(x / factor) * 3];
+                sum[0] += (row[x] >> 16) & 0xFF;
+                sum[1] += (row[x] >> 8) & 0xFF;
+                sum[2] += row[x] & 0xFF;
+            }
+        }
+
+        std::span<uint32_t> target = image.row(y);
+        for (int x = 0; x < width; ++x)
+        {
+            const uint32_t count = static_cast<uint32_t>(std::min(factor, sourceWidth - x * factor) * rows);
+            const uint32_t *sum = &sums[static_cast<size_t>(x) * 3];
+            target[x] = ((sum[0] + count / 2) / count) << 16 | ((sum[1] + count / 2) / count) << 8 | ((sum[2] + count / 2) / count);
+        }
+    }
+    return image;
+}
+
+int ImageIO::shrinkFactor(int width, int height, const DecodeOptions &options)
+{
+    int factor = INT_MAX;
+    if (options.minWidth > 0)
+    {
+        factor = std::min(factor, width / options.minWidth);
+    }
+    if (options.minHeight > 0)
+    {
+        factor = std::min(factor, height / options.minHeight);
+    }
+    return factor == INT_MAX ? 1 : std::max(factor, 1);
+}
+
+bool ImageIO::isSupportedExtension(const std::string &filename)
+{
+    size_t dot = filename.find_last_of('.');
+    if (dot == std::string::npos)
+    {
+        return false;
+    }
+    std::string extension = filename.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension == "png" || extension == "jpg" || extension == "jpeg" || extension == "gif" ||
+           extension == "bmp" || extension == "tga";
+}
+
+PixelBuffer ImageIO::fromRgba(const uint8_t *rgba, int width, int height)
+{
+    using Pixel = PixelFormat::Rgba8::Pixel;
+    ConstFormatView<PixelFormat::Rgba8> source(reinterpret_cast<const Pixel *>(rgba), width, height, width);
+    PixelBuffer image(width, height);
+    convertPixels(source, image);
+    return image;
+}
+
+PixelBuffer ImageIO::fromRgb(const uint8_t *rgb, int width, int height)
+{
+    using Pixel = PixelFormat::Rgb8::Pixel;
+    ConstFormatView<PixelFormat::Rgb8> source(reinterpret_cast<const Pixel *>(rgb), width, height, width);
+    PixelBuffer image(width, height);
+    convertPixels(source, image);
+    return image;
+}
@@ -0,0 +1,48 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/ImageIO.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include "PixelBuffer.h"
+#include "ScanlineDecoder.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+struct DecodeOptions
+{
+    // Smallest size the image may be box-shrunk to while it is decoded, 0 keeps full size
+    int minWidth = 0;
+    int minHeight = 0;
+    // Peak bytes for decoder state and the decoded image, 0 for no limit
+    size_t memoryCap = 0;
+};
+
+// Display-independent image decoding. PNG and JPEG files stream row by row through
+// ScanlineDecoder, everything else is decoded by stb_image. Images are decoded as RGB8
+// and converted to the XRGB32 working format in one pass.
+class ImageIO
+{
+public:
+    static PixelBuffer load(const std::string &filename, const DecodeOptions &options = {});
+    static PixelBuffer loadFromMemory(const uint8_t *data, size_t size, const DecodeOptions &options = {});
+    static bool isSupportedExtension(const std::string &filename);
+
+    // Tightly packed decoder output, e.g. from stbi_load with 4 or 3 channels
+    static PixelBuffer fromRgba(const uint8_t *rgba, int width, int height);
+    static PixelBuffer fromRgb(const uint8_t *rgb, int width, int height);
+
+    // Largest integer box factor that keeps the image at least minWidth x minHeight
+    static int shrinkFactor(int width, int height, const DecodeOptions &options);
+
+private:
+    // Opens a decoder for the source with the given JPEG scale denominator
+    using Opener = std::function<std::unique_ptr<ScanlineDecoder>(int)>;
+
+    static PixelBuffer decode(const Opener &open, const std::string &name, const DecodeOptions &options);
+};
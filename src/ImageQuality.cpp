@@ -0,0 +1,510 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/ImageQuality.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include "ImageQuality.h"
+#include "Metrics.h"
+#include "Parallel.h"
+#include <spdlog/fmt/fmt.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <numbers>
+#include <numeric>
+#include <stdexcept>
+#include <tuple>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define GFX_QUALITY_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    constexpr int BAND_ROWS = 32;
+    constexpr double SSIM_C1 = (0.01 * 255) * (0.01 * 255);
+    constexpr double SSIM_C2 = (0.03 * 255) * (0.03 * 255);
+    constexpr std::array<double, 5> MS_SSIM_WEIGHTS = {0.0448, 0.2856, 0.3001, 0.2363, 0.1333};
+
+    size_t bandCount(int height)
+    {
+        return static_cast<size_t>((height + BAND_ROWS - 1) / BAND_ROWS);
+    }
+
+    // Sum of squared R, G and B differences of one row
+    uint64_t squaredError(const uint32_t *a, const uint32_t *b, int count)
+    {
+        uint64_t total = 0;
+        int x = 0;
+#if defined(GFX_QUALITY_SSE2)
+        const __m128i mask = _mm_set1_epi32(0x00FFFFFF);
+        const __m128i zero = _mm_setzero_si128();
+        const int vectorEnd = count & ~3;
+        while (x < vectorEnd)
+        {
+            // 4096 pixels add at most 2.7e8 to each 32-bit lane
+            const int chunkEnd = std::min(vectorEnd, x + 4096);
+            __m128i sum = zero;
+            for (; x < chunkEnd; x += 4)
+            {
+                __m128i va = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + x)), mask);
+                __m128i vb = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b + x)), mask);
+                __m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero));
+                __m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero));
+                sum = _mm_add_epi32(sum, _mm_madd_epi16(lo, lo));
+                sum = _mm_add_epi32(sum, _mm_madd_epi16(hi, hi));
+            }
+            alignas(16) uint32_t lanes[4];
+            _mm_store_si128(reinterpret_cast<__m128i *>(lanes), sum);
+            total += static_cast<uint64_t>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+        }
+#endif
+        for (; x < count; ++x)
+        {
+            for (int shift : {0, 8, 16})
+            {
+                int d = static_cast<int>((a[x] >> shift) & 0xFF) - static_cast<int>((b[x] >> shift) & 0xFF);
+                total += static_cast<uint64_t>(d * d);
+            }
+        }
+        return total;
+    }
+
+    // 4x4 block sums of both planes and their products
+    struct BlockSums
+    {
+        double a = 0.0;
+        double b = 0.0;
+        double aa = 0.0;
+        double bb = 0.0;
+        double ab = 0.0;
+
+        BlockSums &operator+=(const BlockSums &other)
+        {
+            a += other.a;
+            b += other.b;
+            aa += other.aa;
+            bb += other.bb;
+            ab += other.ab;
+            return *this;
+        }
+    };
+
+    // Sums of the 4x4 block at a and b, whose rows are `stride` floats apart. With SSE2 a
+    // block row is one register; the float products are widened to double before they are
+    // added, like in the scalar loop.
+    BlockSums blockSums(const float *a, const float *b, size_t stride)
+    {
+        BlockSums s;
+#if defined(GFX_QUALITY_SSE2)
+        __m128d sa = _mm_setzero_pd();
+        __m128d sb = _mm_setzero_pd();
+        __m128d saa = _mm_setzero_pd();
+        __m128d sbb = _mm_setzero_pd();
+        __m128d sab = _mm_setzero_pd();
+        auto add = [](__m128d &sum, __m128 v)
+        { sum = _mm_add_pd(sum, _mm_add_pd(_mm_cvtps_pd(v), _mm_cvtps_pd(_mm_movehl_ps(v, v)))); };
+        for (int y = 0; y < 4; ++y, a += stride, b += stride)
+        {
+            __m128 va = _mm_loadu_ps(a);
+            __m128 vb = _mm_loadu_ps(b);
+            add(sa, va);
+            add(sb, vb);
+            add(saa, _mm_mul_ps(va, va));
+            add(sbb, _mm_mul_ps(vb, vb));
+            add(sab, _mm_mul_ps(va, vb));
+        }
+        auto total = [](__m128d sum)
+        { return _mm_cvtsd_f64(_mm_add_sd(sum, _mm_unpackhi_pd(sum, sum))); };
+        s.a = total(sa);
+        s.b = total(sb);
+        s.aa = total(saa);
+        s.bb = total(sbb);
+        s.ab = total(sab);
+#else
+        for (int y = 0; y < 4; ++y, a += stride, b += stride)
+        {
+            for (int x = 0; x < 4; ++x)
+            {
+                s.a += a[x];
+                s.b += b[x];
+                s.aa += a[x] * a[x];
+                s.bb += b[x] * b[x];
+                s.ab += a[x] * b[x];
+            }
+        }
+#endif
+        return s;
+    }
+
+    // Luminance and contrast-structure terms of one window of n pixels
+    std::pair<double, double> ssimTerms(const BlockSums &s, double n)
+    {
+        double meanA = s.a / n;
+        double meanB = s.b / n;
+        double varianceA = s.aa / n - meanA * meanA;
+        double varianceB = s.bb / n - meanB * meanB;
+        double covariance = s.ab / n - meanA * meanB;
+        double luminance = (2.0 * meanA * meanB + SSIM_C1) / (meanA * meanA + meanB * meanB + SSIM_C1);
+        double contrastStructure = (2.0 * covariance + SSIM_C2) / (varianceA + varianceB + SSIM_C2);
+        return {luminance, contrastStructure};
+    }
+
+    double srgbToLinear(int channel)
+    {
+        double c = channel / 255.0;
+        return c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+    }
+
+    double labCurve(double t)
+    {
+        constexpr double epsilon = 216.0 / 24389.0;
+        constexpr double kappa = 24389.0 / 27.0;
+        return t > epsilon ? std::cbrt(t) : (kappa * t + 16.0) / 116.0;
+    }
+
+    double degrees(double radians)
+    {
+        return radians * 180.0 / std::numbers::pi;
+    }
+
+    double radians(double degrees)
+    {
+        return degrees * std::numbers::pi / 180.0;
+    }
+}
+
+void ImageQuality::checkSizes(ConstPixelView reference, ConstPixelView result)
+{
+    if (reference.width() != result.width() || reference.height() != result.height())
+    {
+        throw std::invalid_argument("Quality metrics need images of the same size");
+    }
+    if (reference.empty())
+    {
+        throw std::invalid_argument("Quality metrics need a non-empty image");
+    }
+}
+
+double ImageQuality::mse(ConstPixelView reference, ConstPixelView result, int threads)
+{
+    checkSizes(reference, result);
+    std::vector<uint64_t> bands(bandCount(reference.height()));
+    Parallel::forEach(bands.size(), threads, [&](size_t band)
+                      {
+        int end = std::min(reference.height(), static_cast<int>(band + 1) * BAND_ROWS);
+        for (int y = static_cast<int>(band) * BAND_ROWS; y < end; ++y)
+        {
+            bands[band] += squaredError(reference.row(y).data(), result.row(y).data(), reference.width());
+        } });
+    uint64_t total = std::accumulate(bands.begin(), bands.end(), uint64_t(0));
+    return static_cast<double>(total) / (3.0 * reference.width() * reference.height());
+}
+
+double ImageQuality::psnr(double mse)
+{
+    if (mse <= 0.0)
+    {
+        return std::numeric_limits<double>::infinity();
+    }
+    return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+ImageQuality::Plane ImageQuality::luma(ConstPixelView image)
+{
+    Plane plane{image.width(), image.height(), std::vector<float>(static_cast<size_t>(image.width()) * image.height())};
+    for (int y = 0; y < image.height(); ++y)
+    {
+        float *out = plane.values.data() + static_cast<size_t>(y) * image.width();
+        std::span<const uint32_t> row = image.row(y);
+        for (int x = 0; x < image.width(); ++x)
+        {
+            // BT.601 weights in 8.8 fixed point
+            uint32_t p = row[x];
+            out[x] = static_cast<float>((77 * ((p >> 16) & 0xFF) + 150 * ((p >> 8) & 0xFF) + 29 * (p & 0xFF) + 128) >> 8);
+        }
+    }
+    return plane;
+}
+
+ImageQuality::Plane ImageQuality::downsample(const Plane &plane)
+{
+    Plane half{plane.width / 2, plane.height / 2, {}};
+    half.values.resize(static_cast<size_t>(half.width) * half.height);
+    for (int y = 0; y < half.height; ++y)
+    {
+        const float *top = plane.values.data() + static_cast<size_t>(2 * y) * plane.width;
+        const float *bottom = top + plane.width;
+        float *out = half.values.data() + static_cast<size_t>(y) * half.width;
+        for (int x = 0; x < half.width; ++x)
+        {
+            out[x] = 0.25f * (top[2 * x] + top[2 * x + 1] + bottom[2 * x] + bottom[2 * x + 1]);
+        }
+    }
+    return half;
+}
+
+std::pair<double, double> ImageQuality::ssimPlanes(const Plane &reference, const Plane &result, int threads)
+{
+    const int width = reference.width;
+    const int height = reference.height;
+    auto sumsOf = [&](int x0, int y0, int w, int h)
+    {
+        BlockSums s;
+        for (int y = y0; y < y0 + h; ++y)
+        {
+            const float *a = reference.values.data() + static_cast<size_t>(y) * width + x0;
+            const float *b = result.values.data() + static_cast<size_t>(y) * width + x0;
+            for (int x = 0; x < w; ++x)
+            {
+                s.a += a[x];
+                s.b += b[x];
+                s.aa += a[x] * a[x];
+                s.bb += b[x] * b[x];
+                s.ab += a[x] * b[x];
+            }
+        }
+        return s;
+    };
+
+    // Smaller than one window: the whole image is the window
+    if (width < 8 || height < 8)
+    {
+        return ssimTerms(sumsOf(0, 0, width, height), static_cast<double>(width) * height);
+    }
+
+    const int blocksX = width / 4;
+    const int blocksY = height / 4;
+    std::vector<BlockSums> blocks(static_cast<size_t>(blocksX) * blocksY);
+    Parallel::forEach(static_cast<size_t>(blocksY), threads, [&](size_t by)
+                      {
+        for (int bx = 0; bx < blocksX; ++bx)
+        {
+            size_t offset = by * 4 * width + static_cast<size_t>(bx) * 4;
+            blocks[by * blocksX + bx] = blockSums(reference.values.data() + offset, result.values.data() + offset, width);
+        } });
+
+    // Every 8x8 window is four neighbouring blocks
+    std::vector<std::pair<double, double>> rows(static_cast<size_t>(blocksY - 1));
+    Parallel::forEach(rows.size(), threads, [&](size_t wy)
+                      {
+        double ssimSum = 0.0;
+        double csSum = 0.0;
+        for (int wx = 0; wx + 1 < blocksX; ++wx)
+        {
+            BlockSums s = blocks[wy * blocksX + wx];
+            s += blocks[wy * blocksX + wx + 1];
+            s += blocks[(wy + 1) * blocksX + wx];
+            s += blocks[(wy + 1) * blocksX + wx + 1];
+            auto [luminance, contrastStructure] = ssimTerms(s, 64.0);
+            ssimSum += luminance * contrastStructure;
+            csSum += contrastStructure;
+        }
+        rows[wy] = {ssimSum, csSum}; });
+
+    double windows = static_cast<double>(blocksX - 1) * (blocksY - 1);
+    double ssimTotal = 0.0;
+    double csTotal = 0.0;
+    for (const auto &[ssimSum, csSum] : rows)
+    {
+        ssimTotal += ssimSum;
+        csTotal += csSum;
+    }
+    return {ssimTotal / windows, csTotal / windows};
+}
+
+double ImageQuality::ssim(ConstPixelView reference, ConstPixelView result, int threads)
+{
+    checkSizes(reference, result);
+    return ssimPlanes(luma(reference), luma(result), threads).first;
+}
+
+double ImageQuality::msSsim(ConstPixelView reference, ConstPixelView result, int threads)
+{
+    checkSizes(reference, result);
+    return multiScale(luma(reference), luma(result), threads).second;
+}
+
+std::pair<double, double> ImageQuality::multiScale(Plane reference, Plane result, int threads)
+{
+    size_t scales = 1;
+    for (int w = reference.width, h = reference.height; scales < MS_SSIM_WEIGHTS.size() && std::min(w, h) >= 16; w /= 2, h /= 2)
+    {
+        ++scales;
+    }
+    double weightSum = std::accumulate(MS_SSIM_WEIGHTS.begin(), MS_SSIM_WEIGHTS.begin() + scales, 0.0);
+
+    double fullScale = 0.0;
+    double product = 1.0;
+    for (size_t scale = 0; scale < scales; ++scale)
+    {
+        auto [ssimValue, contrastStructure] = ssimPlanes(reference, result, threads);
+        if (scale == 0)
+        {
+            fullScale = ssimValue;
+        }
+        // The coarsest scale contributes luminance as well; negative terms are clamped so
+        // the fractional powers stay real
+        double term = scale + 1 == scales ? ssimValue : contrastStructure;
+        product *= std::pow(std::max(term, 0.0), MS_SSIM_WEIGHTS[scale] / weightSum);
+        if (scale + 1 < scales)
+        {
+            reference = downsample(reference);
+            result = downsample(result);
+        }
+    }
+    return {fullScale, product};
+}
+
+LabColor ImageQuality::toLab(uint32_t pixel)
+{
+    static const std::array<double, 256> linear = []()
+    {
+        std::array<double, 256> table{};
+        for (int i = 0; i < 256; ++i)
+        {
+            table[i] = srgbToLinear(i);
+        }
+        return table;
+    }();
+
+    double r = linear[(pixel >> 16) & 0xFF];
+    double g = linear[(pixel >> 8) & 0xFF];
+    double b = linear[pixel & 0xFF];
+    // Relative to the D65 white point
+    double x = (0.4124564 * r + 0.3575761 * g + 0.1804375 * b) / 0.95047;
+    double y = 0.2126729 * r + 0.7151522 * g + 0.0721750 * b;
+    double z = (0.0193339 * r + 0.1191920 * g + 0.9503041 * b) / 1.08883;
+    double fx = labCurve(x);
+    double fy = labCurve(y);
+    double fz = labCurve(z);
+    return {116.0 * fy - 16.0, 500.0 * (fx - fy), 200.0 * (fy - fz)};
+}
+
+// Sharma, Wu and Dalal, "The CIEDE2000 color-difference formula", with kL = kC = kH = 1
+double ImageQuality::ciede2000(const LabColor &first, const LabColor &second)
+{
+    constexpr double pow25To7 = 6103515625.0;
+    double c1 = std::hypot(first.a, first.b);
+    double c2 = std::hypot(second.a, second.b);
+    double meanC7 = std::pow((c1 + c2) / 2.0, 7.0);
+    double g = 0.5 * (1.0 - std::sqrt(meanC7 / (meanC7 + pow25To7)));
+    double a1 = (1.0 + g) * first.a;
+    double a2 = (1.0 + g) * second.a;
+    double c1p = std::hypot(a1, first.b);
+    double c2p = std::hypot(a2, second.b);
+    auto hue = [](double b, double a)
+    {
+        if (a == 0.0 && b == 0.0)
+            return 0.0;
+        double h = degrees(std::atan2(b, a));
+        return h < 0.0 ? h + 360.0 : h;
+    };
+    double h1p = hue(first.b, a1);
+    double h2p = hue(second.b, a2);
+
+    double deltaL = second.l - first.l;
+    double deltaC = c2p - c1p;
+    double deltaHue = 0.0;
+    if (c1p * c2p != 0.0)
+    {
+        deltaHue = h2p - h1p;
+        if (deltaHue > 180.0)
+            deltaHue -= 360.0;
+        else if (deltaHue < -180.0)
+            deltaHue += 360.0;
+    }
+    double deltaH = 2.0 * std::sqrt(c1p * c2p) * std::sin(radians(deltaHue) / 2.0);
+
+    double meanL = (first.l + second.l) / 2.0;
+    double meanCp = (c1p + c2p) / 2.0;
+    double meanHue = h1p + h2p;
+    if (c1p * c2p != 0.0)
+    {
+        if (std::abs(h1p - h2p) <= 180.0)
+            meanHue /= 2.0;
+        else if (h1p + h2p < 360.0)
+            meanHue = (meanHue + 360.0) / 2.0;
+        else
+            meanHue = (meanHue - 360.0) / 2.0;
+    }
+
+    double t = 1.0 - 0.17 * std::cos(radians(meanHue - 30.0)) + 0.24 * std::cos(radians(2.0 * meanHue)) +
+               0.32 * std::cos(radians(3.0 * meanHue + 6.0)) - 0.20 * std::cos(radians(4.0 * meanHue - 63.0));
+    double deltaTheta = 30.0 * std::exp(-std::pow((meanHue - 275.0) / 25.0, 2.0));
+    double meanCp7 = std::pow(meanCp, 7.0);
+    double rc = 2.0 * std::sqrt(meanCp7 / (meanCp7 + pow25To7));
+    double lightness = (meanL - 50.0) * (meanL - 50.0);
+    double sl = 1.0 + 0.015 * lightness / std::sqrt(20.0 + lightness);
+    double sc = 1.0 + 0.045 * meanCp;
+    double sh = 1.0 + 0.015 * meanCp * t;
+    double rt = -std::sin(radians(2.0 * deltaTheta)) * rc;
+
+    double l = deltaL / sl;
+    double c = deltaC / sc;
+    double h = deltaH / sh;
+    return std::sqrt(l * l + c * c + h * h + rt * c * h);
+}
+
+QualityReport ImageQuality::compare(ConstPixelView reference, ConstPixelView result, const QualityOptions &options)
+{
+    StageTimer timer("quality");
+    checkSizes(reference, result);
+    QualityReport report;
+    report.mse = mse(reference, result, options.threads);
+    report.psnr = psnr(report.mse);
+
+    if (options.msSsim)
+    {
+        std::tie(report.ssim, report.msSsim) = multiScale(luma(reference), luma(result), options.threads);
+    }
+    else if (options.ssim)
+    {
+        report.ssim = ssimPlanes(luma(reference), luma(result), options.threads).first;
+    }
+
+    if (options.deltaE)
+    {
+        const int width = reference.width();
+        std::vector<float> differences(static_cast<size_t>(width) * reference.height());
+        Parallel::forEach(bandCount(reference.height()), options.threads, [&](size_t band)
+                          {
+            int end = std::min(reference.height(), static_cast<int>(band + 1) * BAND_ROWS);
+            for (int y = static_cast<int>(band) * BAND_ROWS; y < end; ++y)
+            {
+                std::span<const uint32_t> a = reference.row(y);
+                std::span<const uint32_t> b = result.row(y);
+                float *out = differences.data() + static_cast<size_t>(y) * width;
+                // Results have few colors, so consecutive pixels often repeat a pair
+                uint32_t lastA = ~0u, lastB = ~0u;
+                float last = 0.0f;
+                for (int x = 0; x < width; ++x)
+                {
+                    uint32_t pa = a[x] & 0xFFFFFF;
+                    uint32_t pb = b[x] & 0xFFFFFF;
+                    if (pa != lastA || pb != lastB)
+                    {
+                        last = pa == pb ? 0.0f : static_cast<float>(ciede2000(toLab(pa), toLab(pb)));
+                        lastA = pa;
+                        lastB = pb;
+                    }
+                    out[x] = last;
+                }
+            } });
+        report.meanDeltaE = std::accumulate(differences.begin(), differences.end(), 0.0) / differences.size();
+        report.maxDeltaE = *std::max_element(differences.begin(), differences.end());
+        auto p95 = differences.begin() + static_cast<ptrdiff_t>(std::ceil(0.95 * differences.size())) - 1;
+        std::nth_element(differences.begin(), p95, differences.end());
+        report.p95DeltaE = *p95;
+    }
+    return report;
+}
+
+std::string ImageQuality::describe(const QualityReport &report)
+{
+    return fmt::format("PSNR {:.2f} dB, SSIM {:.4f}, MS-SSIM {:.4f}, CIEDE2000 mean {:.2f} p95 {:.2f} max {:.2f}",
+                       report.psnr, report.ssim, report.msSsim, report.meanDeltaE, report.p95DeltaE, report.maxDeltaE);
+}
@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/ImageQuality.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include "PixelBuffer.h"
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct QualityOptions
+{
+    bool ssim = true;
+    bool msSsim = true;
+    bool deltaE = true;
+    int threads = 0;
+};
+
+struct QualityReport
+{
+    // Mean squared error per 8-bit channel over R, G and B; PSNR is infinite for identical images
+    double mse = 0.0;
+    double psnr = 0.0;
+    // Structural similarity of the luma planes, 1 for identical images
+    double ssim = 0.0;
+    double msSsim = 0.0;
+    // CIEDE2000 color difference per pixel
+    double meanDeltaE = 0.0;
+    double p95DeltaE = 0.0;
+    double maxDeltaE = 0.0;
+};
+
+struct LabColor
+{
+    double l = 0.0;
+    double a = 0.0;
+    double b = 0.0;
+};
+
+// Objective comparison of a conversion result with its source. Both images must have the
+// same size. Work is split into row bands on `threads` cores; the squared error runs four
+// pixels per SSE2 register, SSIM uses 8x8 windows with a stride of 4 built from 4x4 block
+// sums, one block row per SSE2 register.
+class ImageQuality
+{
+public:
+    static QualityReport compare(ConstPixelView reference, ConstPixelView result, const QualityOptions &options = {});
+
+    static double mse(ConstPixelView reference, ConstPixelView result, int threads = 0);
+    static double psnr(double mse);
+    static double ssim(ConstPixelView reference, ConstPixelView result, int threads = 0);
+    // Five scales with the weights of Wang, Simoncelli and Bovik; images too small for all
+    // five use the scales that fit
+    static double msSsim(ConstPixelView reference, ConstPixelView result, int threads = 0);
+
+    // sRGB with a D65 white point
+    static LabColor toLab(uint32_t pixel);
+    static double ciede2000(const LabColor &first, const LabColor &second);
+
+    static std::string describe(const QualityReport &report);
+
+private:
+    struct Plane
+    {
+        int width = 0;
+        int height = 0;
+        std::vector<float> values;
+    };
+
+    static void checkSizes(ConstPixelView reference, ConstPixelView result);
+    static Plane luma(ConstPixelView image);
+    static Plane downsample(const Plane &plane);
+    // Mean SSIM and mean contrast-structure term over all windows
+    static std::pair<double, double> ssimPlanes(const Plane &reference, const Plane &result, int threads);
+    // Full resolution SSIM and MS-SSIM
+    static std::pair<double, double> multiScale(Plane reference, Plane result, int threads);
+};
@@ -0,0 +1,158 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/JobRunner.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include "JobRunner.h"
+#include <spdlog/spdlog.h>
+
+JobRunner::JobRunner() : worker([this]
+                                { run(); })
+{
+}
+
+JobRunner::~JobRunner()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        pending.reset();
+        if (activeToken)
+            activeToken->cancel();
+    }
+    wake.notify_all();
+    worker.join();
+}
+
+void JobRunner::submit(std::string label, Work work)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (activeToken)
+        {
+            activeToken->cancel();
+        }
+        if (pending)
+        {
+            SPDLOG_DEBUG("Job '{}' superseded before it started", pending->label);
+        }
+        pending = std::make_unique<Job>(Job{std::move(label), std::move(work), std::make_shared<ProgressToken>()});
+    }
+    wake.notify_one();
+}
+
+void JobRunner::cancel()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    pending.reset();
+    if (activeToken)
+    {
+        activeToken->cancel();
+    }
+}
+
+size_t JobRunner::dispatchCompletions()
+{
+    std::vector<Completion> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ready.swap(completions);
+    }
+    for (Completion &completion : ready)
+    {
+        if (completion)
+            completion();
+    }
+    return ready.size();
+}
+
+JobStatus JobRunner::getStatus() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    JobStatus status = finished;
+    if (activeToken)
+    {
+        status.busy = true;
+        status.label = activeLabel;
+        status.progress = activeToken->getProgress();
+        status.elapsed = activeToken->getElapsed();
+    }
+    else if (pending)
+    {
+        status.busy = true;
+        status.label = pending->label;
+    }
+    return status;
+}
+
+void JobRunner::waitIdle()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this]
+              { return !pending && !activeToken; });
+}
+
+void JobRunner::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        wake.wait(lock, [this]
+                  { return stopping || pending; });
+        if (stopping)
+        {
+            return;
+        }
+
+        std::unique_ptr<Job> job = std::move(pending);
+        activeToken = job->token;
+        activeLabel = job->label;
+        lock.unlock();
+
+        Completion completion;
+        std::string error;
+        bool cancelled = false;
+        try
+        {
+            completion = job->work(*job->token);
+        }
+        catch (const OperationCancelled &e)
+        {
+            cancelled = !e.isTimeout();
+            error = e.what();
+        }
+        catch (const std::exception &e)
+        {
+            error = e.what();
+        }
+
+        lock.lock();
+        activeToken.reset();
+        // A job that finished after being superseded must not overwrite the newer result
+        cancelled = cancelled || job->token->isCancelled();
+        if (cancelled)
+        {
+            SPDLOG_DEBUG("Job '{}' cancelled after {} ms", job->label, job->token->getElapsed().count());
+        }
+        else
+        {
+            finished.lastLabel = job->label;
+            finished.lastElapsed = job->token->getElapsed();
+            finished.lastError = error;
+            if (error.empty())
+            {
+                completions.push_back(std::move(completion));
+                SPDLOG_DEBUG("Job '{}' finished in {} ms", job->label, finished.lastElapsed.count());
+            }
+            else
+            {
+                spdlog::error("Job '{}' failed: {}", job->label, error);
+            }
+        }
+        if (!pending)
+        {
+            idle.notify_all();
+        }
+    }
+}
@@ -0,0 +1,75 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/JobRunner.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include "ProgressToken.h"
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct JobStatus
+{
+    bool busy = false;
+    std::string label;
+    float progress = 0.0f;
+    std::chrono::milliseconds elapsed{0};
+    // Outcome of the most recent job that did not get superseded
+    std::string lastLabel;
+    std::chrono::milliseconds lastElapsed{0};
+    std::string lastError;
+};
+
+// Runs one job at a time on a worker thread. Submitting a job cancels the running one
+// and replaces any job still waiting, so only the newest request is ever worked on.
+// A job returns a completion that is handed back to the owning thread through
+// dispatchCompletions(), e.g. to upload a texture on the render thread.
+class JobRunner
+{
+public:
+    using Completion = std::function<void()>;
+    using Work = std::function<Completion(ProgressToken &)>;
+
+    JobRunner();
+    ~JobRunner();
+
+    JobRunner(const JobRunner &) = delete;
+    JobRunner &operator=(const JobRunner &) = delete;
+
+    void submit(std::string label, Work work);
+    void cancel();
+    // Runs the completions of finished jobs on the calling thread; returns how many ran
+    size_t dispatchCompletions();
+    JobStatus getStatus() const;
+    // Blocks until no job is running or waiting
+    void waitIdle();
+
+private:
+    struct Job
+    {
+        std::string label;
+        Work work;
+        std::shared_ptr<ProgressToken> token;
+    };
+
+    void run();
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    std::unique_ptr<Job> pending;
+    std::shared_ptr<ProgressToken> activeToken;
+    std::string activeLabel;
+    std::vector<Completion> completions;
+    JobStatus finished;
+    bool stopping = false;
+    std::thread worker;
+};
@@ -5,68 +5,170 @@
 // Copyright (c) 2022 Volker Schwaberow
 
 #include "KoalaConverter.h"
-#include <fstream>
+#include "C64Palette.h"
+#include "Compression.h"
+#include <spdlog/spdlog.h>
 #include <stdexcept>
 
-void KoalaConverter::convertImage(const std::vector<uint8_t> &pixelData, int width, int height)
+KoalaConverter::KoalaConverter() : m_cellCache(CellSolutionCache::shared()) {}
+
+void KoalaConverter::setResampling(ResampleFilter filter, FitMode fit)
+{
+    m_filter = filter;
+    m_fit = fit;
+}
+
+void KoalaConverter::setCellCache(std::shared_ptr<CellSolutionCache> cache)
+{
+    m_cellCache = std::move(cache);
+}
+
+std::shared_ptr<CellSolutionCache> KoalaConverter::getCellCache() const
+{
+    return m_cellCache;
+}
+
+EncoderCapabilities KoalaConverter::capabilities()
+{
+    EncoderCapabilities caps;
+    caps.name = "koala";
+    caps.description = "C64 Koala Painter multicolor bitmap";
+    caps.extension = "kla";
+    caps.width = KOALA_WIDTH;
+    caps.height = KOALA_HEIGHT;
+    caps.paletteSize = C64Palette::COLOR_COUNT;
+    caps.cellWidth = 4;
+    caps.cellHeight = 8;
+    caps.colorsPerCell = 4;
+    caps.sharedBackground = true;
+    caps.pixelAspect = 2.0;
+    return caps;
+}
+
+EncoderCapabilities KoalaConverter::getCapabilities() const
 {
-    if (width != KoalaConverter::KOALA_WIDTH || height != KoalaConverter::KOALA_HEIGHT)
+    return capabilities();
+}
+
+void KoalaConverter::convertImage(ConstPixelView image)
+{
+    if (image.empty())
     {
-        throw std::runtime_error("Image dimensions must be 160x200 for Koala format");
+        throw std::runtime_error("Empty image for Koala conversion");
     }
+    if (image.width() != KOALA_WIDTH || image.height() != KOALA_HEIGHT)
+    {
+        ResampleOptions options;
+        options.width = KOALA_WIDTH;
+        options.height = KOALA_HEIGHT;
+        options.filter = m_filter;
+        options.fit = m_fit;
+        options.pixelAspect = capabilities().pixelAspect;
+        SPDLOG_DEBUG("Resampling {}x{} to {}x{} for Koala with the {} filter", image.width(), image.height(),
+                     KOALA_WIDTH, KOALA_HEIGHT, Resampler::getFilterName(m_filter));
+        convertImage(Resampler::resample(image, options));
+        return;
+    }
+
+    const int width = image.width();
+    const int height = image.height();
 
-    m_bitmap.resize(KOALA_BITMAP_SIZE);
-    m_screenRam.resize(KOALA_SCREEN_RAM_SIZE);
-    m_colorRam.resize(KOALA_COLOR_RAM_SIZE);
+    m_bitmap.assign(KOALA_BITMAP_SIZE, 0);
+    m_screenRam.assign(KOALA_SCREEN_RAM_SIZE, 0);
+    m_colorRam.assign(KOALA_COLOR_RAM_SIZE, 0);
 
-    // TODO: Implement proper color quantization, simplification, and dithering
-    for (int y = 0; y < KoalaConverter::KOALA_HEIGHT; y++)
+    CellSolver solver(CellConstraints::c64Multicolor(), m_cellCache);
+    std::vector<uint8_t> indices = solver.quantize(image);
+    m_backgroundColor = solver.pickBackground(indices);
+
+    CellCacheStatistics before = m_cellCache ? m_cellCache->getStatistics() : CellCacheStatistics{};
+    std::vector<CellSolution> solutions = solver.solveImage(indices, width, height, m_backgroundColor);
+
+    for (size_t charIndex = 0; charIndex < solutions.size(); ++charIndex)
     {
-        for (int x = 0; x < KoalaConverter::KOALA_WIDTH; x++)
-        {
-            int pixelIndex = (y * KoalaConverter::KOALA_WIDTH + x) * 3;
-            uint8_t r = pixelData[pixelIndex];
-            uint8_t g = pixelData[pixelIndex + 1];
-            uint8_t b = pixelData[pixelIndex + 2];
-
-            uint8_t colorIndex = (r > 128 ? 4 : 0) | (g > 128 ? 2 : 0) | (b > 128 ? 1 : 0);
-
-            int charX = x / 4;
-            int charY = y / 8;
-            int charIndex = charY * 40 + charX;
-            int bitIndex = (y % 8) * 8 + (x % 4) * 2;
-
-            m_bitmap[charIndex * 8 + bitIndex / 8] |= (colorIndex & 3) << (6 - (bitIndex % 8));
-
-            if (x % 4 == 0 && y % 8 == 0)
-            {
-                m_screenRam[charIndex] = colorIndex & 0xF;
-                m_colorRam[charIndex] = (colorIndex >> 4) & 0xF;
-            }
-        }
+        const CellSolution &solution = solutions[charIndex];
+        std::copy(solution.bitmap.begin(), solution.bitmap.end(), m_bitmap.begin() + charIndex * 8);
+        m_screenRam[charIndex] = static_cast<uint8_t>((solution.colors[1] << 4) | solution.colors[2]);
+        m_colorRam[charIndex] = solution.colors[3];
     }
 
-    m_backgroundColor = 0;
+    if (m_cellCache)
+    {
+        m_cellCache->logImageStatistics("Koala", before);
+    }
 }
 
-void KoalaConverter::saveFile(const std::string &filename) const
+std::vector<uint8_t> KoalaConverter::getFileData() const
 {
-    std::ofstream file(filename, std::ios::binary);
-    if (!file)
+    std::vector<uint8_t> data;
+    data.reserve(KOALA_HEADER_SIZE + KOALA_BITMAP_SIZE + KOALA_SCREEN_RAM_SIZE + KOALA_COLOR_RAM_SIZE + KOALA_BACKGROUND_COLOR_SIZE);
+    data.push_back(0x00);
+    data.push_back(0x60);
+    data.insert(data.end(), m_bitmap.begin(), m_bitmap.end());
+    data.insert(data.end(), m_screenRam.begin(), m_screenRam.end());
+    data.insert(data.end(), m_colorRam.begin(), m_colorRam.end());
+    data.push_back(m_backgroundColor);
+    return data;
+}
+
+void KoalaConverter::setPacking(KoalaPacking packing)
+{
+    m_packing = packing;
+}
+
+KoalaPacking KoalaConverter::getPacking() const
+{
+    return m_packing;
+}
+
+std::vector<uint8_t> KoalaConverter::getPackedData(KoalaPacking packing) const
+{
+    std::vector<uint8_t> raw = getFileData();
+    if (packing == KoalaPacking::None)
+    {
+        return raw;
+    }
+
+    std::vector<uint8_t> packed;
+    packed.reserve(raw.size());
+    packed.insert(packed.end(), raw.begin(), raw.begin() + KOALA_HEADER_SIZE);
+    const uint8_t *body = raw.data() + KOALA_HEADER_SIZE;
+    size_t bodySize = raw.size() - KOALA_HEADER_SIZE;
+    if (packing == KoalaPacking::Rle)
+    {
+        Compression::packRle(body, bodySize, packed);
+    }
+    else
+    {
+        Compression::packLz(body, bodySize, packed);
+    }
+    return packed;
+}
+
+std::vector<uint8_t> KoalaConverter::unpack(const std::vector<uint8_t> &data, KoalaPacking packing)
+{
+    if (packing == KoalaPacking::None)
     {
-        throw std::runtime_error("Unable to open file for writing");
+        return data;
+    }
+    if (data.size() < KOALA_HEADER_SIZE)
+    {
+        throw std::runtime_error("Packed Koala data is too short");
     }
 
-    uint16_t loadAddress = 0x6000;
-    file.write(reinterpret_cast<const char *>(&loadAddress), KOALA_HEADER_SIZE);
-    file.write(reinterpret_cast<const char *>(m_bitmap.data()), KOALA_BITMAP_SIZE);
-    file.write(reinterpret_cast<const char *>(m_screenRam.data()), KOALA_SCREEN_RAM_SIZE);
-    file.write(reinterpret_cast<const char *>(m_colorRam.data()), KOALA_COLOR_RAM_SIZE);
-    file.write(reinterpret_cast<const char *>(&m_backgroundColor), KOALA_BACKGROUND_COLOR_SIZE);
+    const uint8_t *body = data.data() + KOALA_HEADER_SIZE;
+    size_t bodySize = data.size() - KOALA_HEADER_SIZE;
+    std::vector<uint8_t> unpacked = packing == KoalaPacking::Rle ? Compression::unpackRle(body, bodySize)
+                                                                 : Compression::unpackLz(body, bodySize);
+    unpacked.insert(unpacked.begin(), data.begin(), data.begin() + KOALA_HEADER_SIZE);
+    return unpacked;
+}
 
-    if (!file)
+void KoalaConverter::saveFile(const std::string &filename) const
+{
+    if (m_bitmap.empty())
     {
-        // TODO: Handle error with spdlog
-        throw std::runtime_error("Error writing to file");
+        throw std::runtime_error("No image converted");
     }
-}
\ No newline at end of file
+    writeFile(filename, getPackedData(m_packing));
+}
@@ -7,15 +7,47 @@
 #pragma once
 
 #include "ImageConverter.h"
+#include "CellSolver.h"
+#include "Resampler.h"
 #include <vector>
 #include <cstdint>
+#include <memory>
+
+enum class KoalaPacking
+{
+    None,
+    // "GG" files: load address followed by RLE data with escape byte 0xFE
+    Rle,
+    // Load address followed by an LZ stream (see Compression::packLz)
+    Lz
+};
 
 class KoalaConverter : public ImageConverter
 {
 public:
-    void convertImage(const std::vector<uint8_t> &pixelData, int width, int height) override;
+    KoalaConverter();
+
+    using ImageConverter::convertImage;
+    void convertImage(ConstPixelView image) override;
+    std::vector<uint8_t> getFileData() const override;
+    EncoderCapabilities getCapabilities() const override;
     void saveFile(const std::string &filename) const override;
 
+    // Packed layouts used by saveFile; getFileData always returns the raw 10003 bytes
+    void setPacking(KoalaPacking packing);
+    KoalaPacking getPacking() const;
+    std::vector<uint8_t> getPackedData(KoalaPacking packing) const;
+
+    // Images that are not 160x200 are resampled with the double-wide pixel aspect
+    void setResampling(ResampleFilter filter, FitMode fit);
+
+    void setCellCache(std::shared_ptr<CellSolutionCache> cache);
+    std::shared_ptr<CellSolutionCache> getCellCache() const;
+
+    static EncoderCapabilities capabilities();
+    // Restores the raw layout from any of the packed variants
+    static std::vector<uint8_t> unpack(const std::vector<uint8_t> &data, KoalaPacking packing);
+
 private:
     static constexpr int KOALA_WIDTH = 160;
     static constexpr int KOALA_HEIGHT = 200;
@@ -28,5 +60,9 @@ private:
     std::vector<uint8_t> m_bitmap;
     std::vector<uint8_t> m_screenRam;
     std::vector<uint8_t> m_colorRam;
-    uint8_t m_backgroundColor;
+    uint8_t m_backgroundColor = 0;
+    KoalaPacking m_packing = KoalaPacking::None;
+    ResampleFilter m_filter = ResampleFilter::Mitchell;
+    FitMode m_fit = FitMode::Fit;
+    std::shared_ptr<CellSolutionCache> m_cellCache;
 };
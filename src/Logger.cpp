@@ -6,21 +6,32 @@
 
 #include "Logger.h"
 #include <spdlog/sinks/basic_file_sink.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
 
 std::shared_ptr<spdlog::logger> Logger::logger;
 std::shared_ptr<GuiLogSink> Logger::guiSink;
 
-void Logger::initialize()
+void Logger::initialize(const LoggerOptions &options)
 {
     try
     {
         guiSink = std::make_shared<GuiLogSink>();
-        auto fileSink = std::make_shared<spdlog::sinks::basic_file_sink_mt>("logs/gfxconverter.log");
+        auto fileSink = std::make_shared<spdlog::sinks::basic_file_sink_mt>(options.filename);
+        spdlog::sinks_init_list sinks{guiSink, fileSink};
 
-        logger = std::make_shared<spdlog::logger>("gfxconverter", spdlog::sinks_init_list{guiSink, fileSink});
+        if (options.async)
+        {
+            spdlog::init_thread_pool(options.queueSize, 1);
+            logger = std::make_shared<spdlog::async_logger>("gfxconverter", sinks, spdlog::thread_pool(), options.overflow);
+        }
+        else
+        {
+            logger = std::make_shared<spdlog::logger>("gfxconverter", sinks);
+        }
         spdlog::set_default_logger(logger);
-        spdlog::set_level(spdlog::level::debug);
-        spdlog::flush_on(spdlog::level::debug);
+        spdlog::set_level(options.level);
+        spdlog::flush_on(options.flushLevel);
+        spdlog::flush_every(options.flushInterval);
     }
     catch (const spdlog::spdlog_ex &ex)
     {
@@ -28,6 +39,15 @@ void Logger::initialize()
     }
 }
 
+void Logger::shutdown()
+{
+    // Joins the async thread once it has written everything still queued
+    spdlog::shutdown();
+    logger.reset();
+    // Anything logged afterwards goes to the console like before initialize
+    spdlog::set_default_logger(std::make_shared<spdlog::logger>("", std::make_shared<spdlog::sinks::stdout_color_sink_mt>()));
+}
+
 std::shared_ptr<spdlog::logger> Logger::getLogger()
 {
     return logger;
@@ -7,13 +7,34 @@
 #pragma once
 
 #include <iostream>
+#include <chrono>
 #include <spdlog/spdlog.h>
+#include <spdlog/async.h>
 #include "GuiLogSink.h"
 
+// Messages below SPDLOG_ACTIVE_LEVEL (set by the GRAPHICSCONVERTER_LOG_LEVEL CMake option)
+// are removed at compile time when logged through the SPDLOG_TRACE/SPDLOG_DEBUG macros;
+// use those in per-image and per-cell code, the runtime level below filters the rest.
+struct LoggerOptions
+{
+    spdlog::level::level_enum level = spdlog::level::debug;
+    // Hand formatted messages to a background thread instead of writing the file inline
+    bool async = true;
+    size_t queueSize = 8192;
+    // What a full queue does: block the logging thread or drop the oldest queued message
+    spdlog::async_overflow_policy overflow = spdlog::async_overflow_policy::overrun_oldest;
+    // The file is flushed at this interval and immediately for messages at flushLevel or above
+    std::chrono::seconds flushInterval{2};
+    spdlog::level::level_enum flushLevel = spdlog::level::warn;
+    std::string filename = "logs/gfxconverter.log";
+};
+
 class Logger
 {
 public:
-    static void initialize();
+    static void initialize(const LoggerOptions &options = {});
+    // Drains the async queue and flushes the file; call before exiting
+    static void shutdown();
     static std::shared_ptr<spdlog::logger> getLogger();
     static std::shared_ptr<GuiLogSink> getGuiSink();
 
@@ -41,22 +41,61 @@ std::string saveFileDialog(const std::string &defaultName)
     return "";
 }
 
-void createConvertedTexture(const std::vector<uint32_t> &pixels, int width, int height)
+void uploadTexture(GLuint &textureID, ConstPixelView image)
 {
-    if (convertedTextureID != 0)
+    StageTimer timer("texture upload");
+    if (textureID != 0)
     {
-        glDeleteTextures(1, &convertedTextureID);
+        glDeleteTextures(1, &textureID);
     }
 
-    glGenTextures(1, &convertedTextureID);
-    glBindTexture(GL_TEXTURE_2D, convertedTextureID);
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    // XRGB32 words are B, G, R, 0 in memory; GL_RGBA wants R, G, B and opaque alpha
+    FormatBuffer<PixelFormat::Rgba8> rgba = convertPixels<PixelFormat::Rgba8>(image);
+    // Padded rows upload directly, GL skips the stride difference
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, static_cast<GLint>(rgba.stride()));
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, rgba.width(), rgba.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
     glBindTexture(GL_TEXTURE_2D, 0);
+}
 
-    convertedImageWidth = width;
-    convertedImageHeight = height;
+// Rows [rows.begin, rows.end) of a texture created by uploadTexture from an image of the same size
+void updateTextureRows(GLuint textureID, ConstPixelView image, DirtyRows rows)
+{
+    StageTimer timer("texture upload");
+    FormatBuffer<PixelFormat::Rgba8> rgba = convertPixels<PixelFormat::Rgba8>(image.subView(0, rows.begin, image.width(), rows.end - rows.begin));
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, static_cast<GLint>(rgba.stride()));
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, rows.begin, rgba.width(), rgba.height(), GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// Any other result replaces the editor's, whose row updates would no longer fit the texture.
+// displayWidth/displayHeight default to the texture size; previews of a proxy are
+// shown at the size of the full result
+void createConvertedTexture(ConstPixelView image, int displayWidth = 0, int displayHeight = 0)
+{
+    paletteEditor.reset();
+    uploadTexture(convertedTextureID, image);
+    convertedImageWidth = displayWidth > 0 ? displayWidth : image.width();
+    convertedImageHeight = displayHeight > 0 ? displayHeight : image.height();
+}
+
+// Reduction settings for the selected reducer, with the edited palette when it belongs to them
+PipelineSettings reductionSettings(ColorReductionAlgorithm reducer, int targetColors)
+{
+    PipelineSettings settings;
+    settings.reducer = reducer;
+    settings.targetColors = targetColors;
+    if (editedPalette && editedPalette->reducer == reducer && editedPalette->targetColors == targetColors)
+    {
+        settings.palette = editedPalette->colors;
+    }
+    return settings;
 }
 
 bool loadImageFile(const std::string &filename)
@@ -70,49 +109,37 @@ bool loadImageFile(const std::string &filename)
         spdlog::warn("Koala image loading not yet implemented");
         return false;
     }
-    else if (extension == "png" || extension == "jpg" || extension == "gif")
+    else if (ImageIO::isSupportedExtension(filename))
     {
-        Image img = loadImage(filename.c_str());
-        if (img.data != nullptr)
+        // Streams PNG and JPEG rows straight into the working buffer
+        PixelBuffer image;
+        try
         {
-            originalImage = img;
-            imageLoaded = true;
-            spdlog::info("Successfully loaded image: {}x{} pixels", img.width, img.height);
-            glGenTextures(1, &originalTextureID);
-            glBindTexture(GL_TEXTURE_2D, originalTextureID);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, img.width, img.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, img.data);
-            glBindTexture(GL_TEXTURE_2D, 0);
-
-            originalImageWidth = img.width;
-            originalImageHeight = img.height;
-
-            return true;
+            image = ImageIO::load(filename);
+        }
+        catch (const std::exception &e)
+        {
+            spdlog::error("{}", e.what());
+            return false;
         }
-    }
-    return false;
-}
-
-Image loadImage(const char *filename)
-{
-    Image img;
-    img.data = stbi_load(filename, &img.width, &img.height, &img.channels, 4);
 
-    if (img.data == nullptr)
-    {
-        // TODO: Add error handling
-        return img;
+        imageLoaded = true;
+        spdlog::info("Successfully loaded image: {}x{} pixels", image.width(), image.height());
+        uploadTexture(originalTextureID, image);
+        originalImageWidth = image.width();
+        originalImageHeight = image.height();
+
+        // Results computed for the previous image are no longer wanted
+        jobs.cancel();
+        preview.cancel();
+        paletteEditor.reset();
+        editedPalette.reset();
+        pipeline.setSource(std::move(image));
+        preview.sourceChanged();
+
+        return true;
     }
-
-    glGenTextures(1, &img.textureID);
-    glBindTexture(GL_TEXTURE_2D, img.textureID);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, img.width, img.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, img.data);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    return img;
+    return false;
 }
 
 int main(int, char **)
@@ -138,12 +165,22 @@ int main(int, char **)
     ColorReductionAlgorithm currentColorAlgo = ColorReductionAlgorithm::MedianCut;
     DitheringAlgorithm currentDitheringAlgo = DitheringAlgorithm::FloydSteinberg;
     int targetColors = 16;
+    bool livePreview = false;
+    bool previewDither = false;
+    std::optional<PipelineSettings> lastPreviewSettings;
 
     std::string loadedFilename;
 
     while (!glfwWindowShouldClose(window))
     {
         glfwPollEvents();
+        // Finished background jobs hand their results over on the GL thread
+        jobs.dispatchCompletions();
+        // A frame finishing after Live Preview was switched off must not replace other results
+        if (std::optional<PreviewFrame> frame = preview.poll(); frame && livePreview)
+        {
+            createConvertedTexture(*frame->image, originalImageWidth, originalImageHeight);
+        }
 
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
@@ -189,6 +226,7 @@ int main(int, char **)
         if (ImGui::Button("Convert PNG to Koala"))
         {
             Converter::convertPNGToKoala("input.png", "output.kla");
+            CellSolutionCache::shared()->logStatistics("Koala conversion");
         }
 
         ImGui::Separator();
@@ -199,17 +237,18 @@ int main(int, char **)
         {
             if (imageLoaded)
             {
-                std::vector<uint32_t> imageData(originalImage.width * originalImage.height);
-                for (int i = 0; i < originalImage.width * originalImage.height; ++i)
-                {
-                    imageData[i] = ((uint32_t *)originalImage.data)[i];
-                }
-
-                std::vector<uint32_t> reducedImage = ColorReducer::reduceColors(imageData, originalImage.width, originalImage.height, targetColors, currentColorAlgo);
-                spdlog::debug("Called ColorReducer::reduceColors() with {} colors and algorithm {}", targetColors, ColorReducer::getColorReducerName(currentColorAlgo));
-                createConvertedTexture(reducedImage, originalImage.width, originalImage.height);
-                spdlog::debug("Reduced image to {} colors and has a size of {} bytes", targetColors, reducedImage.size() * sizeof(uint32_t));
-                spdlog::info("Applied color reduction: {} colors", targetColors);
+                PipelineSettings settings = reductionSettings(currentColorAlgo, targetColors);
+                preview.cancel();
+                jobs.submit("Color reduction", [settings](ProgressToken &progress) -> JobRunner::Completion
+                            {
+                    std::shared_ptr<const PixelBuffer> reducedImage = pipeline.dithered(settings, &progress);
+                    spdlog::debug("Reduced image with {} colors and algorithm {}", settings.targetColors, ColorReducer::getColorReducerName(settings.reducer));
+                    return [reducedImage, settings]()
+                    {
+                        createConvertedTexture(*reducedImage);
+                        spdlog::debug("Reduced image to {} colors and has a size of {} bytes", settings.targetColors, reducedImage->size() * sizeof(uint32_t));
+                        spdlog::info("Applied color reduction: {} colors", settings.targetColors);
+                    }; });
             }
         }
 
@@ -218,33 +257,131 @@ int main(int, char **)
         ImGui::Combo("Dithering Algorithm", (int *)&currentDitheringAlgo, "Floyd-Steinberg\0Bayer\0Ordered\0");
         if (ImGui::Button("Apply Dithering"))
         {
-            std::vector<uint32_t> imageData(originalImage.width * originalImage.height);
-            for (int i = 0; i < originalImage.width * originalImage.height; ++i)
-            {
-                imageData[i] = ((uint32_t *)originalImage.data)[i];
-            }
-
-            std::vector<uint32_t> reducedImage = ColorReducer::reduceColors(imageData, originalImage.width, originalImage.height, targetColors, currentColorAlgo);
+            // Only the dither stage reruns when just the dithering algorithm changed
+            PipelineSettings settings = reductionSettings(currentColorAlgo, targetColors);
+            settings.dither = true;
+            settings.dithering = currentDitheringAlgo;
+            preview.cancel();
+            jobs.submit("Dithering", [settings](ProgressToken &progress) -> JobRunner::Completion
+                        {
+                std::shared_ptr<const PixelBuffer> ditheredImage = pipeline.dithered(settings, &progress);
+                return [ditheredImage, settings]()
+                {
+                    createConvertedTexture(*ditheredImage);
+                    spdlog::info("Applied dithering: {} algorithm with {} colors",
+                                 Dithering::getAlgorithmName(settings.dithering), settings.targetColors);
+                }; });
+        }
 
-            std::vector<uint32_t> palette;
-            for (uint32_t color : reducedImage)
-            {
-                if (std::find(palette.begin(), palette.end(), color) == palette.end())
+        if (ImGui::Button("Auto-Tune") && imageLoaded)
+        {
+            // Searches reducer and dithering on proxies, then runs the winner at full resolution
+            // and shows it in the combo boxes
+            PipelineSettings settings;
+            settings.targetColors = targetColors;
+            preview.cancel();
+            jobs.submit("Auto-tune", [settings, &currentColorAlgo, &currentDitheringAlgo, &previewDither](ProgressToken &progress) -> JobRunner::Completion
+                        {
+                TuneOptions options;
+                options.paletteSizes = {settings.targetColors};
+                TuneResult tuned = AutoTuner::tune(*pipeline.resampled(settings, &progress), options, &progress);
+                PipelineSettings best = settings;
+                best.reducer = tuned.best.reducer;
+                best.dither = tuned.best.dither;
+                best.dithering = tuned.best.dithering;
+                std::shared_ptr<const PixelBuffer> result = pipeline.dithered(best, &progress);
+                return [result, tuned, &currentColorAlgo, &currentDitheringAlgo, &previewDither]()
                 {
-                    palette.push_back(color);
-                }
-                if (palette.size() >= static_cast<size_t>(targetColors))
+                    currentColorAlgo = tuned.best.reducer;
+                    currentDitheringAlgo = tuned.best.dithering;
+                    previewDither = tuned.best.dither;
+                    createConvertedTexture(*result);
+                    spdlog::info("Auto-tune chose {} after {} of {} candidates in {} ms", AutoTuner::describe(tuned.best),
+                                 tuned.evaluated, tuned.candidates, tuned.elapsed.count());
+                }; });
+        }
+
+        if (ImGui::Button("Edit Palette") && imageLoaded)
+        {
+            // Remaps the image to the current palette once; edits then only touch the pixels they affect
+            PipelineSettings settings = reductionSettings(currentColorAlgo, targetColors);
+            preview.cancel();
+            jobs.submit("Palette editor", [settings](ProgressToken &progress) -> JobRunner::Completion
+                        {
+                std::shared_ptr<const std::vector<uint32_t>> palette = pipeline.palette(settings, &progress);
+                auto editor = std::make_shared<PaletteEditor>(*pipeline.resampled(settings, &progress), *palette);
+                return [editor, settings]()
                 {
-                    break;
-                }
+                    createConvertedTexture(editor->result());
+                    editor->takeDirtyRows();
+                    paletteEditor = editor;
+                    paletteEditorSettings = settings;
+                }; });
+        }
+        if (editedPalette && editedPalette->reducer == currentColorAlgo && editedPalette->targetColors == targetColors)
+        {
+            ImGui::SameLine();
+            ImGui::Text("Edited palette in use");
+            ImGui::SameLine();
+            if (ImGui::SmallButton("Discard Edits"))
+            {
+                editedPalette.reset();
             }
+        }
 
-            std::vector<uint32_t> ditheredImage = Dithering::applyDithering(imageData, originalImage.width, originalImage.height, palette, currentDitheringAlgo);
+        ImGui::Separator();
+        ImGui::Checkbox("Live Preview", &livePreview);
+        ImGui::SameLine();
+        ImGui::Checkbox("Dither Preview", &previewDither);
+        if (livePreview && imageLoaded)
+        {
+            PipelineSettings settings = reductionSettings(currentColorAlgo, targetColors);
+            settings.dither = previewDither;
+            settings.dithering = currentDitheringAlgo;
+            bool changed = !lastPreviewSettings || lastPreviewSettings->reducer != settings.reducer ||
+                           lastPreviewSettings->targetColors != settings.targetColors || lastPreviewSettings->palette != settings.palette ||
+                           lastPreviewSettings->dither != settings.dither || lastPreviewSettings->dithering != settings.dithering;
+            if (changed)
+            {
+                ImVec2 display = ImGui::GetIO().DisplaySize;
+                preview.setProxySize(static_cast<int>(display.x), static_cast<int>(display.y));
+                preview.request(settings);
+                lastPreviewSettings = settings;
+            }
 
-            createConvertedTexture(ditheredImage, originalImage.width, originalImage.height);
+            JobStatus refine = preview.getRefineStatus();
+            if (refine.busy)
+            {
+                ImGui::ProgressBar(refine.progress, ImVec2(-1.0f, 0.0f), "Refining");
+            }
+        }
+        else if (lastPreviewSettings)
+        {
+            // Switched off: a refinement still running would overwrite the next applied result
+            preview.cancel();
+            lastPreviewSettings.reset();
+        }
 
-            spdlog::info("Applied dithering: {} algorithm with {} colors",
-                         Dithering::getAlgorithmName(currentDitheringAlgo), targetColors);
+        JobStatus status = jobs.getStatus();
+        if (status.busy)
+        {
+            char overlay[64];
+            snprintf(overlay, sizeof(overlay), "%s %.0f%%", status.label.c_str(), status.progress * 100.0f);
+            ImGui::ProgressBar(status.progress, ImVec2(-120.0f, 0.0f), overlay);
+            ImGui::SameLine();
+            ImGui::Text("%.1f s", status.elapsed.count() / 1000.0);
+            ImGui::SameLine();
+            if (ImGui::Button("Cancel"))
+            {
+                jobs.cancel();
+            }
+        }
+        else if (!status.lastLabel.empty())
+        {
+            if (status.lastError.empty())
+                ImGui::Text("%s took %lld ms", status.lastLabel.c_str(), static_cast<long long>(status.lastElapsed.count()));
+            else
+                ImGui::TextColored(ImVec4(1.0f, 0.0f, 0.0f, 1.0f), "%s failed: %s", status.lastLabel.c_str(), status.lastError.c_str());
         }
         ImGui::EndDisabled();
         if (ImGui::Button("Toggle Debug Window"))
@@ -295,8 +432,55 @@ int main(int, char **)
 
             ImGui::Separator();
 
+            ImGui::Text("Stage metrics%s", AllocationCounters::enabled() ? "" : " (allocation counting disabled)");
+            ImGui::SameLine();
+            if (ImGui::Button("Reset Metrics"))
+            {
+                MetricsRegistry::instance().reset();
+            }
+            if (ImGui::BeginTable("StageMetrics", 9, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit))
+            {
+                for (const char *column : {"Stage", "Calls", "Last ms", "p50 ms", "p90 ms", "p99 ms", "Alloc MB", "Allocs", "Peak MB"})
+                {
+                    ImGui::TableSetupColumn(column);
+                }
+                ImGui::TableHeadersRow();
+                for (const StageSummary &stage : MetricsRegistry::instance().summary())
+                {
+                    ImGui::TableNextRow();
+                    ImGui::TableNextColumn();
+                    ImGui::TextUnformatted(stage.stage.c_str());
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%llu", static_cast<unsigned long long>(stage.calls));
+                    for (double ms : {stage.lastMilliseconds, stage.p50, stage.p90, stage.p99})
+                    {
+                        ImGui::TableNextColumn();
+                        ImGui::Text("%.2f", ms);
+                    }
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.1f", stage.allocatedBytes / (1024.0 * 1024.0));
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%llu", static_cast<unsigned long long>(stage.allocations));
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.1f", stage.peakBytes / (1024.0 * 1024.0));
+                }
+                ImGui::EndTable();
+            }
+
+            ImGui::Separator();
+
+            // Copy out what the sink published since the last frame; the lines shown are
+            // owned by the render thread and never touched by logging threads
+            std::vector<LogMessage> newMessages;
+            guiSink->readSince(logCursor, newMessages);
+            logLines.insert(logLines.end(), std::make_move_iterator(newMessages.begin()), std::make_move_iterator(newMessages.end()));
+            while (logLines.size() > GuiLogSink::CAPACITY)
+            {
+                logLines.pop_front();
+            }
+
             ImGui::BeginChild("ScrollingRegion", ImVec2(0, 0), false, ImGuiWindowFlags_HorizontalScrollbar);
-            for (const auto &logMsg : guiSink->getLogBuffer())
+            for (const auto &logMsg : logLines)
             {
                 ImVec4 color;
                 switch (logMsg.level)
@@ -327,6 +511,66 @@ int main(int, char **)
             ImGui::End();
         }
 
+        if (paletteEditor)
+        {
+            bool open = true;
+            ImGui::Begin("Palette Editor", &open);
+            ImGui::Text("Lock, replace or nudge entries; the image follows as you drag");
+            ImGui::Text("Edits are kept for later color reduction and dithering with these settings");
+            const std::vector<uint32_t> &palette = paletteEditor->palette();
+            bool edited = false;
+            for (size_t i = 0; i < palette.size(); ++i)
+            {
+                ImGui::PushID(static_cast<int>(i));
+                bool locked = paletteEditor->isLocked(i);
+                if (ImGui::Checkbox("##lock", &locked))
+                {
+                    paletteEditor->setLocked(i, locked);
+                }
+                ImGui::SameLine();
+                ImGui::BeginDisabled(locked);
+                float rgb[3] = {((palette[i] >> 16) & 0xFF) / 255.0f, ((palette[i] >> 8) & 0xFF) / 255.0f, (palette[i] & 0xFF) / 255.0f};
+                if (ImGui::ColorEdit3("##color", rgb, ImGuiColorEditFlags_NoInputs))
+                {
+                    paletteEditor->replace(i, static_cast<uint32_t>(rgb[0] * 255.0f + 0.5f) << 16 | static_cast<uint32_t>(rgb[1] * 255.0f + 0.5f) << 8 |
+                                                  static_cast<uint32_t>(rgb[2] * 255.0f + 0.5f));
+                    edited = true;
+                }
+                ImGui::SameLine();
+                if (ImGui::SmallButton("-"))
+                {
+                    paletteEditor->nudge(i, -4, -4, -4);
+                    edited = true;
+                }
+                ImGui::SameLine();
+                if (ImGui::SmallButton("+"))
+                {
+                    paletteEditor->nudge(i, 4, 4, 4);
+                    edited = true;
+                }
+                ImGui::EndDisabled();
+                ImGui::SameLine();
+                ImGui::Text("%06X  %zu pixels", palette[i] & 0xFFFFFF, paletteEditor->usage(i));
+                ImGui::PopID();
+            }
+            ImGui::End();
+            if (edited)
+            {
+                editedPalette = EditedPalette{paletteEditor->palette(), paletteEditorSettings.reducer, paletteEditorSettings.targetColors};
+            }
+
+            // Only the rows the edits changed go to the GPU
+            DirtyRows dirty = paletteEditor->takeDirtyRows();
+            if (!dirty.empty())
+            {
+                updateTextureRows(convertedTextureID, paletteEditor->result(), dirty);
+            }
+            if (!open)
+            {
+                paletteEditor.reset();
+            }
+        }
+
         ImGui::Render();
         int display_w, display_h;
         glfwGetFramebufferSize(window, &display_w, &display_h);
@@ -337,6 +581,10 @@ int main(int, char **)
         glfwSwapBuffers(window);
     }
 
+    preview.cancel();
+    jobs.cancel();
+    jobs.waitIdle();
+
     stbi_image_free(originalImage.data);
     stbi_image_free(processedImage.data);
     glDeleteTextures(1, &originalImage.textureID);
@@ -349,5 +597,6 @@ int main(int, char **)
     glfwDestroyWindow(window);
     glfwTerminate();
 
+    Logger::shutdown();
     return 0;
 } // end of main
\ No newline at end of file
@@ -7,6 +7,8 @@
 #pragma once
 
 #include <cstddef>
+#include <deque>
+#include <optional>
 #include <vector>
 #include <iostream>
 #include <nfd.h>
@@ -18,8 +20,14 @@
 #include "Converter.h"
 #include "Dithering.h"
 #include "ColorReducer.h"
+#include "AutoTuner.h"
+#include "ConversionPipeline.h"
+#include "PaletteEditor.h"
+#include "JobRunner.h"
+#include "ProgressivePreview.h"
 #include "GuiLogSink.h"
 #include "Logger.h"
+#include "Metrics.h"
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/basic_file_sink.h>
 
@@ -43,7 +51,25 @@ Image originalImage;
 Image processedImage;
 bool imageLoaded = false;
 bool showDebugWindow = false;
+// Set while the converted texture shows the editor's result
+std::shared_ptr<PaletteEditor> paletteEditor;
+// Reducer settings the open editor's palette was generated with
+PipelineSettings paletteEditorSettings;
+
+// Palette written back by the editor. It replaces the reducer in later runs while the
+// reducer and color count it was generated with are selected.
+struct EditedPalette
+{
+    std::vector<uint32_t> colors;
+    ColorReductionAlgorithm reducer;
+    int targetColors;
+};
+std::optional<EditedPalette> editedPalette;
 
 std::shared_ptr<GuiLogSink> guiSink;
+std::deque<LogMessage> logLines;
+uint64_t logCursor = 0;
+ConversionPipeline pipeline;
+JobRunner jobs;
+ProgressivePreview preview(pipeline);
 
-Image loadImage(const char *filename);
@@ -0,0 +1,114 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/MappedFile.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include "MappedFile.h"
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : m_data(std::exchange(other.m_data, nullptr)),
+      m_size(std::exchange(other.m_size, 0)),
+      m_mapped(std::exchange(other.m_mapped, false)),
+      m_buffer(std::move(other.m_buffer))
+{
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept
+{
+    if (this != &other)
+    {
+        release();
+        m_data = std::exchange(other.m_data, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+        m_mapped = std::exchange(other.m_mapped, false);
+        m_buffer = std::move(other.m_buffer);
+    }
+    return *this;
+}
+
+MappedFile::~MappedFile()
+{
+    release();
+}
+
+void MappedFile::release()
+{
+#ifndef _WIN32
+    if (m_mapped)
+    {
+        munmap(const_cast<uint8_t *>(m_data), m_size);
+    }
+#endif
+    m_data = nullptr;
+    m_size = 0;
+    m_mapped = false;
+    m_buffer.clear();
+}
+
+MappedFile MappedFile::open(const std::filesystem::path &path)
+{
+    MappedFile file;
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Unable to open " + path.string());
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        ::close(fd);
+        throw std::runtime_error("Unable to stat " + path.string());
+    }
+    file.m_size = static_cast<size_t>(info.st_size);
+    if (file.m_size == 0)
+    {
+        ::close(fd);
+        return file;
+    }
+
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    // Read the whole file now instead of page faulting later in a decoder thread
+    flags |= MAP_POPULATE;
+#endif
+    void *data = mmap(nullptr, file.m_size, PROT_READ, flags, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+    {
+        file.m_size = 0;
+        throw std::runtime_error("Unable to map " + path.string());
+    }
+#ifndef MAP_POPULATE
+    madvise(data, file.m_size, MADV_WILLNEED);
+#endif
+    file.m_data = static_cast<const uint8_t *>(data);
+    file.m_mapped = true;
+#else
+    std::ifstream stream(path, std::ios::binary | std::ios::ate);
+    if (!stream)
+    {
+        throw std::runtime_error("Unable to open " + path.string());
+    }
+    file.m_buffer.resize(static_cast<size_t>(stream.tellg()));
+    stream.seekg(0);
+    if (!stream.read(reinterpret_cast<char *>(file.m_buffer.data()), static_cast<std::streamsize>(file.m_buffer.size())))
+    {
+        throw std::runtime_error("Unable to read " + path.string());
+    }
+    file.m_data = file.m_buffer.data();
+    file.m_size = file.m_buffer.size();
+#endif
+    return file;
+}
@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/MappedFile.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+// Read-only file contents. On POSIX systems the file is memory mapped and its pages are
+// faulted in by open(), so whoever calls open() pays for the disk access and later
+// readers only touch memory. Elsewhere the file is read with one sequential read.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile();
+
+    static MappedFile open(const std::filesystem::path &path);
+
+    std::span<const uint8_t> bytes() const { return {m_data, m_size}; }
+    size_t size() const { return m_size; }
+    bool isMapped() const { return m_mapped; }
+
+private:
+    void release();
+
+    const uint8_t *m_data = nullptr;
+    size_t m_size = 0;
+    bool m_mapped = false;
+    std::vector<uint8_t> m_buffer;
+};
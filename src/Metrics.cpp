@@ -0,0 +1,224 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/Metrics.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include "Metrics.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#if defined(GFX_COUNT_ALLOCATIONS) && defined(__GLIBC__)
+#include <malloc.h>
+#define GFX_ALLOCATION_HOOKS 1
+static size_t allocationSize(void *p) { return malloc_usable_size(p); }
+#elif defined(GFX_COUNT_ALLOCATIONS) && defined(__APPLE__)
+#include <malloc/malloc.h>
+#define GFX_ALLOCATION_HOOKS 1
+static size_t allocationSize(void *p) { return malloc_size(p); }
+#endif
+
+namespace
+{
+    // Constant initialized, so usable from operator new before any static constructor ran
+    thread_local AllocationCounters::Snapshot counters;
+}
+
+#ifdef GFX_ALLOCATION_HOOKS
+namespace
+{
+    void *countedAllocation(void *p)
+    {
+        size_t size = allocationSize(p);
+        counters.bytes += size;
+        ++counters.count;
+        counters.live += static_cast<int64_t>(size);
+        counters.peak = std::max(counters.peak, counters.live);
+        return p;
+    }
+
+    void countedFree(void *p)
+    {
+        if (p != nullptr)
+        {
+            // Memory freed by another thread than the one that allocated it shows up as a
+            // negative live size here; peaks are only compared within one thread
+            counters.live -= static_cast<int64_t>(allocationSize(p));
+            std::free(p);
+        }
+    }
+
+    void *allocate(size_t size)
+    {
+        void *p = std::malloc(size == 0 ? 1 : size);
+        if (p == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        return countedAllocation(p);
+    }
+
+    void *allocateAligned(size_t size, std::align_val_t alignment)
+    {
+        void *p = nullptr;
+        size_t align = std::max(static_cast<size_t>(alignment), sizeof(void *));
+        if (posix_memalign(&p, align, size == 0 ? 1 : size) != 0)
+        {
+            throw std::bad_alloc();
+        }
+        return countedAllocation(p);
+    }
+}
+
+void *operator new(size_t size) { return allocate(size); }
+void *operator new[](size_t size) { return allocate(size); }
+void *operator new(size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+void *operator new[](size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+void operator delete(void *p) noexcept { countedFree(p); }
+void operator delete[](void *p) noexcept { countedFree(p); }
+void operator delete(void *p, size_t) noexcept { countedFree(p); }
+void operator delete[](void *p, size_t) noexcept { countedFree(p); }
+void operator delete(void *p, std::align_val_t) noexcept { countedFree(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { countedFree(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept { countedFree(p); }
+void operator delete[](void *p, size_t, std::align_val_t) noexcept { countedFree(p); }
+#endif
+
+bool AllocationCounters::enabled()
+{
+#ifdef GFX_ALLOCATION_HOOKS
+    return true;
+#else
+    return false;
+#endif
+}
+
+AllocationCounters::Snapshot AllocationCounters::current()
+{
+    return counters;
+}
+
+int64_t AllocationCounters::resetPeak()
+{
+    int64_t previous = counters.peak;
+    counters.peak = counters.live;
+    return previous;
+}
+
+void AllocationCounters::restorePeak(int64_t peak)
+{
+    counters.peak = std::max(counters.peak, peak);
+}
+
+MetricsRegistry &MetricsRegistry::instance()
+{
+    static MetricsRegistry registry;
+    return registry;
+}
+
+void MetricsRegistry::record(std::string_view stage, const StageSample &sample)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_stages.find(stage);
+    if (it == m_stages.end())
+    {
+        it = m_stages.emplace(std::string(stage), Stage{}).first;
+    }
+    Stage &entry = it->second;
+    ++entry.calls;
+    entry.totalMilliseconds += sample.milliseconds;
+    entry.allocatedBytes += sample.allocatedBytes;
+    entry.allocations += sample.allocations;
+    entry.peakBytes = std::max(entry.peakBytes, sample.peakBytes);
+    entry.recent[entry.next] = sample.milliseconds;
+    entry.next = (entry.next + 1) % WINDOW;
+}
+
+std::vector<StageSummary> MetricsRegistry::summary() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<StageSummary> result;
+    result.reserve(m_stages.size());
+    for (const auto &[name, stage] : m_stages)
+    {
+        StageSummary summary;
+        summary.stage = name;
+        summary.calls = stage.calls;
+        summary.totalMilliseconds = stage.totalMilliseconds;
+        summary.lastMilliseconds = stage.recent[(stage.next + WINDOW - 1) % WINDOW];
+        summary.allocatedBytes = stage.allocatedBytes;
+        summary.allocations = stage.allocations;
+        summary.peakBytes = stage.peakBytes;
+
+        std::vector<double> recent(stage.recent.begin(), stage.recent.begin() + std::min<uint64_t>(stage.calls, WINDOW));
+        std::sort(recent.begin(), recent.end());
+        auto percentile = [&recent](double q)
+        {
+            size_t rank = static_cast<size_t>(std::ceil(q * recent.size()));
+            return recent.empty() ? 0.0 : recent[std::clamp<size_t>(rank, 1, recent.size()) - 1];
+        };
+        summary.p50 = percentile(0.50);
+        summary.p90 = percentile(0.90);
+        summary.p99 = percentile(0.99);
+        result.push_back(std::move(summary));
+    }
+    return result;
+}
+
+std::string MetricsRegistry::toJson() const
+{
+    std::string json = std::string("{\n  \"allocationCounting\": ") + (AllocationCounters::enabled() ? "true" : "false") + ",\n  \"stages\": [";
+    std::vector<StageSummary> stages = summary();
+    for (size_t i = 0; i < stages.size(); ++i)
+    {
+        const StageSummary &s = stages[i];
+        std::string name;
+        for (char c : s.stage)
+        {
+            if (c == '"' || c == '\\')
+            {
+                name += '\\';
+            }
+            name += c;
+        }
+        char line[512];
+        std::snprintf(line, sizeof(line),
+                      "%s\n    {\"stage\": \"%s\", \"calls\": %llu, \"totalMs\": %.3f, \"lastMs\": %.3f, \"p50Ms\": %.3f, \"p90Ms\": %.3f, "
+                      "\"p99Ms\": %.3f, \"allocatedBytes\": %llu, \"allocations\": %llu, \"peakBytes\": %llu}",
+                      i == 0 ? "" : ",", name.c_str(), static_cast<unsigned long long>(s.calls), s.totalMilliseconds, s.lastMilliseconds,
+                      s.p50, s.p90, s.p99, static_cast<unsigned long long>(s.allocatedBytes), static_cast<unsigned long long>(s.allocations),
+                      static_cast<unsigned long long>(s.peakBytes));
+        json += line;
+    }
+    json += stages.empty() ? "]\n}\n" : "\n  ]\n}\n";
+    return json;
+}
+
+void MetricsRegistry::reset()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stages.clear();
+}
+
+StageTimer::StageTimer(std::string_view stage)
+    : m_stage(stage), m_before(AllocationCounters::current()), m_outerPeak(AllocationCounters::resetPeak())
+{
+    m_start = std::chrono::steady_clock::now();
+}
+
+StageTimer::~StageTimer()
+{
+    auto elapsed = std::chrono::steady_clock::now() - m_start;
+    AllocationCounters::Snapshot after = AllocationCounters::current();
+    AllocationCounters::restorePeak(m_outerPeak);
+
+    StageSample sample;
+    sample.milliseconds = std::chrono::duration<double, std::milli>(elapsed).count();
+    sample.allocatedBytes = after.bytes - m_before.bytes;
+    sample.allocations = after.count - m_before.count;
+    sample.peakBytes = static_cast<uint64_t>(std::max<int64_t>(0, after.peak - m_before.live));
+    MetricsRegistry::instance().record(m_stage, sample);
+}
@@ -0,0 +1,108 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/Metrics.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Heap allocations made by the current thread. Counted by replacing the global operator
+// new/delete when the library is built with GFX_COUNT_ALLOCATIONS on a platform that can
+// report allocation sizes; elsewhere every counter stays 0.
+namespace AllocationCounters
+{
+    struct Snapshot
+    {
+        uint64_t bytes = 0;
+        uint64_t count = 0;
+        // Bytes allocated and not yet freed by this thread, and the highest value seen
+        int64_t live = 0;
+        int64_t peak = 0;
+    };
+
+    bool enabled();
+    Snapshot current();
+    // Restarts peak tracking at the current live size and returns the previous peak
+    int64_t resetPeak();
+    void restorePeak(int64_t peak);
+}
+
+struct StageSample
+{
+    double milliseconds = 0.0;
+    uint64_t allocatedBytes = 0;
+    uint64_t allocations = 0;
+    // Highest live heap size above the level at the start of the stage
+    uint64_t peakBytes = 0;
+};
+
+struct StageSummary
+{
+    std::string stage;
+    uint64_t calls = 0;
+    double totalMilliseconds = 0.0;
+    double lastMilliseconds = 0.0;
+    // Over the most recent MetricsRegistry::WINDOW calls
+    double p50 = 0.0;
+    double p90 = 0.0;
+    double p99 = 0.0;
+    uint64_t allocatedBytes = 0;
+    uint64_t allocations = 0;
+    uint64_t peakBytes = 0;
+};
+
+// Process-wide timing and allocation totals per named stage
+class MetricsRegistry
+{
+public:
+    static constexpr size_t WINDOW = 128;
+
+    static MetricsRegistry &instance();
+
+    void record(std::string_view stage, const StageSample &sample);
+    std::vector<StageSummary> summary() const;
+    std::string toJson() const;
+    void reset();
+
+private:
+    struct Stage
+    {
+        uint64_t calls = 0;
+        double totalMilliseconds = 0.0;
+        uint64_t allocatedBytes = 0;
+        uint64_t allocations = 0;
+        uint64_t peakBytes = 0;
+        std::array<double, WINDOW> recent{};
+        size_t next = 0;
+    };
+
+    mutable std::mutex m_mutex;
+    std::map<std::string, Stage, std::less<>> m_stages;
+};
+
+// Times its own lifetime and the heap use of the current thread and reports both to
+// the registry. Nested timers each report their full scope.
+class StageTimer
+{
+public:
+    explicit StageTimer(std::string_view stage);
+    ~StageTimer();
+    StageTimer(const StageTimer &) = delete;
+    StageTimer &operator=(const StageTimer &) = delete;
+
+private:
+    std::string_view m_stage;
+    std::chrono::steady_clock::time_point m_start;
+    AllocationCounters::Snapshot m_before;
+    int64_t m_outerPeak;
+};
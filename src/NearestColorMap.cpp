@@ -0,0 +1,150 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/NearestColorMap.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include "NearestColorMap.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <stdexcept>
+
+namespace
+{
+    std::array<int, 3> channels(uint32_t color)
+    {
+        return {static_cast<int>((color >> 16) & 0xFF), static_cast<int>((color >> 8) & 0xFF), static_cast<int>(color & 0xFF)};
+    }
+
+    int distanceSquared(const std::array<int, 3> &a, const std::array<int, 3> &b)
+    {
+        int dr = a[0] - b[0];
+        int dg = a[1] - b[1];
+        int db = a[2] - b[2];
+        return dr * dr + dg * dg + db * db;
+    }
+}
+
+NearestColorMap::NearestColorMap(std::vector<uint32_t> palette) : m_palette(std::move(palette))
+{
+    if (m_palette.empty())
+    {
+        throw std::invalid_argument("Cannot map to an empty palette");
+    }
+    if (m_palette.size() > std::numeric_limits<uint16_t>::max())
+    {
+        throw std::invalid_argument("Palette is too large for a nearest color map");
+    }
+
+    std::vector<std::array<int, 3>> entries;
+    for (uint32_t color : m_palette)
+    {
+        entries.push_back(channels(color));
+    }
+
+    const int cellSize = 1 << CELL_BITS;
+    const size_t cells = static_cast<size_t>(CELLS_PER_AXIS) * CELLS_PER_AXIS * CELLS_PER_AXIS;
+    m_offsets.reserve(cells + 1);
+    m_offsets.push_back(0);
+    std::vector<int> minimum(entries.size());
+    for (size_t cell = 0; cell < cells; ++cell)
+    {
+        std::array<int, 3> low = {static_cast<int>(cell / (CELLS_PER_AXIS * CELLS_PER_AXIS)) * cellSize,
+                                  static_cast<int>(cell / CELLS_PER_AXIS % CELLS_PER_AXIS) * cellSize,
+                                  static_cast<int>(cell % CELLS_PER_AXIS) * cellSize};
+
+        // Every color of the cell is at most `bound` away from the entry whose farthest
+        // corner is nearest, so entries that are farther than that from the whole cell
+        // can never win
+        int bound = std::numeric_limits<int>::max();
+        for (size_t e = 0; e < entries.size(); ++e)
+        {
+            int nearDistance = 0;
+            int farDistance = 0;
+            for (int c = 0; c < 3; ++c)
+            {
+                int high = low[c] + cellSize - 1;
+                int value = entries[e][c];
+                int nearGap = value < low[c] ? low[c] - value : value > high ? value - high : 0;
+                int farGap = std::max(value - low[c], high - value);
+                nearDistance += nearGap * nearGap;
+                farDistance += farGap * farGap;
+            }
+            minimum[e] = nearDistance;
+            bound = std::min(bound, farDistance);
+        }
+        for (size_t e = 0; e < entries.size(); ++e)
+        {
+            if (minimum[e] <= bound)
+            {
+                m_candidates.push_back(static_cast<uint16_t>(e));
+            }
+        }
+        m_offsets.push_back(static_cast<uint32_t>(m_candidates.size()));
+    }
+}
+
+size_t NearestColorMap::cellOf(uint32_t color)
+{
+    size_t r = (color >> (16 + CELL_BITS)) & (CELLS_PER_AXIS - 1);
+    size_t g = (color >> (8 + CELL_BITS)) & (CELLS_PER_AXIS - 1);
+    size_t b = (color >> CELL_BITS) & (CELLS_PER_AXIS - 1);
+    return (r * CELLS_PER_AXIS + g) * CELLS_PER_AXIS + b;
+}
+
+size_t NearestColorMap::index(uint32_t color) const
+{
+    size_t cell = cellOf(color);
+    std::array<int, 3> rgb = channels(color);
+    size_t best = 0;
+    int bestDistance = std::numeric_limits<int>::max();
+    for (uint32_t i = m_offsets[cell]; i < m_offsets[cell + 1]; ++i)
+    {
+        size_t entry = m_candidates[i];
+        int distance = distanceSquared(rgb, channels(m_palette[entry]));
+        if (distance < bestDistance)
+        {
+            bestDistance = distance;
+            best = entry;
+        }
+    }
+    return best;
+}
+
+double NearestColorMap::averageCandidates() const
+{
+    return static_cast<double>(m_candidates.size()) / (m_offsets.size() - 1);
+}
+
+void NearestColorMap::remap(ConstPixelView image, PixelView output, ProgressToken *progress) const
+{
+    StageTimer timer("remap");
+    if (output.width() != image.width() || output.height() != image.height())
+    {
+        throw std::invalid_argument("Remap output size does not match the image");
+    }
+    for (int y = 0; y < image.height(); ++y)
+    {
+        if (progress && (y & 15) == 0)
+        {
+            progress->checkpoint();
+            progress->report(static_cast<float>(y) / image.height());
+        }
+        std::span<const uint32_t> in = image.row(y);
+        std::span<uint32_t> out = output.row(y);
+        for (size_t x = 0; x < in.size(); ++x)
+        {
+            // Runs of one color are common in the images this is used for
+            out[x] = x > 0 && in[x] == in[x - 1] ? out[x - 1] : nearest(in[x]);
+        }
+    }
+}
+
+PixelBuffer NearestColorMap::remap(ConstPixelView image, ProgressToken *progress) const
+{
+    PixelBuffer output(image.width(), image.height());
+    remap(image, output, progress);
+    return output;
+}
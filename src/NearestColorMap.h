@@ -0,0 +1,43 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/NearestColorMap.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include "PixelBuffer.h"
+#include "ProgressToken.h"
+#include <cstdint>
+#include <vector>
+
+// Exact nearest palette color for any number of pixels against one palette. The RGB cube
+// is split into 32x32x32 cells of 8x8x8 colors and every cell lists the palette entries
+// that can be nearest to some color inside it, so a lookup only measures a few entries.
+// Ties go to the lower palette index, which gives the same result as ColorReducer::remap.
+// Immutable after construction and safe to share between threads.
+class NearestColorMap
+{
+public:
+    explicit NearestColorMap(std::vector<uint32_t> palette);
+
+    size_t index(uint32_t color) const;
+    uint32_t nearest(uint32_t color) const { return m_palette[index(color)]; }
+    const std::vector<uint32_t> &palette() const { return m_palette; }
+    // Average number of entries measured per lookup
+    double averageCandidates() const;
+
+    void remap(ConstPixelView image, PixelView output, ProgressToken *progress = nullptr) const;
+    PixelBuffer remap(ConstPixelView image, ProgressToken *progress = nullptr) const;
+
+private:
+    static constexpr int CELL_BITS = 3;
+    static constexpr int CELLS_PER_AXIS = 256 >> CELL_BITS;
+
+    static size_t cellOf(uint32_t color);
+
+    std::vector<uint32_t> m_palette;
+    // Candidates of cell c are m_candidates[m_offsets[c]] up to m_candidates[m_offsets[c + 1]]
+    std::vector<uint32_t> m_offsets;
+    std::vector<uint16_t> m_candidates;
+};
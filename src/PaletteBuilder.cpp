@@ -0,0 +1,172 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/PaletteBuilder.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include "PaletteBuilder.h"
+#include "Metrics.h"
+#include "Parallel.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+
+namespace
+{
+    // Merges the colors that agree in their top bits per channel, dropping one more low
+    // bit at a time until at most maxColors remain. A merged color sits at the count
+    // weighted mean of its members, which stays inside their cell, so the result is
+    // still sorted and distinct.
+    ColorHistogram coarsen(const ColorHistogram &histogram, size_t maxColors)
+    {
+        std::vector<std::pair<uint32_t, uint32_t>> cells(histogram.colors.size());
+        ColorHistogram coarse;
+        for (int shift = 1; shift < 8; ++shift)
+        {
+            uint32_t channel = (0xFFu << shift) & 0xFF;
+            uint32_t mask = channel << 16 | channel << 8 | channel;
+            for (size_t i = 0; i < cells.size(); ++i)
+            {
+                cells[i] = {histogram.colors[i] & mask, static_cast<uint32_t>(i)};
+            }
+            std::sort(cells.begin(), cells.end());
+            size_t distinct = 0;
+            for (size_t i = 0; i < cells.size(); ++i)
+            {
+                distinct += i == 0 || cells[i].first != cells[i - 1].first;
+            }
+            if (distinct <= maxColors || shift == 7)
+            {
+                break;
+            }
+        }
+
+        for (size_t i = 0; i < cells.size();)
+        {
+            uint64_t count = 0;
+            std::array<uint64_t, 3> sums{};
+            size_t end = i;
+            for (; end < cells.size() && cells[end].first == cells[i].first; ++end)
+            {
+                uint32_t color = histogram.colors[cells[end].second];
+                uint64_t weight = histogram.counts[cells[end].second];
+                count += weight;
+                sums[0] += ((color >> 16) & 0xFF) * weight;
+                sums[1] += ((color >> 8) & 0xFF) * weight;
+                sums[2] += (color & 0xFF) * weight;
+            }
+            auto mean = [count](uint64_t sum)
+            { return static_cast<uint32_t>((sum + count / 2) / count); };
+            coarse.colors.push_back(mean(sums[0]) << 16 | mean(sums[1]) << 8 | mean(sums[2]));
+            coarse.counts.push_back(count);
+            i = end;
+        }
+        return coarse;
+    }
+}
+
+ColorHistogram PaletteBuilder::merge(const ColorHistogram &first, const ColorHistogram &second)
+{
+    ColorHistogram merged;
+    merged.colors.reserve(first.colors.size() + second.colors.size());
+    merged.counts.reserve(first.colors.size() + second.colors.size());
+    size_t a = 0;
+    size_t b = 0;
+    while (a < first.colors.size() || b < second.colors.size())
+    {
+        if (b == second.colors.size() || (a < first.colors.size() && first.colors[a] < second.colors[b]))
+        {
+            merged.colors.push_back(first.colors[a]);
+            merged.counts.push_back(first.counts[a++]);
+        }
+        else if (a == first.colors.size() || second.colors[b] < first.colors[a])
+        {
+            merged.colors.push_back(second.colors[b]);
+            merged.counts.push_back(second.counts[b++]);
+        }
+        else
+        {
+            merged.colors.push_back(first.colors[a]);
+            merged.counts.push_back(first.counts[a++] + second.counts[b++]);
+        }
+    }
+    return merged;
+}
+
+ColorHistogram PaletteBuilder::histogram(size_t count, const Loader &load, int threads, ProgressToken *progress)
+{
+    StageTimer timer("shared histogram");
+    const size_t workers = std::min(count, static_cast<size_t>(Parallel::resolveThreadCount(threads)));
+    std::vector<ColorHistogram> partial(workers);
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    Parallel::forEach(workers, static_cast<int>(workers), [&](size_t worker)
+                      {
+        for (size_t i = next++; i < count; i = next++)
+        {
+            ProgressToken::checkpoint(progress);
+            PixelBuffer image = load(i);
+            partial[worker] = merge(partial[worker], ColorReducer::buildHistogram(image));
+            ProgressToken::report(progress, static_cast<float>(++done) / count);
+        } });
+
+    // Pairwise, so every color is merged about log2(workers) times
+    while (partial.size() > 1)
+    {
+        std::vector<ColorHistogram> merged((partial.size() + 1) / 2);
+        Parallel::forEach(merged.size(), threads, [&](size_t i)
+                          { merged[i] = 2 * i + 1 < partial.size() ? merge(partial[2 * i], partial[2 * i + 1]) : std::move(partial[2 * i]); });
+        partial = std::move(merged);
+    }
+    return partial.empty() ? ColorHistogram{} : std::move(partial.front());
+}
+
+std::vector<uint32_t> PaletteBuilder::samples(const ColorHistogram &histogram)
+{
+    // Too many distinct colors would leave no room for their weights
+    ColorHistogram coarse;
+    if (histogram.colors.size() > MAX_SAMPLES / 2)
+    {
+        coarse = coarsen(histogram, MAX_SAMPLES / 2);
+    }
+    const ColorHistogram &source = coarse.colors.empty() ? histogram : coarse;
+
+    // The reducers take pixels, so every color is repeated by its count. For large sets
+    // each color keeps one sample and the rest of the budget is shared by count, which
+    // never exceeds MAX_SAMPLES. Colors stay in histogram order, which keeps the result
+    // deterministic.
+    uint64_t total = std::accumulate(source.counts.begin(), source.counts.end(), uint64_t(0));
+    const size_t distinct = source.colors.size();
+    double scale = total > MAX_SAMPLES ? static_cast<double>(MAX_SAMPLES - distinct) / static_cast<double>(total - distinct) : 1.0;
+    std::vector<uint32_t> result;
+    result.reserve(static_cast<size_t>(std::min<uint64_t>(total, MAX_SAMPLES)));
+    for (size_t i = 0; i < distinct; ++i)
+    {
+        size_t repeat = total > MAX_SAMPLES ? 1 + static_cast<size_t>(std::floor(static_cast<double>(source.counts[i] - 1) * scale))
+                                            : static_cast<size_t>(source.counts[i]);
+        result.insert(result.end(), repeat, source.colors[i]);
+    }
+    return result;
+}
+
+std::vector<uint32_t> PaletteBuilder::build(const ColorHistogram &histogram, int targetColors, ColorReductionAlgorithm algo,
+                                            ProgressToken *progress, uint64_t seed)
+{
+    if (histogram.colors.empty())
+    {
+        throw std::invalid_argument("Cannot build a palette from an empty histogram");
+    }
+
+    // Merged colors only exist past MAX_SAMPLES / 2 distinct colors, far more than any
+    // palette, so the histogram itself still decides whether reduction is needed
+    std::vector<uint32_t> pixels = samples(histogram);
+    int width = static_cast<int>(pixels.size());
+    std::vector<uint32_t> palette = ColorReducer::generatePalette(ConstPixelView(pixels.data(), width, 1, width), histogram, targetColors,
+                                                                  algo, progress, seed);
+    SPDLOG_DEBUG("Shared palette of {} colors from {} distinct colors and {} samples", palette.size(), histogram.colors.size(), pixels.size());
+    return palette;
+}
@@ -0,0 +1,39 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/PaletteBuilder.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include "ColorReducer.h"
+#include "PixelBuffer.h"
+#include "ProgressToken.h"
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// One palette for a whole set of images, e.g. the tiles of a level. The images are
+// counted into one weighted histogram and the palette is built from it once; remapping
+// against it is done with a NearestColorMap shared by all images.
+class PaletteBuilder
+{
+public:
+    // Loads image `index`; called from several threads at once
+    using Loader = std::function<PixelBuffer(size_t index)>;
+
+    // Histogram of all `count` images. Every worker merges the images it loads into its
+    // own histogram and the worker histograms are merged once at the end.
+    static ColorHistogram histogram(size_t count, const Loader &load, int threads = 0, ProgressToken *progress = nullptr);
+    static ColorHistogram merge(const ColorHistogram &first, const ColorHistogram &second);
+    // Palette of the histogram's colors weighted by their counts, with any reducer
+    static std::vector<uint32_t> build(const ColorHistogram &histogram, int targetColors, ColorReductionAlgorithm algo,
+                                       ProgressToken *progress = nullptr, uint64_t seed = ColorReducer::DEFAULT_SEED);
+
+    // The pixels build() hands to the reducer, at most MAX_SAMPLES of them, in color order
+    static std::vector<uint32_t> samples(const ColorHistogram &histogram);
+
+    // Pixels the reducers see at most. Larger histograms are scaled down; past
+    // MAX_SAMPLES / 2 distinct colors, neighboring colors are merged first.
+    static constexpr size_t MAX_SAMPLES = size_t(1) << 22;
+};
@@ -0,0 +1,322 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/PaletteEditor.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include "PaletteEditor.h"
+#include "Metrics.h"
+#include "Parallel.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+    std::array<int, 3> channels(uint32_t color)
+    {
+        return {static_cast<int>((color >> 16) & 0xFF), static_cast<int>((color >> 8) & 0xFF), static_cast<int>(color & 0xFF)};
+    }
+
+    int distanceSquared(const std::array<int, 3> &a, const std::array<int, 3> &b)
+    {
+        int dr = a[0] - b[0];
+        int dg = a[1] - b[1];
+        int db = a[2] - b[2];
+        return dr * dr + dg * dg + db * db;
+    }
+
+    // Squared distance from `color` to the nearest point of the box
+    int boxDistance(const std::array<int, 3> &color, const std::array<int, 3> &low, const std::array<int, 3> &high)
+    {
+        int distance = 0;
+        for (int c = 0; c < 3; ++c)
+        {
+            int gap = color[c] < low[c] ? low[c] - color[c] : color[c] > high[c] ? color[c] - high[c] : 0;
+            distance += gap * gap;
+        }
+        return distance;
+    }
+
+    uint32_t shiftChannel(uint32_t color, int shift, int delta)
+    {
+        return static_cast<uint32_t>(std::clamp(static_cast<int>((color >> shift) & 0xFF) + delta, 0, 255)) << shift;
+    }
+}
+
+PaletteEditor::PaletteEditor(ConstPixelView source, std::vector<uint32_t> palette, int threads)
+    : m_source(source), m_result(source.width(), source.height()), m_palette(std::move(palette)), m_threads(threads)
+{
+    StageTimer timer("remap");
+    // Validates the palette and gives the initial indices
+    NearestColorMap map(m_palette);
+    m_usage.assign(m_palette.size(), 0);
+    m_locked.assign(m_palette.size(), false);
+    m_indices.resize(static_cast<size_t>(source.width()) * source.height());
+    m_tilesX = (source.width() + TILE - 1) / TILE;
+    m_tilesY = (source.height() + TILE - 1) / TILE;
+    m_tiles.resize(static_cast<size_t>(m_tilesX) * m_tilesY);
+    m_wordsPerRow = (static_cast<size_t>(m_tilesX) + 63) / 64;
+    m_entryTiles.assign(m_palette.size(), std::vector<uint64_t>(m_wordsPerRow * m_tilesY, 0));
+
+    Parallel::forEach(static_cast<size_t>(m_tilesY), m_threads, [&](size_t tileY)
+                      {
+        int y0 = static_cast<int>(tileY) * TILE;
+        int y1 = std::min(y0 + TILE, m_source.height());
+        for (int y = y0; y < y1; ++y)
+        {
+            std::span<const uint32_t> in = m_source.row(y);
+            std::span<uint32_t> out = m_result.row(y);
+            uint16_t *indices = m_indices.data() + static_cast<size_t>(y) * m_source.width();
+            for (size_t x = 0; x < in.size(); ++x)
+            {
+                indices[x] = x > 0 && in[x] == in[x - 1] ? indices[x - 1] : static_cast<uint16_t>(map.index(in[x]));
+                out[x] = m_palette[indices[x]];
+            }
+        }
+        std::vector<uint16_t> entries;
+        for (int tileX = 0; tileX < m_tilesX; ++tileX)
+        {
+            Tile &tile = m_tiles[tileY * m_tilesX + tileX];
+            tile.low = {255, 255, 255};
+            tile.high = {0, 0, 0};
+            entries.clear();
+            for (int y = y0; y < y1; ++y)
+            {
+                for (int x = tileX * TILE; x < std::min((tileX + 1) * TILE, m_source.width()); ++x)
+                {
+                    std::array<int, 3> rgb = channels(m_source(x, y));
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        tile.low[c] = std::min(tile.low[c], rgb[c]);
+                        tile.high[c] = std::max(tile.high[c], rgb[c]);
+                    }
+                    entries.push_back(m_indices[static_cast<size_t>(y) * m_source.width() + x]);
+                }
+            }
+            updateTile(tileY * m_tilesX + tileX, entries);
+        } });
+
+    for (uint16_t index : m_indices)
+    {
+        ++m_usage[index];
+    }
+    m_dirty = {0, source.height()};
+}
+
+void PaletteEditor::checkEntry(size_t entry) const
+{
+    if (entry >= m_palette.size())
+    {
+        throw std::out_of_range("Palette entry " + std::to_string(entry) + " out of range");
+    }
+}
+
+size_t PaletteEditor::usage(size_t entry) const
+{
+    checkEntry(entry);
+    return m_usage[entry];
+}
+
+bool PaletteEditor::isLocked(size_t entry) const
+{
+    checkEntry(entry);
+    return m_locked[entry];
+}
+
+void PaletteEditor::setLocked(size_t entry, bool locked)
+{
+    checkEntry(entry);
+    m_locked[entry] = locked;
+}
+
+bool PaletteEditor::usesEntry(size_t entry, size_t tile) const
+{
+    size_t bit = tile / m_tilesX * m_wordsPerRow * 64 + tile % m_tilesX;
+    return (m_entryTiles[entry][bit / 64] >> (bit % 64)) & 1;
+}
+
+void PaletteEditor::setUsesEntry(size_t entry, size_t tile, bool uses)
+{
+    size_t bit = tile / m_tilesX * m_wordsPerRow * 64 + tile % m_tilesX;
+    uint64_t &word = m_entryTiles[entry][bit / 64];
+    word = uses ? word | (uint64_t(1) << (bit % 64)) : word & ~(uint64_t(1) << (bit % 64));
+}
+
+void PaletteEditor::updateTile(size_t tile, std::vector<uint16_t> &entries)
+{
+    std::sort(entries.begin(), entries.end());
+    entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+    std::vector<bool> used(entries.size(), false);
+
+    int tileX = static_cast<int>(tile % m_tilesX);
+    int tileY = static_cast<int>(tile / m_tilesX);
+    int error = 0;
+    for (int y = tileY * TILE; y < std::min((tileY + 1) * TILE, m_source.height()); ++y)
+    {
+        for (int x = tileX * TILE; x < std::min((tileX + 1) * TILE, m_source.width()); ++x)
+        {
+            uint16_t index = m_indices[static_cast<size_t>(y) * m_source.width() + x];
+            error = std::max(error, distanceSquared(channels(m_source(x, y)), channels(m_palette[index])));
+            auto it = std::lower_bound(entries.begin(), entries.end(), index);
+            if (it != entries.end() && *it == index)
+            {
+                used[it - entries.begin()] = true;
+            }
+        }
+    }
+    m_tiles[tile].error = error;
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        setUsesEntry(entries[i], tile, used[i]);
+    }
+}
+
+void PaletteEditor::editRow(int tileY, uint16_t entry, const NearestColorMap *map, Band &band)
+{
+    const std::array<int, 3> color = channels(m_palette[entry]);
+    const int width = m_source.width();
+    // Pixels per entry in the current tile, reset after every tile
+    std::vector<uint16_t> count(m_palette.size(), 0);
+    std::vector<uint16_t> present;
+    std::vector<uint16_t> moved;
+    for (int tileX = 0; tileX < m_tilesX; ++tileX)
+    {
+        size_t tile = static_cast<size_t>(tileY) * m_tilesX + tileX;
+        // Any other pixel only moves when the new color is at least as close as its
+        // current one, which no pixel of the tile is when the whole box is farther away
+        bool reachable = boxDistance(color, m_tiles[tile].low, m_tiles[tile].high) <= m_tiles[tile].error;
+        if (!reachable && !usesEntry(entry, tile))
+        {
+            continue;
+        }
+        ++band.visited;
+        moved.assign(1, entry);
+        int error = 0;
+        const int x0 = tileX * TILE;
+        const int columns = std::min(TILE, width - x0);
+        for (int y = tileY * TILE; y < std::min((tileY + 1) * TILE, m_source.height()); ++y)
+        {
+            const uint32_t *in = m_source.row(y).data() + x0;
+            uint32_t *out = m_result.row(y).data() + x0;
+            uint16_t *indices = m_indices.data() + static_cast<size_t>(y) * width + x0;
+            for (int x = 0; x < columns; ++x)
+            {
+                std::array<int, 3> rgb = channels(in[x]);
+                uint16_t index = indices[x];
+                uint16_t next = index;
+                int distance = 0;
+                if (index == entry)
+                {
+                    // May move anywhere
+                    next = static_cast<uint16_t>(map->index(in[x]));
+                    distance = distanceSquared(rgb, channels(m_palette[next]));
+                }
+                else
+                {
+                    distance = distanceSquared(rgb, channels(m_palette[index]));
+                    int candidate = reachable ? distanceSquared(rgb, color) : std::numeric_limits<int>::max();
+                    // Ties go to the lower index, as in a full remap
+                    if (candidate < distance || (candidate == distance && entry < index))
+                    {
+                        next = entry;
+                        distance = candidate;
+                    }
+                }
+                error = std::max(error, distance);
+                if (count[next]++ == 0)
+                {
+                    present.push_back(next);
+                }
+                if (next != index)
+                {
+                    --band.usage[index];
+                    ++band.usage[next];
+                    moved.push_back(index);
+                    moved.push_back(next);
+                    indices[x] = next;
+                }
+                if (out[x] != m_palette[next])
+                {
+                    out[x] = m_palette[next];
+                    ++band.changed;
+                    band.firstRow = band.lastRow < 0 ? y : std::min(band.firstRow, y);
+                    band.lastRow = std::max(band.lastRow, y);
+                }
+            }
+        }
+
+        m_tiles[tile].error = error;
+        for (uint16_t index : moved)
+        {
+            setUsesEntry(index, tile, count[index] > 0);
+        }
+        for (uint16_t index : present)
+        {
+            count[index] = 0;
+        }
+        present.clear();
+    }
+}
+
+size_t PaletteEditor::replace(size_t entry, uint32_t color)
+{
+    checkEntry(entry);
+    if (m_locked[entry])
+    {
+        throw std::invalid_argument("Palette entry " + std::to_string(entry) + " is locked");
+    }
+    if (m_palette[entry] == color)
+    {
+        return 0;
+    }
+
+    StageTimer timer("palette edit");
+    m_palette[entry] = color;
+    // Only pixels of the edited entry need a full lookup
+    std::optional<NearestColorMap> map;
+    if (m_usage[entry] > 0)
+    {
+        map.emplace(m_palette);
+    }
+    std::vector<Band> bands(static_cast<size_t>(m_tilesY));
+    Parallel::forEach(bands.size(), m_threads, [&](size_t tileY)
+                      { editRow(static_cast<int>(tileY), static_cast<uint16_t>(entry), map ? &*map : nullptr, bands[tileY]); });
+
+    size_t changed = 0;
+    m_lastVisitedTiles = 0;
+    for (const Band &band : bands)
+    {
+        changed += band.changed;
+        m_lastVisitedTiles += band.visited;
+        for (const auto &[index, delta] : band.usage)
+        {
+            m_usage[index] += delta;
+        }
+        if (band.lastRow >= 0)
+        {
+            m_dirty = m_dirty.empty() ? DirtyRows{band.firstRow, band.lastRow + 1}
+                                      : DirtyRows{std::min(m_dirty.begin, band.firstRow), std::max(m_dirty.end, band.lastRow + 1)};
+        }
+    }
+    SPDLOG_DEBUG("Palette entry {} set to {:06X}: {} pixels changed, {} of {} tiles visited", entry, color, changed,
+                 m_lastVisitedTiles, m_tiles.size());
+    return changed;
+}
+
+size_t PaletteEditor::nudge(size_t entry, int red, int green, int blue)
+{
+    checkEntry(entry);
+    uint32_t color = m_palette[entry];
+    return replace(entry, (color & 0xFF000000) | shiftChannel(color, 16, red) | shiftChannel(color, 8, green) | shiftChannel(color, 0, blue));
+}
+
+DirtyRows PaletteEditor::takeDirtyRows()
+{
+    DirtyRows dirty = m_dirty;
+    m_dirty = {};
+    return dirty;
+}
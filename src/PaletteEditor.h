@@ -0,0 +1,99 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/PaletteEditor.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include "NearestColorMap.h"
+#include "PixelBuffer.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Output rows [begin, end) that changed since they were last taken
+struct DirtyRows
+{
+    int begin = 0;
+    int end = 0;
+
+    bool empty() const { return begin >= end; }
+};
+
+// Interactive editing of single palette entries on a remapped image. The editor keeps
+// the palette index of every pixel and, per entry, a bitmap of the 16x16 tiles that use
+// it. Changing entry k can only move pixels that use k, or pixels that are now closer to
+// k than to their own entry; tiles whose source colors are all farther from the new
+// color than their worst current match are skipped without looking at their pixels. The
+// result always equals a full nearest color remap to the edited palette.
+class PaletteEditor
+{
+public:
+    static constexpr int TILE = 16;
+
+    // threads: workers per edit, 0 for one per hardware thread
+    PaletteEditor(ConstPixelView source, std::vector<uint32_t> palette, int threads = 0);
+
+    const std::vector<uint32_t> &palette() const { return m_palette; }
+    const PixelBuffer &result() const { return m_result; }
+    // Palette index of every pixel, row by row
+    const std::vector<uint16_t> &indices() const { return m_indices; }
+    size_t usage(size_t entry) const;
+    bool isLocked(size_t entry) const;
+    // Locked entries refuse edits
+    void setLocked(size_t entry, bool locked);
+
+    // Both return the number of output pixels that changed
+    size_t replace(size_t entry, uint32_t color);
+    size_t nudge(size_t entry, int red, int green, int blue);
+
+    // Rows to re-upload after the edits so far; resets the range
+    DirtyRows takeDirtyRows();
+    // Tiles whose pixels the last edit had to look at
+    size_t lastVisitedTiles() const { return m_lastVisitedTiles; }
+
+private:
+    struct Tile
+    {
+        // Bounding box of the source colors
+        std::array<int, 3> low;
+        std::array<int, 3> high;
+        // Largest squared distance between a source pixel and its palette color
+        int error = 0;
+    };
+
+    struct Band
+    {
+        size_t changed = 0;
+        size_t visited = 0;
+        int firstRow = 0;
+        int lastRow = -1;
+        std::unordered_map<uint16_t, int64_t> usage;
+    };
+
+    void checkEntry(size_t entry) const;
+    bool usesEntry(size_t entry, size_t tile) const;
+    void setUsesEntry(size_t entry, size_t tile, bool uses);
+    // Sets the error of a tile and its bits for `entries`, the entries whose use may have changed
+    void updateTile(size_t tile, std::vector<uint16_t> &entries);
+    void editRow(int tileY, uint16_t entry, const NearestColorMap *map, Band &band);
+
+    PixelBuffer m_source;
+    PixelBuffer m_result;
+    std::vector<uint32_t> m_palette;
+    std::vector<uint16_t> m_indices;
+    std::vector<size_t> m_usage;
+    std::vector<bool> m_locked;
+    int m_threads;
+    int m_tilesX;
+    int m_tilesY;
+    std::vector<Tile> m_tiles;
+    // Per entry one bit per tile; every tile row starts a new word so rows can be edited in parallel
+    size_t m_wordsPerRow;
+    std::vector<std::vector<uint64_t>> m_entryTiles;
+    DirtyRows m_dirty;
+    size_t m_lastVisitedTiles = 0;
+};
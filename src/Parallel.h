@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/Parallel.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Parallel
+{
+    inline int resolveThreadCount(int requested)
+    {
+        if (requested > 0)
+            return requested;
+        unsigned int hardware = std::thread::hardware_concurrency();
+        return hardware == 0 ? 1 : static_cast<int>(hardware);
+    }
+
+    // Calls fn(index) for every index in [0, count), handing out indices dynamically to
+    // up to `threads` workers. The first exception thrown by a worker is rethrown here.
+    template <typename Fn>
+    void forEach(size_t count, int threads, Fn &&fn)
+    {
+        int workers = static_cast<int>(std::min<size_t>(count, static_cast<size_t>(resolveThreadCount(threads))));
+        if (workers <= 1)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                fn(i);
+            }
+            return;
+        }
+
+        std::atomic<size_t> next{0};
+        std::exception_ptr error;
+        std::mutex errorMutex;
+
+        auto worker = [&]()
+        {
+            try
+            {
+                for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1))
+                {
+                    fn(i);
+                }
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error)
+                    error = std::current_exception();
+                next = count;
+            }
+        };
+
+        std::vector<std::thread> pool;
+        pool.reserve(workers - 1);
+        for (int t = 1; t < workers; ++t)
+        {
+            pool.emplace_back(worker);
+        }
+        worker();
+        for (std::thread &thread : pool)
+        {
+            thread.join();
+        }
+
+        if (error)
+            std::rethrow_exception(error);
+    }
+}
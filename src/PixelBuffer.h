@@ -0,0 +1,271 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/PixelBuffer.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <numeric>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "PixelFormat.h"
+
+// Rows of every ImageBuffer start on this boundary
+constexpr size_t PIXEL_BUFFER_ALIGNMENT = 64;
+
+// Non-owning 2D view. stride is in elements and may be larger than width, which is how
+// sub-rectangles share the storage of their parent. Format is a PixelFormat tag.
+template <typename T, typename Format = typename PixelFormat::DefaultFormat<std::remove_const_t<T>>::type>
+class ImageView
+{
+    static_assert(std::is_same_v<std::remove_const_t<T>, typename Format::Pixel>, "Pixel type does not match the format");
+
+public:
+    using element_type = T;
+    using format = Format;
+
+    ImageView() = default;
+    ImageView(T *data, int width, int height, ptrdiff_t stride)
+        : m_data(data), m_width(width), m_height(height), m_stride(stride)
+    {
+        if (width < 0 || height < 0 || stride < width)
+        {
+            throw std::invalid_argument("Invalid image view geometry");
+        }
+    }
+    // Contiguous pixels, e.g. a std::vector holding width * height elements
+    ImageView(std::span<T> pixels, int width, int height) : ImageView(pixels.data(), width, height, width)
+    {
+        if (pixels.size() < static_cast<size_t>(width) * height)
+        {
+            throw std::invalid_argument("Not enough pixels for image view");
+        }
+    }
+
+    // Mutable views convert to const views
+    template <typename U, typename = std::enable_if_t<std::is_same_v<T, const U>>>
+    ImageView(const ImageView<U, Format> &other)
+        : m_data(other.data()), m_width(other.width()), m_height(other.height()), m_stride(other.stride()) {}
+
+    T *data() const { return m_data; }
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    ptrdiff_t stride() const { return m_stride; }
+    size_t size() const { return static_cast<size_t>(m_width) * m_height; }
+    bool empty() const { return m_width == 0 || m_height == 0; }
+    bool isContiguous() const { return m_stride == m_width || m_height <= 1; }
+
+    std::span<T> row(int y) const { return {m_data + y * m_stride, static_cast<size_t>(m_width)}; }
+    T &operator()(int x, int y) const { return m_data[y * m_stride + x]; }
+
+    // All pixels as one span; only valid for contiguous views
+    std::span<T> pixels() const
+    {
+        if (!isContiguous())
+        {
+            throw std::logic_error("Image view is not contiguous");
+        }
+        return {m_data, size()};
+    }
+
+    ImageView subView(int x, int y, int width, int height) const
+    {
+        if (x < 0 || y < 0 || width < 0 || height < 0 || x + width > m_width || y + height > m_height)
+        {
+            throw std::out_of_range("Sub-rectangle outside of image");
+        }
+        return ImageView(m_data + y * m_stride + x, width, height, m_stride);
+    }
+
+    std::vector<std::remove_const_t<T>> toVector() const
+    {
+        std::vector<std::remove_const_t<T>> out;
+        out.reserve(size());
+        for (int y = 0; y < m_height; ++y)
+        {
+            std::span<T> r = row(y);
+            out.insert(out.end(), r.begin(), r.end());
+        }
+        return out;
+    }
+
+private:
+    T *m_data = nullptr;
+    int m_width = 0;
+    int m_height = 0;
+    ptrdiff_t m_stride = 0;
+};
+
+// Owning image storage with every row aligned to PIXEL_BUFFER_ALIGNMENT bytes.
+// Copies are deep; views and sub-views never copy.
+template <typename T, typename Format = typename PixelFormat::DefaultFormat<T>::type>
+class ImageBuffer
+{
+    static_assert(std::is_trivially_copyable_v<T>, "ImageBuffer holds plain pixel data");
+    static_assert(std::is_same_v<T, typename Format::Pixel>, "Pixel type does not match the format");
+
+public:
+    using element_type = T;
+    using format = Format;
+
+    ImageBuffer() = default;
+    ImageBuffer(int width, int height) { allocate(width, height); }
+    ImageBuffer(int width, int height, T value)
+    {
+        allocate(width, height);
+        for (int y = 0; y < m_height; ++y)
+        {
+            std::fill_n(m_data.get() + y * m_stride, m_width, value);
+        }
+    }
+    explicit ImageBuffer(ImageView<const T, Format> source)
+    {
+        allocate(source.width(), source.height());
+        copyFrom(source);
+    }
+    ImageBuffer(const std::vector<T> &pixels, int width, int height)
+        : ImageBuffer(ImageView<const T, Format>(std::span<const T>(pixels), width, height)) {}
+
+    ImageBuffer(const ImageBuffer &other) : ImageBuffer(other.view()) {}
+    ImageBuffer(ImageBuffer &&other) noexcept
+        : m_data(std::move(other.m_data)), m_width(std::exchange(other.m_width, 0)),
+          m_height(std::exchange(other.m_height, 0)), m_stride(std::exchange(other.m_stride, 0)) {}
+    ImageBuffer &operator=(const ImageBuffer &other)
+    {
+        if (this != &other)
+        {
+            ImageBuffer copy(other);
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+    ImageBuffer &operator=(ImageBuffer &&other) noexcept
+    {
+        m_data = std::move(other.m_data);
+        m_width = std::exchange(other.m_width, 0);
+        m_height = std::exchange(other.m_height, 0);
+        m_stride = std::exchange(other.m_stride, 0);
+        return *this;
+    }
+
+    T *data() { return m_data.get(); }
+    const T *data() const { return m_data.get(); }
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    ptrdiff_t stride() const { return m_stride; }
+    size_t size() const { return static_cast<size_t>(m_width) * m_height; }
+    bool empty() const { return m_width == 0 || m_height == 0; }
+
+    std::span<T> row(int y) { return view().row(y); }
+    std::span<const T> row(int y) const { return view().row(y); }
+    T &operator()(int x, int y) { return m_data[y * m_stride + x]; }
+    const T &operator()(int x, int y) const { return m_data[y * m_stride + x]; }
+
+    ImageView<T, Format> view() { return ImageView<T, Format>(m_data.get(), m_width, m_height, m_stride); }
+    ImageView<const T, Format> view() const { return ImageView<const T, Format>(m_data.get(), m_width, m_height, m_stride); }
+    operator ImageView<T, Format>() { return view(); }
+    operator ImageView<const T, Format>() const { return view(); }
+    ImageView<T, Format> subView(int x, int y, int width, int height) { return view().subView(x, y, width, height); }
+    ImageView<const T, Format> subView(int x, int y, int width, int height) const { return view().subView(x, y, width, height); }
+
+    void copyFrom(ImageView<const T, Format> source)
+    {
+        if (source.width() != m_width || source.height() != m_height)
+        {
+            throw std::invalid_argument("Image size mismatch");
+        }
+        for (int y = 0; y < m_height; ++y)
+        {
+            std::memcpy(m_data.get() + y * m_stride, source.row(y).data(), static_cast<size_t>(m_width) * sizeof(T));
+        }
+    }
+
+    std::vector<T> toVector() const { return view().toVector(); }
+
+    bool operator==(const ImageBuffer &other) const
+    {
+        if (m_width != other.m_width || m_height != other.m_height)
+            return false;
+        for (int y = 0; y < m_height; ++y)
+        {
+            if (!std::equal(row(y).begin(), row(y).end(), other.row(y).begin()))
+                return false;
+        }
+        return true;
+    }
+
+private:
+    struct AlignedDelete
+    {
+        void operator()(T *p) const { ::operator delete[](p, std::align_val_t(PIXEL_BUFFER_ALIGNMENT)); }
+    };
+
+    void allocate(int width, int height)
+    {
+        if (width < 0 || height < 0)
+        {
+            throw std::invalid_argument("Invalid image size");
+        }
+        // Rows must hold whole pixels, so 3-byte formats pad to a multiple of 192 bytes
+        constexpr size_t rowAlignment = std::lcm(PIXEL_BUFFER_ALIGNMENT, sizeof(T));
+        size_t rowBytes = (static_cast<size_t>(width) * sizeof(T) + rowAlignment - 1) / rowAlignment * rowAlignment;
+        size_t bytes = std::max<size_t>(rowBytes * height, PIXEL_BUFFER_ALIGNMENT);
+        m_data.reset(static_cast<T *>(::operator new[](bytes, std::align_val_t(PIXEL_BUFFER_ALIGNMENT))));
+        std::memset(m_data.get(), 0, bytes);
+        m_width = width;
+        m_height = height;
+        m_stride = static_cast<ptrdiff_t>(rowBytes / sizeof(T));
+    }
+
+    std::unique_ptr<T[], AlignedDelete> m_data;
+    int m_width = 0;
+    int m_height = 0;
+    ptrdiff_t m_stride = 0;
+};
+
+// 0x00RRGGBB pixels, the representation used throughout the converter
+using PixelBuffer = ImageBuffer<uint32_t>;
+using PixelView = ImageView<uint32_t>;
+using ConstPixelView = ImageView<const uint32_t>;
+
+template <typename Format>
+using FormatBuffer = ImageBuffer<typename Format::Pixel, Format>;
+template <typename Format>
+using FormatView = ImageView<typename Format::Pixel, Format>;
+template <typename Format>
+using ConstFormatView = ImageView<const typename Format::Pixel, Format>;
+
+// Converts between the formats of two equally sized images, row by row. Both arguments
+// may be views or buffers.
+template <typename Source, typename Target>
+void convertPixels(const Source &source, Target &&target)
+{
+    using From = typename std::remove_cvref_t<Source>::format;
+    using To = typename std::remove_cvref_t<Target>::format;
+    if (source.width() != target.width() || source.height() != target.height())
+    {
+        throw std::invalid_argument("Pixel conversion needs images of the same size");
+    }
+    for (int y = 0; y < source.height(); ++y)
+    {
+        PixelFormat::convertRow<From, To>(source.row(y).data(), target.row(y).data(), static_cast<size_t>(source.width()));
+    }
+}
+
+template <typename To, typename Source>
+FormatBuffer<To> convertPixels(const Source &source)
+{
+    FormatBuffer<To> target(source.width(), source.height());
+    convertPixels(source, target);
+    return target;
+}
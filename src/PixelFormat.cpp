@@ -0,0 +1,151 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/PixelFormat.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include "PixelFormat.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define GFX_PIXELFORMAT_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(GFX_PIXELFORMAT_X86) && (defined(__GNUC__) || defined(__clang__))
+#define GFX_PIXELFORMAT_TARGET(isa) __attribute__((target(isa)))
+#define GFX_PIXELFORMAT_RUNTIME_DISPATCH 1
+#else
+#define GFX_PIXELFORMAT_TARGET(isa)
+#endif
+
+namespace
+{
+    enum class Kernel
+    {
+        Scalar,
+        Ssse3,
+        Avx2
+    };
+
+    Kernel detectKernel()
+    {
+#if defined(GFX_PIXELFORMAT_RUNTIME_DISPATCH)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return Kernel::Avx2;
+        if (__builtin_cpu_supports("ssse3"))
+            return Kernel::Ssse3;
+        return Kernel::Scalar;
+#elif defined(GFX_PIXELFORMAT_X86) && defined(__AVX2__)
+        return Kernel::Avx2;
+#elif defined(GFX_PIXELFORMAT_X86) && (defined(__SSSE3__) || defined(__AVX__))
+        return Kernel::Ssse3;
+#else
+        return Kernel::Scalar;
+#endif
+    }
+
+    Kernel activeKernel()
+    {
+        static const Kernel kernel = detectKernel();
+        return kernel;
+    }
+
+#if defined(GFX_PIXELFORMAT_X86)
+    GFX_PIXELFORMAT_TARGET("ssse3")
+    size_t shuffle4Ssse3(const uint8_t *source, uint8_t *target, size_t count, const uint8_t *shuffle, const uint8_t *fill)
+    {
+        const __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i *>(shuffle));
+        const __m128i bits = _mm_loadu_si128(reinterpret_cast<const __m128i *>(fill));
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i * 4));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(target + i * 4), _mm_or_si128(_mm_shuffle_epi8(v, mask), bits));
+        }
+        return i;
+    }
+
+    // vpshufb shuffles within 128-bit lanes, which is exactly four 4-byte pixels each
+    GFX_PIXELFORMAT_TARGET("avx2")
+    size_t shuffle4Avx2(const uint8_t *source, uint8_t *target, size_t count, const uint8_t *shuffle, const uint8_t *fill)
+    {
+        const __m256i mask = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(shuffle)));
+        const __m256i bits = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(fill)));
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(source + i * 4));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(target + i * 4), _mm256_or_si256(_mm256_shuffle_epi8(v, mask), bits));
+        }
+        return i;
+    }
+
+    // Each 16-byte load holds four 3-byte pixels plus four bytes of the next group, so the
+    // loop stops while a full load still fits inside the source row
+    GFX_PIXELFORMAT_TARGET("ssse3")
+    size_t shuffle3Ssse3(const uint8_t *source, uint8_t *target, size_t count, const uint8_t *shuffle, const uint8_t *fill)
+    {
+        const __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i *>(shuffle));
+        const __m128i bits = _mm_loadu_si128(reinterpret_cast<const __m128i *>(fill));
+        size_t i = 0;
+        for (; (i + 4) * 3 + 4 <= count * 3; i += 4)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i * 3));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(target + i * 4), _mm_or_si128(_mm_shuffle_epi8(v, mask), bits));
+        }
+        return i;
+    }
+#endif
+}
+
+namespace PixelFormat
+{
+    namespace detail
+    {
+        size_t shuffle4to4(const uint8_t *source, uint8_t *target, size_t count, const uint8_t *shuffle, const uint8_t *fill)
+        {
+#if defined(GFX_PIXELFORMAT_X86)
+            switch (activeKernel())
+            {
+            case Kernel::Avx2:
+            {
+                size_t done = shuffle4Avx2(source, target, count, shuffle, fill);
+                return done + shuffle4Ssse3(source + done * 4, target + done * 4, count - done, shuffle, fill);
+            }
+            case Kernel::Ssse3:
+                return shuffle4Ssse3(source, target, count, shuffle, fill);
+            default:
+                break;
+            }
+#endif
+            (void)source, (void)target, (void)count, (void)shuffle, (void)fill;
+            return 0;
+        }
+
+        size_t shuffle3to4(const uint8_t *source, uint8_t *target, size_t count, const uint8_t *shuffle, const uint8_t *fill)
+        {
+#if defined(GFX_PIXELFORMAT_X86)
+            if (activeKernel() != Kernel::Scalar)
+            {
+                return shuffle3Ssse3(source, target, count, shuffle, fill);
+            }
+#endif
+            (void)source, (void)target, (void)count, (void)shuffle, (void)fill;
+            return 0;
+        }
+    }
+
+    std::string activeKernelName()
+    {
+        switch (activeKernel())
+        {
+        case Kernel::Avx2:
+            return "AVX2";
+        case Kernel::Ssse3:
+            return "SSSE3";
+        default:
+            return "Scalar";
+        }
+    }
+}
@@ -0,0 +1,184 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/PixelFormat.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+// Compile-time pixel format tags. A format names its pixel type and the byte offset of
+// every channel inside one pixel; -1 marks a channel the format does not store.
+namespace PixelFormat
+{
+    struct Rgba8
+    {
+        using Pixel = std::array<uint8_t, 4>;
+        static constexpr int red = 0, green = 1, blue = 2, alpha = 3;
+        static constexpr bool indexed = false;
+        static constexpr const char *name = "RGBA8";
+    };
+
+    struct Bgra8
+    {
+        using Pixel = std::array<uint8_t, 4>;
+        static constexpr int red = 2, green = 1, blue = 0, alpha = 3;
+        static constexpr bool indexed = false;
+        static constexpr const char *name = "BGRA8";
+    };
+
+    struct Rgb8
+    {
+        using Pixel = std::array<uint8_t, 3>;
+        static constexpr int red = 0, green = 1, blue = 2, alpha = -1;
+        static constexpr bool indexed = false;
+        static constexpr const char *name = "RGB8";
+    };
+
+    // Native 0x00RRGGBB words, the working format of reducers, ditherers and encoders
+    struct Xrgb32
+    {
+        using Pixel = uint32_t;
+        static constexpr bool little = std::endian::native == std::endian::little;
+        static constexpr int red = little ? 2 : 1, green = little ? 1 : 2, blue = little ? 0 : 3, alpha = -1;
+        static constexpr bool indexed = false;
+        static constexpr const char *name = "XRGB32";
+    };
+
+    // Palette indices; only expandRow turns them into colors
+    struct Indexed8
+    {
+        using Pixel = uint8_t;
+        static constexpr int red = -1, green = -1, blue = -1, alpha = -1;
+        static constexpr bool indexed = true;
+        static constexpr const char *name = "Indexed8";
+    };
+
+    // Format assumed for views and buffers that do not name one
+    template <typename Pixel>
+    struct DefaultFormat;
+    template <>
+    struct DefaultFormat<uint32_t>
+    {
+        using type = Xrgb32;
+    };
+    template <>
+    struct DefaultFormat<uint8_t>
+    {
+        using type = Indexed8;
+    };
+
+    namespace detail
+    {
+        // Byte shuffle for four pixels of a 4-byte destination; 0x80 clears the byte,
+        // fill is OR-ed in afterwards. Both return how many pixels they converted.
+        size_t shuffle4to4(const uint8_t *source, uint8_t *target, size_t count, const uint8_t *shuffle, const uint8_t *fill);
+        size_t shuffle3to4(const uint8_t *source, uint8_t *target, size_t count, const uint8_t *shuffle, const uint8_t *fill);
+
+        template <typename From, typename To>
+        struct Swizzle
+        {
+            static constexpr size_t fromBytes = sizeof(typename From::Pixel);
+            static constexpr size_t toBytes = sizeof(typename To::Pixel);
+
+            static constexpr std::array<uint8_t, 16> shuffle()
+            {
+                std::array<uint8_t, 16> mask{};
+                for (size_t i = 0; i < mask.size(); ++i)
+                {
+                    mask[i] = 0x80;
+                }
+                const int from[4] = {From::red, From::green, From::blue, From::alpha};
+                const int to[4] = {To::red, To::green, To::blue, To::alpha};
+                for (size_t p = 0; p < 4; ++p)
+                {
+                    for (int c = 0; c < 4; ++c)
+                    {
+                        if (to[c] >= 0 && from[c] >= 0)
+                        {
+                            mask[p * toBytes + to[c]] = static_cast<uint8_t>(p * fromBytes + from[c]);
+                        }
+                    }
+                }
+                return mask;
+            }
+
+            // Opaque alpha when the source has none
+            static constexpr std::array<uint8_t, 16> fill()
+            {
+                std::array<uint8_t, 16> bytes{};
+                if (To::alpha >= 0 && From::alpha < 0)
+                {
+                    for (size_t p = 0; p < 4; ++p)
+                    {
+                        bytes[p * toBytes + To::alpha] = 0xFF;
+                    }
+                }
+                return bytes;
+            }
+        };
+    }
+
+    // Converts `count` pixels. Four-byte targets go through SSSE3/AVX2 byte shuffles when
+    // the CPU has them; everything else, and the tail, is a scalar channel copy.
+    template <typename From, typename To>
+    void convertRow(const typename From::Pixel *source, typename To::Pixel *target, size_t count)
+    {
+        static_assert(!From::indexed && !To::indexed, "Indexed pixels need a palette, use expandRow");
+        using Swizzle = detail::Swizzle<From, To>;
+
+        if constexpr (std::is_same_v<From, To>)
+        {
+            std::memcpy(target, source, count * sizeof(typename From::Pixel));
+        }
+        else
+        {
+            const uint8_t *in = reinterpret_cast<const uint8_t *>(source);
+            uint8_t *out = reinterpret_cast<uint8_t *>(target);
+            size_t done = 0;
+            if constexpr (Swizzle::toBytes == 4)
+            {
+                static constexpr std::array<uint8_t, 16> shuffle = Swizzle::shuffle();
+                static constexpr std::array<uint8_t, 16> fill = Swizzle::fill();
+                if constexpr (Swizzle::fromBytes == 4)
+                    done = detail::shuffle4to4(in, out, count, shuffle.data(), fill.data());
+                else if constexpr (Swizzle::fromBytes == 3)
+                    done = detail::shuffle3to4(in, out, count, shuffle.data(), fill.data());
+            }
+
+            const int from[4] = {From::red, From::green, From::blue, From::alpha};
+            const int to[4] = {To::red, To::green, To::blue, To::alpha};
+            for (size_t i = done; i < count; ++i)
+            {
+                const uint8_t *s = in + i * Swizzle::fromBytes;
+                uint8_t *d = out + i * Swizzle::toBytes;
+                std::memset(d, 0, Swizzle::toBytes);
+                for (int c = 0; c < 4; ++c)
+                {
+                    if (to[c] >= 0)
+                        d[to[c]] = from[c] >= 0 ? s[from[c]] : 0xFF;
+                }
+            }
+        }
+    }
+
+    // Looks every index up in an XRGB32 palette; indices past its end become black
+    template <typename To>
+    void expandRow(const uint8_t *indices, const uint32_t *palette, size_t paletteSize, typename To::Pixel *target, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            uint32_t color = indices[i] < paletteSize ? palette[indices[i]] : 0;
+            convertRow<Xrgb32, To>(&color, target + i, 1);
+        }
+    }
+
+    std::string activeKernelName();
+}
@@ -0,0 +1,223 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/Planar.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include "Planar.h"
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define GFX_PLANAR_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(GFX_PLANAR_X86) && (defined(__GNUC__) || defined(__clang__))
+#define GFX_PLANAR_TARGET(isa) __attribute__((target(isa)))
+#define GFX_PLANAR_RUNTIME_DISPATCH 1
+#else
+#define GFX_PLANAR_TARGET(isa)
+#endif
+
+namespace
+{
+    enum class Kernel
+    {
+        Scalar,
+        Ssse3,
+        Avx2
+    };
+
+    Kernel detectKernel()
+    {
+#if defined(GFX_PLANAR_RUNTIME_DISPATCH)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return Kernel::Avx2;
+        if (__builtin_cpu_supports("ssse3"))
+            return Kernel::Ssse3;
+        return Kernel::Scalar;
+#elif defined(GFX_PLANAR_X86) && defined(__AVX2__)
+        return Kernel::Avx2;
+#elif defined(GFX_PLANAR_X86) && (defined(__SSSE3__) || defined(__AVX__))
+        return Kernel::Ssse3;
+#else
+        return Kernel::Scalar;
+#endif
+    }
+
+    Kernel activeKernel()
+    {
+        static const Kernel kernel = detectKernel();
+        return kernel;
+    }
+
+    // Gathers bit `plane` of eight pixels into one byte with a bit-matrix multiply:
+    // bit 8*i of the masked word lands in bit 63-i of the product.
+    inline uint8_t gatherPlane8(const uint8_t *px, int plane)
+    {
+        uint64_t v = 0;
+        for (int i = 0; i < 8; ++i)
+        {
+            v |= static_cast<uint64_t>(px[i]) << (8 * i);
+        }
+        return static_cast<uint8_t>((((v >> plane) & 0x0101010101010101ULL) * 0x8040201008040201ULL) >> 56);
+    }
+
+    // masks[p] receives plane p of 16 pixels, pixel 0 in bit 15
+    inline void masks16Scalar(const uint8_t *px, int planes, uint16_t *masks)
+    {
+        for (int p = 0; p < planes; ++p)
+        {
+            masks[p] = static_cast<uint16_t>((gatherPlane8(px, p) << 8) | gatherPlane8(px + 8, p));
+        }
+    }
+
+#if defined(GFX_PLANAR_X86)
+    // Reversing the bytes puts pixel 0 in bit 15 of the movemask; shifting each 16-bit lane
+    // left by 7-p moves bit p of every byte into its sign bit.
+    GFX_PLANAR_TARGET("ssse3")
+    void masks16Ssse3(const uint8_t *px, int planes, uint16_t *masks)
+    {
+        const __m128i reverse = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+        __m128i v = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(px)), reverse);
+        for (int p = 0; p < planes; ++p)
+        {
+            masks[p] = static_cast<uint16_t>(_mm_movemask_epi8(_mm_sll_epi16(v, _mm_cvtsi32_si128(7 - p))));
+        }
+    }
+
+    GFX_PLANAR_TARGET("avx2")
+    void masks32Avx2(const uint8_t *px, int planes, uint16_t *first, uint16_t *second)
+    {
+        const __m256i reverse = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                                                 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+        __m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(px)), reverse);
+        for (int p = 0; p < planes; ++p)
+        {
+            uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_sll_epi16(v, _mm_cvtsi32_si128(7 - p))));
+            first[p] = static_cast<uint16_t>(mask & 0xFFFF);
+            second[p] = static_cast<uint16_t>(mask >> 16);
+        }
+    }
+#endif
+
+    // Calls emit(group, masks) for every 16-pixel group of the row; the last group is zero padded
+    template <typename Emit>
+    void forEachGroup(const uint8_t *chunky, int width, int planes, Kernel kernel, Emit &&emit)
+    {
+        uint16_t first[8];
+        uint16_t second[8];
+        int x = 0;
+
+#if defined(GFX_PLANAR_X86)
+        if (kernel == Kernel::Avx2)
+        {
+            for (; x + 32 <= width; x += 32)
+            {
+                masks32Avx2(chunky + x, planes, first, second);
+                emit(x / 16, first);
+                emit(x / 16 + 1, second);
+            }
+        }
+        if (kernel != Kernel::Scalar)
+        {
+            for (; x + 16 <= width; x += 16)
+            {
+                masks16Ssse3(chunky + x, planes, first);
+                emit(x / 16, first);
+            }
+        }
+#endif
+        for (; x + 16 <= width; x += 16)
+        {
+            masks16Scalar(chunky + x, planes, first);
+            emit(x / 16, first);
+        }
+        if (x < width)
+        {
+            uint8_t padded[16] = {};
+            std::copy(chunky + x, chunky + width, padded);
+            masks16Scalar(padded, planes, first);
+            emit(x / 16, first);
+        }
+    }
+
+    void validate(int width, int planes)
+    {
+        if (width < 0 || planes < 1 || planes > 8)
+        {
+            throw std::invalid_argument("Planar conversion needs 1 to 8 planes");
+        }
+    }
+
+    void toPlanar(const uint8_t *chunky, int width, int planes, uint8_t *out, size_t planeStride, Kernel kernel)
+    {
+        validate(width, planes);
+        const size_t rowBytes = (static_cast<size_t>(width) + 7) / 8;
+        forEachGroup(chunky, width, planes, kernel, [&](int group, const uint16_t *masks)
+                     {
+            size_t offset = static_cast<size_t>(group) * 2;
+            for (int p = 0; p < planes; ++p)
+            {
+                uint8_t *row = out + p * planeStride;
+                row[offset] = static_cast<uint8_t>(masks[p] >> 8);
+                if (offset + 1 < rowBytes)
+                    row[offset + 1] = static_cast<uint8_t>(masks[p] & 0xFF);
+            } });
+    }
+}
+
+namespace Planar
+{
+    void chunkyToPlanar(const uint8_t *chunky, int width, int planes, uint8_t *out, size_t planeStride)
+    {
+        toPlanar(chunky, width, planes, out, planeStride, activeKernel());
+    }
+
+    void chunkyToPlanarScalar(const uint8_t *chunky, int width, int planes, uint8_t *out, size_t planeStride)
+    {
+        toPlanar(chunky, width, planes, out, planeStride, Kernel::Scalar);
+    }
+
+    void chunkyToInterleavedWords(const uint8_t *chunky, int width, int planes, uint8_t *out)
+    {
+        validate(width, planes);
+        if (width % 16 != 0)
+        {
+            throw std::invalid_argument("Interleaved bitplanes need a width that is a multiple of 16");
+        }
+        forEachGroup(chunky, width, planes, activeKernel(), [&](int group, const uint16_t *masks)
+                     {
+            uint8_t *words = out + static_cast<size_t>(group) * planes * 2;
+            for (int p = 0; p < planes; ++p)
+            {
+                words[p * 2] = static_cast<uint8_t>(masks[p] >> 8);
+                words[p * 2 + 1] = static_cast<uint8_t>(masks[p] & 0xFF);
+            } });
+    }
+
+    int planesForColors(int colors)
+    {
+        int planes = 1;
+        while ((1 << planes) < colors && planes < 8)
+        {
+            ++planes;
+        }
+        return planes;
+    }
+
+    std::string activeKernelName()
+    {
+        switch (activeKernel())
+        {
+        case Kernel::Avx2:
+            return "AVX2";
+        case Kernel::Ssse3:
+            return "SSSE3";
+        default:
+            return "Scalar";
+        }
+    }
+}
@@ -0,0 +1,28 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/Planar.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Chunky-to-planar conversion: 8-bit palette indices become bitplanes with the leftmost
+// pixel in the most significant bit. Uses AVX2 or SSSE3 when the CPU supports them.
+namespace Planar
+{
+    // Writes `planes` rows of (width + 7) / 8 bytes, plane p starting at out + p * planeStride
+    void chunkyToPlanar(const uint8_t *chunky, int width, int planes, uint8_t *out, size_t planeStride);
+    // Atari ST layout: every group of 16 pixels becomes `planes` consecutive big-endian words.
+    // width must be a multiple of 16.
+    void chunkyToInterleavedWords(const uint8_t *chunky, int width, int planes, uint8_t *out);
+
+    // Portable reference implementation, used for tails and for verifying the SIMD paths
+    void chunkyToPlanarScalar(const uint8_t *chunky, int width, int planes, uint8_t *out, size_t planeStride);
+
+    int planesForColors(int colors);
+    std::string activeKernelName();
+}
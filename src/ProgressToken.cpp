@@ -0,0 +1,66 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/ProgressToken.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include "ProgressToken.h"
+#include <algorithm>
+
+ProgressToken::ProgressToken() : start(Clock::now()) {}
+
+ProgressToken::ProgressToken(const ProgressToken *parent) : start(Clock::now()), parent(parent) {}
+
+void ProgressToken::cancel()
+{
+    cancelled = true;
+}
+
+bool ProgressToken::isCancelled() const
+{
+    return cancelled;
+}
+
+void ProgressToken::setTimeout(std::chrono::milliseconds timeout)
+{
+    deadline = timeout.count() > 0 ? (Clock::now() + timeout).time_since_epoch().count() : 0;
+}
+
+bool ProgressToken::isExpired() const
+{
+    Clock::rep limit = deadline;
+    return limit != 0 && Clock::now().time_since_epoch().count() >= limit;
+}
+
+void ProgressToken::report(float fraction)
+{
+    progress = std::clamp(fraction, 0.0f, 1.0f);
+}
+
+void ProgressToken::report(float begin, float end, float fraction)
+{
+    report(begin + (end - begin) * std::clamp(fraction, 0.0f, 1.0f));
+}
+
+float ProgressToken::getProgress() const
+{
+    return progress;
+}
+
+std::chrono::milliseconds ProgressToken::getElapsed() const
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start);
+}
+
+void ProgressToken::checkpoint() const
+{
+    if (cancelled)
+    {
+        throw OperationCancelled("Operation cancelled");
+    }
+    if (isExpired())
+    {
+        throw OperationCancelled("Operation timed out after " + std::to_string(getElapsed().count()) + " ms", true);
+    }
+    checkpoint(parent);
+}
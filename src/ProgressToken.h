@@ -0,0 +1,72 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/ProgressToken.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+
+// Thrown from ProgressToken::checkpoint when the operation should stop
+class OperationCancelled : public std::runtime_error
+{
+public:
+    explicit OperationCancelled(const std::string &what, bool timedOut = false)
+        : std::runtime_error(what), timedOut(timedOut) {}
+
+    bool isTimeout() const { return timedOut; }
+
+private:
+    bool timedOut;
+};
+
+// Shared between a long running operation and whoever waits for it. The operation
+// reports progress and calls checkpoint() regularly; the owner may cancel it or give
+// it a deadline. All members are safe to use from different threads.
+class ProgressToken
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    ProgressToken();
+    // checkpoint() also throws once `parent` is cancelled or expired; parent must outlive this token
+    explicit ProgressToken(const ProgressToken *parent);
+
+    void cancel();
+    bool isCancelled() const;
+    void setTimeout(std::chrono::milliseconds timeout);
+    bool isExpired() const;
+
+    // fraction in [0, 1] of the whole operation
+    void report(float fraction);
+    // Maps the progress of a sub-step into [begin, end) of the whole operation
+    void report(float begin, float end, float fraction);
+    float getProgress() const;
+    std::chrono::milliseconds getElapsed() const;
+
+    // Throws OperationCancelled after cancel() or once the deadline has passed, of this token or its parent
+    void checkpoint() const;
+
+    // Convenience for optional tokens
+    static void checkpoint(const ProgressToken *token)
+    {
+        if (token)
+            token->checkpoint();
+    }
+    static void report(ProgressToken *token, float fraction)
+    {
+        if (token)
+            token->report(fraction);
+    }
+
+private:
+    std::atomic<bool> cancelled{false};
+    std::atomic<float> progress{0.0f};
+    std::atomic<Clock::rep> deadline{0};
+    Clock::time_point start;
+    const ProgressToken *parent = nullptr;
+};
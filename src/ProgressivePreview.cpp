@@ -0,0 +1,150 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/ProgressivePreview.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include "ProgressivePreview.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <thread>
+
+ProgressivePreview::ProgressivePreview(ConversionPipeline &full) : m_full(full), m_proxy(2) {}
+
+void ProgressivePreview::setProxySize(int maxWidth, int maxHeight)
+{
+    maxWidth = std::max(1, maxWidth);
+    maxHeight = std::max(1, maxHeight);
+    if (maxWidth != m_proxyMaxWidth || maxHeight != m_proxyMaxHeight)
+    {
+        m_proxyMaxWidth = maxWidth;
+        m_proxyMaxHeight = maxHeight;
+        ++m_proxyVersion;
+    }
+}
+
+void ProgressivePreview::setRefineDelay(std::chrono::milliseconds delay)
+{
+    m_refineDelay = delay;
+}
+
+void ProgressivePreview::sourceChanged()
+{
+    cancel();
+    ++m_proxyVersion;
+    std::lock_guard<std::mutex> lock(m_frameMutex);
+    m_latest.reset();
+    m_latestTaken = true;
+}
+
+void ProgressivePreview::cancel()
+{
+    m_proxyJobs.cancel();
+    m_refineJobs.cancel();
+    // A job past its last checkpoint may still publish; nothing requested so far is shown
+    std::lock_guard<std::mutex> lock(m_frameMutex);
+    m_discardThrough = m_generation;
+    m_latestTaken = true;
+}
+
+void ProgressivePreview::updateProxySource(int maxWidth, int maxHeight, ProgressToken &progress)
+{
+    std::shared_ptr<const PixelBuffer> source = m_full.source();
+    if (!source)
+    {
+        throw std::runtime_error("Preview has no source image");
+    }
+
+    double scale = std::min({1.0, static_cast<double>(maxWidth) / source->width(), static_cast<double>(maxHeight) / source->height()});
+    PipelineSettings proxySize;
+    proxySize.width = std::max(1, static_cast<int>(source->width() * scale));
+    proxySize.height = std::max(1, static_cast<int>(source->height() * scale));
+    // Area averaging is plenty for a preview and the cheapest filter
+    proxySize.filter = ResampleFilter::Box;
+
+    std::shared_ptr<const PixelBuffer> proxy = m_full.resampled(proxySize, &progress);
+    progress.checkpoint();
+    m_proxy.setSource(*proxy);
+    SPDLOG_DEBUG("Preview proxy is {}x{} for a {}x{} source", proxy->width(), proxy->height(), source->width(), source->height());
+}
+
+void ProgressivePreview::request(const PipelineSettings &settings)
+{
+    uint64_t generation = ++m_generation;
+    PipelineSettings proxySettings = settings;
+    proxySettings.width = 0;
+    proxySettings.height = 0;
+
+    uint64_t proxyVersion = m_proxyVersion;
+    int maxWidth = m_proxyMaxWidth;
+    int maxHeight = m_proxyMaxHeight;
+    m_proxyJobs.submit("Preview", [this, proxySettings, generation, proxyVersion, maxWidth, maxHeight](ProgressToken &progress) -> JobRunner::Completion
+                       {
+        // A cancelled rebuild leaves the built version behind, so the next job retries it
+        if (m_proxyBuiltVersion != proxyVersion)
+        {
+            updateProxySource(maxWidth, maxHeight, progress);
+            m_proxyBuiltVersion = proxyVersion;
+        }
+        std::shared_ptr<const PixelBuffer> image = m_proxy.dithered(proxySettings, &progress);
+        publish(PreviewFrame{image, false, generation});
+        return nullptr; });
+
+    std::chrono::milliseconds delay = m_refineDelay;
+    m_refineJobs.submit("Refining preview", [this, settings, generation, delay](ProgressToken &progress) -> JobRunner::Completion
+                        {
+        // Scrubbing keeps replacing this job, so only settled parameters reach full resolution
+        auto until = std::chrono::steady_clock::now() + delay;
+        while (std::chrono::steady_clock::now() < until)
+        {
+            progress.checkpoint();
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        std::shared_ptr<const PixelBuffer> image = m_full.dithered(settings, &progress);
+        progress.checkpoint();
+        publish(PreviewFrame{image, true, generation});
+        return nullptr; });
+}
+
+void ProgressivePreview::publish(PreviewFrame frame)
+{
+    std::lock_guard<std::mutex> lock(m_frameMutex);
+    if (frame.generation <= m_discardThrough)
+    {
+        return;
+    }
+    if (frame.refined)
+    {
+        m_refinedGeneration = std::max(m_refinedGeneration, frame.generation);
+    }
+    else if (frame.generation <= m_refinedGeneration)
+    {
+        // The full resolution result for these settings is already showing
+        return;
+    }
+    if (m_latest && m_latest->generation > frame.generation)
+    {
+        return;
+    }
+    m_latest = std::move(frame);
+    m_latestTaken = false;
+}
+
+std::optional<PreviewFrame> ProgressivePreview::poll()
+{
+    m_proxyJobs.dispatchCompletions();
+    m_refineJobs.dispatchCompletions();
+
+    std::lock_guard<std::mutex> lock(m_frameMutex);
+    if (m_latestTaken || !m_latest)
+    {
+        return std::nullopt;
+    }
+    m_latestTaken = true;
+    return m_latest;
+}
+
+JobStatus ProgressivePreview::getRefineStatus() const
+{
+    return m_refineJobs.getStatus();
+}
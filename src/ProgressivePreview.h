@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/ProgressivePreview.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include "ConversionPipeline.h"
+#include "JobRunner.h"
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <optional>
+
+struct PreviewFrame
+{
+    std::shared_ptr<const PixelBuffer> image;
+    // false for the proxy result, true once the full resolution result replaced it
+    bool refined = false;
+    uint64_t generation = 0;
+};
+
+// Live preview for interactive parameter changes. Every request is first run on a
+// proxy no larger than the display area, using a pipeline of its own so it never waits
+// for full resolution work. Once the parameters have been stable for the refine delay,
+// the full resolution pipeline runs in the background and its result replaces the proxy.
+class ProgressivePreview
+{
+public:
+    explicit ProgressivePreview(ConversionPipeline &full);
+
+    // Largest proxy size; the proxy keeps the source aspect ratio and is never upscaled
+    void setProxySize(int maxWidth, int maxHeight);
+    void setRefineDelay(std::chrono::milliseconds delay);
+    // Call after the source of the full pipeline changed
+    void sourceChanged();
+
+    void request(const PipelineSettings &settings);
+    void cancel();
+
+    // Returns a frame that has not been returned before. Never waits, so it is cheap to
+    // call every frame on the render thread; a pending proxy shows up on a later call.
+    std::optional<PreviewFrame> poll();
+    JobStatus getRefineStatus() const;
+
+private:
+    // Runs on the proxy worker, so the full resolution resample never blocks the caller
+    void updateProxySource(int maxWidth, int maxHeight, ProgressToken &progress);
+    void publish(PreviewFrame frame);
+
+    ConversionPipeline &m_full;
+    ConversionPipeline m_proxy;
+    int m_proxyMaxWidth = 640;
+    int m_proxyMaxHeight = 400;
+    // Bumped whenever the proxy source must be rebuilt; the proxy worker compares it
+    // with the version it last built, which only that worker reads or writes
+    uint64_t m_proxyVersion = 1;
+    uint64_t m_proxyBuiltVersion = 0;
+    std::chrono::milliseconds m_refineDelay{150};
+    uint64_t m_generation = 0;
+
+    std::mutex m_frameMutex;
+    std::optional<PreviewFrame> m_latest;
+    bool m_latestTaken = true;
+    uint64_t m_refinedGeneration = 0;
+    // Frames of requests made before the last cancel() are dropped
+    uint64_t m_discardThrough = 0;
+
+    // Declared last so the workers stop before the state above goes away
+    JobRunner m_proxyJobs;
+    JobRunner m_refineJobs;
+};
@@ -0,0 +1,338 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/Resampler.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include "Resampler.h"
+#include "Metrics.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <numbers>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define GFX_RESAMPLE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    constexpr int BAND_ROWS = 16;
+
+    // Pixels travel as four floats in memory byte order: blue, green, red, unused
+    inline void unpackRow(std::span<const uint32_t> row, float *out)
+    {
+        for (size_t x = 0; x < row.size(); ++x, out += 4)
+        {
+#if defined(GFX_RESAMPLE_SSE2)
+            const __m128i zero = _mm_setzero_si128();
+            __m128i v = _mm_cvtsi32_si128(static_cast<int>(row[x] & 0xFFFFFF));
+            v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(v, zero), zero);
+            _mm_storeu_ps(out, _mm_cvtepi32_ps(v));
+#else
+            out[0] = static_cast<float>(row[x] & 0xFF);
+            out[1] = static_cast<float>((row[x] >> 8) & 0xFF);
+            out[2] = static_cast<float>((row[x] >> 16) & 0xFF);
+            out[3] = 0.0f;
+#endif
+        }
+    }
+
+    inline uint32_t packPixel(const float *in)
+    {
+#if defined(GFX_RESAMPLE_SSE2)
+        __m128i v = _mm_cvtps_epi32(_mm_loadu_ps(in));
+        v = _mm_packs_epi32(v, v);
+        v = _mm_packus_epi16(v, v);
+        return static_cast<uint32_t>(_mm_cvtsi128_si32(v)) & 0xFFFFFF;
+#else
+        auto channel = [](float value)
+        {
+            return static_cast<uint32_t>(std::clamp(std::lround(value), 0L, 255L));
+        };
+        return (channel(in[2]) << 16) | (channel(in[1]) << 8) | channel(in[0]);
+#endif
+    }
+
+    // out[0..3] = sum of weights[k] * pixels[k * 4 .. k * 4 + 3]
+    inline void dotPixels(const float *pixels, const float *weights, int taps, float *out)
+    {
+#if defined(GFX_RESAMPLE_SSE2)
+        __m128 acc = _mm_setzero_ps();
+        for (int k = 0; k < taps; ++k)
+        {
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(pixels + k * 4)));
+        }
+        _mm_storeu_ps(out, acc);
+#else
+        float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        for (int k = 0; k < taps; ++k)
+        {
+            for (int c = 0; c < 4; ++c)
+            {
+                acc[c] += weights[k] * pixels[k * 4 + c];
+            }
+        }
+        std::copy(acc, acc + 4, out);
+#endif
+    }
+
+    // acc[0..count) += weight * row[0..count), count is a multiple of four
+    inline void accumulateRow(float *acc, const float *row, float weight, size_t count)
+    {
+#if defined(GFX_RESAMPLE_SSE2)
+        const __m128 w = _mm_set1_ps(weight);
+        for (size_t i = 0; i < count; i += 4)
+        {
+            _mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_mul_ps(w, _mm_loadu_ps(row + i))));
+        }
+#else
+        for (size_t i = 0; i < count; ++i)
+        {
+            acc[i] += weight * row[i];
+        }
+#endif
+    }
+
+    double sinc(double x)
+    {
+        if (x == 0.0)
+            return 1.0;
+        x *= std::numbers::pi;
+        return std::sin(x) / x;
+    }
+}
+
+std::string Resampler::getFilterName(ResampleFilter filter)
+{
+    switch (filter)
+    {
+    case ResampleFilter::Box:
+        return "Box";
+    case ResampleFilter::Bilinear:
+        return "Bilinear";
+    case ResampleFilter::Mitchell:
+        return "Mitchell";
+    case ResampleFilter::Lanczos3:
+        return "Lanczos3";
+    default:
+        return "Unknown";
+    }
+}
+
+double Resampler::filterSupport(ResampleFilter filter)
+{
+    switch (filter)
+    {
+    case ResampleFilter::Box:
+        return 0.5;
+    case ResampleFilter::Bilinear:
+        return 1.0;
+    case ResampleFilter::Mitchell:
+        return 2.0;
+    default:
+        return 3.0;
+    }
+}
+
+double Resampler::filterWeight(ResampleFilter filter, double x)
+{
+    switch (filter)
+    {
+    case ResampleFilter::Box:
+        return (x >= -0.5 && x < 0.5) ? 1.0 : 0.0;
+    case ResampleFilter::Bilinear:
+        return std::max(0.0, 1.0 - std::abs(x));
+    case ResampleFilter::Mitchell:
+    {
+        // Mitchell-Netravali with B = C = 1/3
+        constexpr double B = 1.0 / 3.0;
+        constexpr double C = 1.0 / 3.0;
+        x = std::abs(x);
+        if (x < 1.0)
+            return ((12 - 9 * B - 6 * C) * x * x * x + (-18 + 12 * B + 6 * C) * x * x + (6 - 2 * B)) / 6;
+        if (x < 2.0)
+            return ((-B - 6 * C) * x * x * x + (6 * B + 30 * C) * x * x + (-12 * B - 48 * C) * x + (8 * B + 24 * C)) / 6;
+        return 0.0;
+    }
+    default:
+        return std::abs(x) < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0;
+    }
+}
+
+Resampler::FilterBank Resampler::buildFilterBank(ResampleFilter filter, int sourceSize, int targetSize, double sourceOffset, double sourceLength)
+{
+    const double scale = targetSize / sourceLength;
+    // Downscaling widens the filter so every source pixel contributes
+    const double filterScale = std::max(1.0, 1.0 / scale);
+    const double support = filterSupport(filter) * filterScale;
+
+    std::vector<std::vector<float>> weights(targetSize);
+    FilterBank bank;
+    bank.start.resize(targetSize);
+    for (int i = 0; i < targetSize; ++i)
+    {
+        double center = sourceOffset + (i + 0.5) / scale;
+        int left = static_cast<int>(std::floor(center - support));
+        int right = static_cast<int>(std::ceil(center + support));
+        int first = std::clamp(left, 0, sourceSize - 1);
+        int last = std::clamp(right, 0, sourceSize - 1);
+
+        // Taps outside the image are folded onto the edge pixels
+        std::vector<float> &row = weights[i];
+        row.assign(last - first + 1, 0.0f);
+        double sum = 0.0;
+        for (int j = left; j <= right; ++j)
+        {
+            double w = filterWeight(filter, (j + 0.5 - center) / filterScale);
+            if (w == 0.0)
+                continue;
+            row[std::clamp(j, 0, sourceSize - 1) - first] += static_cast<float>(w);
+            sum += w;
+        }
+        if (sum != 0.0)
+        {
+            for (float &w : row)
+            {
+                w = static_cast<float>(w / sum);
+            }
+        }
+        else
+        {
+            row[std::clamp(static_cast<int>(center), first, last) - first] = 1.0f;
+        }
+
+        // Trailing zero taps would only cost multiplies
+        while (row.size() > 1 && row.back() == 0.0f)
+        {
+            row.pop_back();
+        }
+        size_t skip = 0;
+        while (skip + 1 < row.size() && row[skip] == 0.0f)
+        {
+            ++skip;
+        }
+        row.erase(row.begin(), row.begin() + skip);
+        bank.start[i] = first + static_cast<int>(skip);
+        bank.taps = std::max(bank.taps, static_cast<int>(row.size()));
+    }
+
+    // Fixed tap count per output keeps the inner loops branch free; starts are pulled
+    // back near the right edge so the padded taps stay inside the image
+    bank.weights.assign(static_cast<size_t>(targetSize) * bank.taps, 0.0f);
+    for (int i = 0; i < targetSize; ++i)
+    {
+        int start = std::min(bank.start[i], std::max(0, sourceSize - bank.taps));
+        int shift = bank.start[i] - start;
+        for (size_t k = 0; k < weights[i].size() && shift + static_cast<int>(k) < bank.taps; ++k)
+        {
+            bank.weights[static_cast<size_t>(i) * bank.taps + shift + k] = weights[i][k];
+        }
+        bank.start[i] = start;
+    }
+    return bank;
+}
+
+PixelBuffer Resampler::resample(ConstPixelView image, const ResampleOptions &options, ProgressToken *progress)
+{
+    StageTimer timer("resample");
+    if (image.empty() || options.width <= 0 || options.height <= 0 || !(options.pixelAspect > 0.0))
+    {
+        throw std::invalid_argument("Invalid resample geometry");
+    }
+
+    // Source region and target rectangle; source pixels are square, target pixels are
+    // pixelAspect times as wide as they are high
+    double regionX = 0.0;
+    double regionY = 0.0;
+    double regionWidth = image.width();
+    double regionHeight = image.height();
+    int targetX = 0;
+    int targetY = 0;
+    int targetWidth = options.width;
+    int targetHeight = options.height;
+    const double displayWidth = options.width * options.pixelAspect;
+    const double displayHeight = options.height;
+
+    if (options.fit == FitMode::Fit)
+    {
+        double s = std::min(displayWidth / image.width(), displayHeight / image.height());
+        targetWidth = std::clamp(static_cast<int>(std::lround(image.width() * s / options.pixelAspect)), 1, options.width);
+        targetHeight = std::clamp(static_cast<int>(std::lround(image.height() * s)), 1, options.height);
+        targetX = (options.width - targetWidth) / 2;
+        targetY = (options.height - targetHeight) / 2;
+    }
+    else if (options.fit == FitMode::Crop)
+    {
+        double s = std::max(displayWidth / image.width(), displayHeight / image.height());
+        regionWidth = std::min<double>(image.width(), displayWidth / s);
+        regionHeight = std::min<double>(image.height(), displayHeight / s);
+        regionX = (image.width() - regionWidth) / 2;
+        regionY = (image.height() - regionHeight) / 2;
+    }
+
+    FilterBank columns = buildFilterBank(options.filter, image.width(), targetWidth, regionX, regionWidth);
+    FilterBank rows = buildFilterBank(options.filter, image.height(), targetHeight, regionY, regionHeight);
+
+    // Only the source rows some output row reads go through the horizontal pass
+    const int firstRow = rows.start.front();
+    const int lastRow = rows.start.back() + rows.taps;
+    const size_t rowFloats = static_cast<size_t>(targetWidth) * 4;
+    std::vector<float> horizontal(static_cast<size_t>(lastRow - firstRow) * rowFloats);
+
+    const size_t horizontalBands = (lastRow - firstRow + BAND_ROWS - 1) / BAND_ROWS;
+    const size_t verticalBands = (targetHeight + BAND_ROWS - 1) / BAND_ROWS;
+    std::atomic<size_t> bandsDone{0};
+    auto bandFinished = [&]()
+    {
+        size_t done = ++bandsDone;
+        ProgressToken::report(progress, static_cast<float>(done) / (horizontalBands + verticalBands));
+    };
+
+    Parallel::forEach(horizontalBands, options.threads, [&](size_t band)
+                      {
+        ProgressToken::checkpoint(progress);
+        std::vector<float> source(static_cast<size_t>(image.width()) * 4);
+        int end = std::min(lastRow, firstRow + static_cast<int>((band + 1) * BAND_ROWS));
+        for (int y = firstRow + static_cast<int>(band * BAND_ROWS); y < end; ++y)
+        {
+            unpackRow(image.row(y), source.data());
+            float *out = horizontal.data() + (y - firstRow) * rowFloats;
+            for (int x = 0; x < targetWidth; ++x)
+            {
+                dotPixels(source.data() + columns.start[x] * 4, columns.weights.data() + static_cast<size_t>(x) * columns.taps,
+                          columns.taps, out + x * 4);
+            }
+        }
+        bandFinished(); });
+
+    PixelBuffer output(options.width, options.height, options.background);
+    Parallel::forEach(verticalBands, options.threads, [&](size_t band)
+                      {
+        ProgressToken::checkpoint(progress);
+        std::vector<float> acc(rowFloats);
+        int end = std::min(targetHeight, static_cast<int>((band + 1) * BAND_ROWS));
+        for (int y = static_cast<int>(band * BAND_ROWS); y < end; ++y)
+        {
+            std::fill(acc.begin(), acc.end(), 0.0f);
+            const float *weights = rows.weights.data() + static_cast<size_t>(y) * rows.taps;
+            for (int k = 0; k < rows.taps; ++k)
+            {
+                if (weights[k] != 0.0f)
+                {
+                    accumulateRow(acc.data(), horizontal.data() + (rows.start[y] + k - firstRow) * rowFloats, weights[k], rowFloats);
+                }
+            }
+            std::span<uint32_t> out = output.row(targetY + y);
+            for (int x = 0; x < targetWidth; ++x)
+            {
+                out[targetX + x] = packPixel(acc.data() + x * 4);
+            }
+        }
+        bandFinished(); });
+
+    return output;
+}
@@ -0,0 +1,66 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/Resampler.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include "PixelBuffer.h"
+#include "ProgressToken.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class ResampleFilter
+{
+    Box,
+    Bilinear,
+    Mitchell,
+    Lanczos3
+};
+
+enum class FitMode
+{
+    // Whole source onto the whole target, ignoring the aspect ratio
+    Stretch,
+    // Whole source inside the target, the rest is filled with the background color
+    Fit,
+    // Target fully covered, the source is cropped around its center
+    Crop
+};
+
+struct ResampleOptions
+{
+    int width = 0;
+    int height = 0;
+    ResampleFilter filter = ResampleFilter::Mitchell;
+    FitMode fit = FitMode::Stretch;
+    // Displayed width of one target pixel relative to its height, 2.0 for C64 multicolor
+    double pixelAspect = 1.0;
+    uint32_t background = 0x000000;
+    int threads = 0;
+};
+
+// Separable resampling with precomputed filter weights. The horizontal pass turns every
+// source row into float RGBX, the vertical pass blends those rows into the target; both
+// run in row bands on all cores and process one pixel per SSE register.
+class Resampler
+{
+public:
+    static PixelBuffer resample(ConstPixelView image, const ResampleOptions &options, ProgressToken *progress = nullptr);
+    static std::string getFilterName(ResampleFilter filter);
+
+private:
+    // For every output coordinate: first source index and `taps` normalized weights
+    struct FilterBank
+    {
+        int taps = 0;
+        std::vector<int> start;
+        std::vector<float> weights;
+    };
+
+    static FilterBank buildFilterBank(ResampleFilter filter, int sourceSize, int targetSize, double sourceOffset, double sourceLength);
+    static double filterSupport(ResampleFilter filter);
+    static double filterWeight(ResampleFilter filter, double x);
+};
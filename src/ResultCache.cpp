@@ -0,0 +1,245 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/ResultCache.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include "ResultCache.h"
+#include "Hash.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+    constexpr char MAGIC[4] = {'G', 'C', 'R', 'C'};
+
+    // Magic, format version, key, payload size and payload checksum
+    struct EntryHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t key;
+        uint64_t size;
+        uint64_t checksum;
+    };
+
+    std::string hexKey(uint64_t key)
+    {
+        char name[17];
+        std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+        return name;
+    }
+
+    std::optional<uint64_t> parseKey(const std::filesystem::path &path)
+    {
+        std::string stem = path.stem().string();
+        if (path.extension() != ".bin" || stem.size() != 16 || stem.find_first_not_of("0123456789abcdef") != std::string::npos)
+        {
+            return std::nullopt;
+        }
+        return std::stoull(stem, nullptr, 16);
+    }
+}
+
+ResultCache::ResultCache(std::filesystem::path directory, uint64_t maxBytes)
+    : m_directory(std::move(directory)), m_maxBytes(maxBytes)
+{
+    std::filesystem::create_directories(m_directory);
+
+    std::vector<std::pair<std::filesystem::file_time_type, uint64_t>> found;
+    for (const auto &entry : std::filesystem::recursive_directory_iterator(m_directory))
+    {
+        if (!entry.is_regular_file())
+        {
+            continue;
+        }
+        std::optional<uint64_t> key = parseKey(entry.path());
+        if (!key)
+        {
+            // Leftovers of a store that was interrupted
+            if (entry.path().string().find(".tmp") != std::string::npos)
+            {
+                std::error_code error;
+                std::filesystem::remove(entry.path(), error);
+            }
+            continue;
+        }
+        found.emplace_back(entry.last_write_time(), *key);
+        m_entries[*key] = Entry{entry.file_size(), {}};
+    }
+
+    std::sort(found.begin(), found.end(), [](const auto &a, const auto &b)
+              { return a.first > b.first; });
+    for (const auto &[time, key] : found)
+    {
+        m_order.push_back(key);
+        m_entries[key].position = std::prev(m_order.end());
+        m_statistics.bytes += m_entries[key].size;
+    }
+    m_statistics.entries = m_entries.size();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    evict();
+}
+
+std::optional<std::vector<uint8_t>> ResultCache::find(uint64_t key)
+{
+    std::filesystem::path path;
+    uint64_t generation = 0;
+    uint64_t entrySize = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_entries.find(key);
+        if (it == m_entries.end())
+        {
+            ++m_statistics.misses;
+            return std::nullopt;
+        }
+        m_order.splice(m_order.begin(), m_order, it->second.position);
+        generation = it->second.generation;
+        entrySize = it->second.size;
+        path = pathFor(key);
+    }
+
+    // Read outside the lock; an entry evicted or replaced in the meantime is simply a miss
+    std::ifstream file(path, std::ios::binary);
+    EntryHeader header{};
+    std::vector<uint8_t> data;
+    bool valid = static_cast<bool>(file.read(reinterpret_cast<char *>(&header), sizeof(header))) &&
+                 std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 && header.version == FORMAT_VERSION && header.key == key;
+    // The header is only trusted as far as the size on record, so a corrupt one cannot
+    // force a huge allocation
+    valid = valid && entrySize >= sizeof(header) && header.size == entrySize - sizeof(header);
+    if (valid)
+    {
+        data.resize(header.size);
+        file.read(reinterpret_cast<char *>(data.data()), static_cast<std::streamsize>(data.size()));
+        valid = static_cast<uint64_t>(file.gcount()) == header.size && Hash::xxh64(data.data(), data.size()) == header.checksum;
+    }
+    file.close();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!valid)
+    {
+        // Only the entry that was read may be dropped, not one stored since
+        auto it = m_entries.find(key);
+        if (it != m_entries.end() && it->second.generation == generation)
+        {
+            spdlog::warn("Dropping unreadable cache entry {}", path.string());
+            forget(key);
+        }
+        ++m_statistics.misses;
+        return std::nullopt;
+    }
+    std::error_code error;
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+    ++m_statistics.hits;
+    return data;
+}
+
+void ResultCache::store(uint64_t key, std::span<const uint8_t> data)
+{
+    const std::filesystem::path path = pathFor(key);
+    std::filesystem::path temp = path;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        temp += ".tmp" + std::to_string(m_tempCounter++);
+    }
+
+    EntryHeader header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = FORMAT_VERSION;
+    header.key = key;
+    header.size = data.size();
+    header.checksum = Hash::xxh64(data.data(), data.size());
+
+    // A cache that cannot be written only costs speed, the conversion itself succeeded
+    std::error_code error;
+    std::filesystem::create_directories(path.parent_path(), error);
+    {
+        std::ofstream file(temp, std::ios::binary);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()));
+        if (!file)
+        {
+            spdlog::warn("Unable to write cache entry {}", temp.string());
+            file.close();
+            std::filesystem::remove(temp, error);
+            return;
+        }
+    }
+    // Readers see either the old or the complete new entry
+    std::filesystem::rename(temp, path, error);
+    if (error)
+    {
+        spdlog::warn("Unable to store cache entry {}: {}", path.string(), error.message());
+        std::filesystem::remove(temp, error);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(key);
+    if (it != m_entries.end())
+    {
+        m_statistics.bytes -= it->second.size;
+        m_order.erase(it->second.position);
+        m_entries.erase(it);
+    }
+    m_order.push_front(key);
+    m_entries[key] = Entry{sizeof(header) + data.size(), m_order.begin(), ++m_generation};
+    m_statistics.bytes += sizeof(header) + data.size();
+    m_statistics.entries = m_entries.size();
+    ++m_statistics.stores;
+    evict();
+}
+
+void ResultCache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    while (!m_order.empty())
+    {
+        forget(m_order.back());
+    }
+}
+
+ResultCacheStatistics ResultCache::statistics() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_statistics;
+}
+
+std::filesystem::path ResultCache::pathFor(uint64_t key) const
+{
+    std::string name = hexKey(key);
+    return m_directory / name.substr(0, 2) / (name + ".bin");
+}
+
+void ResultCache::forget(uint64_t key)
+{
+    auto it = m_entries.find(key);
+    if (it == m_entries.end())
+    {
+        return;
+    }
+    std::error_code error;
+    std::filesystem::remove(pathFor(key), error);
+    m_statistics.bytes -= it->second.size;
+    m_order.erase(it->second.position);
+    m_entries.erase(it);
+    m_statistics.entries = m_entries.size();
+}
+
+void ResultCache::evict()
+{
+    // Keep at least the newest entry even if it alone is over the limit
+    while (m_statistics.bytes > m_maxBytes && m_order.size() > 1)
+    {
+        forget(m_order.back());
+        ++m_statistics.evictions;
+    }
+}
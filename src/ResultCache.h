@@ -0,0 +1,69 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/ResultCache.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+struct ResultCacheStatistics
+{
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t stores = 0;
+    uint64_t evictions = 0;
+    uint64_t entries = 0;
+    uint64_t bytes = 0;
+};
+
+// Content-addressed conversion results on disk. Every entry is one file named after its
+// 64-bit key below a 256-way fan-out directory. The use order is kept in the file
+// modification times, so it survives restarts, and the least recently used entries are
+// removed once the total size exceeds maxBytes. Safe to share between threads.
+class ResultCache
+{
+public:
+    // Part of every key; bump it when encoder output changes for the same input and settings
+    static constexpr uint32_t FORMAT_VERSION = 1;
+
+    ResultCache(std::filesystem::path directory, uint64_t maxBytes);
+
+    std::optional<std::vector<uint8_t>> find(uint64_t key);
+    void store(uint64_t key, std::span<const uint8_t> data);
+    void clear();
+
+    ResultCacheStatistics statistics() const;
+    const std::filesystem::path &directory() const { return m_directory; }
+
+private:
+    struct Entry
+    {
+        uint64_t size;
+        std::list<uint64_t>::iterator position;
+        // Changes whenever a store replaces the file, so a reader can tell its file is stale
+        uint64_t generation = 0;
+    };
+
+    std::filesystem::path pathFor(uint64_t key) const;
+    void forget(uint64_t key);
+    void evict();
+
+    std::filesystem::path m_directory;
+    uint64_t m_maxBytes;
+    mutable std::mutex m_mutex;
+    // Most recently used first
+    std::list<uint64_t> m_order;
+    std::unordered_map<uint64_t, Entry> m_entries;
+    ResultCacheStatistics m_statistics;
+    uint64_t m_tempCounter = 0;
+    uint64_t m_generation = 0;
+};
@@ -0,0 +1,455 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/ScanlineDecoder.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include "ScanlineDecoder.h"
+#include "PixelFormat.h"
+#include <stb_image.h>
+#include <png.h>
+#include <climits>
+#include <csetjmp>
+#include <cstdio>
+#include <cstring>
+// jpeglib.h needs FILE and size_t declared first
+#include <jpeglib.h>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+    struct FileCloser
+    {
+        void operator()(FILE *file) const { std::fclose(file); }
+    };
+    using FilePtr = std::unique_ptr<FILE, FileCloser>;
+
+    enum class Container
+    {
+        Png,
+        Jpeg,
+        Other
+    };
+
+    Container detect(const unsigned char *magic, size_t length)
+    {
+        if (length >= 8 && png_sig_cmp(magic, 0, 8) == 0)
+        {
+            return Container::Png;
+        }
+        if (length >= 3 && magic[0] == 0xFF && magic[1] == 0xD8 && magic[2] == 0xFF)
+        {
+            return Container::Jpeg;
+        }
+        return Container::Other;
+    }
+
+    void toXrgb(const uint8_t *rgb, std::span<uint32_t> row)
+    {
+        PixelFormat::convertRow<PixelFormat::Rgb8, PixelFormat::Xrgb32>(reinterpret_cast<const PixelFormat::Rgb8::Pixel *>(rgb), row.data(), row.size());
+    }
+
+    // libpng reports errors with longjmp, so every function that calls into it keeps only
+    // trivially destructible locals and the png structs are owned by a member.
+    // Input comes from a file or from memory the caller keeps alive.
+    class PngDecoder : public ScanlineDecoder
+    {
+    public:
+        PngDecoder(FilePtr file, std::span<const uint8_t> memory, const std::string &filename)
+            : m_file(std::move(file)), m_memory(memory)
+        {
+            m_format = "PNG";
+            m_handle.png = png_create_read_struct(PNG_LIBPNG_VER_STRING, m_error, onError, onWarning);
+            m_handle.info = m_handle.png != nullptr ? png_create_info_struct(m_handle.png) : nullptr;
+            if (m_handle.info == nullptr)
+            {
+                throw std::runtime_error("Unable to initialize the PNG decoder");
+            }
+            if (!readHeader())
+            {
+                throw std::runtime_error("Unable to decode " + filename + ": " + m_error);
+            }
+
+            size_t rowBytes = static_cast<size_t>(m_width) * 3;
+            // zlib's 32 KiB window plus the current and previous row for unfiltering
+            m_workingSet = 32768 + rowBytes * 3;
+            if (!m_streaming)
+            {
+                m_workingSet += rowBytes * m_height + sizeof(png_bytep) * m_height;
+            }
+        }
+
+    protected:
+        void decodeRow(std::span<uint32_t> row) override
+        {
+            if (!m_streaming)
+            {
+                if (m_pixels.empty())
+                {
+                    readImage();
+                }
+                toXrgb(&m_pixels[static_cast<size_t>(currentRow()) * m_width * 3], row);
+                return;
+            }
+            m_pixels.resize(static_cast<size_t>(m_width) * 3);
+            if (!readNextRow(m_pixels.data()))
+            {
+                throw std::runtime_error(std::string("PNG decoding failed: ") + m_error);
+            }
+            toXrgb(m_pixels.data(), row);
+        }
+
+    private:
+        struct Handle
+        {
+            png_structp png = nullptr;
+            png_infop info = nullptr;
+            ~Handle() { png_destroy_read_struct(&png, info != nullptr ? &info : nullptr, nullptr); }
+        };
+
+        static void onError(png_structp png, png_const_charp message)
+        {
+            char *error = static_cast<char *>(png_get_error_ptr(png));
+            std::snprintf(error, ERROR_SIZE, "%s", message);
+            png_longjmp(png, 1);
+        }
+
+        static void onWarning(png_structp, png_const_charp) {}
+
+        static void readMemory(png_structp png, png_bytep target, size_t length)
+        {
+            PngDecoder *self = static_cast<PngDecoder *>(png_get_io_ptr(png));
+            if (length > self->m_memory.size() - self->m_offset)
+            {
+                png_error(png, "Unexpected end of data");
+            }
+            std::memcpy(target, self->m_memory.data() + self->m_offset, length);
+            self->m_offset += length;
+        }
+
+        bool readHeader()
+        {
+            if (setjmp(png_jmpbuf(m_handle.png)))
+            {
+                return false;
+            }
+            if (m_file)
+            {
+                png_init_io(m_handle.png, m_file.get());
+            }
+            else
+            {
+                png_set_read_fn(m_handle.png, this, readMemory);
+            }
+            png_read_info(m_handle.png, m_handle.info);
+            // Everything becomes 8 bit RGB; alpha is dropped like the stb path did
+            png_set_expand(m_handle.png);
+            png_set_strip_16(m_handle.png);
+            png_set_strip_alpha(m_handle.png);
+            png_set_gray_to_rgb(m_handle.png);
+            png_set_interlace_handling(m_handle.png);
+            png_read_update_info(m_handle.png, m_handle.info);
+
+            m_width = static_cast<int>(png_get_image_width(m_handle.png, m_handle.info));
+            m_height = static_cast<int>(png_get_image_height(m_handle.png, m_handle.info));
+            // Adam7 spreads every row over seven passes
+            m_streaming = png_get_interlace_type(m_handle.png, m_handle.info) == PNG_INTERLACE_NONE;
+            return true;
+        }
+
+        bool readNextRow(png_bytep target)
+        {
+            if (setjmp(png_jmpbuf(m_handle.png)))
+            {
+                return false;
+            }
+            png_read_row(m_handle.png, target, nullptr);
+            return true;
+        }
+
+        bool readRows(png_bytepp rows)
+        {
+            if (setjmp(png_jmpbuf(m_handle.png)))
+            {
+                return false;
+            }
+            png_read_image(m_handle.png, rows);
+            return true;
+        }
+
+        void readImage()
+        {
+            size_t rowBytes = static_cast<size_t>(m_width) * 3;
+            m_pixels.resize(rowBytes * m_height);
+            std::vector<png_bytep> rows(m_height);
+            for (int y = 0; y < m_height; ++y)
+            {
+                rows[y] = &m_pixels[y * rowBytes];
+            }
+            if (!readRows(rows.data()))
+            {
+                throw std::runtime_error(std::string("PNG decoding failed: ") + m_error);
+            }
+        }
+
+        static constexpr size_t ERROR_SIZE = 256;
+
+        FilePtr m_file;
+        std::span<const uint8_t> m_memory;
+        size_t m_offset = 0;
+        Handle m_handle;
+        char m_error[ERROR_SIZE] = {};
+        std::vector<uint8_t> m_pixels;
+    };
+
+    class JpegDecoder : public ScanlineDecoder
+    {
+    public:
+        JpegDecoder(FilePtr file, std::span<const uint8_t> memory, const std::string &filename, int scaleDenominator)
+            : m_file(std::move(file)), m_memory(memory)
+        {
+            m_format = "JPEG";
+            m_scalable = true;
+            if (!readHeader(scaleDenominator))
+            {
+                throw std::runtime_error("Unable to decode " + filename + ": " + m_handle.error.message);
+            }
+        }
+
+        // CMYK and YCCK cannot be converted to RGB by libjpeg
+        bool isSupported() const { return m_supported; }
+
+    protected:
+        void decodeRow(std::span<uint32_t> row) override
+        {
+            m_pixels.resize(static_cast<size_t>(m_width) * 3);
+            if (!readNextRow(m_pixels.data()))
+            {
+                throw std::runtime_error(std::string("JPEG decoding failed: ") + m_handle.error.message);
+            }
+            toXrgb(m_pixels.data(), row);
+        }
+
+    private:
+        struct Error
+        {
+            jpeg_error_mgr manager;
+            std::jmp_buf jump;
+            char message[JMSG_LENGTH_MAX];
+        };
+
+        struct Handle
+        {
+            jpeg_decompress_struct info{};
+            Error error{};
+            bool created = false;
+            ~Handle()
+            {
+                if (created)
+                {
+                    jpeg_destroy_decompress(&info);
+                }
+            }
+        };
+
+        static void onError(j_common_ptr info)
+        {
+            Error *error = reinterpret_cast<Error *>(info->err);
+            (*info->err->format_message)(info, error->message);
+            std::longjmp(error->jump, 1);
+        }
+
+        // Corrupt data only produces warnings, libjpeg fills the rest of the image
+        static void onMessage(j_common_ptr, int) {}
+
+        bool readHeader(int scaleDenominator)
+        {
+            m_handle.info.err = jpeg_std_error(&m_handle.error.manager);
+            m_handle.error.manager.error_exit = onError;
+            m_handle.error.manager.emit_message = onMessage;
+            if (setjmp(m_handle.error.jump))
+            {
+                return false;
+            }
+            jpeg_create_decompress(&m_handle.info);
+            m_handle.created = true;
+            if (m_file)
+            {
+                jpeg_stdio_src(&m_handle.info, m_file.get());
+            }
+            else
+            {
+                jpeg_mem_src(&m_handle.info, m_memory.data(), static_cast<unsigned long>(m_memory.size()));
+            }
+            jpeg_read_header(&m_handle.info, TRUE);
+
+            m_width = static_cast<int>(m_handle.info.image_width);
+            m_height = static_cast<int>(m_handle.info.image_height);
+            if (m_handle.info.jpeg_color_space == JCS_CMYK || m_handle.info.jpeg_color_space == JCS_YCCK)
+            {
+                m_supported = false;
+                return true;
+            }
+
+            m_handle.info.out_color_space = JCS_RGB;
+            m_handle.info.scale_num = 1;
+            m_handle.info.scale_denom = scaleDenominator >= 8 ? 8 : scaleDenominator >= 4 ? 4 : scaleDenominator >= 2 ? 2 : 1;
+            jpeg_calc_output_dimensions(&m_handle.info);
+            m_width = static_cast<int>(m_handle.info.output_width);
+            m_height = static_cast<int>(m_handle.info.output_height);
+
+            // One MCU row of every component plus the upsampled output row
+            size_t components = static_cast<size_t>(m_handle.info.num_components);
+            m_workingSet = static_cast<size_t>(m_handle.info.image_width) * components * 16 * 2 + static_cast<size_t>(m_width) * 3 * 2;
+            // Progressive scans keep every DCT coefficient of the whole image until the last scan
+            m_streaming = !m_handle.info.progressive_mode;
+            if (!m_streaming)
+            {
+                m_workingSet += static_cast<size_t>(m_handle.info.image_width) * m_handle.info.image_height * components * sizeof(JCOEF);
+            }
+            return true;
+        }
+
+        bool readNextRow(JSAMPLE *target)
+        {
+            if (setjmp(m_handle.error.jump))
+            {
+                return false;
+            }
+            if (!m_started)
+            {
+                jpeg_start_decompress(&m_handle.info);
+                m_started = true;
+            }
+            JSAMPROW rows[1] = {target};
+            jpeg_read_scanlines(&m_handle.info, rows, 1);
+            return true;
+        }
+
+        FilePtr m_file;
+        std::span<const uint8_t> m_memory;
+        Handle m_handle;
+        bool m_supported = true;
+        bool m_started = false;
+        std::vector<uint8_t> m_pixels;
+    };
+
+    // Every other format goes through stb_image, which only decodes whole images
+    class StbDecoder : public ScanlineDecoder
+    {
+    public:
+        StbDecoder(const std::string &filename, std::span<const uint8_t> memory)
+            : m_filename(filename), m_memory(memory), m_pixels(nullptr, stbi_image_free)
+        {
+            m_format = "stb_image";
+            m_streaming = false;
+            if (m_memory.size() > static_cast<size_t>(INT_MAX))
+            {
+                throw std::runtime_error("Encoded image is too large");
+            }
+            int channels = 0;
+            int known = m_memory.empty() ? stbi_info(filename.c_str(), &m_width, &m_height, &channels)
+                                         : stbi_info_from_memory(m_memory.data(), static_cast<int>(m_memory.size()), &m_width, &m_height, &channels);
+            if (known == 0)
+            {
+                throw std::runtime_error("Unable to decode " + filename + ": " + stbi_failure_reason());
+            }
+            m_workingSet = static_cast<size_t>(m_width) * m_height * 3;
+        }
+
+    protected:
+        void decodeRow(std::span<uint32_t> row) override
+        {
+            if (m_pixels == nullptr)
+            {
+                int width = 0;
+                int height = 0;
+                int channels = 0;
+                m_pixels.reset(m_memory.empty() ? stbi_load(m_filename.c_str(), &width, &height, &channels, 3)
+                                                : stbi_load_from_memory(m_memory.data(), static_cast<int>(m_memory.size()), &width, &height, &channels, 3));
+                if (m_pixels == nullptr || width != m_width || height != m_height)
+                {
+                    throw std::runtime_error("Unable to decode " + m_filename + ": " + stbi_failure_reason());
+                }
+            }
+            toXrgb(m_pixels.get() + static_cast<size_t>(currentRow()) * m_width * 3, row);
+        }
+
+    private:
+        std::string m_filename;
+        std::span<const uint8_t> m_memory;
+        std::unique_ptr<unsigned char, void (*)(void *)> m_pixels;
+    };
+}
+
+std::unique_ptr<ScanlineDecoder> ScanlineDecoder::open(const std::string &filename, int scaleDenominator)
+{
+    FilePtr file(std::fopen(filename.c_str(), "rb"));
+    if (!file)
+    {
+        throw std::runtime_error("Unable to open " + filename);
+    }
+    unsigned char magic[8] = {};
+    size_t length = std::fread(magic, 1, sizeof(magic), file.get());
+    std::rewind(file.get());
+
+    switch (detect(magic, length))
+    {
+    case Container::Png:
+        return std::make_unique<PngDecoder>(std::move(file), std::span<const uint8_t>(), filename);
+    case Container::Jpeg:
+    {
+        auto decoder = std::make_unique<JpegDecoder>(std::move(file), std::span<const uint8_t>(), filename, scaleDenominator);
+        if (decoder->isSupported())
+        {
+            return decoder;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    return std::make_unique<StbDecoder>(filename, std::span<const uint8_t>());
+}
+
+std::unique_ptr<ScanlineDecoder> ScanlineDecoder::open(std::span<const uint8_t> data, int scaleDenominator)
+{
+    const std::string name = "image";
+    if (data.empty())
+    {
+        throw std::runtime_error("Unable to decode an empty image");
+    }
+    switch (detect(data.data(), data.size()))
+    {
+    case Container::Png:
+        return std::make_unique<PngDecoder>(nullptr, data, name);
+    case Container::Jpeg:
+    {
+        auto decoder = std::make_unique<JpegDecoder>(nullptr, data, name, scaleDenominator);
+        if (decoder->isSupported())
+        {
+            return decoder;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    return std::make_unique<StbDecoder>(name, data);
+}
+
+bool ScanlineDecoder::readRow(std::span<uint32_t> row)
+{
+    if (m_row >= m_height)
+    {
+        return false;
+    }
+    if (row.size() < static_cast<size_t>(m_width))
+    {
+        throw std::invalid_argument("Row buffer is narrower than the image");
+    }
+    decodeRow(row.first(m_width));
+    ++m_row;
+    return true;
+}
@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/ScanlineDecoder.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+
+// Row-by-row image decoding. PNG and baseline JPEG stream through libpng and libjpeg and
+// only hold a few rows at a time. Interlaced PNGs, progressive JPEGs and every other
+// format have to be decoded completely before the first row is available.
+class ScanlineDecoder
+{
+public:
+    virtual ~ScanlineDecoder() = default;
+
+    // JPEGs can shrink by 2, 4 or 8 while decoding; scaleDenominator is rounded down to
+    // one of those and ignored by the other formats
+    static std::unique_ptr<ScanlineDecoder> open(const std::string &filename, int scaleDenominator = 1);
+    // Decodes from encoded bytes that must outlive the decoder, e.g. a MappedFile
+    static std::unique_ptr<ScanlineDecoder> open(std::span<const uint8_t> data, int scaleDenominator = 1);
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    int currentRow() const { return m_row; }
+    bool isStreaming() const { return m_streaming; }
+    bool canScale() const { return m_scalable; }
+    // Estimated memory the decoder holds while producing rows
+    size_t workingSetBytes() const { return m_workingSet; }
+    const std::string &formatName() const { return m_format; }
+
+    // Decodes the next row as XRGB32 into the first width() pixels of `row`;
+    // false once every row has been read
+    bool readRow(std::span<uint32_t> row);
+
+protected:
+    virtual void decodeRow(std::span<uint32_t> row) = 0;
+
+    int m_width = 0;
+    int m_height = 0;
+    bool m_streaming = true;
+    bool m_scalable = false;
+    size_t m_workingSet = 0;
+    std::string m_format;
+
+private:
+    int m_row = 0;
+};
@@ -0,0 +1,98 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/ZxSpectrumConverter.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include "ZxSpectrumConverter.h"
+#include <stdexcept>
+
+ZxSpectrumConverter::ZxSpectrumConverter() : m_cellCache(CellSolutionCache::shared()) {}
+
+void ZxSpectrumConverter::setCellCache(std::shared_ptr<CellSolutionCache> cache)
+{
+    m_cellCache = std::move(cache);
+}
+
+const CellConstraints &ZxSpectrumConverter::constraints()
+{
+    // Index bit 3 is the bright bit, bits 0-2 are the GRB color number
+    static const CellConstraints zx{
+        8, 8,
+        {0x000000, 0x0000D7, 0xD70000, 0xD700D7, 0x00D700, 0x00D7D7, 0xD7D700, 0xD7D7D7,
+         0x000000, 0x0000FF, 0xFF0000, 0xFF00FF, 0x00FF00, 0x00FFFF, 0xFFFF00, 0xFFFFFF},
+        2,
+        false,
+        {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1}};
+    return zx;
+}
+
+EncoderCapabilities ZxSpectrumConverter::capabilities()
+{
+    EncoderCapabilities caps;
+    caps.name = "zx-scr";
+    caps.description = "ZX Spectrum screen (SCR)";
+    caps.extension = "scr";
+    caps.width = SCR_WIDTH;
+    caps.height = SCR_HEIGHT;
+    caps.paletteSize = 15;
+    caps.cellWidth = 8;
+    caps.cellHeight = 8;
+    caps.colorsPerCell = 2;
+    return caps;
+}
+
+EncoderCapabilities ZxSpectrumConverter::getCapabilities() const
+{
+    return capabilities();
+}
+
+void ZxSpectrumConverter::convertImage(ConstPixelView image)
+{
+    const int width = image.width();
+    const int height = image.height();
+    if (width != SCR_WIDTH || height != SCR_HEIGHT)
+    {
+        throw std::runtime_error("Image dimensions must be 256x192 for ZX Spectrum SCR format");
+    }
+
+    CellSolver solver(constraints(), m_cellCache);
+    CellCacheStatistics before = m_cellCache ? m_cellCache->getStatistics() : CellCacheStatistics{};
+    std::vector<CellSolution> solutions = solver.solveImage(solver.quantize(image), width, height);
+    if (m_cellCache)
+    {
+        m_cellCache->logImageStatistics("ZX Spectrum", before);
+    }
+
+    m_bitmap.assign(SCR_BITMAP_SIZE, 0);
+    m_attributes.assign(SCR_ATTRIBUTE_SIZE, 0);
+
+    const int cellsX = SCR_WIDTH / 8;
+    for (size_t cell = 0; cell < solutions.size(); ++cell)
+    {
+        const CellSolution &solution = solutions[cell];
+        int column = static_cast<int>(cell % cellsX);
+        int charRow = static_cast<int>(cell / cellsX);
+        for (int line = 0; line < 8; ++line)
+        {
+            int y = charRow * 8 + line;
+            // Display file order: thirds, then pixel line within the cell, then character row
+            int address = ((y & 0xC0) << 5) | ((y & 0x07) << 8) | ((y & 0x38) << 2) | column;
+            m_bitmap[address] = solution.bitmap[line];
+        }
+
+        uint8_t ink = solution.colors[1];
+        uint8_t paper = solution.colors[0];
+        uint8_t bright = ((ink | paper) & 0x08) ? 0x40 : 0x00;
+        m_attributes[cell] = static_cast<uint8_t>(bright | ((paper & 0x07) << 3) | (ink & 0x07));
+    }
+}
+
+std::vector<uint8_t> ZxSpectrumConverter::getFileData() const
+{
+    std::vector<uint8_t> data;
+    data.reserve(SCR_BITMAP_SIZE + SCR_ATTRIBUTE_SIZE);
+    data.insert(data.end(), m_bitmap.begin(), m_bitmap.end());
+    data.insert(data.end(), m_attributes.begin(), m_attributes.end());
+    return data;
+}
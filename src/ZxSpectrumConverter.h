@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: src/ZxSpectrumConverter.h
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#pragma once
+
+#include "ImageConverter.h"
+#include "CellSolver.h"
+#include <vector>
+#include <cstdint>
+#include <memory>
+
+// ZX Spectrum SCR: 256x192 bitmap with one ink/paper attribute per 8x8 cell.
+// Ink and paper share the attribute's bright bit.
+class ZxSpectrumConverter : public ImageConverter
+{
+public:
+    ZxSpectrumConverter();
+
+    using ImageConverter::convertImage;
+    void convertImage(ConstPixelView image) override;
+    std::vector<uint8_t> getFileData() const override;
+    EncoderCapabilities getCapabilities() const override;
+
+    void setCellCache(std::shared_ptr<CellSolutionCache> cache);
+
+    static EncoderCapabilities capabilities();
+    static const CellConstraints &constraints();
+
+private:
+    static constexpr int SCR_WIDTH = 256;
+    static constexpr int SCR_HEIGHT = 192;
+    static constexpr int SCR_BITMAP_SIZE = 6144;
+    static constexpr int SCR_ATTRIBUTE_SIZE = 768;
+
+    std::vector<uint8_t> m_bitmap;
+    std::vector<uint8_t> m_attributes;
+    std::shared_ptr<CellSolutionCache> m_cellCache;
+};
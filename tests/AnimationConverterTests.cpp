@@ -0,0 +1,173 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: tests/AnimationConverterTests.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include <gtest/gtest.h>
+#include "AnimationConverter.h"
+#include "Corpus.h"
+#include <stdexcept>
+
+class AnimationConverterTest : public ::testing::Test
+{
+protected:
+    // Copy of `image` with a white square at (x, y)
+    static PixelBuffer withSquare(const PixelBuffer &image, int x, int y, int size)
+    {
+        PixelBuffer result = image;
+        for (int dy = 0; dy < size; ++dy)
+        {
+            for (int dx = 0; dx < size; ++dx)
+            {
+                result(x + dx, y + dy) = 0xFFFFFF;
+            }
+        }
+        return result;
+    }
+
+    static std::vector<PixelBuffer> convert(const std::vector<PixelBuffer> &images, const AnimationOptions &options,
+                                            AnimationStatistics *statistics = nullptr)
+    {
+        std::vector<AnimationFrame> frames;
+        for (const PixelBuffer &image : images)
+        {
+            frames.push_back({image, 40});
+        }
+        std::unique_ptr<FrameSource> source = FrameSource::fromFrames(std::move(frames));
+        std::vector<PixelBuffer> outputs;
+        AnimationStatistics result = AnimationConverter(options).run(*source, [&](size_t index, const AnimationFrame &frame)
+                                                                     {
+            EXPECT_EQ(index, outputs.size());
+            EXPECT_EQ(frame.delay, 40);
+            outputs.push_back(frame.image); });
+        if (statistics)
+        {
+            *statistics = result;
+        }
+        return outputs;
+    }
+
+    // Pixels outside the tile at (tileX, tileY) that differ between the two images
+    static int changedOutsideTile(const PixelBuffer &a, const PixelBuffer &b, int tileX, int tileY)
+    {
+        int changed = 0;
+        for (int y = 0; y < a.height(); ++y)
+        {
+            for (int x = 0; x < a.width(); ++x)
+            {
+                bool inside = x / AnimationConverter::TILE == tileX && y / AnimationConverter::TILE == tileY;
+                changed += !inside && a(x, y) != b(x, y);
+            }
+        }
+        return changed;
+    }
+};
+
+TEST_F(AnimationConverterTest, UnchangedTilesAreReused)
+{
+    PixelBuffer still = Corpus::generate(CorpusKind::Gradient, 64, 48);
+    AnimationOptions options;
+    options.targetColors = 8;
+    AnimationStatistics statistics;
+    std::vector<PixelBuffer> outputs = convert({still, still, withSquare(still, 20, 20, 6)}, options, &statistics);
+
+    ASSERT_EQ(outputs.size(), 3u);
+    EXPECT_EQ(statistics.frames, 3u);
+    EXPECT_EQ(statistics.tiles, 3u * 12);
+    // Everything on the second frame and all but one tile on the third
+    EXPECT_EQ(statistics.reusedTiles, 12u + 11u);
+    EXPECT_EQ(statistics.paletteChanges, 0u);
+    EXPECT_EQ(outputs[1], outputs[0]);
+    EXPECT_EQ(changedOutsideTile(outputs[1], outputs[2], 1, 1), 0);
+    EXPECT_NE(outputs[2], outputs[1]);
+}
+
+TEST_F(AnimationConverterTest, ErrorDiffusionDoesNotCrawl)
+{
+    PixelBuffer still = Corpus::generate(CorpusKind::Gradient, 64, 48);
+    AnimationOptions options;
+    options.targetColors = 4;
+    options.dither = true;
+    options.dithering = DitheringAlgorithm::FloydSteinberg;
+    // Every pixel changes a little, a full-frame ditherer would shuffle the whole pattern
+    PixelBuffer shifted = still;
+    for (int y = 0; y < shifted.height(); ++y)
+    {
+        for (int x = 0; x < shifted.width(); ++x)
+        {
+            uint32_t color = shifted(x, y);
+            // One step up per channel, saturating so no channel carries into the next
+            for (int shift = 0; shift < 24; shift += 8)
+            {
+                color += ((color >> shift) & 0xFF) < 0xFF ? uint32_t(1) << shift : 0;
+            }
+            shifted(x, y) = color;
+        }
+    }
+    std::vector<PixelBuffer> stable = convert({still, shifted}, options);
+
+    options.ditherHysteresis = 0;
+    std::vector<PixelBuffer> plain = convert({still, shifted}, options);
+
+    int stableChanges = changedOutsideTile(stable[0], stable[1], -1, -1);
+    int plainChanges = changedOutsideTile(plain[0], plain[1], -1, -1);
+    EXPECT_LT(stableChanges * 4, plainChanges) << stableChanges << " " << plainChanges;
+}
+
+TEST_F(AnimationConverterTest, EvolvingPaletteReplacesOnlyUnusedEntries)
+{
+    std::vector<uint32_t> previous = {0x000000, 0xFF0000, 0x00FF00};
+    std::vector<uint32_t> fresh = {0x030303, 0xFF0000, 0x0000FF};
+
+    EXPECT_EQ(AnimationConverter::evolvePalette(previous, fresh, 24), (std::vector<uint32_t>{0x000000, 0xFF0000, 0x0000FF}));
+    EXPECT_EQ(AnimationConverter::evolvePalette({}, fresh, 24), fresh);
+    // Close colors keep the palette identical, so the frame can reuse its tiles
+    EXPECT_EQ(AnimationConverter::evolvePalette(previous, {0x010000, 0xFE0000, 0x00FE00}, 24), previous);
+
+    AnimationOptions options;
+    options.targetColors = 8;
+    options.paletteMode = PaletteMode::Evolving;
+    PixelBuffer still = Corpus::generate(CorpusKind::Gradient, 64, 48);
+    AnimationStatistics statistics;
+    convert({still, still, still}, options, &statistics);
+    EXPECT_EQ(statistics.paletteChanges, 0u);
+    EXPECT_EQ(statistics.reusedTiles, 2u * 12);
+}
+
+TEST_F(AnimationConverterTest, EvolvingPaletteIsRebuiltOnlyAfterLargeChanges)
+{
+    AnimationOptions options;
+    options.targetColors = 8;
+    options.paletteMode = PaletteMode::Evolving;
+    PixelBuffer still = Corpus::generate(CorpusKind::Gradient, 64, 48);
+    PixelBuffer other = Corpus::generate(CorpusKind::Noise, 64, 48);
+    std::vector<PixelBuffer> frames = {still, still, withSquare(still, 20, 20, 6), other};
+
+    // One tile of twelve is below the default area, the new image is not
+    AnimationStatistics statistics;
+    std::vector<PixelBuffer> outputs = convert(frames, options, &statistics);
+    EXPECT_EQ(statistics.paletteBuilds, 2u);
+    EXPECT_EQ(changedOutsideTile(outputs[1], outputs[2], 1, 1), 0);
+
+    options.paletteRebuildArea = 0.0;
+    convert(frames, options, &statistics);
+    EXPECT_EQ(statistics.paletteBuilds, 3u);
+}
+
+TEST_F(AnimationConverterTest, OutputDoesNotDependOnThreadsAndChecksFrameSizes)
+{
+    PixelBuffer still = Corpus::generate(CorpusKind::Gradient, 80, 48);
+    std::vector<PixelBuffer> images = {still, withSquare(still, 40, 8, 12), withSquare(still, 50, 30, 10)};
+    AnimationOptions options;
+    options.targetColors = 6;
+    options.dither = true;
+    options.threads = 1;
+    std::vector<PixelBuffer> serial = convert(images, options);
+    options.threads = 4;
+    EXPECT_EQ(convert(images, options), serial);
+
+    EXPECT_THROW(convert({still, Corpus::generate(CorpusKind::Gradient, 40, 48)}, options), std::runtime_error);
+    options.targetColors = 0;
+    EXPECT_THROW(convert({still}, options), std::invalid_argument);
+}
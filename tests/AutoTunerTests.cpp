@@ -0,0 +1,118 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: tests/AutoTunerTests.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include <gtest/gtest.h>
+#include "AutoTuner.h"
+#include "BatchConverter.h"
+#include "Corpus.h"
+#include <cmath>
+
+class AutoTunerTest : public ::testing::Test
+{
+protected:
+    static PixelBuffer makeBlocks(int width, int height)
+    {
+        const uint32_t colors[] = {0x000000, 0xFFFFFF, 0xFF0000, 0x00FF00};
+        PixelBuffer image(width, height);
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                image(x, y) = colors[(x / 8 + y / 8) % 4];
+            }
+        }
+        return image;
+    }
+};
+
+TEST_F(AutoTunerTest, ExactPaletteNeedsNoDithering)
+{
+    TuneOptions options;
+    options.paletteSizes = {4};
+    options.budget = std::chrono::seconds(30);
+    TuneResult result = AutoTuner::tune(makeBlocks(32, 32), options);
+
+    EXPECT_FALSE(result.budgetExhausted);
+    EXPECT_FALSE(result.best.dither);
+    EXPECT_NEAR(result.score, 0.0, 1e-9);
+    // Small enough to be ranked completely at full size in one round
+    EXPECT_EQ(result.evaluated, result.candidates);
+    EXPECT_EQ(result.pruned, 0u);
+}
+
+TEST_F(AutoTunerTest, SmoothGradientPrefersDithering)
+{
+    TuneOptions options;
+    options.paletteSizes = {4};
+    options.budget = std::chrono::seconds(30);
+    TuneResult result = AutoTuner::tune(Corpus::generate(CorpusKind::Gradient, 96, 64), options);
+
+    EXPECT_TRUE(result.best.dither) << AutoTuner::describe(result.best);
+    EXPECT_LT(result.score, AutoTuner::score(Corpus::generate(CorpusKind::Gradient, 96, 64), AutoTuner::apply(Corpus::generate(CorpusKind::Gradient, 96, 64), TuneCandidate{ColorReductionAlgorithm::MedianCut, 4})));
+}
+
+TEST_F(AutoTunerTest, SuccessiveHalvingPrunesOnProxies)
+{
+    PixelBuffer image = Corpus::generate(CorpusKind::Gradient, 256, 256);
+    TuneOptions options;
+    options.paletteSizes = {8};
+    options.proxyPixels = 64 * 64;
+    options.budget = std::chrono::seconds(30);
+    TuneResult result = AutoTuner::tune(image, options);
+
+    // 12 candidates at 16x16, the best 6 at 32x32, the best 3 at 64x64
+    EXPECT_EQ(result.candidates, 12u);
+    EXPECT_EQ(result.evaluated, 21u);
+    EXPECT_EQ(result.pruned, 9u);
+
+    // The batch runs the winner at full resolution
+    BatchOptions batch;
+    batch.targetColors = 8;
+    batch.autoTune = true;
+    PixelBuffer processed = BatchConverter::process(image, batch);
+    EXPECT_EQ(processed.width(), 256);
+    EXPECT_LE(ColorReducer::buildHistogram(processed).colors.size(), 8u);
+}
+
+TEST_F(AutoTunerTest, StopsWhenTheBudgetRunsOut)
+{
+    // Far too little time for twelve candidates on a 256x256 proxy
+    TuneOptions options;
+    options.budget = std::chrono::milliseconds(1);
+    options.proxyPixels = 1024 * 1024;
+    TuneResult result = AutoTuner::tune(Corpus::generate(CorpusKind::Gradient, 1024, 1024), options);
+
+    EXPECT_TRUE(result.budgetExhausted);
+    EXPECT_LT(result.evaluated, result.candidates);
+    EXPECT_LT(result.elapsed.count(), 5000);
+
+    ProgressToken cancelled;
+    cancelled.cancel();
+    options.budget = std::chrono::seconds(30);
+    EXPECT_THROW(AutoTuner::tune(Corpus::generate(CorpusKind::Gradient, 64, 64), options, &cancelled), OperationCancelled);
+}
+
+TEST_F(AutoTunerTest, CallerCancellationReachesRunningCandidates)
+{
+    TuneOptions options;
+    options.threads = 1;
+    options.proxyPixels = 1024 * 1024;
+    options.budget = std::chrono::seconds(60);
+    ProgressToken caller;
+    caller.setTimeout(std::chrono::milliseconds(20));
+
+    try
+    {
+        AutoTuner::tune(Corpus::generate(CorpusKind::Gradient, 1024, 1024), options, &caller);
+        FAIL() << "Expected the caller's deadline to end the search";
+    }
+    catch (const OperationCancelled &error)
+    {
+        // Not turned into an exhausted budget, and well short of it
+        EXPECT_TRUE(error.isTimeout());
+        EXPECT_LT(caller.getElapsed().count(), 5000);
+    }
+}
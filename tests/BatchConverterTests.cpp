@@ -0,0 +1,215 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: tests/BatchConverterTests.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include <gtest/gtest.h>
+#include "BatchConverter.h"
+#include "BoundedQueue.h"
+#include "Corpus.h"
+#include "KoalaConverter.h"
+#include "MappedFile.h"
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+#include <thread>
+
+class BatchConverterTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        root = std::filesystem::path(::testing::TempDir()) / "batch_converter_test";
+        std::filesystem::remove_all(root);
+        std::filesystem::create_directories(root / "in" / "nested");
+    }
+
+    void TearDown() override
+    {
+        std::filesystem::remove_all(root);
+    }
+
+    void touch(const std::filesystem::path &path)
+    {
+        std::ofstream(path) << "x";
+    }
+
+    std::filesystem::path root;
+};
+
+TEST_F(BatchConverterTest, BoundedQueueBlocksAndDrains)
+{
+    BoundedQueue<int> queue(2);
+    std::thread producer([&]()
+                         {
+        for (int i = 0; i < 100; ++i)
+        {
+            queue.push(i);
+        }
+        queue.close(); });
+
+    int expected = 0;
+    while (std::optional<int> value = queue.pop())
+    {
+        EXPECT_LE(queue.size(), 2);
+        EXPECT_EQ(*value, expected++);
+    }
+    producer.join();
+
+    EXPECT_EQ(expected, 100);
+    EXPECT_FALSE(queue.push(1));
+}
+
+TEST_F(BatchConverterTest, CollectJobsMirrorsDirectoryTree)
+{
+    touch(root / "in" / "a.png");
+    touch(root / "in" / "notes.txt");
+    touch(root / "in" / "nested" / "b.JPG");
+
+    std::vector<BatchJob> flat = BatchConverter::collectJobs({root / "in"}, root / "out", ".kla", false);
+    std::vector<BatchJob> tree = BatchConverter::collectJobs({root / "in"}, root / "out", ".kla", true);
+
+    ASSERT_EQ(flat.size(), 1);
+    EXPECT_EQ(flat[0].output, root / "out" / "a.kla");
+    ASSERT_EQ(tree.size(), 2);
+    EXPECT_EQ(tree[1].output, root / "out" / "nested" / "b.kla");
+    EXPECT_THROW(BatchConverter::collectJobs({root / "missing.png"}, root / "out", ".kla", false), std::invalid_argument);
+}
+
+TEST_F(BatchConverterTest, PipelineWritesEveryImageAndReportsFailures)
+{
+    std::vector<BatchJob> jobs;
+    for (int i = 0; i < 12; ++i)
+    {
+        touch(root / "in" / ("image" + std::to_string(i) + ".png"));
+        jobs.push_back({root / "in" / ("image" + std::to_string(i) + ".png"),
+                        root / "out" / "sub" / ("image" + std::to_string(i) + ".scr")});
+    }
+
+    BatchOptions options;
+    options.encoder = "zx-scr";
+    options.targetColors = 8;
+    options.dither = true;
+    options.workerThreads = 3;
+    options.queueDepth = 2;
+    BatchConverter converter(options);
+    converter.setLoader([](const std::filesystem::path &path, std::span<const uint8_t>)
+                        {
+        if (path.filename() == "image5.png")
+        {
+            throw std::runtime_error("corrupt image");
+        }
+        // Other sizes are resampled to the encoder's 256x192
+        if (path.filename() == "image7.png")
+        {
+            return Corpus::generate(CorpusKind::Noise, 64, 64);
+        }
+        return Corpus::generate(CorpusKind::Noise, 256, 192); });
+
+    BatchReport report = converter.run(jobs);
+
+    EXPECT_EQ(report.converted, 11);
+    EXPECT_EQ(report.failed, 1);
+    ASSERT_EQ(report.errors.size(), 1);
+    EXPECT_NE(report.errors[0].find("image5.png"), std::string::npos);
+    EXPECT_EQ(std::filesystem::file_size(jobs[0].output), 6912);
+    EXPECT_FALSE(std::filesystem::exists(jobs[5].output));
+    EXPECT_EQ(std::filesystem::file_size(jobs[7].output), 6912);
+
+    options.overwrite = false;
+    BatchConverter again(options);
+    again.setLoader([](const std::filesystem::path &, std::span<const uint8_t>)
+                    { return Corpus::generate(CorpusKind::Noise, 256, 192); });
+    BatchReport second = again.run(jobs);
+    EXPECT_EQ(second.skipped, 11);
+    EXPECT_EQ(second.converted, 1);
+}
+
+TEST_F(BatchConverterTest, WritesPackedKoalaFiles)
+{
+    touch(root / "in" / "a.png");
+    std::vector<BatchJob> jobs = {{root / "in" / "a.png", root / "out" / "raw.kla"}, {root / "in" / "a.png", root / "out" / "lz.kla"}};
+    auto load = [](const std::filesystem::path &, std::span<const uint8_t>)
+    { return PixelBuffer(160, 200, 0x000000); };
+
+    BatchOptions options;
+    BatchConverter raw(options);
+    raw.setLoader(load);
+    EXPECT_EQ(raw.run({jobs[0]}).converted, 1);
+    options.koalaPacking = KoalaPacking::Lz;
+    BatchConverter packed(options);
+    packed.setLoader(load);
+    EXPECT_EQ(packed.run({jobs[1]}).converted, 1);
+
+    auto read = [](const std::filesystem::path &path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), {});
+    };
+    std::vector<uint8_t> rawData = read(jobs[0].output);
+    std::vector<uint8_t> lzData = read(jobs[1].output);
+    EXPECT_EQ(rawData.size(), 10003u);
+    EXPECT_LT(lzData.size(), rawData.size());
+    EXPECT_EQ(KoalaConverter::unpack(lzData, KoalaPacking::Lz), rawData);
+
+    std::span<const uint8_t> source;
+    EXPECT_NE(BatchConverter::cacheKey(source, options), BatchConverter::cacheKey(source, BatchOptions{}));
+}
+
+TEST_F(BatchConverterTest, DecodersGetPrefetchedFileContents)
+{
+    std::vector<BatchJob> jobs;
+    for (int i = 0; i < 6; ++i)
+    {
+        std::filesystem::path input = root / "in" / ("image" + std::to_string(i) + ".png");
+        std::ofstream(input, std::ios::binary) << std::string(static_cast<size_t>(i) * 1000 + 1, static_cast<char>('a' + i));
+        jobs.push_back({input, root / "out" / ("image" + std::to_string(i) + ".scr")});
+    }
+    // Missing inputs fail in the I/O stage without stalling the pipeline
+    jobs.push_back({root / "in" / "missing.png", root / "out" / "missing.scr"});
+
+    BatchOptions options;
+    options.encoder = "zx-scr";
+    options.prefetchFiles = 1;
+    BatchConverter converter(options);
+    converter.setLoader([](const std::filesystem::path &path, std::span<const uint8_t> data)
+                        {
+        int i = path.stem().string().back() - '0';
+        if (data.size() != static_cast<size_t>(i) * 1000 + 1 || data.front() != 'a' + i || data.back() != 'a' + i)
+        {
+            throw std::runtime_error("wrong contents");
+        }
+        return Corpus::generate(CorpusKind::Noise, 256, 192); });
+
+    BatchReport report = converter.run(jobs);
+
+    EXPECT_EQ(report.converted, 6);
+    ASSERT_EQ(report.failed, 1);
+    EXPECT_NE(report.errors[0].find("missing.png"), std::string::npos);
+}
+
+TEST_F(BatchConverterTest, MappedFileHandlesEmptyAndMissingFiles)
+{
+    touch(root / "in" / "full.bin");
+    std::ofstream(root / "in" / "empty.bin").close();
+
+    MappedFile full = MappedFile::open(root / "in" / "full.bin");
+    ASSERT_EQ(full.size(), 1u);
+    EXPECT_EQ(full.bytes()[0], 'x');
+    MappedFile moved = std::move(full);
+    EXPECT_EQ(full.size(), 0u);
+    EXPECT_EQ(moved.bytes()[0], 'x');
+
+    EXPECT_TRUE(MappedFile::open(root / "in" / "empty.bin").bytes().empty());
+    EXPECT_THROW(MappedFile::open(root / "in" / "missing.bin"), std::runtime_error);
+}
+
+TEST_F(BatchConverterTest, UnknownEncoderThrowsBeforeWork)
+{
+    BatchOptions options;
+    options.encoder = "nope";
+
+    EXPECT_THROW(BatchConverter(options).run({}), std::invalid_argument);
+}
@@ -0,0 +1,146 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: tests/CellSolverTests.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include <gtest/gtest.h>
+#include "CellSolver.h"
+#include "KoalaConverter.h"
+#include "Hash.h"
+#include <vector>
+#include <cstdint>
+#include <string>
+
+class CellSolverTest : public ::testing::Test
+{
+protected:
+    std::shared_ptr<CellSolutionCache> cache = std::make_shared<CellSolutionCache>();
+};
+
+TEST(HashTest, MatchesReferenceXXH64)
+{
+    EXPECT_EQ(Hash::xxh64("", 0), 0xEF46DB3751D8E999ULL);
+    EXPECT_EQ(Hash::xxh64("abc", 3), 0x44BC2CF5AD770999ULL);
+
+    std::string longInput = "Nobody inspects the spammish repetition, twice over, twice over.";
+    EXPECT_EQ(Hash::xxh64(longInput.data(), longInput.size()), Hash::xxh64(longInput.data(), longInput.size()));
+    EXPECT_NE(Hash::xxh64(longInput.data(), longInput.size()), Hash::xxh64(longInput.data(), longInput.size(), 1));
+}
+
+TEST_F(CellSolverTest, MulticolorUsesBackgroundForSolidCell)
+{
+    CellSolver solver(CellConstraints::c64Multicolor(), cache);
+    std::vector<uint8_t> cell(4 * 8, 6);
+
+    CellSolution solution = solver.solve(cell, 6);
+
+    for (uint8_t byte : solution.bitmap)
+    {
+        EXPECT_EQ(byte, 0);
+    }
+    EXPECT_EQ(solution.colors[0], 6);
+}
+
+TEST_F(CellSolverTest, MulticolorKeepsThreeFreeColorsExact)
+{
+    CellSolver solver(CellConstraints::c64Multicolor(), cache);
+    std::vector<uint8_t> cell(4 * 8, 0);
+    cell[0] = 1;
+    cell[1] = 2;
+    cell[2] = 5;
+
+    CellSolution solution = solver.solve(cell, 0);
+
+    EXPECT_EQ(solution.colors[(solution.bitmap[0] >> 6) & 3], 1);
+    EXPECT_EQ(solution.colors[(solution.bitmap[0] >> 4) & 3], 2);
+    EXPECT_EQ(solution.colors[(solution.bitmap[0] >> 2) & 3], 5);
+    EXPECT_EQ(solution.colors[solution.bitmap[0] & 3], 0);
+}
+
+TEST_F(CellSolverTest, HiresSplitsTwoColors)
+{
+    CellSolver solver(CellConstraints::c64Hires(), cache);
+    std::vector<uint8_t> cell(8 * 8, 1);
+    for (int y = 0; y < 8; ++y)
+    {
+        for (int x = 0; x < 4; ++x)
+        {
+            cell[y * 8 + x] = 2;
+        }
+    }
+
+    CellSolution solution = solver.solve(cell);
+
+    for (uint8_t byte : solution.bitmap)
+    {
+        EXPECT_TRUE(byte == 0xF0 || byte == 0x0F);
+    }
+    EXPECT_EQ(solution.colors[(solution.bitmap[0] & 0x80) ? 1 : 0], 2);
+}
+
+TEST_F(CellSolverTest, RepeatedCellsHitCache)
+{
+    CellSolver solver(CellConstraints::c64Multicolor(), cache);
+    std::vector<uint8_t> cell(4 * 8);
+    for (size_t i = 0; i < cell.size(); ++i)
+    {
+        cell[i] = static_cast<uint8_t>(i % 16);
+    }
+
+    CellSolution first = solver.solve(cell, 0);
+    CellSolution second = solver.solve(cell, 0);
+    solver.solve(cell, 1);
+
+    EXPECT_EQ(first.bitmap, second.bitmap);
+    EXPECT_EQ(first.colors, second.colors);
+
+    CellCacheStatistics stats = cache->getStatistics();
+    EXPECT_EQ(stats.hits, 1);
+    EXPECT_EQ(stats.misses, 2);
+    EXPECT_EQ(cache->size(), 2);
+}
+
+TEST_F(CellSolverTest, KoalaConversionSharesCacheAcrossImages)
+{
+    std::vector<uint32_t> image(160 * 200);
+    for (size_t i = 0; i < image.size(); ++i)
+    {
+        image[i] = static_cast<uint32_t>(i % 160) << 16;
+    }
+
+    KoalaConverter first;
+    first.setCellCache(cache);
+    first.convertImage(image, 160, 200);
+    CellCacheStatistics afterFirst = cache->getStatistics();
+
+    KoalaConverter second;
+    second.setCellCache(cache);
+    second.convertImage(image, 160, 200);
+    CellCacheStatistics afterSecond = cache->getStatistics();
+
+    EXPECT_GT(afterFirst.hits, 0);
+    EXPECT_EQ(afterSecond.misses, afterFirst.misses);
+    EXPECT_EQ(afterSecond.hits, afterFirst.hits + 1000);
+}
+
+TEST_F(CellSolverTest, GroupConstraintKeepsColorsInOneGroup)
+{
+    CellConstraints constraints{8, 8, {0x000000, 0x0000D7, 0x000000, 0x0000FF}, 2, false, {0, 0, 1, 1}};
+    CellSolver solver(constraints, cache);
+    std::vector<uint8_t> cell(8 * 8, 0);
+    cell[0] = 3;
+
+    CellSolution solution = solver.solve(cell);
+
+    EXPECT_EQ(constraints.groups[solution.colors[0]], constraints.groups[solution.colors[1]]);
+    EXPECT_EQ(solution.colors[(solution.bitmap[0] & 0x80) ? 1 : 0], 3);
+    EXPECT_EQ(constraints.palette[solution.colors[(solution.bitmap[1] & 0x80) ? 1 : 0]], 0x000000);
+}
+
+TEST_F(CellSolverTest, RejectsUnpackableConstraints)
+{
+    CellConstraints constraints{8, 8, {0x000000, 0xFFFFFF, 0xFF0000}, 3, false, {}};
+
+    EXPECT_THROW(CellSolver solver(constraints), std::invalid_argument);
+}
@@ -6,6 +6,7 @@
 
 #include <gtest/gtest.h>
 #include "ColorReducer.h"
+#include "Corpus.h"
 #include <vector>
 #include <set>
 #include <algorithm>
@@ -55,6 +56,60 @@ TEST_F(ColorReducerTest, ReduceColorsOctree)
     EXPECT_LE(uniqueColors.size(), 8);
 }
 
+TEST_F(ColorReducerTest, OctreeWithTinyPaletteStillFindsColors)
+{
+    // Many distinct colors and only two nodes: the budget runs out long before level 8
+    std::vector<uint32_t> gradient(64 * 64);
+    for (size_t i = 0; i < gradient.size(); ++i)
+    {
+        gradient[i] = static_cast<uint32_t>((i % 64) * 4 << 16 | (i / 64) * 4 << 8 | (i % 7) * 30);
+    }
+
+    std::vector<uint32_t> result = ColorReducer::reduceColors(gradient, 64, 64, 2, ColorReductionAlgorithm::OctreeQuantization);
+
+    std::set<uint32_t> uniqueColors(result.begin(), result.end());
+    EXPECT_GE(uniqueColors.size(), 1u);
+    EXPECT_LE(uniqueColors.size(), 2u);
+}
+
+TEST_F(ColorReducerTest, ChannelSumsDoNotOverflowAbove8MPixels)
+{
+    // 255 * 8.4M passes INT_MAX; a single box, centroid or node has to sum them all
+    const int width = 3000;
+    const int height = 3000;
+    std::vector<uint32_t> image(static_cast<size_t>(width) * height, 0xF0F0F0);
+    image.back() = 0xFFFFFF;
+
+    for (ColorReductionAlgorithm algo : {ColorReductionAlgorithm::MedianCut, ColorReductionAlgorithm::KMeans,
+                                         ColorReductionAlgorithm::OctreeQuantization})
+    {
+        std::vector<uint32_t> result = ColorReducer::reduceColors(image, width, height, 1, algo);
+        ASSERT_EQ(result.size(), image.size());
+        EXPECT_EQ(result.front(), 0xF0F0F0u) << ColorReducer::getColorReducerName(algo);
+        EXPECT_EQ(std::count(result.begin(), result.end(), result.front()), static_cast<std::ptrdiff_t>(result.size()));
+    }
+}
+
+TEST_F(ColorReducerTest, PaddedRowsGiveTheSameResultAsPackedPixels)
+{
+    // 21 pixels do not fill the 64 byte row alignment, so the buffer has padding
+    PixelBuffer image = Corpus::generate(CorpusKind::Noise, 21, 13);
+    ASSERT_FALSE(image.view().isContiguous());
+    std::vector<uint32_t> packed = image.toVector();
+    for (ColorReductionAlgorithm algo : {ColorReductionAlgorithm::MedianCut, ColorReductionAlgorithm::KMeans, ColorReductionAlgorithm::OctreeQuantization})
+    {
+        EXPECT_EQ(ColorReducer::reduceColors(image, 8, algo), ColorReducer::reduceColors(packed, 21, 13, 8, algo))
+            << ColorReducer::getColorReducerName(algo);
+    }
+
+    PixelBuffer flat(21, 13);
+    for (int y = 0; y < flat.height(); ++y)
+    {
+        std::fill(flat.row(y).begin(), flat.row(y).end(), 0x336699);
+    }
+    EXPECT_EQ(ColorReducer::reduceColors(flat, 8, ColorReductionAlgorithm::KMeans), std::vector<uint32_t>(21 * 13, 0x336699));
+}
+
 TEST_F(ColorReducerTest, PreservesAlpha)
 {
     std::vector<uint32_t> result = ColorReducer::reduceColors(testImage, 4, 4, 8, ColorReductionAlgorithm::MedianCut);
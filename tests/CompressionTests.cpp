@@ -0,0 +1,120 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: tests/CompressionTests.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include <gtest/gtest.h>
+#include "Compression.h"
+#include "KoalaConverter.h"
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <random>
+
+class CompressionTest : public ::testing::Test
+{
+protected:
+    static std::vector<uint8_t> makeMixedData()
+    {
+        std::mt19937 rng(7);
+        std::vector<uint8_t> data;
+        for (int block = 0; block < 64; ++block)
+        {
+            data.insert(data.end(), static_cast<size_t>(rng() % 300), static_cast<uint8_t>(rng()));
+            for (int i = 0; i < 40; ++i)
+            {
+                data.push_back(static_cast<uint8_t>(rng()));
+            }
+            data.insert(data.end(), {0xFE, 0xFE, 0x12, 0xFE});
+        }
+        return data;
+    }
+
+    static std::vector<uint8_t> readFile(const std::string &path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+};
+
+TEST_F(CompressionTest, RleRoundTripsAndEscapesMarker)
+{
+    std::vector<uint8_t> data = makeMixedData();
+    std::vector<uint8_t> packed;
+
+    Compression::packRle(data.data(), data.size(), packed);
+
+    EXPECT_LT(packed.size(), data.size());
+    EXPECT_EQ(Compression::unpackRle(packed.data(), packed.size()), data);
+
+    std::vector<uint8_t> single;
+    uint8_t escape = Compression::RLE_ESCAPE;
+    Compression::packRle(&escape, 1, single);
+    EXPECT_EQ(single, (std::vector<uint8_t>{0xFE, 0xFE, 0x01}));
+}
+
+TEST_F(CompressionTest, LzRoundTripsAndBeatsRle)
+{
+    std::vector<uint8_t> data = makeMixedData();
+    // Repeat a long block so the match finder has distant references
+    std::vector<uint8_t> repeated(data.begin(), data.begin() + 500);
+    data.insert(data.end(), repeated.begin(), repeated.end());
+    std::vector<uint8_t> lz;
+    std::vector<uint8_t> rle;
+
+    Compression::packLz(data.data(), data.size(), lz);
+    Compression::packRle(data.data(), data.size(), rle);
+
+    EXPECT_LT(lz.size(), rle.size());
+    EXPECT_EQ(Compression::unpackLz(lz.data(), lz.size()), data);
+}
+
+TEST_F(CompressionTest, LzHandlesShortAndEmptyInput)
+{
+    for (size_t size : {0, 1, 2, 3, 4})
+    {
+        std::vector<uint8_t> data(size, 0x33);
+        std::vector<uint8_t> packed;
+        Compression::packLz(data.data(), data.size(), packed);
+        EXPECT_EQ(Compression::unpackLz(packed.data(), packed.size()), data) << size;
+    }
+
+    std::vector<uint8_t> bad = {0x80, 0x05, 0x00};
+    EXPECT_THROW(Compression::unpackLz(bad.data(), bad.size()), std::runtime_error);
+}
+
+TEST_F(CompressionTest, KoalaWritesLittleEndianPackedFiles)
+{
+    std::vector<uint32_t> image(160 * 200, 0x000000);
+    for (int y = 0; y < 100; ++y)
+    {
+        for (int x = 0; x < 160; ++x)
+        {
+            image[y * 160 + x] = (x / 8) % 2 ? 0xFFFFFF : 0x68372B;
+        }
+    }
+    KoalaConverter converter;
+    converter.convertImage(image, 160, 200);
+    std::vector<uint8_t> raw = converter.getFileData();
+
+    std::string path = ::testing::TempDir() + "koala_writer_test.kla";
+    for (KoalaPacking packing : {KoalaPacking::None, KoalaPacking::Rle, KoalaPacking::Lz})
+    {
+        converter.setPacking(packing);
+        converter.saveFile(path);
+        std::vector<uint8_t> written = readFile(path);
+
+        ASSERT_GE(written.size(), 2);
+        EXPECT_EQ(written[0], 0x00);
+        EXPECT_EQ(written[1], 0x60);
+        EXPECT_EQ(KoalaConverter::unpack(written, packing), raw);
+        if (packing != KoalaPacking::None)
+        {
+            EXPECT_LT(written.size(), raw.size() / 2);
+        }
+    }
+    std::remove(path.c_str());
+}
@@ -0,0 +1,164 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: tests/ConversionPipelineTests.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include <gtest/gtest.h>
+#include "ConversionPipeline.h"
+#include "Corpus.h"
+#include <set>
+#include <thread>
+
+class ConversionPipelineTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        std::vector<uint32_t> pixels(64 * 50);
+        for (int y = 0; y < 50; ++y)
+        {
+            for (int x = 0; x < 64; ++x)
+            {
+                pixels[y * 64 + x] = (static_cast<uint32_t>(x * 4) << 16) | (static_cast<uint32_t>(y * 5) << 8) | 0x80;
+            }
+        }
+        pipeline.setSource(std::move(pixels), 64, 50);
+    }
+
+    uint64_t misses(ConversionPipeline::Stage stage) const
+    {
+        return pipeline.getStatistics()[stage].misses;
+    }
+
+    ConversionPipeline pipeline;
+};
+
+TEST_F(ConversionPipelineTest, DitherChangeRecomputesOnlyDitherStage)
+{
+    PipelineSettings settings;
+    settings.targetColors = 8;
+    settings.dither = true;
+    pipeline.dithered(settings);
+
+    settings.dithering = DitheringAlgorithm::Bayer;
+    std::shared_ptr<const PixelBuffer> bayer = pipeline.dithered(settings);
+
+    EXPECT_EQ(misses(ConversionPipeline::Resample), 1);
+    EXPECT_EQ(misses(ConversionPipeline::Histogram), 1);
+    EXPECT_EQ(misses(ConversionPipeline::Palette), 1);
+    EXPECT_EQ(misses(ConversionPipeline::Dither), 2);
+
+    settings.dithering = DitheringAlgorithm::FloydSteinberg;
+    pipeline.dithered(settings);
+    EXPECT_EQ(misses(ConversionPipeline::Dither), 2);
+
+    std::vector<uint32_t> pixels = bayer->toVector();
+    std::set<uint32_t> colors(pixels.begin(), pixels.end());
+    EXPECT_LE(colors.size(), 8);
+}
+
+TEST_F(ConversionPipelineTest, PaletteChangeKeepsResampleAndHistogram)
+{
+    PipelineSettings settings;
+    settings.targetColors = 4;
+    std::shared_ptr<const std::vector<uint32_t>> four = pipeline.palette(settings);
+    settings.targetColors = 16;
+    std::shared_ptr<const std::vector<uint32_t>> sixteen = pipeline.palette(settings);
+
+    EXPECT_LE(four->size(), 4);
+    EXPECT_GT(sixteen->size(), four->size());
+    EXPECT_EQ(misses(ConversionPipeline::Histogram), 1);
+    EXPECT_EQ(misses(ConversionPipeline::Palette), 2);
+}
+
+TEST_F(ConversionPipelineTest, FixedPaletteReplacesTheReducer)
+{
+    PipelineSettings settings;
+    settings.targetColors = 4;
+    std::shared_ptr<const PixelBuffer> reduced = pipeline.dithered(settings);
+    settings.palette = {0x000000, 0xFFFFFF};
+    EXPECT_EQ(*pipeline.palette(settings), settings.palette);
+    std::shared_ptr<const PixelBuffer> fixed = pipeline.dithered(settings);
+    std::vector<uint32_t> pixels = fixed->toVector();
+    EXPECT_EQ(std::set<uint32_t>(pixels.begin(), pixels.end()), std::set<uint32_t>({0x000000, 0xFFFFFF}));
+
+    // Another palette is another result; the reducer's stays cached
+    settings.palette = {0x000000, 0xFF0000};
+    EXPECT_NE(*pipeline.dithered(settings), *fixed);
+    settings.palette.clear();
+    EXPECT_EQ(pipeline.dithered(settings), reduced);
+}
+
+TEST_F(ConversionPipelineTest, NewSourceInvalidatesEverything)
+{
+    PipelineSettings settings;
+    settings.width = 32;
+    settings.height = 25;
+    std::shared_ptr<const PixelBuffer> first = pipeline.dithered(settings);
+    EXPECT_EQ(first->width(), 32);
+    EXPECT_EQ(first->height(), 25);
+
+    pipeline.setSource(std::vector<uint32_t>(64 * 50, 0x102030), 64, 50);
+    std::shared_ptr<const PixelBuffer> second = pipeline.dithered(settings);
+
+    EXPECT_EQ(misses(ConversionPipeline::Resample), 2);
+    EXPECT_EQ((*second)(0, 0), 0x102030u);
+
+    // Same content again is recognized by its hash
+    pipeline.setSource(std::vector<uint32_t>(64 * 50, 0x102030), 64, 50);
+    pipeline.dithered(settings);
+    EXPECT_EQ(misses(ConversionPipeline::Dither), 2);
+}
+
+TEST_F(ConversionPipelineTest, EncodeStageUsesRegistry)
+{
+    PipelineSettings settings;
+    settings.width = 160;
+    settings.height = 200;
+    settings.encoder = "koala";
+
+    std::shared_ptr<const std::vector<uint8_t>> data = pipeline.encoded(settings);
+    pipeline.encoded(settings);
+
+    EXPECT_EQ(data->size(), 10003);
+    EXPECT_EQ(misses(ConversionPipeline::Encode), 1);
+}
+
+TEST_F(ConversionPipelineTest, LongStageDoesNotBlockOtherCallers)
+{
+    pipeline.setSource(Corpus::generate(CorpusKind::Photo, 1024, 1024));
+    PipelineSettings settings;
+    settings.reducer = ColorReductionAlgorithm::KMeans;
+    settings.targetColors = 256;
+    ProgressToken token;
+    bool cancelled = false;
+    std::thread worker([&]()
+                       {
+        try
+        {
+            pipeline.palette(settings, &token);
+        }
+        catch (const OperationCancelled &)
+        {
+            cancelled = true;
+        } });
+
+    // Wait until the worker is inside the palette stage
+    for (int i = 0; i < 10000 && token.getProgress() == 0.0f; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    pipeline.getStatistics();
+    pipeline.setSource(Corpus::generate(CorpusKind::Flat, 32, 32));
+    PipelineSettings small;
+    small.targetColors = 4;
+    EXPECT_EQ(pipeline.dithered(small)->width(), 32);
+
+    // Still inside k-means, a blocked caller would only get here after it finished
+    token.cancel();
+    worker.join();
+    EXPECT_TRUE(cancelled);
+    // The cancelled stage cached nothing for the new source
+    EXPECT_EQ(pipeline.resampled(small)->width(), 32);
+}
@@ -76,4 +76,55 @@ TEST_F(ConverterTest, HandleInvalidDimensions)
     EXPECT_THROW(converter.convertToBitmap(inputImage, width, height), std::invalid_argument);
     EXPECT_THROW(converter.convertToHires(inputImage, width, height), std::invalid_argument);
     EXPECT_THROW(converter.convertToMulticolor(inputImage, width, height), std::invalid_argument);
-}
\ No newline at end of file
+}
+
+TEST_F(ConverterTest, ConvertToFliReproducesPaletteImage)
+{
+    int width = 16;
+    int height = 16;
+    std::vector<uint32_t> inputImage(width * height);
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            // Two colors per line plus background: representable exactly in FLI
+            inputImage[y * width + x] = (x % 4 == 0) ? 0x000000 : (y % 2 == 0 ? 0x68372B : 0x9AD284);
+        }
+    }
+
+    FliResult result = converter.convertToFli(inputImage, width, height, FliMode::Fli);
+
+    ASSERT_EQ(result.frames.size(), 1);
+    EXPECT_EQ(result.frames[0].bitmap.size(), 4 * 2 * 8);
+    EXPECT_EQ(result.frames[0].colorRAM.size(), 4 * 2);
+    EXPECT_EQ(result.error, 0);
+    EXPECT_TRUE(result.complete);
+    EXPECT_EQ(FliEncoder::render(result), inputImage);
+}
+
+TEST_F(ConverterTest, ConvertToIfliDoesNotIncreaseError)
+{
+    int width = 32;
+    int height = 16;
+    std::vector<uint32_t> inputImage(width * height);
+    for (int i = 0; i < width * height; ++i)
+    {
+        uint32_t v = static_cast<uint32_t>((i * 37) & 0xFF);
+        inputImage[i] = (v << 16) | ((255 - v) << 8) | (v / 2);
+    }
+
+    FliOptions options;
+    options.flickerWeight = 0.0f;
+    FliResult fli = converter.convertToFli(inputImage, width, height, FliMode::Fli, options);
+    FliResult ifli = converter.convertToFli(inputImage, width, height, FliMode::Ifli, options);
+
+    ASSERT_EQ(ifli.frames.size(), 2);
+    EXPECT_LE(ifli.error, fli.error);
+}
+
+TEST_F(ConverterTest, ConvertToAfliRejectsPartialCells)
+{
+    std::vector<uint32_t> inputImage(12 * 8, 0);
+
+    EXPECT_THROW(converter.convertToFli(inputImage, 12, 8, FliMode::Afli), std::invalid_argument);
+}
@@ -0,0 +1,114 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: tests/EncoderRegistryTests.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include <gtest/gtest.h>
+#include "EncoderRegistry.h"
+#include "AmstradCpcConverter.h"
+#include <vector>
+#include <cstdint>
+#include <set>
+
+class EncoderRegistryTest : public ::testing::Test
+{
+protected:
+    static std::vector<uint32_t> makeImage(int width, int height)
+    {
+        std::vector<uint32_t> image(width * height);
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                image[y * width + x] = (static_cast<uint32_t>(x * 255 / width) << 16) | (static_cast<uint32_t>(y * 255 / height) << 8) | 0x40;
+            }
+        }
+        return image;
+    }
+};
+
+TEST_F(EncoderRegistryTest, ListsBuiltinEncoders)
+{
+    std::set<std::string> names;
+    for (const EncoderCapabilities &caps : EncoderRegistry::instance().list())
+    {
+        names.insert(caps.name);
+    }
+
+    for (const char *expected : {"koala", "c64-hires", "zx-scr", "cpc-mode0", "cpc-mode1", "cpc-mode2", "amiga-ilbm", "atari-pi1"})
+    {
+        EXPECT_TRUE(names.count(expected)) << "Missing encoder " << expected;
+    }
+}
+
+TEST_F(EncoderRegistryTest, UnknownEncoderThrows)
+{
+    EXPECT_THROW(EncoderRegistry::instance().create("does-not-exist"), std::invalid_argument);
+    EXPECT_FALSE(EncoderRegistry::instance().find("does-not-exist").has_value());
+}
+
+TEST_F(EncoderRegistryTest, EveryEncoderProducesOutput)
+{
+    const std::map<std::string, size_t> expectedSizes = {
+        {"koala", 10003}, {"c64-hires", 9009}, {"zx-scr", 6912}, {"cpc-mode0", 16384}, {"cpc-mode1", 16384}, {"cpc-mode2", 16384}, {"atari-pi1", 32034}};
+
+    for (const auto &[name, size] : expectedSizes)
+    {
+        auto caps = EncoderRegistry::instance().find(name);
+        ASSERT_TRUE(caps.has_value());
+
+        auto encoder = EncoderRegistry::instance().create(name);
+        encoder->convertImage(makeImage(caps->width, caps->height), caps->width, caps->height);
+        EXPECT_EQ(encoder->getFileData().size(), size) << name;
+        EXPECT_EQ(encoder->getCapabilities().name, name);
+    }
+}
+
+TEST_F(EncoderRegistryTest, RejectsWrongDimensions)
+{
+    auto encoder = EncoderRegistry::instance().create("zx-scr");
+
+    EXPECT_THROW(encoder->convertImage(makeImage(320, 200), 320, 200), std::runtime_error);
+}
+
+TEST_F(EncoderRegistryTest, ZxSpectrumUsesDisplayFileOrder)
+{
+    auto encoder = EncoderRegistry::instance().create("zx-scr");
+    std::vector<uint32_t> image(256 * 192, 0x000000);
+    // Pixel row 1 of the first cell lives 256 bytes into the display file
+    image[1 * 256] = 0xFFFFFF;
+
+    encoder->convertImage(image, 256, 192);
+    std::vector<uint8_t> data = encoder->getFileData();
+
+    uint8_t attribute = data[6144];
+    bool inkIsWhite = (attribute & 0x07) == 7;
+    EXPECT_EQ(data[256], inkIsWhite ? 0x80 : 0x7F);
+    EXPECT_EQ(data[0], inkIsWhite ? 0x00 : 0xFF);
+}
+
+TEST_F(EncoderRegistryTest, CpcMode1PacksPenBits)
+{
+    AmstradCpcConverter encoder(1);
+    std::vector<uint32_t> image(320 * 200, 0x000000);
+    for (int i = 0; i < 320 * 100; i += 4)
+    {
+        image[i] = 0xFFFFFF;
+    }
+
+    encoder.convertImage(image, 320, 200);
+    std::vector<uint8_t> data = encoder.getFileData();
+    const std::vector<uint8_t> &pens = encoder.getPens();
+
+    auto penAt = [&](int p)
+    {
+        return ((data[0] >> (7 - p)) & 1) | (((data[0] >> (3 - p)) & 1) << 1);
+    };
+
+    ASSERT_GE(pens.size(), 2);
+    EXPECT_NE(penAt(0), penAt(1));
+    EXPECT_EQ(penAt(1), penAt(2));
+    EXPECT_EQ(penAt(1), penAt(3));
+    EXPECT_GT(AmstradCpcConverter::hardwareColor(pens[penAt(0)]), AmstradCpcConverter::hardwareColor(pens[penAt(1)]));
+}
@@ -0,0 +1,260 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: tests/GoldenTests.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include <gtest/gtest.h>
+#include "AutoTuner.h"
+#include "ColorReducer.h"
+#include "Corpus.h"
+#include "Dithering.h"
+#include "EncoderRegistry.h"
+#include "FliEncoder.h"
+#include "Hash.h"
+#include "ImageQuality.h"
+#include "Resampler.h"
+#include <bit>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+// Output digests of every algorithm on the synthetic benchmark corpus, compared against
+// tests/golden/digests.txt. An optimization that changes a digest is not bit-exact with
+// the code it replaces. After an intended output change, run the tests with
+// GFX_UPDATE_GOLDEN=1 to rewrite the file and review its diff like any other change.
+class GoldenTest : public ::testing::Test
+{
+protected:
+    static constexpr int WIDTH = 96;
+    static constexpr int HEIGHT = 72;
+
+    static void TearDownTestSuite()
+    {
+        if (!updating())
+        {
+            return;
+        }
+        std::map<std::string, uint64_t> digests = load();
+        for (const auto &[name, digest] : updated())
+        {
+            digests[name] = digest;
+        }
+        std::ofstream file(GFX_GOLDEN_FILE);
+        file << "# Output digests checked by tests/GoldenTests.cpp, rewrite with GFX_UPDATE_GOLDEN=1\n";
+        for (const auto &[name, digest] : digests)
+        {
+            file << name << " " << std::hex << std::setw(16) << std::setfill('0') << digest << std::dec << "\n";
+        }
+    }
+
+    static bool updating()
+    {
+        const char *value = std::getenv("GFX_UPDATE_GOLDEN");
+        return value != nullptr && *value != '\0' && std::string(value) != "0";
+    }
+
+    static std::map<std::string, uint64_t> &updated()
+    {
+        static std::map<std::string, uint64_t> digests;
+        return digests;
+    }
+
+    static std::map<std::string, uint64_t> load()
+    {
+        std::map<std::string, uint64_t> digests;
+        std::ifstream file(GFX_GOLDEN_FILE);
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (line.empty() || line[0] == '#')
+            {
+                continue;
+            }
+            std::istringstream fields(line);
+            std::string name;
+            uint64_t digest = 0;
+            if (fields >> name >> std::hex >> digest)
+            {
+                digests[name] = digest;
+            }
+        }
+        return digests;
+    }
+
+    static void expectGolden(const std::string &name, uint64_t digest)
+    {
+        if (updating())
+        {
+            updated()[name] = digest;
+            return;
+        }
+        static const std::map<std::string, uint64_t> golden = load();
+        auto it = golden.find(name);
+        if (it == golden.end())
+        {
+            ADD_FAILURE() << "No golden digest for " << name << ", run the tests with GFX_UPDATE_GOLDEN=1";
+            return;
+        }
+        EXPECT_EQ(it->second, digest) << name << " no longer matches its golden output";
+    }
+
+    static uint64_t digest(ConstPixelView image)
+    {
+        uint64_t key = Hash::combine(static_cast<uint64_t>(image.width()), static_cast<uint64_t>(image.height()));
+        for (int y = 0; y < image.height(); ++y)
+        {
+            std::span<const uint32_t> row = image.row(y);
+            key = Hash::combine(key, Hash::xxh64(row.data(), row.size_bytes()));
+        }
+        return key;
+    }
+
+    static uint64_t digest(const std::vector<uint8_t> &data)
+    {
+        return Hash::xxh64(data.data(), data.size());
+    }
+
+    static uint64_t digest(const std::vector<uint32_t> &pixels)
+    {
+        return Hash::xxh64(pixels.data(), pixels.size() * sizeof(uint32_t));
+    }
+
+    static std::string name(CorpusKind kind)
+    {
+        return Corpus::name(kind);
+    }
+};
+
+TEST_F(GoldenTest, ColorReducers)
+{
+    for (CorpusKind kind : Corpus::kinds)
+    {
+        PixelBuffer image = Corpus::generate(kind, WIDTH, HEIGHT);
+        for (ColorReductionAlgorithm reducer : {ColorReductionAlgorithm::MedianCut, ColorReductionAlgorithm::KMeans,
+                                                ColorReductionAlgorithm::OctreeQuantization})
+        {
+            std::vector<uint32_t> reduced = ColorReducer::reduceColors(image, 16, reducer);
+            EXPECT_EQ(ColorReducer::reduceColors(image, 16, reducer), reduced);
+            expectGolden("reduce/" + name(kind) + "/" + ColorReducer::getColorReducerName(reducer), digest(reduced));
+        }
+    }
+}
+
+TEST_F(GoldenTest, KMeansSeed)
+{
+    PixelBuffer image = Corpus::generate(CorpusKind::Photo, WIDTH, HEIGHT);
+    std::vector<uint32_t> first = ColorReducer::reduceColors(image, 16, ColorReductionAlgorithm::KMeans, nullptr, 7);
+    std::vector<uint32_t> second = ColorReducer::reduceColors(image, 16, ColorReductionAlgorithm::KMeans, nullptr, 7);
+
+    EXPECT_EQ(first, second);
+    EXPECT_NE(first, ColorReducer::reduceColors(image, 16, ColorReductionAlgorithm::KMeans));
+    expectGolden("reduce/Photo/KMeans/seed7", digest(first));
+}
+
+TEST_F(GoldenTest, Ditherers)
+{
+    for (CorpusKind kind : Corpus::kinds)
+    {
+        PixelBuffer image = Corpus::generate(kind, WIDTH, HEIGHT);
+        std::vector<uint32_t> palette = ColorReducer::generatePalette(image, ColorReducer::buildHistogram(image), 8,
+                                                                      ColorReductionAlgorithm::MedianCut);
+        expectGolden("remap/" + name(kind), digest(ColorReducer::remap(image, palette)));
+        for (DitheringAlgorithm dithering : {DitheringAlgorithm::FloydSteinberg, DitheringAlgorithm::Bayer, DitheringAlgorithm::Ordered})
+        {
+            expectGolden("dither/" + name(kind) + "/" + Dithering::getAlgorithmName(dithering),
+                         digest(Dithering::applyDithering(image, palette, dithering)));
+        }
+    }
+}
+
+TEST_F(GoldenTest, ResamplerIsIndependentOfThreads)
+{
+    const std::pair<FitMode, std::string> fits[] = {{FitMode::Stretch, "Stretch"}, {FitMode::Fit, "Fit"}, {FitMode::Crop, "Crop"}};
+    const std::pair<ResampleFilter, std::string> filters[] = {{ResampleFilter::Box, "Box"}, {ResampleFilter::Bilinear, "Bilinear"},
+                                                              {ResampleFilter::Mitchell, "Mitchell"}, {ResampleFilter::Lanczos3, "Lanczos3"}};
+    for (CorpusKind kind : {CorpusKind::Photo, CorpusKind::PixelArt})
+    {
+        PixelBuffer image = Corpus::generate(kind, 2 * WIDTH + 1, HEIGHT + 13);
+        for (const auto &[filter, filterName] : filters)
+        {
+            for (const auto &[fit, fitName] : fits)
+            {
+                ResampleOptions options;
+                options.width = WIDTH;
+                options.height = HEIGHT;
+                options.filter = filter;
+                options.fit = fit;
+                options.pixelAspect = 2.0;
+                options.threads = 1;
+                uint64_t serial = digest(Resampler::resample(image, options));
+                options.threads = 4;
+                EXPECT_EQ(digest(Resampler::resample(image, options)), serial);
+                expectGolden("resample/" + name(kind) + "/" + filterName + "/" + fitName, serial);
+            }
+        }
+    }
+}
+
+TEST_F(GoldenTest, Encoders)
+{
+    for (const EncoderCapabilities &caps : EncoderRegistry::instance().list())
+    {
+        int width = caps.width > 0 ? caps.width : WIDTH;
+        int height = caps.height > 0 ? caps.height : HEIGHT;
+        // The gradient covers every hue; photo tones collapse to a single pen on two and four pen modes
+        PixelBuffer image = Corpus::generate(CorpusKind::Gradient, width, height);
+        std::unique_ptr<ImageConverter> encoder = EncoderRegistry::instance().create(caps.name);
+        encoder->convertImage(image);
+        expectGolden("encode/" + caps.name, digest(encoder->getFileData()));
+    }
+}
+
+TEST_F(GoldenTest, FliIsIndependentOfThreads)
+{
+    for (FliMode mode : {FliMode::Fli, FliMode::Afli, FliMode::Ifli})
+    {
+        int width = mode == FliMode::Afli ? 64 : 32;
+        PixelBuffer image = Corpus::generate(CorpusKind::Photo, width, 16);
+        FliOptions options;
+        options.threads = 1;
+        FliResult serial = FliEncoder::encode(image.view().toVector(), width, 16, mode, options);
+        options.threads = 4;
+        FliResult parallel = FliEncoder::encode(image.view().toVector(), width, 16, mode, options);
+
+        std::vector<uint32_t> rendered = FliEncoder::render(serial);
+        EXPECT_EQ(FliEncoder::render(parallel), rendered);
+        EXPECT_EQ(parallel.error, serial.error);
+        expectGolden("fli/" + FliEncoder::getModeName(mode), Hash::combine(digest(rendered), serial.error));
+    }
+}
+
+TEST_F(GoldenTest, AutoTuneAndQualityAreIndependentOfThreads)
+{
+    // Scores go through libm, so only the thread independence is checked here, not a digest
+    PixelBuffer image = Corpus::generate(CorpusKind::Photo, WIDTH, HEIGHT);
+    TuneOptions options;
+    options.budget = std::chrono::milliseconds(0);
+    options.proxyPixels = 32 * 24;
+    options.threads = 1;
+    TuneResult serial = AutoTuner::tune(image, options);
+    options.threads = 4;
+    TuneResult parallel = AutoTuner::tune(image, options);
+
+    EXPECT_EQ(AutoTuner::describe(parallel.best), AutoTuner::describe(serial.best));
+    EXPECT_EQ(std::bit_cast<uint64_t>(parallel.score), std::bit_cast<uint64_t>(serial.score));
+
+    PixelBuffer result = AutoTuner::apply(image, serial.best);
+    QualityOptions quality;
+    quality.threads = 1;
+    QualityReport first = ImageQuality::compare(image, result, quality);
+    quality.threads = 4;
+    QualityReport second = ImageQuality::compare(image, result, quality);
+    EXPECT_EQ(std::bit_cast<uint64_t>(second.mse), std::bit_cast<uint64_t>(first.mse));
+    EXPECT_EQ(std::bit_cast<uint64_t>(second.ssim), std::bit_cast<uint64_t>(first.ssim));
+    EXPECT_EQ(std::bit_cast<uint64_t>(second.msSsim), std::bit_cast<uint64_t>(first.msSsim));
+    EXPECT_EQ(std::bit_cast<uint64_t>(second.meanDeltaE), std::bit_cast<uint64_t>(first.meanDeltaE));
+    EXPECT_EQ(std::bit_cast<uint64_t>(second.p95DeltaE), std::bit_cast<uint64_t>(first.p95DeltaE));
+}
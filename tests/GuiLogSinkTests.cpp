@@ -0,0 +1,120 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: tests/GuiLogSinkTests.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include <gtest/gtest.h>
+#include "GuiLogSink.h"
+#include <spdlog/logger.h>
+#include <atomic>
+#include <set>
+#include <thread>
+
+class GuiLogSinkTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        sink = std::make_shared<GuiLogSink>();
+        logger = std::make_shared<spdlog::logger>("gui_sink_test", sink);
+        logger->set_level(spdlog::level::trace);
+    }
+
+    std::shared_ptr<GuiLogSink> sink;
+    std::shared_ptr<spdlog::logger> logger;
+};
+
+TEST_F(GuiLogSinkTest, ReadsNewMessagesFromCursor)
+{
+    logger->info("first {}", 1);
+    logger->warn("second");
+
+    uint64_t cursor = 0;
+    std::vector<LogMessage> messages;
+    EXPECT_EQ(sink->readSince(cursor, messages), 0u);
+    ASSERT_EQ(messages.size(), 2u);
+    EXPECT_EQ(cursor, 2u);
+    EXPECT_EQ(messages[0].level, spdlog::level::info);
+    EXPECT_NE(messages[0].message.find("[info] first 1"), std::string::npos);
+    EXPECT_EQ(messages[1].level, spdlog::level::warn);
+
+    logger->error("third");
+    messages.clear();
+    sink->readSince(cursor, messages);
+    ASSERT_EQ(messages.size(), 1u);
+    EXPECT_NE(messages[0].message.find("third"), std::string::npos);
+}
+
+TEST_F(GuiLogSinkTest, KeepsTheNewestCapacityMessages)
+{
+    const size_t total = GuiLogSink::CAPACITY + 100;
+    for (size_t i = 0; i < total; ++i)
+    {
+        logger->info("message {}", i);
+    }
+    logger->info(std::string(GuiLogSink::MESSAGE_BYTES * 2, 'x'));
+
+    uint64_t cursor = 0;
+    std::vector<LogMessage> messages;
+    EXPECT_EQ(sink->readSince(cursor, messages), 101u);
+    ASSERT_EQ(messages.size(), GuiLogSink::CAPACITY);
+    EXPECT_NE(messages.front().message.find("message 101"), std::string::npos);
+    // Long lines are cut at the slot size
+    EXPECT_EQ(messages.back().message.size(), GuiLogSink::MESSAGE_BYTES);
+    EXPECT_EQ(sink->snapshot().size(), GuiLogSink::CAPACITY);
+    EXPECT_EQ(sink->published(), total + 1);
+}
+
+TEST_F(GuiLogSinkTest, ConcurrentWritersAndReader)
+{
+    const int writers = 4;
+    const int perWriter = 5000;
+    std::atomic<bool> done{false};
+    size_t read = 0;
+    size_t lost = 0;
+    std::thread reader([&]()
+                       {
+        uint64_t cursor = 0;
+        std::vector<LogMessage> messages;
+        while (!done)
+        {
+            messages.clear();
+            lost += sink->readSince(cursor, messages);
+            for (const LogMessage &message : messages)
+            {
+                // A torn copy would mix two lines
+                ASSERT_EQ(message.message.find("writer"), message.message.rfind("writer"));
+            }
+            read += messages.size();
+        }
+        messages.clear();
+        lost += sink->readSince(cursor, messages);
+        read += messages.size(); });
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < writers; ++t)
+    {
+        threads.emplace_back([&, t]()
+                             {
+            for (int i = 0; i < perWriter; ++i)
+            {
+                logger->info("writer {} message {}", t, i);
+            } });
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    done = true;
+    reader.join();
+
+    // Every message is either read or reported lost
+    EXPECT_EQ(read + lost, static_cast<size_t>(writers * perWriter));
+    std::set<std::string> last;
+    for (const LogMessage &message : sink->snapshot())
+    {
+        last.insert(message.message.substr(message.message.find("writer")));
+    }
+    EXPECT_EQ(last.size(), GuiLogSink::CAPACITY);
+}
@@ -0,0 +1,214 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: tests/ImageQualityTests.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include <gtest/gtest.h>
+#include "ImageQuality.h"
+#include "BatchConverter.h"
+#include "Corpus.h"
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+
+class ImageQualityTest : public ::testing::Test
+{
+protected:
+    // Deterministic per-pixel noise of up to +-amplitude on every channel
+    static PixelBuffer addNoise(const PixelBuffer &image, int amplitude)
+    {
+        PixelBuffer noisy(image.width(), image.height());
+        uint32_t state = 12345;
+        for (int y = 0; y < image.height(); ++y)
+        {
+            for (int x = 0; x < image.width(); ++x)
+            {
+                uint32_t pixel = 0;
+                for (int shift : {0, 8, 16})
+                {
+                    state = state * 1664525u + 1013904223u;
+                    int offset = static_cast<int>(state >> 16) % (2 * amplitude + 1) - amplitude;
+                    int channel = std::clamp(static_cast<int>((image(x, y) >> shift) & 0xFF) + offset, 0, 255);
+                    pixel |= static_cast<uint32_t>(channel) << shift;
+                }
+                noisy(x, y) = pixel;
+            }
+        }
+        return noisy;
+    }
+};
+
+TEST_F(ImageQualityTest, IdenticalImagesArePerfect)
+{
+    PixelBuffer image = Corpus::generate(CorpusKind::Gradient, 64, 48);
+    QualityReport report = ImageQuality::compare(image, image);
+
+    EXPECT_EQ(report.mse, 0.0);
+    EXPECT_TRUE(std::isinf(report.psnr));
+    EXPECT_NEAR(report.ssim, 1.0, 1e-9);
+    EXPECT_NEAR(report.msSsim, 1.0, 1e-9);
+    EXPECT_EQ(report.meanDeltaE, 0.0);
+    EXPECT_EQ(report.maxDeltaE, 0.0);
+}
+
+TEST_F(ImageQualityTest, MseAndPsnrOfAConstantOffset)
+{
+    // Odd width covers the scalar tail after the SSE2 loop; the unused top byte is ignored
+    PixelBuffer a(37, 5);
+    PixelBuffer b(37, 5);
+    for (int y = 0; y < 5; ++y)
+    {
+        for (int x = 0; x < 37; ++x)
+        {
+            a(x, y) = 0xFF204060;
+            b(x, y) = 0x002A4A6A;
+        }
+    }
+    EXPECT_DOUBLE_EQ(ImageQuality::mse(a, b), 100.0);
+    EXPECT_NEAR(ImageQuality::psnr(100.0), 28.1308, 1e-4);
+}
+
+TEST_F(ImageQualityTest, Ciede2000MatchesReferenceData)
+{
+    // Pairs from Sharma, Wu and Dalal's test data
+    struct Pair
+    {
+        LabColor first;
+        LabColor second;
+        double expected;
+    };
+    const Pair pairs[] = {
+        {{50.0, 2.6772, -79.7751}, {50.0, 0.0, -82.7485}, 2.0425},
+        {{50.0, -1.0, 2.0}, {50.0, 0.0, 0.0}, 2.3669},
+        {{50.0, 2.5, 0.0}, {73.0, 25.0, -18.0}, 27.1492},
+        {{50.0, 2.5, 0.0}, {56.0, -27.0, -3.0}, 31.9030},
+        {{60.2574, -34.0099, 36.2677}, {60.4626, -34.1751, 39.4387}, 1.2644},
+        {{22.7233, 20.0904, -46.6940}, {23.0331, 14.9730, -42.5619}, 2.0373},
+    };
+    for (const Pair &pair : pairs)
+    {
+        EXPECT_NEAR(ImageQuality::ciede2000(pair.first, pair.second), pair.expected, 1e-4);
+        EXPECT_NEAR(ImageQuality::ciede2000(pair.second, pair.first), pair.expected, 1e-4);
+    }
+
+    LabColor white = ImageQuality::toLab(0xFFFFFF);
+    EXPECT_NEAR(white.l, 100.0, 1e-3);
+    EXPECT_NEAR(white.a, 0.0, 1e-3);
+    EXPECT_NEAR(white.b, 0.0, 1e-3);
+    EXPECT_NEAR(ImageQuality::toLab(0x000000).l, 0.0, 1e-9);
+}
+
+TEST_F(ImageQualityTest, MoreNoiseScoresWorse)
+{
+    PixelBuffer image = Corpus::generate(CorpusKind::Gradient, 128, 96);
+    QualityReport light = ImageQuality::compare(image, addNoise(image, 4));
+    QualityReport heavy = ImageQuality::compare(image, addNoise(image, 40));
+
+    EXPECT_GT(light.psnr, heavy.psnr);
+    EXPECT_GT(light.ssim, heavy.ssim);
+    EXPECT_GT(light.msSsim, heavy.msSsim);
+    EXPECT_LT(light.meanDeltaE, heavy.meanDeltaE);
+    EXPECT_LE(heavy.p95DeltaE, heavy.maxDeltaE);
+    EXPECT_LT(heavy.ssim, 1.0);
+    EXPECT_GT(heavy.ssim, 0.0);
+}
+
+TEST_F(ImageQualityTest, SsimMatchesDirectWindowSums)
+{
+    PixelBuffer image = Corpus::generate(CorpusKind::Gradient, 70, 45);
+    PixelBuffer noisy = addNoise(image, 20);
+    auto luma = [](uint32_t p)
+    { return static_cast<double>((77 * ((p >> 16) & 0xFF) + 150 * ((p >> 8) & 0xFF) + 29 * (p & 0xFF) + 128) >> 8); };
+
+    // Every 8x8 window at a multiple of 4, summed pixel by pixel
+    const double c1 = (0.01 * 255) * (0.01 * 255);
+    const double c2 = (0.03 * 255) * (0.03 * 255);
+    double total = 0.0;
+    int windows = 0;
+    for (int wy = 0; wy + 8 <= image.height() / 4 * 4; wy += 4)
+    {
+        for (int wx = 0; wx + 8 <= image.width() / 4 * 4; wx += 4)
+        {
+            double a = 0, b = 0, aa = 0, bb = 0, ab = 0;
+            for (int y = wy; y < wy + 8; ++y)
+            {
+                for (int x = wx; x < wx + 8; ++x)
+                {
+                    double la = luma(image(x, y));
+                    double lb = luma(noisy(x, y));
+                    a += la;
+                    b += lb;
+                    aa += la * la;
+                    bb += lb * lb;
+                    ab += la * lb;
+                }
+            }
+            double meanA = a / 64, meanB = b / 64;
+            double varianceA = aa / 64 - meanA * meanA;
+            double varianceB = bb / 64 - meanB * meanB;
+            double covariance = ab / 64 - meanA * meanB;
+            total += (2 * meanA * meanB + c1) / (meanA * meanA + meanB * meanB + c1) * (2 * covariance + c2) / (varianceA + varianceB + c2);
+            ++windows;
+        }
+    }
+    EXPECT_NEAR(ImageQuality::ssim(image, noisy), total / windows, 1e-12);
+}
+
+TEST_F(ImageQualityTest, ThreadCountDoesNotChangeResults)
+{
+    PixelBuffer image = Corpus::generate(CorpusKind::Gradient, 333, 257);
+    PixelBuffer noisy = addNoise(image, 12);
+    QualityOptions single;
+    single.threads = 1;
+    QualityOptions many;
+    many.threads = 8;
+
+    QualityReport a = ImageQuality::compare(image, noisy, single);
+    QualityReport b = ImageQuality::compare(image, noisy, many);
+    EXPECT_EQ(a.mse, b.mse);
+    EXPECT_EQ(a.ssim, b.ssim);
+    EXPECT_EQ(a.msSsim, b.msSsim);
+    EXPECT_EQ(a.p95DeltaE, b.p95DeltaE);
+    EXPECT_THROW(ImageQuality::compare(image, PixelBuffer(10, 10)), std::invalid_argument);
+}
+
+TEST_F(ImageQualityTest, BatchReportsAndEnforcesMinimums)
+{
+    std::filesystem::path root = std::filesystem::path(::testing::TempDir()) / "image_quality_test";
+    std::filesystem::remove_all(root);
+    std::filesystem::create_directories(root);
+    std::vector<BatchJob> jobs;
+    for (int i = 0; i < 3; ++i)
+    {
+        std::filesystem::path input = root / ("image" + std::to_string(i) + ".png");
+        std::ofstream(input) << i;
+        jobs.push_back({input, root / "out" / ("image" + std::to_string(i) + ".scr")});
+    }
+    auto loader = [](const std::filesystem::path &, std::span<const uint8_t>)
+    {
+        return Corpus::generate(CorpusKind::Gradient, 256, 192);
+    };
+
+    BatchOptions options;
+    options.encoder = "zx-scr";
+    options.targetColors = 4;
+    options.measureQuality = true;
+    BatchConverter measured(options);
+    measured.setLoader(loader);
+    BatchReport report = measured.run(jobs);
+    EXPECT_EQ(report.converted, 3u);
+    ASSERT_EQ(report.quality.size(), 3u);
+    EXPECT_GT(report.quality[0].second.psnr, 10.0);
+
+    // Four colors cannot reach 60 dB
+    options.minPsnr = 60.0;
+    std::filesystem::remove_all(root / "out");
+    BatchConverter gated(options);
+    gated.setLoader(loader);
+    report = gated.run(jobs);
+    EXPECT_EQ(report.converted, 0u);
+    EXPECT_EQ(report.failed, 3u);
+    EXPECT_FALSE(std::filesystem::exists(jobs[0].output));
+    std::filesystem::remove_all(root);
+}
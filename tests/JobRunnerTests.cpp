@@ -0,0 +1,113 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: tests/JobRunnerTests.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include <gtest/gtest.h>
+#include "JobRunner.h"
+#include "ColorReducer.h"
+#include "Corpus.h"
+#include "Dithering.h"
+#include <atomic>
+#include <thread>
+
+class JobRunnerTest : public ::testing::Test
+{
+};
+
+TEST_F(JobRunnerTest, CancelledTokenStopsReductionAndDithering)
+{
+    std::vector<uint32_t> image = Corpus::generate(CorpusKind::Noise, 64, 64).view().toVector();
+    ProgressToken token;
+    token.cancel();
+
+    EXPECT_THROW(ColorReducer::reduceColors(image, 64, 64, 8, ColorReductionAlgorithm::MedianCut, &token), OperationCancelled);
+    EXPECT_THROW(ColorReducer::reduceColors(image, 64, 64, 8, ColorReductionAlgorithm::KMeans, &token), OperationCancelled);
+    EXPECT_THROW(Dithering::applyDithering(image, 64, 64, {0x000000, 0xFFFFFF}, DitheringAlgorithm::Bayer, &token), OperationCancelled);
+}
+
+TEST_F(JobRunnerTest, ProgressReachesEndWithoutCancellation)
+{
+    std::vector<uint32_t> image = Corpus::generate(CorpusKind::Noise, 64, 64).view().toVector();
+    ProgressToken token;
+
+    Dithering::applyDithering(image, 64, 64, {0x000000, 0xFFFFFF}, DitheringAlgorithm::FloydSteinberg, &token);
+
+    EXPECT_GT(token.getProgress(), 0.8f);
+    EXPECT_FALSE(token.isCancelled());
+}
+
+TEST_F(JobRunnerTest, TimeoutIsReportedAsTimeout)
+{
+    ProgressToken token;
+    token.setTimeout(std::chrono::milliseconds(1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+    try
+    {
+        token.checkpoint();
+        FAIL() << "checkpoint did not throw";
+    }
+    catch (const OperationCancelled &e)
+    {
+        EXPECT_TRUE(e.isTimeout());
+    }
+}
+
+TEST_F(JobRunnerTest, NewerJobCancelsStaleOne)
+{
+    JobRunner runner;
+    std::atomic<bool> started{false};
+    std::atomic<bool> staleCancelled{false};
+    int result = 0;
+
+    runner.submit("stale", [&](ProgressToken &progress) -> JobRunner::Completion
+                  {
+        started = true;
+        while (true)
+        {
+            try
+            {
+                progress.checkpoint();
+            }
+            catch (const OperationCancelled &)
+            {
+                staleCancelled = true;
+                throw;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        } });
+    while (!started)
+    {
+        std::this_thread::yield();
+    }
+
+    runner.submit("fresh", [](ProgressToken &progress) -> JobRunner::Completion
+                  {
+        progress.report(1.0f);
+        return [] {}; });
+    runner.submit("newest", [&](ProgressToken &) -> JobRunner::Completion
+                  { return [&result]
+                    { result = 42; }; });
+    runner.waitIdle();
+
+    EXPECT_TRUE(staleCancelled);
+    EXPECT_EQ(runner.dispatchCompletions(), 1);
+    EXPECT_EQ(result, 42);
+
+    JobStatus status = runner.getStatus();
+    EXPECT_FALSE(status.busy);
+    EXPECT_EQ(status.lastLabel, "newest");
+}
+
+TEST_F(JobRunnerTest, FailedJobReportsError)
+{
+    JobRunner runner;
+    runner.submit("broken", [](ProgressToken &) -> JobRunner::Completion
+                  { throw std::runtime_error("boom"); });
+    runner.waitIdle();
+
+    EXPECT_EQ(runner.dispatchCompletions(), 0);
+    EXPECT_EQ(runner.getStatus().lastError, "boom");
+}
@@ -0,0 +1,85 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: tests/LoggerTests.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include <gtest/gtest.h>
+#include "Logger.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+class LoggerTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        root = std::filesystem::path(::testing::TempDir()) / "logger_test";
+        std::filesystem::remove_all(root);
+        std::filesystem::create_directories(root);
+    }
+
+    void TearDown() override
+    {
+        Logger::shutdown();
+        std::filesystem::remove_all(root);
+    }
+
+    std::string readLog() const
+    {
+        std::ifstream file(root / "test.log");
+        std::stringstream text;
+        text << file.rdbuf();
+        return text.str();
+    }
+
+    std::filesystem::path root;
+};
+
+TEST_F(LoggerTest, AsyncLoggerDrainsOnShutdown)
+{
+    LoggerOptions options;
+    options.filename = (root / "test.log").string();
+    // A tiny blocking queue loses nothing even when the writer falls behind
+    options.queueSize = 16;
+    options.overflow = spdlog::async_overflow_policy::block;
+    Logger::initialize(options);
+    for (int i = 0; i < 500; ++i)
+    {
+        spdlog::info("message {}", i);
+    }
+    spdlog::debug("debug line");
+    Logger::shutdown();
+
+    std::string text = readLog();
+    EXPECT_NE(text.find("message 0\n"), std::string::npos);
+    EXPECT_NE(text.find("message 499\n"), std::string::npos);
+    EXPECT_NE(text.find("debug line"), std::string::npos);
+    EXPECT_EQ(Logger::getGuiSink()->published(), 501u);
+    // The console logger takes over after shutdown
+    ASSERT_NE(spdlog::default_logger(), nullptr);
+}
+
+TEST_F(LoggerTest, SynchronousLoggerHonoursLevels)
+{
+    LoggerOptions options;
+    options.filename = (root / "test.log").string();
+    options.async = false;
+    options.level = spdlog::level::info;
+    Logger::initialize(options);
+    spdlog::debug("filtered at runtime");
+    spdlog::warn("flushed immediately");
+
+    EXPECT_NE(readLog().find("flushed immediately"), std::string::npos);
+    EXPECT_EQ(readLog().find("filtered at runtime"), std::string::npos);
+
+    // Arguments of macros below the compile-time level are not even evaluated
+    int evaluated = 0;
+    SPDLOG_TRACE("trace {}", ++evaluated);
+#if SPDLOG_ACTIVE_LEVEL > SPDLOG_LEVEL_TRACE
+    EXPECT_EQ(evaluated, 0);
+#else
+    EXPECT_EQ(evaluated, 1);
+#endif
+}
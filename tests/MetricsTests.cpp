@@ -0,0 +1,126 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: tests/MetricsTests.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include <gtest/gtest.h>
+#include "Metrics.h"
+#include "ColorReducer.h"
+#include <memory>
+#include <optional>
+#include <thread>
+
+class MetricsTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        MetricsRegistry::instance().reset();
+    }
+
+    void TearDown() override
+    {
+        MetricsRegistry::instance().reset();
+    }
+
+    static std::optional<StageSummary> find(const std::string &stage)
+    {
+        for (const StageSummary &summary : MetricsRegistry::instance().summary())
+        {
+            if (summary.stage == stage)
+            {
+                return summary;
+            }
+        }
+        return std::nullopt;
+    }
+};
+
+TEST_F(MetricsTest, PercentilesOverRecentCalls)
+{
+    for (int i = 1; i <= 100; ++i)
+    {
+        StageSample sample;
+        sample.milliseconds = i;
+        sample.allocatedBytes = 10;
+        sample.peakBytes = static_cast<uint64_t>(i);
+        MetricsRegistry::instance().record("test", sample);
+    }
+
+    std::optional<StageSummary> summary = find("test");
+    ASSERT_TRUE(summary);
+    EXPECT_EQ(summary->calls, 100u);
+    EXPECT_DOUBLE_EQ(summary->totalMilliseconds, 5050.0);
+    EXPECT_DOUBLE_EQ(summary->lastMilliseconds, 100.0);
+    EXPECT_DOUBLE_EQ(summary->p50, 50.0);
+    EXPECT_DOUBLE_EQ(summary->p90, 90.0);
+    EXPECT_DOUBLE_EQ(summary->p99, 99.0);
+    EXPECT_EQ(summary->allocatedBytes, 1000u);
+    EXPECT_EQ(summary->peakBytes, 100u);
+
+    // Only the last WINDOW calls count towards the percentiles
+    for (size_t i = 0; i < MetricsRegistry::WINDOW; ++i)
+    {
+        MetricsRegistry::instance().record("test", StageSample{1000.0, 0, 0, 0});
+    }
+    EXPECT_DOUBLE_EQ(find("test")->p50, 1000.0);
+}
+
+TEST_F(MetricsTest, StageTimerCountsAllocations)
+{
+    {
+        StageTimer outer("outer");
+        auto kept = std::make_unique<std::vector<char>>(1 << 20);
+        {
+            StageTimer inner("inner");
+            std::vector<char> temporary(4 << 20);
+        }
+    }
+
+    std::optional<StageSummary> inner = find("inner");
+    std::optional<StageSummary> outer = find("outer");
+    ASSERT_TRUE(inner && outer);
+    EXPECT_EQ(inner->calls, 1u);
+    if (!AllocationCounters::enabled())
+    {
+        GTEST_SKIP() << "built without allocation counting";
+    }
+    EXPECT_GE(inner->allocatedBytes, 4u << 20);
+    EXPECT_GE(inner->allocations, 1u);
+    EXPECT_GE(inner->peakBytes, 4u << 20);
+    EXPECT_LT(inner->peakBytes, 5u << 20);
+    // The outer stage sees the inner peak on top of its own live megabyte
+    EXPECT_GE(outer->allocatedBytes, 5u << 20);
+    EXPECT_GE(outer->peakBytes, 5u << 20);
+}
+
+TEST_F(MetricsTest, PipelineStagesReportAndJsonLists)
+{
+    PixelBuffer image(32, 32);
+    for (int y = 0; y < 32; ++y)
+    {
+        for (int x = 0; x < 32; ++x)
+        {
+            image(x, y) = static_cast<uint32_t>(x * 8 << 16 | y * 8);
+        }
+    }
+    std::vector<uint32_t> palette = ColorReducer::generatePalette(image, ColorReducer::buildHistogram(image), 4,
+                                                                  ColorReductionAlgorithm::MedianCut);
+    ColorReducer::remap(image, palette);
+
+    for (const char *stage : {"histogram", "palette", "remap"})
+    {
+        ASSERT_TRUE(find(stage)) << stage;
+        EXPECT_EQ(find(stage)->calls, 1u) << stage;
+    }
+    std::string json = MetricsRegistry::instance().toJson();
+    EXPECT_NE(json.find("\"stage\": \"remap\""), std::string::npos);
+    EXPECT_NE(json.find("\"p99Ms\""), std::string::npos);
+
+    // Threads record into the same registry
+    std::thread worker([&]()
+                       { ColorReducer::remap(image, palette); });
+    worker.join();
+    EXPECT_EQ(find("remap")->calls, 2u);
+}
@@ -0,0 +1,153 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: tests/PaletteBuilderTests.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include <gtest/gtest.h>
+#include "BatchConverter.h"
+#include "Corpus.h"
+#include "NearestColorMap.h"
+#include "PaletteBuilder.h"
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+
+class PaletteBuilderTest : public ::testing::Test
+{
+protected:
+    static std::vector<PixelBuffer> makeSet()
+    {
+        std::vector<PixelBuffer> images;
+        for (CorpusKind kind : Corpus::kinds)
+        {
+            images.push_back(Corpus::generate(kind, 48, 32));
+        }
+        return images;
+    }
+};
+
+TEST_F(PaletteBuilderTest, MergedHistogramCountsEveryPixelOnce)
+{
+    ColorHistogram first{{0x000000, 0x102030, 0xFFFFFF}, {2, 3, 1}};
+    ColorHistogram second{{0x102030, 0x405060}, {4, 5}};
+    ColorHistogram merged = PaletteBuilder::merge(first, second);
+    EXPECT_EQ(merged.colors, (std::vector<uint32_t>{0x000000, 0x102030, 0x405060, 0xFFFFFF}));
+    EXPECT_EQ(merged.counts, (std::vector<uint64_t>{2, 7, 5, 1}));
+
+    // A background shared by many large tiles passes 2^32 pixels
+    ColorHistogram tiles{{0x000000}, {uint64_t(3) << 31}};
+    EXPECT_EQ(PaletteBuilder::merge(tiles, tiles).counts, (std::vector<uint64_t>{uint64_t(3) << 32}));
+
+    std::vector<PixelBuffer> images = makeSet();
+    auto load = [&](size_t index)
+    { return images[index]; };
+    ColorHistogram serial = PaletteBuilder::histogram(images.size(), load, 1);
+    ColorHistogram parallel = PaletteBuilder::histogram(images.size(), load, 3);
+    EXPECT_EQ(parallel.colors, serial.colors);
+    EXPECT_EQ(parallel.counts, serial.counts);
+    uint64_t total = 0;
+    for (uint64_t count : serial.counts)
+    {
+        total += count;
+    }
+    EXPECT_EQ(total, images.size() * 48 * 32);
+    EXPECT_TRUE(PaletteBuilder::histogram(0, load).colors.empty());
+}
+
+TEST_F(PaletteBuilderTest, BuildsPaletteWithEveryReducer)
+{
+    std::vector<PixelBuffer> images = makeSet();
+    ColorHistogram histogram = PaletteBuilder::histogram(images.size(), [&](size_t index)
+                                                         { return images[index]; });
+    for (ColorReductionAlgorithm algo : {ColorReductionAlgorithm::MedianCut, ColorReductionAlgorithm::KMeans,
+                                         ColorReductionAlgorithm::OctreeQuantization})
+    {
+        std::vector<uint32_t> palette = PaletteBuilder::build(histogram, 16, algo);
+        EXPECT_FALSE(palette.empty());
+        EXPECT_LE(palette.size(), 16u);
+        EXPECT_EQ(PaletteBuilder::build(histogram, 16, algo), palette);
+    }
+    EXPECT_THROW(PaletteBuilder::build(ColorHistogram{}, 16, ColorReductionAlgorithm::MedianCut), std::invalid_argument);
+}
+
+TEST_F(PaletteBuilderTest, ManyDistinctColorsAreMergedBeforeReduction)
+{
+    // More distinct colors than MAX_SAMPLES, as in a large photographic tileset
+    ColorHistogram histogram;
+    const uint32_t distinct = 9'000'000;
+    histogram.colors.resize(distinct);
+    std::iota(histogram.colors.begin(), histogram.colors.end(), 0u);
+    histogram.counts.assign(distinct, 1);
+    histogram.counts.back() = uint64_t(1) << 33;
+
+    EXPECT_LE(PaletteBuilder::samples(histogram).size(), PaletteBuilder::MAX_SAMPLES);
+    // Small histograms are repeated exactly by their counts
+    EXPECT_EQ(PaletteBuilder::samples(ColorHistogram{{0x000000, 0xFFFFFF}, {2, 3}}),
+              (std::vector<uint32_t>{0x000000, 0x000000, 0xFFFFFF, 0xFFFFFF, 0xFFFFFF}));
+    std::vector<uint32_t> palette = PaletteBuilder::build(histogram, 8, ColorReductionAlgorithm::MedianCut);
+    ASSERT_GE(palette.size(), 2u);
+    EXPECT_LE(palette.size(), 8u);
+    for (uint32_t color : palette)
+    {
+        EXPECT_LE(color, histogram.colors.back());
+    }
+    // The dominant color keeps its weight through the merge and the scaling
+    EXPECT_NE(std::find(palette.begin(), palette.end(), histogram.colors.back()), palette.end());
+}
+
+TEST_F(PaletteBuilderTest, NearestColorMapMatchesLinearSearch)
+{
+    std::mt19937 gen(11);
+    for (size_t size : {1u, 2u, 16u, 256u})
+    {
+        std::vector<uint32_t> palette(size);
+        for (uint32_t &color : palette)
+        {
+            color = gen() & 0xFFFFFF;
+        }
+        // Duplicates make the lower index win, as in the linear search
+        palette.push_back(palette.front());
+        NearestColorMap map(palette);
+        EXPECT_LE(map.averageCandidates(), static_cast<double>(palette.size()));
+        for (const PixelBuffer &image : makeSet())
+        {
+            EXPECT_EQ(map.remap(image), ColorReducer::remap(image, palette)) << size;
+        }
+    }
+    EXPECT_THROW(NearestColorMap({}), std::invalid_argument);
+}
+
+TEST_F(PaletteBuilderTest, BatchUsesSharedPalette)
+{
+    std::vector<PixelBuffer> images = makeSet();
+    ColorHistogram histogram = PaletteBuilder::histogram(images.size(), [&](size_t index)
+                                                         { return images[index]; });
+    BatchOptions options;
+    options.palette = PaletteBuilder::build(histogram, 8, ColorReductionAlgorithm::MedianCut);
+    NearestColorMap map(options.palette);
+    for (const PixelBuffer &image : images)
+    {
+        PixelBuffer result = BatchConverter::process(image, options, nullptr, &map);
+        EXPECT_EQ(result, BatchConverter::process(image, options));
+        for (uint32_t pixel : result.toVector())
+        {
+            EXPECT_NE(std::find(options.palette.begin(), options.palette.end(), pixel), options.palette.end());
+        }
+    }
+
+    // Dithering looks the nearest colors up in the same map, with the same result
+    for (DitheringAlgorithm algo : {DitheringAlgorithm::FloydSteinberg, DitheringAlgorithm::Bayer, DitheringAlgorithm::Ordered})
+    {
+        options.dither = true;
+        options.dithering = algo;
+        EXPECT_EQ(BatchConverter::process(images[1], options, nullptr, &map), BatchConverter::process(images[1], options));
+    }
+    options.dither = false;
+
+    std::span<const uint8_t> source;
+    uint64_t key = BatchConverter::cacheKey(source, options);
+    options.palette.back() ^= 1;
+    EXPECT_NE(BatchConverter::cacheKey(source, options), key);
+}
@@ -0,0 +1,133 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: tests/PaletteEditorTests.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include <gtest/gtest.h>
+#include "ColorReducer.h"
+#include "Corpus.h"
+#include "NearestColorMap.h"
+#include "PaletteEditor.h"
+#include <random>
+#include <stdexcept>
+
+class PaletteEditorTest : public ::testing::Test
+{
+protected:
+    static std::vector<uint32_t> makePalette(ConstPixelView image, int colors)
+    {
+        return ColorReducer::generatePalette(image, ColorReducer::buildHistogram(image), colors, ColorReductionAlgorithm::MedianCut);
+    }
+
+    // The editor must always agree with a full remap of its source to its palette
+    static void expectFullRemap(const PaletteEditor &editor, ConstPixelView source)
+    {
+        NearestColorMap map(editor.palette());
+        ASSERT_EQ(editor.result(), map.remap(source));
+        std::vector<size_t> usage(editor.palette().size(), 0);
+        for (int y = 0; y < source.height(); ++y)
+        {
+            for (int x = 0; x < source.width(); ++x)
+            {
+                size_t index = editor.indices()[static_cast<size_t>(y) * source.width() + x];
+                ASSERT_EQ(index, map.index(source(x, y)));
+                ++usage[index];
+            }
+        }
+        for (size_t i = 0; i < usage.size(); ++i)
+        {
+            EXPECT_EQ(editor.usage(i), usage[i]) << i;
+        }
+    }
+};
+
+TEST_F(PaletteEditorTest, EditsMatchFullRemap)
+{
+    for (CorpusKind kind : Corpus::kinds)
+    {
+        // Not a multiple of the tile size, so the edge tiles are partial
+        PixelBuffer source = Corpus::generate(kind, 100, 70);
+        std::vector<uint32_t> palette = makePalette(source, 12);
+        PaletteEditor serial(source, palette, 1);
+        PaletteEditor parallel(source, palette, 4);
+        expectFullRemap(serial, source);
+
+        std::mt19937 gen(5);
+        for (int edit = 0; edit < 20; ++edit)
+        {
+            size_t entry = gen() % palette.size();
+            if (edit % 2 == 0)
+            {
+                uint32_t color = gen() & 0xFFFFFF;
+                EXPECT_EQ(serial.replace(entry, color), parallel.replace(entry, color));
+            }
+            else
+            {
+                int red = static_cast<int>(gen() % 33) - 16;
+                EXPECT_EQ(serial.nudge(entry, red, -red / 2, 8), parallel.nudge(entry, red, -red / 2, 8));
+            }
+            expectFullRemap(serial, source);
+            EXPECT_EQ(parallel.result(), serial.result());
+        }
+    }
+}
+
+TEST_F(PaletteEditorTest, DirtyRowsCoverEveryChange)
+{
+    PixelBuffer source = Corpus::generate(CorpusKind::Photo, 64, 96);
+    PaletteEditor editor(source, makePalette(source, 8));
+    DirtyRows initial = editor.takeDirtyRows();
+    EXPECT_EQ(initial.begin, 0);
+    EXPECT_EQ(initial.end, 96);
+    EXPECT_TRUE(editor.takeDirtyRows().empty());
+
+    // Recolor every used entry in turn; each row whose output changed must lie inside the reported dirty range
+    std::vector<uint32_t> palette = editor.palette();
+    for (size_t i = 1; i < palette.size(); ++i)
+    {
+        if (editor.usage(i) == 0)
+        {
+            continue;
+        }
+        PixelBuffer before = editor.result();
+        size_t changed = editor.replace(i, palette[i] ^ 0x200000);
+        DirtyRows dirty = editor.takeDirtyRows();
+        EXPECT_GT(changed, 0u);
+        for (int y = 0; y < source.height(); ++y)
+        {
+            bool rowChanged = !std::equal(before.row(y).begin(), before.row(y).end(), editor.result().row(y).begin());
+            EXPECT_FALSE(rowChanged && (y < dirty.begin || y >= dirty.end)) << y;
+        }
+    }
+}
+
+TEST_F(PaletteEditorTest, SmallNudgeSkipsDistantTiles)
+{
+    PixelBuffer source = Corpus::generate(CorpusKind::Gradient, 256, 256);
+    PaletteEditor editor(source, makePalette(source, 32));
+    size_t tiles = (256 / PaletteEditor::TILE) * (256 / PaletteEditor::TILE);
+    editor.nudge(5, 2, 2, 2);
+    EXPECT_GT(editor.lastVisitedTiles(), 0u);
+    EXPECT_LT(editor.lastVisitedTiles() * 2, tiles);
+    expectFullRemap(editor, source);
+}
+
+TEST_F(PaletteEditorTest, LockedEntriesRefuseEdits)
+{
+    PixelBuffer source = Corpus::generate(CorpusKind::Flat, 40, 40);
+    PaletteEditor editor(source, {0x000000, 0x808080, 0xFFFFFF});
+    editor.setLocked(1, true);
+    EXPECT_TRUE(editor.isLocked(1));
+    EXPECT_THROW(editor.replace(1, 0x123456), std::invalid_argument);
+    EXPECT_THROW(editor.nudge(1, 1, 0, 0), std::invalid_argument);
+    EXPECT_EQ(editor.palette()[1], 0x808080u);
+    editor.setLocked(1, false);
+    EXPECT_NO_THROW(editor.replace(1, 0x123456));
+
+    // Channels stop at white
+    EXPECT_EQ(editor.nudge(2, 10, 10, 10), 0u);
+    EXPECT_EQ(editor.palette()[2], 0xFFFFFFu);
+    EXPECT_THROW(editor.replace(3, 0), std::out_of_range);
+    EXPECT_THROW(PaletteEditor(source, {}), std::invalid_argument);
+}
@@ -0,0 +1,94 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: tests/PixelBufferTests.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include <gtest/gtest.h>
+#include "PixelBuffer.h"
+#include "ColorReducer.h"
+#include "Dithering.h"
+#include <cstdint>
+#include <vector>
+
+class PixelBufferTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        for (int y = 0; y < buffer.height(); ++y)
+        {
+            for (int x = 0; x < buffer.width(); ++x)
+            {
+                buffer(x, y) = static_cast<uint32_t>((x * 20) << 16 | (y * 30) << 8 | 0x40);
+            }
+        }
+    }
+
+    PixelBuffer buffer{13, 7};
+};
+
+TEST_F(PixelBufferTest, RowsAreAligned)
+{
+    EXPECT_GE(buffer.stride(), buffer.width());
+    for (int y = 0; y < buffer.height(); ++y)
+    {
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(buffer.row(y).data()) % PIXEL_BUFFER_ALIGNMENT, 0u);
+    }
+}
+
+TEST_F(PixelBufferTest, SubViewSharesStorage)
+{
+    PixelView sub = buffer.subView(2, 3, 4, 2);
+
+    EXPECT_EQ(sub.width(), 4);
+    EXPECT_EQ(sub.height(), 2);
+    EXPECT_EQ(sub.stride(), buffer.stride());
+    EXPECT_FALSE(sub.isContiguous());
+    EXPECT_EQ(&sub(0, 0), &buffer(2, 3));
+
+    sub(1, 1) = 0x123456;
+    EXPECT_EQ(buffer(3, 4), 0x123456u);
+    EXPECT_THROW(buffer.subView(10, 0, 4, 1), std::out_of_range);
+    EXPECT_THROW(sub.pixels(), std::logic_error);
+}
+
+TEST_F(PixelBufferTest, CopiesAreDeep)
+{
+    PixelBuffer copy(buffer);
+    EXPECT_EQ(copy, buffer);
+    EXPECT_NE(copy.data(), buffer.data());
+
+    copy(0, 0) = 0xFFFFFF;
+    EXPECT_NE(copy, buffer);
+}
+
+TEST_F(PixelBufferTest, VectorRoundTrip)
+{
+    std::vector<uint32_t> pixels = buffer.toVector();
+    ASSERT_EQ(pixels.size(), buffer.size());
+    EXPECT_EQ(pixels[13 * 2 + 5], buffer(5, 2));
+
+    PixelBuffer restored(pixels, buffer.width(), buffer.height());
+    EXPECT_EQ(restored, buffer);
+    EXPECT_THROW(PixelBuffer(pixels, 14, 7), std::invalid_argument);
+}
+
+TEST_F(PixelBufferTest, RemapAndDitherWorkOnSubViews)
+{
+    const std::vector<uint32_t> palette = {0x000000, 0xFFFFFF};
+    ConstPixelView sub = buffer.subView(3, 1, 8, 5);
+    PixelBuffer gathered(sub);
+
+    PixelBuffer remapped = ColorReducer::remap(sub, palette);
+    EXPECT_EQ(remapped, ColorReducer::remap(gathered.view(), palette));
+
+    PixelBuffer dithered = Dithering::applyDithering(sub, palette, DitheringAlgorithm::FloydSteinberg);
+    EXPECT_EQ(dithered, Dithering::applyDithering(gathered.view(), palette, DitheringAlgorithm::FloydSteinberg));
+
+    // Writing through a sub-view leaves the rest of the buffer alone
+    PixelBuffer target(buffer);
+    ColorReducer::remap(sub, palette, target.subView(3, 1, 8, 5));
+    EXPECT_EQ(target(0, 0), buffer(0, 0));
+    EXPECT_EQ(target(3, 1), remapped(0, 0));
+}
@@ -0,0 +1,114 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: tests/PixelFormatTests.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include <gtest/gtest.h>
+#include "PixelFormat.h"
+#include "PixelBuffer.h"
+#include "ImageIO.h"
+#include <cstdint>
+#include <vector>
+
+using namespace PixelFormat;
+
+class PixelFormatTest : public ::testing::Test
+{
+protected:
+    // Odd lengths exercise the SIMD body and the scalar tail together
+    static std::vector<uint8_t> makeBytes(size_t count)
+    {
+        std::vector<uint8_t> bytes(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            bytes[i] = static_cast<uint8_t>(i * 37 + 11);
+        }
+        return bytes;
+    }
+};
+
+TEST_F(PixelFormatTest, RgbaToXrgbMatchesChannelMath)
+{
+    for (size_t count : {0u, 1u, 3u, 4u, 7u, 8u, 13u, 33u})
+    {
+        std::vector<uint8_t> rgba = makeBytes(count * 4);
+        std::vector<uint32_t> xrgb(count);
+        convertRow<Rgba8, Xrgb32>(reinterpret_cast<const Rgba8::Pixel *>(rgba.data()), xrgb.data(), count);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            const uint8_t *p = &rgba[i * 4];
+            uint32_t expected = (static_cast<uint32_t>(p[0]) << 16) | (static_cast<uint32_t>(p[1]) << 8) | p[2];
+            ASSERT_EQ(xrgb[i], expected) << "pixel " << i << " of " << count;
+        }
+    }
+}
+
+TEST_F(PixelFormatTest, RgbToXrgbDoesNotReadPastTheRow)
+{
+    for (size_t count : {1u, 5u, 6u, 7u, 17u, 40u})
+    {
+        std::vector<uint8_t> rgb = makeBytes(count * 3);
+        std::vector<uint32_t> xrgb(count);
+        convertRow<Rgb8, Xrgb32>(reinterpret_cast<const Rgb8::Pixel *>(rgb.data()), xrgb.data(), count);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            const uint8_t *p = &rgb[i * 3];
+            uint32_t expected = (static_cast<uint32_t>(p[0]) << 16) | (static_cast<uint32_t>(p[1]) << 8) | p[2];
+            ASSERT_EQ(xrgb[i], expected) << "pixel " << i << " of " << count;
+        }
+    }
+}
+
+TEST_F(PixelFormatTest, XrgbToRgbaIsOpaque)
+{
+    std::vector<uint32_t> xrgb = {0x102030, 0xFF0000, 0x00FF00, 0x0000FF, 0xABCDEF, 0x000000, 0xFFFFFF, 0x123456, 0x654321};
+    std::vector<Rgba8::Pixel> rgba(xrgb.size());
+    convertRow<Xrgb32, Rgba8>(xrgb.data(), rgba.data(), xrgb.size());
+
+    EXPECT_EQ(rgba[0], (Rgba8::Pixel{0x10, 0x20, 0x30, 0xFF}));
+    EXPECT_EQ(rgba[8], (Rgba8::Pixel{0x65, 0x43, 0x21, 0xFF}));
+
+    std::vector<Bgra8::Pixel> bgra(rgba.size());
+    convertRow<Rgba8, Bgra8>(rgba.data(), bgra.data(), rgba.size());
+    std::vector<uint32_t> back(xrgb.size());
+    convertRow<Bgra8, Xrgb32>(bgra.data(), back.data(), bgra.size());
+    EXPECT_EQ(back, xrgb);
+}
+
+TEST_F(PixelFormatTest, Rgb8BuffersKeepAlignedRows)
+{
+    FormatBuffer<Rgb8> rgb(21, 3);
+    for (int y = 0; y < rgb.height(); ++y)
+    {
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(rgb.row(y).data()) % PIXEL_BUFFER_ALIGNMENT, 0u);
+    }
+
+    rgb(20, 2) = {1, 2, 3};
+    PixelBuffer xrgb = convertPixels<Xrgb32>(rgb);
+    EXPECT_EQ(xrgb(20, 2), 0x010203u);
+    EXPECT_EQ(convertPixels<Rgb8>(xrgb), rgb);
+}
+
+TEST_F(PixelFormatTest, IndexedExpandsThroughPalette)
+{
+    const std::vector<uint32_t> palette = {0x000000, 0xFF8000};
+    const uint8_t indices[] = {1, 0, 7};
+    Rgba8::Pixel out[3];
+    expandRow<Rgba8>(indices, palette.data(), palette.size(), out, 3);
+
+    EXPECT_EQ(out[0], (Rgba8::Pixel{0xFF, 0x80, 0x00, 0xFF}));
+    EXPECT_EQ(out[1], (Rgba8::Pixel{0, 0, 0, 0xFF}));
+    EXPECT_EQ(out[2], (Rgba8::Pixel{0, 0, 0, 0xFF}));
+}
+
+TEST_F(PixelFormatTest, DecoderBytesBecomeWorkingFormat)
+{
+    const uint8_t rgba[] = {0xFF, 0x00, 0x00, 0x80, 0x00, 0x00, 0xFF, 0xFF};
+    PixelBuffer image = ImageIO::fromRgba(rgba, 2, 1);
+
+    EXPECT_EQ(image(0, 0), 0xFF0000u);
+    EXPECT_EQ(image(1, 0), 0x0000FFu);
+}
@@ -0,0 +1,135 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: tests/PlanarTests.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include <gtest/gtest.h>
+#include "Planar.h"
+#include "AmigaIlbmConverter.h"
+#include "AtariStConverter.h"
+#include "ColorReducer.h"
+#include <vector>
+#include <cstdint>
+#include <random>
+
+class PlanarTest : public ::testing::Test
+{
+protected:
+    static std::vector<uint8_t> makeIndices(int count, int planes, unsigned seed)
+    {
+        std::mt19937 rng(seed);
+        std::vector<uint8_t> indices(count);
+        for (uint8_t &index : indices)
+        {
+            index = static_cast<uint8_t>(rng() & ((1u << planes) - 1));
+        }
+        return indices;
+    }
+};
+
+TEST_F(PlanarTest, SimdMatchesScalar)
+{
+    for (int planes = 1; planes <= 8; ++planes)
+    {
+        for (int width : {1, 7, 8, 15, 16, 17, 31, 32, 33, 64, 100, 320, 641})
+        {
+            std::vector<uint8_t> chunky = makeIndices(width, planes, static_cast<unsigned>(width * 8 + planes));
+            size_t stride = (width + 7) / 8;
+            std::vector<uint8_t> simd(stride * planes, 0xAA);
+            std::vector<uint8_t> scalar(stride * planes, 0xAA);
+
+            Planar::chunkyToPlanar(chunky.data(), width, planes, simd.data(), stride);
+            Planar::chunkyToPlanarScalar(chunky.data(), width, planes, scalar.data(), stride);
+
+            EXPECT_EQ(simd, scalar) << "width " << width << " planes " << planes << " kernel " << Planar::activeKernelName();
+        }
+    }
+}
+
+TEST_F(PlanarTest, PlanesHoldIndexBits)
+{
+    std::vector<uint8_t> chunky(16, 0);
+    chunky[0] = 1;
+    chunky[9] = 2;
+    chunky[15] = 3;
+    std::vector<uint8_t> planes(4);
+
+    Planar::chunkyToPlanar(chunky.data(), 16, 2, planes.data(), 2);
+
+    EXPECT_EQ(planes[0], 0x80);
+    EXPECT_EQ(planes[1], 0x01);
+    EXPECT_EQ(planes[2], 0x00);
+    EXPECT_EQ(planes[3], 0x41);
+}
+
+TEST_F(PlanarTest, InterleavedWordsFollowAtariLayout)
+{
+    std::vector<uint8_t> chunky(32, 0);
+    chunky[0] = 0x0F;
+    chunky[16] = 0x02;
+    std::vector<uint8_t> words(32 / 16 * 4 * 2);
+
+    Planar::chunkyToInterleavedWords(chunky.data(), 32, 4, words.data());
+
+    for (int p = 0; p < 4; ++p)
+    {
+        EXPECT_EQ(words[p * 2], 0x80);
+        EXPECT_EQ(words[p * 2 + 1], 0x00);
+    }
+    EXPECT_EQ(words[8 + 0], 0x00);
+    EXPECT_EQ(words[8 + 2], 0x80);
+    EXPECT_THROW(Planar::chunkyToInterleavedWords(chunky.data(), 24, 4, words.data()), std::invalid_argument);
+}
+
+TEST_F(PlanarTest, IndexedImageListsDistinctColors)
+{
+    std::vector<uint32_t> pixels = {0xFF0000, 0x00FF00, 0xFF0000, 0x0000FF};
+
+    IndexedImage image = ColorReducer::toIndexed(pixels, 2, 2);
+
+    ASSERT_EQ(image.palette.size(), 3);
+    EXPECT_EQ(image.indices[0], image.indices[2]);
+    EXPECT_EQ(image.palette[image.indices[3]], 0x0000FFu);
+}
+
+TEST_F(PlanarTest, IlbmHasFormHeaderAndByteRunBody)
+{
+    IndexedImage image{20, 2, {0x000000, 0xFFFFFF, 0xFF0000}, std::vector<uint8_t>(40, 1)};
+    AmigaIlbmConverter converter;
+    converter.setCompression(false);
+    converter.convertIndexed(image);
+
+    std::vector<uint8_t> data = converter.getFileData();
+
+    ASSERT_GT(data.size(), 12);
+    EXPECT_EQ(std::string(data.begin(), data.begin() + 4), "FORM");
+    EXPECT_EQ(std::string(data.begin() + 8, data.begin() + 12), "ILBM");
+    uint32_t formSize = (data[4] << 24) | (data[5] << 16) | (data[6] << 8) | data[7];
+    EXPECT_EQ(formSize + 8, data.size());
+    // BMHD: 20x2, two planes
+    EXPECT_EQ(data[20], 0);
+    EXPECT_EQ(data[21], 20);
+    EXPECT_EQ(data[28], 2);
+    // Body: 2 rows x 2 planes x 4 bytes (20 pixels padded to two words)
+    EXPECT_EQ(std::string(data.end() - 16 - 8, data.end() - 16 - 4), "BODY");
+    EXPECT_EQ(data[data.size() - 16], 0xFF);
+    EXPECT_EQ(data[data.size() - 14], 0xF0);
+
+    std::vector<uint8_t> packed;
+    std::vector<uint8_t> row(40, 0x55);
+    row[39] = 0x01;
+    AmigaIlbmConverter::packByteRun1(row.data(), row.size(), packed);
+    ASSERT_EQ(packed.size(), 4);
+    EXPECT_EQ(packed[0], static_cast<uint8_t>(257 - 39));
+    EXPECT_EQ(packed[1], 0x55);
+    EXPECT_EQ(packed[2], 0);
+    EXPECT_EQ(packed[3], 0x01);
+}
+
+TEST_F(PlanarTest, AtariPaletteUsesThreeBitsPerChannel)
+{
+    EXPECT_EQ(AtariStConverter::toStColor(0xFFFFFF), 0x0777);
+    EXPECT_EQ(AtariStConverter::toStColor(0xFF0000), 0x0700);
+    EXPECT_EQ(AtariStConverter::toStColor(0x204060), 0x0123);
+}
@@ -0,0 +1,121 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: tests/ProgressivePreviewTests.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include <gtest/gtest.h>
+#include "ProgressivePreview.h"
+#include "Corpus.h"
+#include <thread>
+
+class ProgressivePreviewTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        pipeline.setSource(Corpus::generate(CorpusKind::Noise, 400, 300));
+    }
+
+    std::optional<PreviewFrame> waitForFrame(ProgressivePreview &preview, bool refined)
+    {
+        auto until = std::chrono::steady_clock::now() + std::chrono::seconds(20);
+        while (std::chrono::steady_clock::now() < until)
+        {
+            std::optional<PreviewFrame> frame = preview.poll();
+            if (frame && frame->refined == refined)
+            {
+                return frame;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+        return std::nullopt;
+    }
+
+    ConversionPipeline pipeline;
+};
+
+TEST_F(ProgressivePreviewTest, ProxyArrivesFirstThenFullResolution)
+{
+    ProgressivePreview preview(pipeline);
+    preview.setProxySize(100, 100);
+    preview.setRefineDelay(std::chrono::milliseconds(20));
+    PipelineSettings settings;
+    settings.targetColors = 8;
+
+    preview.request(settings);
+    std::optional<PreviewFrame> proxy = waitForFrame(preview, false);
+
+    ASSERT_TRUE(proxy.has_value());
+    EXPECT_FALSE(proxy->refined);
+    EXPECT_EQ(proxy->image->width(), 100);
+    EXPECT_EQ(proxy->image->height(), 75);
+
+    std::optional<PreviewFrame> full = waitForFrame(preview, true);
+    ASSERT_TRUE(full.has_value());
+    EXPECT_EQ(full->image->width(), 400);
+    EXPECT_EQ(full->generation, proxy->generation);
+    EXPECT_FALSE(preview.poll().has_value());
+}
+
+TEST_F(ProgressivePreviewTest, ScrubbingOnlyRefinesSettledParameters)
+{
+    ProgressivePreview preview(pipeline);
+    preview.setProxySize(80, 60);
+    preview.setRefineDelay(std::chrono::milliseconds(100));
+    PipelineSettings settings;
+
+    for (int colors = 2; colors <= 12; ++colors)
+    {
+        settings.targetColors = colors;
+        preview.request(settings);
+        preview.poll();
+    }
+
+    std::optional<PreviewFrame> full = waitForFrame(preview, true);
+    ASSERT_TRUE(full.has_value());
+    EXPECT_EQ(full->generation, 11);
+    // Only the last setting reached the full resolution palette stage
+    EXPECT_EQ(pipeline.getStatistics()[ConversionPipeline::Palette].misses, 1);
+}
+
+TEST_F(ProgressivePreviewTest, ProxyFollowsSourceChanges)
+{
+    ProgressivePreview preview(pipeline);
+    preview.setProxySize(100, 100);
+    preview.setRefineDelay(std::chrono::milliseconds(1000));
+    PipelineSettings settings;
+    settings.targetColors = 4;
+
+    preview.request(settings);
+    std::optional<PreviewFrame> first = waitForFrame(preview, false);
+    ASSERT_TRUE(first.has_value());
+    EXPECT_EQ(first->image->height(), 75);
+
+    pipeline.setSource(std::vector<uint32_t>(200 * 400, 0x336699), 200, 400);
+    preview.sourceChanged();
+    preview.request(settings);
+    std::optional<PreviewFrame> second = waitForFrame(preview, false);
+    ASSERT_TRUE(second.has_value());
+    EXPECT_EQ(second->image->width(), 50);
+    EXPECT_EQ(second->image->height(), 100);
+    EXPECT_GT(second->generation, first->generation);
+}
+
+TEST_F(ProgressivePreviewTest, CancelDropsFramesOfEarlierRequests)
+{
+    ProgressivePreview preview(pipeline);
+    preview.setProxySize(100, 100);
+    preview.setRefineDelay(std::chrono::milliseconds(0));
+    PipelineSettings settings;
+    settings.targetColors = 4;
+
+    preview.request(settings);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    preview.cancel();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    EXPECT_FALSE(preview.poll().has_value());
+
+    preview.request(settings);
+    EXPECT_TRUE(waitForFrame(preview, true).has_value());
+}
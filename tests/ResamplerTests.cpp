@@ -0,0 +1,126 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: tests/ResamplerTests.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include <gtest/gtest.h>
+#include "Resampler.h"
+#include "Corpus.h"
+#include "KoalaConverter.h"
+#include <cstdint>
+#include <vector>
+
+class ResamplerTest : public ::testing::Test
+{
+protected:
+    static ResampleOptions options(int width, int height, ResampleFilter filter)
+    {
+        ResampleOptions result;
+        result.width = width;
+        result.height = height;
+        result.filter = filter;
+        return result;
+    }
+};
+
+TEST_F(ResamplerTest, SolidColorSurvivesEveryFilter)
+{
+    PixelBuffer image(37, 23, 0x336699);
+    for (ResampleFilter filter : {ResampleFilter::Box, ResampleFilter::Bilinear, ResampleFilter::Mitchell, ResampleFilter::Lanczos3})
+    {
+        for (auto [width, height] : {std::pair{10, 7}, std::pair{80, 51}})
+        {
+            PixelBuffer result = Resampler::resample(image, options(width, height, filter));
+            EXPECT_EQ(result, PixelBuffer(width, height, 0x336699)) << Resampler::getFilterName(filter) << " " << width;
+        }
+    }
+}
+
+TEST_F(ResamplerTest, BoxDownscaleAveragesBlocks)
+{
+    PixelBuffer image(4, 2);
+    const uint32_t values[] = {0x000000, 0x040404, 0x808080, 0x808080, 0x000000, 0x040404, 0x101010, 0x303030};
+    for (int i = 0; i < 8; ++i)
+    {
+        image(i % 4, i / 4) = values[i];
+    }
+
+    PixelBuffer result = Resampler::resample(image, options(2, 1, ResampleFilter::Box));
+
+    EXPECT_EQ(result(0, 0), 0x020202u);
+    EXPECT_EQ(result(1, 0), 0x505050u);
+}
+
+TEST_F(ResamplerTest, SameSizeBoxIsIdentity)
+{
+    PixelBuffer image = Corpus::generate(CorpusKind::Gradient, 31, 17);
+    EXPECT_EQ(Resampler::resample(image, options(31, 17, ResampleFilter::Box)), image);
+    EXPECT_EQ(Resampler::resample(image, options(31, 17, ResampleFilter::Bilinear)), image);
+}
+
+TEST_F(ResamplerTest, ThreadCountDoesNotChangeResult)
+{
+    PixelBuffer image = Corpus::generate(CorpusKind::Gradient, 300, 200);
+    ResampleOptions single = options(160, 111, ResampleFilter::Lanczos3);
+    single.threads = 1;
+    ResampleOptions many = single;
+    many.threads = 8;
+
+    EXPECT_EQ(Resampler::resample(image, single), Resampler::resample(image, many));
+}
+
+TEST_F(ResamplerTest, FitLetterboxesWithBackground)
+{
+    PixelBuffer image(100, 100, 0xFFFFFF);
+    ResampleOptions fit = options(40, 20, ResampleFilter::Bilinear);
+    fit.fit = FitMode::Fit;
+    fit.background = 0x0000FF;
+
+    PixelBuffer result = Resampler::resample(image, fit);
+
+    EXPECT_EQ(result(0, 10), 0x0000FFu);
+    EXPECT_EQ(result(39, 10), 0x0000FFu);
+    EXPECT_EQ(result(20, 0), 0xFFFFFFu);
+    EXPECT_EQ(result(20, 19), 0xFFFFFFu);
+}
+
+TEST_F(ResamplerTest, DoubleWidePixelsFillC64Screen)
+{
+    // 320x200 square pixels cover exactly the display area of 160x200 double-wide pixels
+    PixelBuffer image(320, 200, 0xFF0000);
+    ResampleOptions koala = options(160, 200, ResampleFilter::Mitchell);
+    koala.fit = FitMode::Fit;
+    koala.pixelAspect = 2.0;
+    koala.background = 0x000000;
+
+    PixelBuffer result = Resampler::resample(image, koala);
+
+    EXPECT_EQ(result(0, 0), 0xFF0000u);
+    EXPECT_EQ(result(159, 199), 0xFF0000u);
+}
+
+TEST_F(ResamplerTest, CropKeepsTheCenter)
+{
+    PixelBuffer image(30, 10, 0x000000);
+    for (int y = 0; y < 10; ++y)
+    {
+        for (int x = 10; x < 20; ++x)
+        {
+            image(x, y) = 0xFFFFFF;
+        }
+    }
+    ResampleOptions crop = options(10, 10, ResampleFilter::Box);
+    crop.fit = FitMode::Crop;
+
+    EXPECT_EQ(Resampler::resample(image, crop), PixelBuffer(10, 10, 0xFFFFFF));
+}
+
+TEST_F(ResamplerTest, KoalaResamplesOtherSizes)
+{
+    KoalaConverter converter;
+    converter.convertImage(Corpus::generate(CorpusKind::Gradient, 320, 256));
+    EXPECT_EQ(converter.getFileData().size(), 10003u);
+
+    EXPECT_THROW(Resampler::resample(PixelBuffer(), options(10, 10, ResampleFilter::Box)), std::invalid_argument);
+}
@@ -0,0 +1,196 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: tests/ResultCacheTests.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include <gtest/gtest.h>
+#include "ResultCache.h"
+#include "BatchConverter.h"
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+class ResultCacheTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        root = std::filesystem::path(::testing::TempDir()) / "result_cache_test";
+        std::filesystem::remove_all(root);
+        std::filesystem::create_directories(root);
+    }
+
+    void TearDown() override
+    {
+        std::filesystem::remove_all(root);
+    }
+
+    static std::vector<uint8_t> bytes(size_t count, uint8_t value)
+    {
+        return std::vector<uint8_t>(count, value);
+    }
+
+    std::filesystem::path root;
+};
+
+TEST_F(ResultCacheTest, StoresAndFindsEntries)
+{
+    ResultCache cache(root / "cache", 1 << 20);
+    EXPECT_FALSE(cache.find(42));
+
+    cache.store(42, bytes(100, 7));
+    std::optional<std::vector<uint8_t>> hit = cache.find(42);
+    ASSERT_TRUE(hit);
+    EXPECT_EQ(*hit, bytes(100, 7));
+
+    // Same key again replaces the entry
+    cache.store(42, bytes(10, 1));
+    EXPECT_EQ(*cache.find(42), bytes(10, 1));
+
+    ResultCacheStatistics stats = cache.statistics();
+    EXPECT_EQ(stats.hits, 2u);
+    EXPECT_EQ(stats.misses, 1u);
+    EXPECT_EQ(stats.stores, 2u);
+    EXPECT_EQ(stats.entries, 1u);
+}
+
+TEST_F(ResultCacheTest, EvictsLeastRecentlyUsed)
+{
+    // Room for two 1000 byte entries plus headers, not three
+    ResultCache cache(root / "cache", 2100);
+    cache.store(1, bytes(1000, 1));
+    cache.store(2, bytes(1000, 2));
+    ASSERT_TRUE(cache.find(1));
+    cache.store(3, bytes(1000, 3));
+
+    EXPECT_TRUE(cache.find(1));
+    EXPECT_FALSE(cache.find(2));
+    EXPECT_TRUE(cache.find(3));
+    EXPECT_EQ(cache.statistics().evictions, 1u);
+    EXPECT_LE(cache.statistics().bytes, 2100u);
+}
+
+TEST_F(ResultCacheTest, SurvivesReopenAndDropsCorruptEntries)
+{
+    {
+        ResultCache cache(root / "cache", 1 << 20);
+        cache.store(0x1234, bytes(64, 9));
+        cache.store(0xABCD, bytes(64, 8));
+    }
+
+    ResultCache reopened(root / "cache", 1 << 20);
+    EXPECT_EQ(reopened.statistics().entries, 2u);
+    EXPECT_EQ(*reopened.find(0x1234), bytes(64, 9));
+
+    std::filesystem::path corrupt = root / "cache" / "00" / "000000000000abcd.bin";
+    ASSERT_TRUE(std::filesystem::exists(corrupt));
+    std::filesystem::resize_file(corrupt, 40);
+    EXPECT_FALSE(reopened.find(0xABCD));
+    EXPECT_FALSE(std::filesystem::exists(corrupt));
+    EXPECT_EQ(reopened.statistics().entries, 1u);
+}
+
+TEST_F(ResultCacheTest, RejectsHeaderSizeThatDoesNotMatchTheFile)
+{
+    {
+        ResultCache cache(root / "cache", 1 << 20);
+        cache.store(0xABCD, bytes(64, 8));
+    }
+
+    // Payload size field after magic, version and key: far more than the file holds
+    std::filesystem::path entry = root / "cache" / "00" / "000000000000abcd.bin";
+    {
+        std::fstream file(entry, std::ios::binary | std::ios::in | std::ios::out);
+        uint64_t size = uint64_t(1) << 60;
+        file.seekp(16);
+        file.write(reinterpret_cast<const char *>(&size), sizeof(size));
+    }
+
+    ResultCache reopened(root / "cache", 1 << 20);
+    EXPECT_FALSE(reopened.find(0xABCD));
+    EXPECT_FALSE(std::filesystem::exists(entry));
+    EXPECT_EQ(reopened.statistics().misses, 1u);
+}
+
+TEST_F(ResultCacheTest, ConcurrentStoresAndFinds)
+{
+    ResultCache cache(root / "cache", 1 << 20);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&cache, t]()
+                             {
+            for (uint64_t i = 0; i < 50; ++i)
+            {
+                cache.store(i, bytes(32, static_cast<uint8_t>(i)));
+                std::optional<std::vector<uint8_t>> hit = cache.find((i * 7 + t) % 50);
+                if (hit)
+                {
+                    EXPECT_EQ(*hit, bytes(32, static_cast<uint8_t>((i * 7 + t) % 50)));
+                }
+            } });
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    EXPECT_EQ(cache.statistics().entries, 50u);
+}
+
+TEST_F(ResultCacheTest, BatchHitsSkipDecoding)
+{
+    std::vector<BatchJob> jobs;
+    for (int i = 0; i < 4; ++i)
+    {
+        std::filesystem::path input = root / ("image" + std::to_string(i) + ".png");
+        std::ofstream(input, std::ios::binary) << "source " << i;
+        jobs.push_back({input, root / "out" / ("image" + std::to_string(i) + ".scr")});
+    }
+
+    BatchOptions options;
+    options.encoder = "zx-scr";
+    options.targetColors = 4;
+    options.cacheDirectory = root / "cache";
+    std::atomic<int> decodes{0};
+    auto loader = [&decodes](const std::filesystem::path &path, std::span<const uint8_t>)
+    {
+        ++decodes;
+        int i = path.stem().string().back() - '0';
+        PixelBuffer image(256, 192);
+        for (int y = 0; y < 192; ++y)
+        {
+            for (int x = 0; x < 256; ++x)
+            {
+                image(x, y) = static_cast<uint32_t>((x * (i + 1)) << 16 | y << 8);
+            }
+        }
+        return image;
+    };
+
+    BatchConverter first(options);
+    first.setLoader(loader);
+    EXPECT_EQ(first.run(jobs).cached, 0u);
+    EXPECT_EQ(decodes, 4);
+    std::ifstream original(jobs[2].output, std::ios::binary);
+    std::vector<char> expected((std::istreambuf_iterator<char>(original)), std::istreambuf_iterator<char>());
+
+    std::filesystem::remove_all(root / "out");
+    std::ofstream(jobs[3].input, std::ios::binary) << "changed";
+    BatchConverter second(options);
+    second.setLoader(loader);
+    BatchReport report = second.run(jobs);
+
+    EXPECT_EQ(report.converted, 4u);
+    EXPECT_EQ(report.cached, 3u);
+    EXPECT_EQ(decodes, 5);
+    std::ifstream restored(jobs[2].output, std::ios::binary);
+    EXPECT_EQ(std::vector<char>((std::istreambuf_iterator<char>(restored)), std::istreambuf_iterator<char>()), expected);
+
+    // Different settings miss the cache
+    BatchOptions other = options;
+    other.targetColors = 8;
+    EXPECT_NE(BatchConverter::cacheKey({}, options), BatchConverter::cacheKey({}, other));
+}
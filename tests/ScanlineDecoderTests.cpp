@@ -0,0 +1,249 @@
+// SPDX-License-Identifier: MIT OR Apache-2.0
+// Project: gfxconverter
+// File: tests/ScanlineDecoderTests.cpp
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2022 Volker Schwaberow
+
+#include <gtest/gtest.h>
+#include "ScanlineDecoder.h"
+#include "Corpus.h"
+#include "ImageIO.h"
+#include <png.h>
+#include <cstdio>
+#include <jpeglib.h>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+class ScanlineDecoderTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        root = std::filesystem::path(::testing::TempDir()) / "scanline_decoder_test";
+        std::filesystem::remove_all(root);
+        std::filesystem::create_directories(root);
+    }
+
+    void TearDown() override
+    {
+        std::filesystem::remove_all(root);
+    }
+
+    static std::vector<uint8_t> toRgb(ConstPixelView image, int y)
+    {
+        std::vector<uint8_t> rgb;
+        for (uint32_t pixel : image.row(y))
+        {
+            rgb.push_back(static_cast<uint8_t>(pixel >> 16));
+            rgb.push_back(static_cast<uint8_t>(pixel >> 8));
+            rgb.push_back(static_cast<uint8_t>(pixel));
+        }
+        return rgb;
+    }
+
+    std::string writePng(const std::string &name, ConstPixelView image, bool interlaced = false)
+    {
+        std::string filename = (root / name).string();
+        FILE *file = std::fopen(filename.c_str(), "wb");
+        png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+        png_infop info = png_create_info_struct(png);
+        png_init_io(png, file);
+        png_set_IHDR(png, info, image.width(), image.height(), 8, PNG_COLOR_TYPE_RGB,
+                     interlaced ? PNG_INTERLACE_ADAM7 : PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+        png_write_info(png, info);
+        std::vector<std::vector<uint8_t>> rows;
+        std::vector<png_bytep> pointers;
+        for (int y = 0; y < image.height(); ++y)
+        {
+            rows.push_back(toRgb(image, y));
+        }
+        for (auto &row : rows)
+        {
+            pointers.push_back(row.data());
+        }
+        png_write_image(png, pointers.data());
+        png_write_end(png, nullptr);
+        png_destroy_write_struct(&png, &info);
+        std::fclose(file);
+        return filename;
+    }
+
+    std::string writeJpeg(const std::string &name, ConstPixelView image, bool progressive = false)
+    {
+        std::string filename = (root / name).string();
+        FILE *file = std::fopen(filename.c_str(), "wb");
+        jpeg_compress_struct info;
+        jpeg_error_mgr error;
+        info.err = jpeg_std_error(&error);
+        jpeg_create_compress(&info);
+        jpeg_stdio_dest(&info, file);
+        info.image_width = image.width();
+        info.image_height = image.height();
+        info.input_components = 3;
+        info.in_color_space = JCS_RGB;
+        jpeg_set_defaults(&info);
+        jpeg_set_quality(&info, 95, TRUE);
+        if (progressive)
+        {
+            jpeg_simple_progression(&info);
+        }
+        jpeg_start_compress(&info, TRUE);
+        for (int y = 0; y < image.height(); ++y)
+        {
+            std::vector<uint8_t> rgb = toRgb(image, y);
+            JSAMPROW row = rgb.data();
+            jpeg_write_scanlines(&info, &row, 1);
+        }
+        jpeg_finish_compress(&info);
+        jpeg_destroy_compress(&info);
+        std::fclose(file);
+        return filename;
+    }
+
+    static int maxChannelDifference(uint32_t a, uint32_t b)
+    {
+        int result = 0;
+        for (int shift : {0, 8, 16})
+        {
+            result = std::max(result, std::abs(static_cast<int>((a >> shift) & 0xFF) - static_cast<int>((b >> shift) & 0xFF)));
+        }
+        return result;
+    }
+
+    std::filesystem::path root;
+};
+
+TEST_F(ScanlineDecoderTest, PngStreamsRows)
+{
+    PixelBuffer image = Corpus::generate(CorpusKind::Gradient, 37, 23);
+    auto decoder = ScanlineDecoder::open(writePng("plain.png", image));
+
+    EXPECT_EQ(decoder->formatName(), "PNG");
+    EXPECT_TRUE(decoder->isStreaming());
+    EXPECT_EQ(decoder->width(), 37);
+    EXPECT_EQ(decoder->height(), 23);
+    // A few rows and the inflate window, nowhere near the full image
+    EXPECT_LT(decoder->workingSetBytes(), 37u * 3 * 8 + 65536);
+
+    std::vector<uint32_t> row(37);
+    for (int y = 0; y < 23; ++y)
+    {
+        ASSERT_TRUE(decoder->readRow(row));
+        ASSERT_TRUE(std::equal(row.begin(), row.end(), image.row(y).begin())) << "row " << y;
+    }
+    EXPECT_FALSE(decoder->readRow(row));
+}
+
+TEST_F(ScanlineDecoderTest, InterlacedPngDecodesWhole)
+{
+    PixelBuffer image = Corpus::generate(CorpusKind::Gradient, 29, 19);
+    auto decoder = ScanlineDecoder::open(writePng("adam7.png", image, true));
+
+    EXPECT_FALSE(decoder->isStreaming());
+    EXPECT_GE(decoder->workingSetBytes(), 29u * 19 * 3);
+    EXPECT_EQ(ImageIO::load((root / "adam7.png").string()), image);
+}
+
+TEST_F(ScanlineDecoderTest, JpegStreamsAndScalesInTheDct)
+{
+    PixelBuffer image = Corpus::generate(CorpusKind::Gradient, 64, 48);
+    std::string filename = writeJpeg("baseline.jpg", image);
+
+    auto decoder = ScanlineDecoder::open(filename);
+    EXPECT_EQ(decoder->formatName(), "JPEG");
+    EXPECT_TRUE(decoder->isStreaming());
+    EXPECT_TRUE(decoder->canScale());
+
+    std::vector<uint32_t> row(64);
+    for (int y = 0; y < 48; ++y)
+    {
+        ASSERT_TRUE(decoder->readRow(row));
+        for (int x = 0; x < 64; ++x)
+        {
+            ASSERT_LE(maxChannelDifference(row[x], image(x, y)), 8) << x << "," << y;
+        }
+    }
+
+    auto quarter = ScanlineDecoder::open(filename, 4);
+    EXPECT_EQ(quarter->width(), 16);
+    EXPECT_EQ(quarter->height(), 12);
+    // 6 rounds down to the DCT scale 4
+    EXPECT_EQ(ScanlineDecoder::open(filename, 6)->width(), 16);
+}
+
+TEST_F(ScanlineDecoderTest, ProgressiveJpegNeedsCoefficientMemory)
+{
+    PixelBuffer image = Corpus::generate(CorpusKind::Gradient, 64, 48);
+    auto baseline = ScanlineDecoder::open(writeJpeg("baseline.jpg", image));
+    auto progressive = ScanlineDecoder::open(writeJpeg("progressive.jpg", image, true));
+
+    EXPECT_FALSE(progressive->isStreaming());
+    EXPECT_GT(progressive->workingSetBytes(), baseline->workingSetBytes() + 64u * 48 * 3);
+
+    PixelBuffer decoded = ImageIO::load((root / "progressive.jpg").string());
+    EXPECT_LE(maxChannelDifference(decoded(10, 10), image(10, 10)), 8);
+}
+
+TEST_F(ScanlineDecoderTest, LoadBoxShrinksToMinimumSize)
+{
+    PixelBuffer image(5, 2);
+    const uint32_t values[] = {0x000000, 0x040404, 0x808080, 0x808080, 0xFF0000, 0x000000, 0x040404, 0x101010, 0x303030, 0x00FF00};
+    for (int i = 0; i < 10; ++i)
+    {
+        image(i % 5, i / 5) = values[i];
+    }
+    DecodeOptions options;
+    options.minWidth = 2;
+
+    PixelBuffer result = ImageIO::load(writePng("small.png", image), options);
+
+    ASSERT_EQ(result.width(), 3);
+    ASSERT_EQ(result.height(), 1);
+    EXPECT_EQ(result(0, 0), 0x020202u);
+    EXPECT_EQ(result(1, 0), 0x505050u);
+    // The last column only covers one source column
+    EXPECT_EQ(result(2, 0), 0x808000u);
+}
+
+TEST_F(ScanlineDecoderTest, MemoryCapRejectsOrShrinks)
+{
+    std::string filename = writePng("large.png", Corpus::generate(CorpusKind::Gradient, 400, 300));
+    DecodeOptions options;
+    options.memoryCap = 200 * 1024;
+
+    EXPECT_THROW(ImageIO::load(filename, options), std::runtime_error);
+
+    options.minWidth = 80;
+    options.minHeight = 60;
+    PixelBuffer result = ImageIO::load(filename, options);
+    EXPECT_EQ(result.width(), 80);
+    EXPECT_EQ(result.height(), 60);
+}
+
+TEST_F(ScanlineDecoderTest, DecodesFromMemory)
+{
+    PixelBuffer image = Corpus::generate(CorpusKind::Gradient, 40, 30);
+    std::ifstream png(writePng("memory.png", image), std::ios::binary);
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(png)), std::istreambuf_iterator<char>());
+
+    EXPECT_EQ(ImageIO::loadFromMemory(bytes.data(), bytes.size()), image);
+    // Truncated data fails instead of reading past the buffer
+    EXPECT_THROW(ImageIO::loadFromMemory(bytes.data(), bytes.size() / 2), std::runtime_error);
+
+    std::ifstream jpeg(writeJpeg("memory.jpg", image), std::ios::binary);
+    bytes.assign(std::istreambuf_iterator<char>(jpeg), std::istreambuf_iterator<char>());
+    auto decoder = ScanlineDecoder::open(std::span<const uint8_t>(bytes), 2);
+    EXPECT_EQ(decoder->width(), 20);
+    EXPECT_EQ(decoder->height(), 15);
+}
+
+TEST_F(ScanlineDecoderTest, UnknownDataThrows)
+{
+    std::ofstream(root / "broken.png") << "not an image";
+    EXPECT_THROW(ScanlineDecoder::open((root / "broken.png").string()), std::runtime_error);
+    EXPECT_THROW(ScanlineDecoder::open((root / "missing.png").string()), std::runtime_error);
+}